@@ -2,5 +2,12 @@
 
 glslangValidator -V -o bin\\basic.vert.spirv basic.vert.glsl
 glslangValidator -V -o bin\\basic.frag.spirv basic.frag.glsl
+glslangValidator -V -o bin\\depth.vert.spirv depth.vert.glsl
+glslangValidator -V -o bin\\instanced.vert.spirv instanced.vert.glsl
+glslangValidator -V -o bin\\cull.comp.spirv cull.comp.glsl
+glslangValidator -V -o bin\\hiz.comp.spirv hiz.comp.glsl
+glslangValidator -V -o bin\\cluster.comp.spirv cluster.comp.glsl
+glslangValidator -V --target-env spirv1.4 -o bin\\cluster.task.spirv cluster.task.glsl
+glslangValidator -V --target-env spirv1.4 -o bin\\cluster.mesh.spirv cluster.mesh.glsl
 
-pause
\ No newline at end of file
+pause
@@ -1,10 +1,16 @@
 #version 460 core
 
 layout(location = 0) in vec3 in_color;
+layout(location = 1) flat in uint in_materialId;
 
 layout(location = 0) out vec4 out_color;
 
+vec3 material_tints[2] = vec3[](
+    vec3(1.0, 1.0, 1.0),
+    vec3(1.0, 0.6, 0.2)
+);
+
 void main()
 {
-	out_color = vec4(in_color, 1.0);
+    out_color = vec4(in_color * material_tints[in_materialId % 2], 1.0);
 }
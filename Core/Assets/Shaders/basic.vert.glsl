@@ -1,9 +1,36 @@
 #version 460 core
 
-layout(location = 0) in vec3 a_Position;
+layout(location = 0) in vec3 a_Position; // Float, half or snorm16 by the import settings, see VertexCompression.h
 
 layout(location = 0) out vec3 out_color;
+layout(location = 1) flat out uint out_materialId;
 
+// Must match ObjectData in Renderer.h
+struct ObjectData
+{
+    vec3 position;
+    float scale;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+};
+
+// Must match DrawPushConstants in Renderer.h
+layout(push_constant) uniform DrawConstants
+{
+    uint objectOffset;
+    uint materialId;
+    vec2 cameraPosition;
+    float cameraZoom;
+    float positionScale; // Compressed positions: stored * scale + offset
+    vec3 positionOffset;
+} u_draw;
+
+// Must produce the same position as depth.vert.glsl, the main pass tests EQUAL against the prepass depth
+invariant gl_Position;
 
 vec3 triangle_colors[3] = vec3[](
     vec3(1.0, 0.0, 0.0),
@@ -13,7 +40,12 @@ vec3 triangle_colors[3] = vec3[](
 
 void main()
 {
-    gl_Position = vec4(a_Position, 1.0);
+    ObjectData object = objects[u_draw.objectOffset + gl_InstanceIndex];
+
+    vec3 position = a_Position * u_draw.positionScale + u_draw.positionOffset;
+    vec3 world = position * object.scale + object.position;
+    gl_Position = vec4((world.xy - u_draw.cameraPosition) * u_draw.cameraZoom, world.z, 1.0);
 
-    out_color = triangle_colors[gl_VertexIndex];
+    out_color = triangle_colors[gl_VertexIndex % 3] * object.color.rgb;
+    out_materialId = u_draw.materialId;
 }
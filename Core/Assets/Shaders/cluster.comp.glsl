@@ -0,0 +1,199 @@
+#version 460 core
+
+// Cluster culling: one workgroup per object. Objects outside the frustum are dropped whole, otherwise every meshlet
+// is tested by its bounding sphere and normal cone, and the triangles of the survivors are appended to an index
+// buffer drawn by a single command per object
+
+layout(local_size_x = 64) in;
+
+// Must match ObjectData in Renderer.h
+struct ObjectData
+{
+    vec3 position;
+    float scale;
+    vec4 color;
+};
+
+// Must match ObjectCullData in Renderer.h
+struct ObjectCullData
+{
+    uint meshId;
+    uint drawGroup;
+};
+
+// Must match MeshSimplifier::MaxLodCount
+const uint MAX_LODS = 8;
+
+// Must match MeshLodCullData in Renderer.h
+struct MeshLod
+{
+    uint firstIndex;
+    uint indexCount;
+    float error;
+    uint padding;
+};
+
+// Must match MeshCullData in Renderer.h
+struct MeshCullData
+{
+    vec3 boundsCenter;
+    float boundsRadius;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint lodCount;
+    MeshLod lods[MAX_LODS];
+    uint firstMeshlet;
+    uint meshletCount;
+    uvec2 padding;
+};
+
+// Must match MeshletCullData in Renderer.h
+struct MeshletData
+{
+    vec3 center;
+    float radius;
+    vec3 coneAxis;
+    float coneCutoff;
+    uint firstVertex;
+    uint firstTriangle;
+    uint vertexCount;
+    uint triangleCount;
+};
+
+// Matches VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer { ObjectData objects[]; };
+layout(std430, set = 0, binding = 1) readonly buffer ObjectCullBuffer { ObjectCullData objectCull[]; };
+layout(std430, set = 0, binding = 2) readonly buffer MeshCullBuffer { MeshCullData meshes[]; };
+layout(std430, set = 0, binding = 3) readonly buffer DrawGroupBuffer { uvec2 groups[]; }; // first command, capacity per phase
+layout(std430, set = 0, binding = 4) writeonly buffer CommandBuffer { DrawCommand commands[]; };
+layout(std430, set = 0, binding = 5) buffer DrawCountBuffer { uint drawCounts[]; };
+
+layout(std430, set = 1, binding = 0) readonly buffer MeshletBuffer { MeshletData meshlets[]; };
+layout(std430, set = 1, binding = 1) readonly buffer MeshletVertexBuffer { uint meshletVertices[]; };
+layout(std430, set = 1, binding = 2) readonly buffer MeshletTriangleBuffer { uint meshletTriangles[]; }; // 8 bits per corner
+layout(std430, set = 1, binding = 4) writeonly buffer ClusterIndexBuffer { uint clusterIndices[]; };
+
+// Must match the draw count buffer layout in Renderer.h
+const uint FRUSTUM_CULLED_COUNTER = 0;
+const uint CLUSTER_INDEX_COUNTER = 2;
+const uint CONE_CULLED_COUNTER = 3;
+const uint DRAW_COUNT_OFFSET = 4;
+
+// Must match ClusterCullPushConstants in Renderer.h
+layout(push_constant) uniform ClusterCullConstants
+{
+    vec4 frustumPlanes[6]; // xyz normal, w distance
+    uint objectCount;
+    uint indexCapacity;
+} u_cull;
+
+shared uint s_triangleCount;
+shared uint s_indexCursor;
+shared bool s_fits;
+
+bool InFrustum(vec3 center, float radius)
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        if (dot(u_cull.frustumPlanes[i].xyz, center) + u_cull.frustumPlanes[i].w < -radius)
+            return false;
+    }
+    return true;
+}
+
+// The camera looks down +z everywhere and objects only scale uniformly, so the cone holds in world space as it is
+bool FacesAway(MeshletData meshlet)
+{
+    return meshlet.coneAxis.z > meshlet.coneCutoff;
+}
+
+void main()
+{
+    uint objectIndex = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    if (objectIndex >= u_cull.objectCount)
+        return;
+
+    ObjectCullData cull = objectCull[objectIndex];
+    if (cull.drawGroup == 0xFFFFFFFFu)
+        return;
+
+    ObjectData object = objects[objectIndex];
+    MeshCullData mesh = meshes[cull.meshId];
+
+    if (!InFrustum(mesh.boundsCenter * object.scale + object.position, mesh.boundsRadius * object.scale))
+    {
+        if (gl_LocalInvocationIndex == 0)
+            atomicAdd(drawCounts[FRUSTUM_CULLED_COUNTER], 1);
+        return;
+    }
+
+    if (gl_LocalInvocationIndex == 0)
+        s_triangleCount = 0;
+    barrier();
+
+    // Count first, the object's range in the index buffer is reserved in one go
+    for (uint i = gl_LocalInvocationIndex; i < mesh.meshletCount; i += gl_WorkGroupSize.x)
+    {
+        MeshletData meshlet = meshlets[mesh.firstMeshlet + i];
+        if (!InFrustum(meshlet.center * object.scale + object.position, meshlet.radius * object.scale))
+            continue;
+
+        if (FacesAway(meshlet))
+            atomicAdd(drawCounts[CONE_CULLED_COUNTER], meshlet.triangleCount);
+        else
+            atomicAdd(s_triangleCount, meshlet.triangleCount);
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0)
+    {
+        uint indexCount = s_triangleCount * 3;
+        uint firstIndex = atomicAdd(drawCounts[CLUSTER_INDEX_COUNTER], indexCount);
+        s_fits = indexCount > 0 && firstIndex + indexCount <= u_cull.indexCapacity;
+        s_indexCursor = firstIndex;
+
+        if (s_fits)
+        {
+            uint drawIndex = atomicAdd(drawCounts[DRAW_COUNT_OFFSET + cull.drawGroup * 2], 1);
+
+            DrawCommand command;
+            command.indexCount = indexCount;
+            command.instanceCount = 1;
+            command.firstIndex = firstIndex;
+            command.vertexOffset = mesh.vertexOffset;
+            command.firstInstance = objectIndex;
+            commands[groups[cull.drawGroup].x + drawIndex] = command;
+        }
+    }
+    barrier();
+
+    if (!s_fits)
+        return;
+
+    // Same tests again, each surviving meshlet takes its slice and writes mesh relative indices
+    for (uint i = gl_LocalInvocationIndex; i < mesh.meshletCount; i += gl_WorkGroupSize.x)
+    {
+        MeshletData meshlet = meshlets[mesh.firstMeshlet + i];
+        if (!InFrustum(meshlet.center * object.scale + object.position, meshlet.radius * object.scale) || FacesAway(meshlet))
+            continue;
+
+        uint index = atomicAdd(s_indexCursor, meshlet.triangleCount * 3);
+        for (uint triangle = 0; triangle < meshlet.triangleCount; ++triangle)
+        {
+            uint corners = meshletTriangles[meshlet.firstTriangle + triangle];
+            clusterIndices[index++] = meshletVertices[meshlet.firstVertex + (corners & 0xFFu)];
+            clusterIndices[index++] = meshletVertices[meshlet.firstVertex + ((corners >> 8) & 0xFFu)];
+            clusterIndices[index++] = meshletVertices[meshlet.firstVertex + ((corners >> 16) & 0xFFu)];
+        }
+    }
+}
@@ -0,0 +1,109 @@
+#version 460 core
+#extension GL_EXT_mesh_shader : require
+
+// Outputs one meshlet the task shader kept, shaded like basic.vert.glsl
+
+layout(local_size_x = 64) in;
+layout(triangles, max_vertices = 64, max_primitives = 124) out; // Must match MeshletBuilder::MaxVertices, MaxTriangles
+
+layout(location = 0) out vec3 out_color[];
+layout(location = 1) flat out uint out_materialId[];
+
+// Must match ObjectData in Renderer.h
+struct ObjectData
+{
+    vec3 position;
+    float scale;
+    vec4 color;
+};
+
+// Must match MeshletCullData in Renderer.h
+struct MeshletData
+{
+    vec3 center;
+    float radius;
+    vec3 coneAxis;
+    float coneCutoff;
+    uint firstVertex;
+    uint firstTriangle;
+    uint vertexCount;
+    uint triangleCount;
+};
+
+// Must match cluster.task.glsl
+struct TaskPayload
+{
+    uint objectIndex;
+    uint meshlets[32];
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer { ObjectData objects[]; };
+layout(std430, set = 1, binding = 0) readonly buffer MeshletBuffer { MeshletData meshlets[]; };
+layout(std430, set = 1, binding = 1) readonly buffer MeshletVertexBuffer { uint meshletVertices[]; };
+layout(std430, set = 1, binding = 2) readonly buffer MeshletTriangleBuffer { uint meshletTriangles[]; }; // 8 bits per corner
+layout(std430, set = 1, binding = 3) readonly buffer PositionBuffer { uint positionWords[]; }; // The vertex pool
+
+// Must match VertexCompression::PositionFormat: float xyz, or half / snorm16 xyzw
+layout(constant_id = 0) const uint POSITION_FORMAT = 0;
+
+// Must match ClusterDrawPushConstants in Renderer.h
+layout(push_constant) uniform ClusterDrawConstants
+{
+    uint objectOffset;
+    uint materialId;
+    vec2 cameraPosition;
+    float cameraZoom;
+    uint firstMeshlet;
+    uint meshletCount;
+    int vertexOffset;
+    vec3 boundsCenter;
+    float boundsRadius;
+    vec3 positionOffset; // Compressed positions: stored * scale + offset
+    float positionScale;
+} u_draw;
+
+taskPayloadSharedEXT TaskPayload payload;
+
+vec3 triangle_colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+// Same values the vertex input would read for the pipeline's position format
+vec3 LoadPosition(uint vertex)
+{
+    if (POSITION_FORMAT == 0)
+        return uintBitsToFloat(uvec3(positionWords[vertex * 3], positionWords[vertex * 3 + 1], positionWords[vertex * 3 + 2]));
+
+    uvec2 words = uvec2(positionWords[vertex * 2], positionWords[vertex * 2 + 1]);
+    if (POSITION_FORMAT == 1)
+        return vec3(unpackHalf2x16(words.x), unpackHalf2x16(words.y).x);
+    return vec3(unpackSnorm2x16(words.x), unpackSnorm2x16(words.y).x);
+}
+
+void main()
+{
+    MeshletData meshlet = meshlets[u_draw.firstMeshlet + payload.meshlets[gl_WorkGroupID.x]];
+    ObjectData object = objects[payload.objectIndex];
+
+    SetMeshOutputsEXT(meshlet.vertexCount, meshlet.triangleCount);
+
+    for (uint i = gl_LocalInvocationIndex; i < meshlet.vertexCount; i += gl_WorkGroupSize.x)
+    {
+        // Same vertex numbering as gl_VertexIndex in the vertex pipeline, so the colors match
+        uint vertex = uint(u_draw.vertexOffset) + meshletVertices[meshlet.firstVertex + i];
+        vec3 position = LoadPosition(vertex) * u_draw.positionScale + u_draw.positionOffset;
+
+        vec3 world = position * object.scale + object.position;
+        gl_MeshVerticesEXT[i].gl_Position = vec4((world.xy - u_draw.cameraPosition) * u_draw.cameraZoom, world.z, 1.0);
+        out_color[i] = triangle_colors[vertex % 3] * object.color.rgb;
+        out_materialId[i] = u_draw.materialId;
+    }
+
+    for (uint i = gl_LocalInvocationIndex; i < meshlet.triangleCount; i += gl_WorkGroupSize.x)
+    {
+        uint corners = meshletTriangles[meshlet.firstTriangle + i];
+        gl_PrimitiveTriangleIndicesEXT[i] = uvec3(corners & 0xFFu, (corners >> 8) & 0xFFu, (corners >> 16) & 0xFFu);
+    }
+}
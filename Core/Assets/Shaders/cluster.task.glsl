@@ -0,0 +1,115 @@
+#version 460 core
+#extension GL_EXT_mesh_shader : require
+
+// Cluster culling with mesh shaders: each workgroup tests 32 meshlets of one object (the y of the launch) and
+// emits a mesh workgroup for every one that may be visible
+
+layout(local_size_x = 32) in;
+
+// Must match ObjectData in Renderer.h
+struct ObjectData
+{
+    vec3 position;
+    float scale;
+    vec4 color;
+};
+
+// Must match MeshletCullData in Renderer.h
+struct MeshletData
+{
+    vec3 center;
+    float radius;
+    vec3 coneAxis;
+    float coneCutoff;
+    uint firstVertex;
+    uint firstTriangle;
+    uint vertexCount;
+    uint triangleCount;
+};
+
+// Must match cluster.mesh.glsl
+struct TaskPayload
+{
+    uint objectIndex;
+    uint meshlets[32]; // Relative to the push constant's firstMeshlet
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer { ObjectData objects[]; };
+layout(std430, set = 1, binding = 0) readonly buffer MeshletBuffer { MeshletData meshlets[]; };
+layout(std430, set = 1, binding = 5) buffer DrawCountBuffer { uint drawCounts[]; };
+
+// Must match the draw count buffer layout in Renderer.h
+const uint FRUSTUM_CULLED_COUNTER = 0;
+const uint CLUSTER_INDEX_COUNTER = 2;
+const uint CONE_CULLED_COUNTER = 3;
+
+// Must match ClusterDrawPushConstants in Renderer.h
+layout(push_constant) uniform ClusterDrawConstants
+{
+    uint objectOffset;
+    uint materialId;
+    vec2 cameraPosition;
+    float cameraZoom;
+    uint firstMeshlet;
+    uint meshletCount;
+    int vertexOffset;
+    vec3 boundsCenter;
+    float boundsRadius;
+    vec3 positionOffset; // Compressed positions: stored * scale + offset
+    float positionScale;
+} u_draw;
+
+taskPayloadSharedEXT TaskPayload payload;
+
+shared uint s_visibleCount;
+
+// The camera maps world xy straight to NDC and keeps z as depth, the view volume is a box
+bool InView(vec3 center, float radius)
+{
+    vec2 ndc = (center.xy - u_draw.cameraPosition) * u_draw.cameraZoom;
+    float ndcRadius = radius * u_draw.cameraZoom;
+    return all(lessThanEqual(abs(ndc) - ndcRadius, vec2(1.0))) && center.z + radius >= 0.0 && center.z - radius <= 1.0;
+}
+
+void main()
+{
+    uint objectIndex = u_draw.objectOffset + gl_WorkGroupID.y;
+    ObjectData object = objects[objectIndex];
+
+    if (gl_LocalInvocationIndex == 0)
+    {
+        s_visibleCount = 0;
+        payload.objectIndex = objectIndex;
+    }
+    barrier();
+
+    // Whole object first, it's counted once, by the first workgroup of the object
+    if (!InView(u_draw.boundsCenter * object.scale + object.position, u_draw.boundsRadius * object.scale))
+    {
+        if (gl_WorkGroupID.x == 0 && gl_LocalInvocationIndex == 0)
+            atomicAdd(drawCounts[FRUSTUM_CULLED_COUNTER], 1);
+        EmitMeshTasksEXT(0, 1, 1);
+    }
+
+    // The camera looks down +z everywhere and objects only scale uniformly, so the cone holds in world space as it is
+    uint meshletIndex = gl_WorkGroupID.x * 32 + gl_LocalInvocationIndex;
+    if (meshletIndex < u_draw.meshletCount)
+    {
+        MeshletData meshlet = meshlets[u_draw.firstMeshlet + meshletIndex];
+        if (InView(meshlet.center * object.scale + object.position, meshlet.radius * object.scale))
+        {
+            if (meshlet.coneAxis.z > meshlet.coneCutoff)
+            {
+                atomicAdd(drawCounts[CONE_CULLED_COUNTER], meshlet.triangleCount);
+            }
+            else
+            {
+                payload.meshlets[atomicAdd(s_visibleCount, 1)] = meshletIndex;
+                atomicAdd(drawCounts[CLUSTER_INDEX_COUNTER], meshlet.triangleCount * 3);
+            }
+        }
+    }
+    barrier();
+
+    EmitMeshTasksEXT(s_visibleCount, 1, 1);
+}
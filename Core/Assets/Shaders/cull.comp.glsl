@@ -0,0 +1,204 @@
+#version 460 core
+
+// Frustum (and optionally Hi-Z occlusion) culls one object per invocation and appends a draw command for survivors
+
+layout(local_size_x = 64) in;
+
+// Must match ObjectData in Renderer.h
+struct ObjectData
+{
+    vec3 position;
+    float scale;
+    vec4 color;
+};
+
+// Must match ObjectCullData in Renderer.h
+struct ObjectCullData
+{
+    uint meshId;
+    uint drawGroup;
+};
+
+// Must match MeshSimplifier::MaxLodCount
+const uint MAX_LODS = 8;
+
+// Must match MeshLodCullData in Renderer.h
+struct MeshLod
+{
+    uint firstIndex;
+    uint indexCount;
+    float error; // In pixels at object scale 1, already divided by the allowed error
+    uint padding;
+};
+
+// Must match MeshCullData in Renderer.h
+struct MeshCullData
+{
+    vec3 boundsCenter;
+    float boundsRadius;
+    uint indexCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint lodCount;
+    MeshLod lods[MAX_LODS];
+    uint firstMeshlet; // Cluster culling only
+    uint meshletCount;
+    uvec2 padding;
+};
+
+// Matches VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer { ObjectData objects[]; };
+layout(std430, set = 0, binding = 1) readonly buffer ObjectCullBuffer { ObjectCullData objectCull[]; };
+layout(std430, set = 0, binding = 2) readonly buffer MeshCullBuffer { MeshCullData meshes[]; };
+layout(std430, set = 0, binding = 3) readonly buffer DrawGroupBuffer { uvec2 groups[]; }; // first command, capacity per phase
+layout(std430, set = 0, binding = 4) writeonly buffer CommandBuffer { DrawCommand commands[]; };
+layout(std430, set = 0, binding = 5) buffer DrawCountBuffer { uint drawCounts[]; };
+layout(std430, set = 0, binding = 6) buffer VisibilityBuffer { uint visibility[]; }; // Last frame's result
+layout(set = 0, binding = 7) uniform sampler2D u_hiz; // Max depth pyramid
+
+// Must match CullPhase in Renderer.h
+const uint PHASE_SINGLE = 0;
+const uint PHASE_FIRST = 1;
+const uint PHASE_SECOND = 2;
+
+// Must match the draw count buffer layout in Renderer.h
+const uint FRUSTUM_CULLED_COUNTER = 0;
+const uint OCCLUSION_CULLED_COUNTER = 1;
+const uint DRAW_COUNT_OFFSET = 4;
+
+// Must match CullPushConstants in Renderer.h
+layout(push_constant) uniform CullConstants
+{
+    vec4 frustumPlanes[6]; // xyz normal, w distance
+    uint objectCount;
+    uint phase;
+    vec2 cameraPosition;
+    float cameraZoom;
+    uint hizMipLevels;
+    uvec2 hizSize;
+} u_cull;
+
+bool IsOccluded(vec3 center, float radius)
+{
+    // Screen rect of the sphere, the camera maps world xy straight to NDC (y up, texel rows go down)
+    vec2 ndcMin = (center.xy - radius - u_cull.cameraPosition) * u_cull.cameraZoom;
+    vec2 ndcMax = (center.xy + radius - u_cull.cameraPosition) * u_cull.cameraZoom;
+    vec2 uvMin = clamp(vec2(ndcMin.x, -ndcMax.y) * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMax = clamp(vec2(ndcMax.x, -ndcMin.y) * 0.5 + 0.5, 0.0, 1.0);
+
+    // Pick the level where the rect spans at most 2x2 texels
+    vec2 extent = (uvMax - uvMin) * vec2(u_cull.hizSize);
+    int level = int(ceil(log2(max(max(extent.x, extent.y), 1.0))));
+    level = min(level, int(u_cull.hizMipLevels) - 1);
+
+    ivec2 levelSize = max(ivec2(u_cull.hizSize) >> level, ivec2(1));
+    ivec2 texelMin = min(ivec2(uvMin * vec2(levelSize)), levelSize - 1);
+    ivec2 texelMax = min(ivec2(uvMax * vec2(levelSize)), levelSize - 1);
+
+    float occluderDepth = 0.0;
+    for (int y = texelMin.y; y <= texelMax.y; ++y)
+    {
+        for (int x = texelMin.x; x <= texelMax.x; ++x)
+        {
+            occluderDepth = max(occluderDepth, texelFetch(u_hiz, ivec2(x, y), level).r);
+        }
+    }
+
+    // Orthographic depth is world z, the sphere's nearest point is center.z - radius
+    return center.z - radius > occluderDepth;
+}
+
+// Coarsest level whose error stays within the allowed screen error, errors only grow down the chain
+uint SelectLod(MeshCullData mesh, float scale)
+{
+    for (uint level = mesh.lodCount - 1; level > 0; --level)
+    {
+        if (mesh.lods[level].error * scale <= 1.0)
+            return level;
+    }
+    return 0;
+}
+
+void AppendDraw(uint objectIndex, ObjectCullData cull, MeshCullData mesh, float scale, uint slot)
+{
+    uint drawIndex = atomicAdd(drawCounts[DRAW_COUNT_OFFSET + cull.drawGroup * 2 + slot], 1);
+    uint lod = SelectLod(mesh, scale);
+
+    DrawCommand command;
+    command.indexCount = mesh.lods[lod].indexCount;
+    command.instanceCount = 1;
+    command.firstIndex = mesh.lods[lod].firstIndex;
+    command.vertexOffset = mesh.vertexOffset;
+    command.firstInstance = objectIndex;
+
+    uvec2 group = groups[cull.drawGroup];
+    commands[group.x + slot * group.y + drawIndex] = command;
+}
+
+void main()
+{
+    uint objectIndex = gl_GlobalInvocationID.x;
+    if (objectIndex >= u_cull.objectCount)
+        return;
+
+    ObjectCullData cull = objectCull[objectIndex];
+    if (cull.drawGroup == 0xFFFFFFFFu)
+        return;
+
+    ObjectData object = objects[objectIndex];
+    MeshCullData mesh = meshes[cull.meshId];
+
+    vec3 center = mesh.boundsCenter * object.scale + object.position;
+    float radius = mesh.boundsRadius * object.scale;
+    bool inFrustum = true;
+    for (int i = 0; i < 6; ++i)
+    {
+        if (dot(u_cull.frustumPlanes[i].xyz, center) + u_cull.frustumPlanes[i].w < -radius)
+            inFrustum = false;
+    }
+
+    if (u_cull.phase == PHASE_SINGLE)
+    {
+        if (inFrustum)
+            AppendDraw(objectIndex, cull, mesh, object.scale, 0);
+        else
+            atomicAdd(drawCounts[FRUSTUM_CULLED_COUNTER], 1);
+        return;
+    }
+
+    // Phase 1: redraw what was visible last frame, it becomes the occluder set for the Hi-Z
+    if (u_cull.phase == PHASE_FIRST)
+    {
+        if (inFrustum && visibility[objectIndex] != 0)
+            AppendDraw(objectIndex, cull, mesh, object.scale, 0);
+        return;
+    }
+
+    // Phase 2: test everything against the new Hi-Z, draw what phase 1 missed
+    bool wasDrawn = inFrustum && visibility[objectIndex] != 0;
+    if (!inFrustum)
+    {
+        visibility[objectIndex] = 0;
+        atomicAdd(drawCounts[FRUSTUM_CULLED_COUNTER], 1);
+        return;
+    }
+
+    bool occluded = IsOccluded(center, radius);
+    visibility[objectIndex] = occluded ? 0 : 1;
+    if (wasDrawn)
+        return;
+
+    if (occluded)
+        atomicAdd(drawCounts[OCCLUSION_CULLED_COUNTER], 1);
+    else
+        AppendDraw(objectIndex, cull, mesh, object.scale, 1);
+}
@@ -0,0 +1,41 @@
+#version 460 core
+
+// Depth prepass: position only, no fragment shader
+
+layout(location = 0) in vec3 a_Position; // Float, half or snorm16 by the import settings, see VertexCompression.h
+
+// Must match ObjectData in Renderer.h
+struct ObjectData
+{
+    vec3 position;
+    float scale;
+    vec4 color;
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer ObjectBuffer
+{
+    ObjectData objects[];
+};
+
+// Must match DrawPushConstants in Renderer.h
+layout(push_constant) uniform DrawConstants
+{
+    uint objectOffset;
+    uint materialId;
+    vec2 cameraPosition;
+    float cameraZoom;
+    float positionScale; // Compressed positions: stored * scale + offset
+    vec3 positionOffset;
+} u_draw;
+
+// Must match basic.vert.glsl exactly
+invariant gl_Position;
+
+void main()
+{
+    ObjectData object = objects[u_draw.objectOffset + gl_InstanceIndex];
+
+    vec3 position = a_Position * u_draw.positionScale + u_draw.positionOffset;
+    vec3 world = position * object.scale + object.position;
+    gl_Position = vec4((world.xy - u_draw.cameraPosition) * u_draw.cameraZoom, world.z, 1.0);
+}
@@ -0,0 +1,37 @@
+#version 460 core
+
+// Builds one level of the max depth pyramid (Hi-Z) from the depth buffer or the level above it
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform sampler2D u_source;
+layout(set = 0, binding = 1, r32f) uniform writeonly image2D u_destination;
+
+// Must match DepthPyramidPushConstants in Renderer.h
+layout(push_constant) uniform DepthPyramidConstants
+{
+    uvec2 sourceSize;
+    uvec2 destinationSize;
+} u_pyramid;
+
+void main()
+{
+    uvec2 texel = gl_GlobalInvocationID.xy;
+    if (any(greaterThanEqual(texel, u_pyramid.destinationSize)))
+        return;
+
+    // Level 0 isn't an exact halving of the depth buffer, so take the whole footprint (up to 3x3)
+    uvec2 begin = texel * u_pyramid.sourceSize / u_pyramid.destinationSize;
+    uvec2 end = ((texel + 1) * u_pyramid.sourceSize + u_pyramid.destinationSize - 1) / u_pyramid.destinationSize;
+
+    float maxDepth = 0.0;
+    for (uint y = begin.y; y < end.y; ++y)
+    {
+        for (uint x = begin.x; x < end.x; ++x)
+        {
+            maxDepth = max(maxDepth, texelFetch(u_source, ivec2(x, y), 0).r);
+        }
+    }
+
+    imageStore(u_destination, ivec2(texel), vec4(maxDepth));
+}
@@ -0,0 +1,37 @@
+#version 460 core
+
+layout(location = 0) in vec3 a_Position; // Float, half or snorm16 by the import settings, see VertexCompression.h
+
+// Per-instance stream (binding 1), must match InstanceData in Renderer.h
+layout(location = 1) in vec4 a_InstancePositionScale;
+layout(location = 2) in vec4 a_InstanceColor;
+
+// Must match DrawPushConstants in Renderer.h
+layout(push_constant) uniform DrawConstants
+{
+    uint objectOffset;
+    uint materialId;
+    vec2 cameraPosition;
+    float cameraZoom;
+    float positionScale; // Compressed positions: stored * scale + offset
+    vec3 positionOffset;
+} u_draw;
+
+layout(location = 0) out vec3 out_color;
+layout(location = 1) flat out uint out_materialId;
+
+vec3 triangle_colors[3] = vec3[](
+    vec3(1.0, 0.0, 0.0),
+    vec3(0.0, 1.0, 0.0),
+    vec3(0.0, 0.0, 1.0)
+);
+
+void main()
+{
+    vec3 position = a_Position * u_draw.positionScale + u_draw.positionOffset;
+    vec3 world = position * a_InstancePositionScale.w + a_InstancePositionScale.xyz;
+    gl_Position = vec4((world.xy - u_draw.cameraPosition) * u_draw.cameraZoom, world.z, 1.0);
+
+    out_color = triangle_colors[gl_VertexIndex % 3] * a_InstanceColor.rgb;
+    out_materialId = 0;
+}
@@ -0,0 +1,541 @@
+#include "BatchMath.h"
+
+#include "Debug.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#if MATH_SIMD_SSE
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC takes any intrinsic anywhere, GCC and Clang need the kernel itself marked for the instruction set
+#if defined(__GNUC__)
+#define BATCH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BATCH_TARGET(isa)
+#endif
+
+static constexpr size_t StreamAlignment = 64;
+
+Vector3Array::~Vector3Array()
+{
+    if (m_x != nullptr)
+        operator delete(m_x, std::align_val_t(StreamAlignment));
+}
+
+Vector3Array::Vector3Array(Vector3Array&& other) noexcept
+{
+    *this = std::move(other);
+}
+
+Vector3Array& Vector3Array::operator=(Vector3Array&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (m_x != nullptr)
+            operator delete(m_x, std::align_val_t(StreamAlignment));
+        m_x = other.m_x;
+        m_y = other.m_y;
+        m_z = other.m_z;
+        m_count = other.m_count;
+        m_capacity = other.m_capacity;
+        other.m_x = other.m_y = other.m_z = nullptr;
+        other.m_count = other.m_capacity = 0;
+    }
+    return *this;
+}
+
+void Vector3Array::Resize(size_t count)
+{
+    if (count <= m_capacity)
+    {
+        m_count = count;
+        return;
+    }
+
+    // Streams are padded to whole cache lines so y and z stay aligned
+    const size_t floatsPerLine = StreamAlignment / sizeof(float);
+    const size_t capacity = (std::max(count, m_capacity * 2) + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+    float* data = (float*)operator new(capacity * 3 * sizeof(float), std::align_val_t(StreamAlignment));
+    if (m_count > 0)
+    {
+        memcpy(data, m_x, m_count * sizeof(float));
+        memcpy(data + capacity, m_y, m_count * sizeof(float));
+        memcpy(data + capacity * 2, m_z, m_count * sizeof(float));
+    }
+    if (m_x != nullptr)
+        operator delete(m_x, std::align_val_t(StreamAlignment));
+
+    m_x = data;
+    m_y = data + capacity;
+    m_z = data + capacity * 2;
+    m_count = count;
+    m_capacity = capacity;
+}
+
+// Scalar kernels, also finish the tails the vector kernels leave
+
+static void TransformPointsScalar(const Matrix4x4& m, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    const Vector4* c = m.columns;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float px = x[i], py = y[i], pz = z[i];
+        outX[i] = c[0].x * px + c[1].x * py + c[2].x * pz + c[3].x;
+        outY[i] = c[0].y * px + c[1].y * py + c[2].y * pz + c[3].y;
+        outZ[i] = c[0].z * px + c[1].z * py + c[2].z * pz + c[3].z;
+    }
+}
+
+static void MultiplyMatricesScalar(const Matrix4x4* a, const Matrix4x4* b, Matrix4x4* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        out[i] = MathScalar::Multiply(a[i], b[i]);
+    }
+}
+
+static void ComputeBoundsScalar(const float* x, const float* y, const float* z, size_t count, Bounds& bounds)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        bounds.min = { std::min(bounds.min.x, x[i]), std::min(bounds.min.y, y[i]), std::min(bounds.min.z, z[i]) };
+        bounds.max = { std::max(bounds.max.x, x[i]), std::max(bounds.max.y, y[i]), std::max(bounds.max.z, z[i]) };
+    }
+}
+
+#if MATH_SIMD_SSE
+
+// SSE4.2: 4 points per iteration
+
+BATCH_TARGET("sse4.2")
+static void TransformPointsSse42(const Matrix4x4& m, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    const Vector4* c = m.columns;
+    const __m128 m00 = _mm_set1_ps(c[0].x), m01 = _mm_set1_ps(c[0].y), m02 = _mm_set1_ps(c[0].z);
+    const __m128 m10 = _mm_set1_ps(c[1].x), m11 = _mm_set1_ps(c[1].y), m12 = _mm_set1_ps(c[1].z);
+    const __m128 m20 = _mm_set1_ps(c[2].x), m21 = _mm_set1_ps(c[2].y), m22 = _mm_set1_ps(c[2].z);
+    const __m128 m30 = _mm_set1_ps(c[3].x), m31 = _mm_set1_ps(c[3].y), m32 = _mm_set1_ps(c[3].z);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 px = _mm_loadu_ps(x + i);
+        const __m128 py = _mm_loadu_ps(y + i);
+        const __m128 pz = _mm_loadu_ps(z + i);
+        _mm_storeu_ps(outX + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, px), _mm_mul_ps(m10, py)), _mm_add_ps(_mm_mul_ps(m20, pz), m30)));
+        _mm_storeu_ps(outY + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, px), _mm_mul_ps(m11, py)), _mm_add_ps(_mm_mul_ps(m21, pz), m31)));
+        _mm_storeu_ps(outZ + i, _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, px), _mm_mul_ps(m12, py)), _mm_add_ps(_mm_mul_ps(m22, pz), m32)));
+    }
+    TransformPointsScalar(m, x + i, y + i, z + i, outX + i, outY + i, outZ + i, count - i);
+}
+
+BATCH_TARGET("sse4.2")
+static void MultiplyMatricesSse42(const Matrix4x4* a, const Matrix4x4* b, Matrix4x4* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        // All of a is loaded before anything is stored, so out may alias it
+        const __m128 a0 = _mm_loadu_ps(&a[i].columns[0].x);
+        const __m128 a1 = _mm_loadu_ps(&a[i].columns[1].x);
+        const __m128 a2 = _mm_loadu_ps(&a[i].columns[2].x);
+        const __m128 a3 = _mm_loadu_ps(&a[i].columns[3].x);
+        for (int column = 0; column < 4; ++column)
+        {
+            const __m128 bc = _mm_loadu_ps(&b[i].columns[column].x);
+            __m128 r = _mm_mul_ps(a0, _mm_shuffle_ps(bc, bc, 0x00));
+            r = _mm_add_ps(r, _mm_mul_ps(a1, _mm_shuffle_ps(bc, bc, 0x55)));
+            r = _mm_add_ps(r, _mm_mul_ps(a2, _mm_shuffle_ps(bc, bc, 0xAA)));
+            r = _mm_add_ps(r, _mm_mul_ps(a3, _mm_shuffle_ps(bc, bc, 0xFF)));
+            _mm_storeu_ps(&out[i].columns[column].x, r);
+        }
+    }
+}
+
+BATCH_TARGET("sse4.2")
+static void ComputeBoundsSse42(const float* x, const float* y, const float* z, size_t count, Bounds& bounds)
+{
+    __m128 minX = _mm_set1_ps(bounds.min.x), minY = _mm_set1_ps(bounds.min.y), minZ = _mm_set1_ps(bounds.min.z);
+    __m128 maxX = _mm_set1_ps(bounds.max.x), maxY = _mm_set1_ps(bounds.max.y), maxZ = _mm_set1_ps(bounds.max.z);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        const __m128 px = _mm_loadu_ps(x + i);
+        const __m128 py = _mm_loadu_ps(y + i);
+        const __m128 pz = _mm_loadu_ps(z + i);
+        minX = _mm_min_ps(minX, px);
+        minY = _mm_min_ps(minY, py);
+        minZ = _mm_min_ps(minZ, pz);
+        maxX = _mm_max_ps(maxX, px);
+        maxY = _mm_max_ps(maxY, py);
+        maxZ = _mm_max_ps(maxZ, pz);
+    }
+
+    alignas(16) float lanes[6][4];
+    _mm_store_ps(lanes[0], minX);
+    _mm_store_ps(lanes[1], minY);
+    _mm_store_ps(lanes[2], minZ);
+    _mm_store_ps(lanes[3], maxX);
+    _mm_store_ps(lanes[4], maxY);
+    _mm_store_ps(lanes[5], maxZ);
+    ComputeBoundsScalar(lanes[0], lanes[1], lanes[2], 4, bounds);
+    ComputeBoundsScalar(lanes[3], lanes[4], lanes[5], 4, bounds);
+    ComputeBoundsScalar(x + i, y + i, z + i, count - i, bounds);
+}
+
+// AVX2: 8 points per iteration, FMA
+
+BATCH_TARGET("avx2,fma")
+static void TransformPointsAvx2(const Matrix4x4& m, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    const Vector4* c = m.columns;
+    const __m256 m00 = _mm256_set1_ps(c[0].x), m01 = _mm256_set1_ps(c[0].y), m02 = _mm256_set1_ps(c[0].z);
+    const __m256 m10 = _mm256_set1_ps(c[1].x), m11 = _mm256_set1_ps(c[1].y), m12 = _mm256_set1_ps(c[1].z);
+    const __m256 m20 = _mm256_set1_ps(c[2].x), m21 = _mm256_set1_ps(c[2].y), m22 = _mm256_set1_ps(c[2].z);
+    const __m256 m30 = _mm256_set1_ps(c[3].x), m31 = _mm256_set1_ps(c[3].y), m32 = _mm256_set1_ps(c[3].z);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 px = _mm256_loadu_ps(x + i);
+        const __m256 py = _mm256_loadu_ps(y + i);
+        const __m256 pz = _mm256_loadu_ps(z + i);
+        _mm256_storeu_ps(outX + i, _mm256_fmadd_ps(m00, px, _mm256_fmadd_ps(m10, py, _mm256_fmadd_ps(m20, pz, m30))));
+        _mm256_storeu_ps(outY + i, _mm256_fmadd_ps(m01, px, _mm256_fmadd_ps(m11, py, _mm256_fmadd_ps(m21, pz, m31))));
+        _mm256_storeu_ps(outZ + i, _mm256_fmadd_ps(m02, px, _mm256_fmadd_ps(m12, py, _mm256_fmadd_ps(m22, pz, m32))));
+    }
+    TransformPointsScalar(m, x + i, y + i, z + i, outX + i, outY + i, outZ + i, count - i);
+}
+
+BATCH_TARGET("avx2,fma")
+static void MultiplyMatricesAvx2(const Matrix4x4* a, const Matrix4x4* b, Matrix4x4* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Two result columns per register, one in each 128 bit lane
+        const __m256 a0 = _mm256_broadcast_ps((const __m128*)&a[i].columns[0]);
+        const __m256 a1 = _mm256_broadcast_ps((const __m128*)&a[i].columns[1]);
+        const __m256 a2 = _mm256_broadcast_ps((const __m128*)&a[i].columns[2]);
+        const __m256 a3 = _mm256_broadcast_ps((const __m128*)&a[i].columns[3]);
+        const __m256 b01 = _mm256_loadu_ps(&b[i].columns[0].x);
+        const __m256 b23 = _mm256_loadu_ps(&b[i].columns[2].x);
+
+        __m256 r01 = _mm256_mul_ps(a0, _mm256_permute_ps(b01, 0x00));
+        __m256 r23 = _mm256_mul_ps(a0, _mm256_permute_ps(b23, 0x00));
+        r01 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b01, 0x55), r01);
+        r23 = _mm256_fmadd_ps(a1, _mm256_permute_ps(b23, 0x55), r23);
+        r01 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b01, 0xAA), r01);
+        r23 = _mm256_fmadd_ps(a2, _mm256_permute_ps(b23, 0xAA), r23);
+        r01 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b01, 0xFF), r01);
+        r23 = _mm256_fmadd_ps(a3, _mm256_permute_ps(b23, 0xFF), r23);
+        _mm256_storeu_ps(&out[i].columns[0].x, r01);
+        _mm256_storeu_ps(&out[i].columns[2].x, r23);
+    }
+}
+
+BATCH_TARGET("avx2,fma")
+static void ComputeBoundsAvx2(const float* x, const float* y, const float* z, size_t count, Bounds& bounds)
+{
+    __m256 minX = _mm256_set1_ps(bounds.min.x), minY = _mm256_set1_ps(bounds.min.y), minZ = _mm256_set1_ps(bounds.min.z);
+    __m256 maxX = _mm256_set1_ps(bounds.max.x), maxY = _mm256_set1_ps(bounds.max.y), maxZ = _mm256_set1_ps(bounds.max.z);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 px = _mm256_loadu_ps(x + i);
+        const __m256 py = _mm256_loadu_ps(y + i);
+        const __m256 pz = _mm256_loadu_ps(z + i);
+        minX = _mm256_min_ps(minX, px);
+        minY = _mm256_min_ps(minY, py);
+        minZ = _mm256_min_ps(minZ, pz);
+        maxX = _mm256_max_ps(maxX, px);
+        maxY = _mm256_max_ps(maxY, py);
+        maxZ = _mm256_max_ps(maxZ, pz);
+    }
+
+    alignas(32) float lanes[6][8];
+    _mm256_store_ps(lanes[0], minX);
+    _mm256_store_ps(lanes[1], minY);
+    _mm256_store_ps(lanes[2], minZ);
+    _mm256_store_ps(lanes[3], maxX);
+    _mm256_store_ps(lanes[4], maxY);
+    _mm256_store_ps(lanes[5], maxZ);
+    ComputeBoundsScalar(lanes[0], lanes[1], lanes[2], 8, bounds);
+    ComputeBoundsScalar(lanes[3], lanes[4], lanes[5], 8, bounds);
+    ComputeBoundsScalar(x + i, y + i, z + i, count - i, bounds);
+}
+
+// AVX-512: 16 points per iteration, the tail is masked instead of falling back to scalar
+
+BATCH_TARGET("avx512f")
+static void TransformPointsAvx512(const Matrix4x4& m, const float* x, const float* y, const float* z,
+    float* outX, float* outY, float* outZ, size_t count)
+{
+    const Vector4* c = m.columns;
+    const __m512 m00 = _mm512_set1_ps(c[0].x), m01 = _mm512_set1_ps(c[0].y), m02 = _mm512_set1_ps(c[0].z);
+    const __m512 m10 = _mm512_set1_ps(c[1].x), m11 = _mm512_set1_ps(c[1].y), m12 = _mm512_set1_ps(c[1].z);
+    const __m512 m20 = _mm512_set1_ps(c[2].x), m21 = _mm512_set1_ps(c[2].y), m22 = _mm512_set1_ps(c[2].z);
+    const __m512 m30 = _mm512_set1_ps(c[3].x), m31 = _mm512_set1_ps(c[3].y), m32 = _mm512_set1_ps(c[3].z);
+
+    for (size_t i = 0; i < count; i += 16)
+    {
+        const __mmask16 mask = count - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - i)) - 1);
+        const __m512 px = _mm512_maskz_loadu_ps(mask, x + i);
+        const __m512 py = _mm512_maskz_loadu_ps(mask, y + i);
+        const __m512 pz = _mm512_maskz_loadu_ps(mask, z + i);
+        _mm512_mask_storeu_ps(outX + i, mask, _mm512_fmadd_ps(m00, px, _mm512_fmadd_ps(m10, py, _mm512_fmadd_ps(m20, pz, m30))));
+        _mm512_mask_storeu_ps(outY + i, mask, _mm512_fmadd_ps(m01, px, _mm512_fmadd_ps(m11, py, _mm512_fmadd_ps(m21, pz, m31))));
+        _mm512_mask_storeu_ps(outZ + i, mask, _mm512_fmadd_ps(m02, px, _mm512_fmadd_ps(m12, py, _mm512_fmadd_ps(m22, pz, m32))));
+    }
+}
+
+BATCH_TARGET("avx512f")
+static void MultiplyMatricesAvx512(const Matrix4x4* a, const Matrix4x4* b, Matrix4x4* out, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        // The whole matrix in one register, one column per 128 bit lane
+        const __m512 a0 = _mm512_broadcast_f32x4(_mm_loadu_ps(&a[i].columns[0].x));
+        const __m512 a1 = _mm512_broadcast_f32x4(_mm_loadu_ps(&a[i].columns[1].x));
+        const __m512 a2 = _mm512_broadcast_f32x4(_mm_loadu_ps(&a[i].columns[2].x));
+        const __m512 a3 = _mm512_broadcast_f32x4(_mm_loadu_ps(&a[i].columns[3].x));
+        const __m512 bColumns = _mm512_loadu_ps(&b[i].columns[0].x);
+
+        __m512 r = _mm512_mul_ps(a0, _mm512_permute_ps(bColumns, 0x00));
+        r = _mm512_fmadd_ps(a1, _mm512_permute_ps(bColumns, 0x55), r);
+        r = _mm512_fmadd_ps(a2, _mm512_permute_ps(bColumns, 0xAA), r);
+        r = _mm512_fmadd_ps(a3, _mm512_permute_ps(bColumns, 0xFF), r);
+        _mm512_storeu_ps(&out[i].columns[0].x, r);
+    }
+}
+
+BATCH_TARGET("avx512f")
+static void ComputeBoundsAvx512(const float* x, const float* y, const float* z, size_t count, Bounds& bounds)
+{
+    __m512 minX = _mm512_set1_ps(bounds.min.x), minY = _mm512_set1_ps(bounds.min.y), minZ = _mm512_set1_ps(bounds.min.z);
+    __m512 maxX = _mm512_set1_ps(bounds.max.x), maxY = _mm512_set1_ps(bounds.max.y), maxZ = _mm512_set1_ps(bounds.max.z);
+    for (size_t i = 0; i < count; i += 16)
+    {
+        // Masked off lanes keep the running value so they can't move the bounds
+        const __mmask16 mask = count - i >= 16 ? (__mmask16)0xFFFF : (__mmask16)((1u << (count - i)) - 1);
+        const __m512 px = _mm512_maskz_loadu_ps(mask, x + i);
+        const __m512 py = _mm512_maskz_loadu_ps(mask, y + i);
+        const __m512 pz = _mm512_maskz_loadu_ps(mask, z + i);
+        minX = _mm512_mask_min_ps(minX, mask, minX, px);
+        minY = _mm512_mask_min_ps(minY, mask, minY, py);
+        minZ = _mm512_mask_min_ps(minZ, mask, minZ, pz);
+        maxX = _mm512_mask_max_ps(maxX, mask, maxX, px);
+        maxY = _mm512_mask_max_ps(maxY, mask, maxY, py);
+        maxZ = _mm512_mask_max_ps(maxZ, mask, maxZ, pz);
+    }
+    bounds.min = { _mm512_reduce_min_ps(minX), _mm512_reduce_min_ps(minY), _mm512_reduce_min_ps(minZ) };
+    bounds.max = { _mm512_reduce_max_ps(maxX), _mm512_reduce_max_ps(maxY), _mm512_reduce_max_ps(maxZ) };
+}
+
+#endif
+
+struct BatchKernels
+{
+    void (*transformPoints)(const Matrix4x4& m, const float* x, const float* y, const float* z, float* outX, float* outY, float* outZ, size_t count);
+    void (*multiplyMatrices)(const Matrix4x4* a, const Matrix4x4* b, Matrix4x4* out, size_t count);
+    void (*computeBounds)(const float* x, const float* y, const float* z, size_t count, Bounds& bounds);
+};
+
+// Indexed by SimdLevel
+static const BatchKernels s_kernels[] =
+{
+    { TransformPointsScalar, MultiplyMatricesScalar, ComputeBoundsScalar },
+#if MATH_SIMD_SSE
+    { TransformPointsSse42, MultiplyMatricesSse42, ComputeBoundsSse42 },
+    { TransformPointsAvx2, MultiplyMatricesAvx2, ComputeBoundsAvx2 },
+    { TransformPointsAvx512, MultiplyMatricesAvx512, ComputeBoundsAvx512 }
+#endif
+};
+
+static SimdLevel DetectSimdLevel()
+{
+#if MATH_SIMD_SSE && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse42 = (info[2] & (1 << 20)) != 0;
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx2 = false;
+    bool avx512 = false;
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        avx512 = (info[1] & (1 << 16)) != 0;
+    }
+
+    // The OS has to save the wider registers on context switches too
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    const bool ymmState = (xcr0 & 0x6) == 0x6;
+    const bool zmmState = (xcr0 & 0xE6) == 0xE6;
+
+    if (avx512 && zmmState)
+        return SimdLevel::Avx512;
+    if (avx2 && fma && ymmState)
+        return SimdLevel::Avx2;
+    if (sse42)
+        return SimdLevel::Sse42;
+#elif MATH_SIMD_SSE && defined(__GNUC__)
+    // Checks OS register state support as well
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return SimdLevel::Avx512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return SimdLevel::Avx2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return SimdLevel::Sse42;
+#endif
+    return SimdLevel::Scalar;
+}
+
+static std::atomic<SimdLevel>& CurrentLevel()
+{
+    static std::atomic<SimdLevel> level{ BatchMath::GetSupportedLevel() };
+    return level;
+}
+
+static const BatchKernels& GetKernels()
+{
+    return s_kernels[(int)CurrentLevel().load(std::memory_order_relaxed)];
+}
+
+SimdLevel BatchMath::GetSupportedLevel()
+{
+    static const SimdLevel supported = DetectSimdLevel();
+    return supported;
+}
+
+SimdLevel BatchMath::GetLevel()
+{
+    return CurrentLevel().load(std::memory_order_relaxed);
+}
+
+void BatchMath::SetLevel(SimdLevel level)
+{
+    CurrentLevel().store(std::min(level, GetSupportedLevel()), std::memory_order_relaxed);
+}
+
+const char* BatchMath::GetLevelName(SimdLevel level)
+{
+    switch (level)
+    {
+    case SimdLevel::Sse42: return "SSE4.2";
+    case SimdLevel::Avx2: return "AVX2";
+    case SimdLevel::Avx512: return "AVX-512";
+    default: return "Scalar";
+    }
+}
+
+void BatchMath::TransformPoints(const Matrix4x4& m, const Vector3Array& in, Vector3Array& out)
+{
+    out.Resize(in.Size());
+    GetKernels().transformPoints(m, in.X(), in.Y(), in.Z(), out.X(), out.Y(), out.Z(), in.Size());
+}
+
+void BatchMath::MultiplyMatrices(const Matrix4x4* a, const Matrix4x4* b, Matrix4x4* out, size_t count)
+{
+    GetKernels().multiplyMatrices(a, b, out, count);
+}
+
+Bounds BatchMath::ComputeBounds(const Vector3Array& points)
+{
+    ASSERT(points.Size() > 0, "Cannot compute the bounds of no points");
+
+    Bounds bounds{ points.Get(0), points.Get(0) };
+    GetKernels().computeBounds(points.X(), points.Y(), points.Z(), points.Size(), bounds);
+    return bounds;
+}
+
+void RunBatchMathBenchmark()
+{
+    // From L1 resident up to well past any last level cache
+    const size_t pointCounts[] = { 1 << 10, 1 << 14, 1 << 18, 1 << 23 };
+    const size_t elementsPerMeasurement = 1 << 26;
+    const uint32_t runs = 3;
+
+    const SimdLevel supported = BatchMath::GetSupportedLevel();
+    const SimdLevel previous = BatchMath::GetLevel();
+    LOG(std::string("Batch math benchmark (best of ") + std::to_string(runs) + ", CPU supports " + BatchMath::GetLevelName(supported) + ")");
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> value(-1.f, 1.f);
+    Matrix4x4 transform = Matrix4x4::Identity();
+    transform.columns[0] = { 0.8f, 0.6f, 0.f, 0.f };
+    transform.columns[1] = { -0.6f, 0.8f, 0.f, 0.f };
+    transform.columns[3] = { 1.f, 2.f, 3.f, 1.f };
+
+    // Best of runs, in elements per second
+    auto measure = [&](size_t count, auto&& body)
+    {
+        const size_t repeats = std::max<size_t>(elementsPerMeasurement / count, 1);
+        double best = 0.0;
+        for (uint32_t run = 0; run < runs; ++run)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (size_t repeat = 0; repeat < repeats; ++repeat)
+            {
+                body();
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::max(best, (double)count * repeats / std::chrono::duration<double>(end - start).count());
+        }
+        return best;
+    };
+
+    for (size_t pointCount : pointCounts)
+    {
+        Vector3Array points(pointCount);
+        for (size_t i = 0; i < pointCount; ++i)
+        {
+            points.Set(i, { value(rng), value(rng), value(rng) });
+        }
+        Vector3Array transformed(pointCount);
+
+        // Matrices are 64 bytes against 12 per point, fewer of them keeps the working sets comparable
+        const size_t matrixCount = std::max<size_t>(pointCount / 8, 1);
+        std::vector<Matrix4x4> matricesA(matrixCount, transform);
+        std::vector<Matrix4x4> matricesB(matrixCount, transform);
+        std::vector<Matrix4x4> matrixResults(matrixCount);
+
+        char line[256];
+        snprintf(line, sizeof(line), "%zu points (%.1f MiB in + out), %zu matrices (%.1f MiB):",
+            pointCount, pointCount * 2 * sizeof(Vector3) / (1024.0 * 1024.0),
+            matrixCount, matrixCount * 3 * sizeof(Matrix4x4) / (1024.0 * 1024.0));
+        LOG(line);
+
+        Bounds bounds{};
+        for (int level = (int)SimdLevel::Scalar; level <= (int)supported; ++level)
+        {
+            BatchMath::SetLevel((SimdLevel)level);
+            const double transformRate = measure(pointCount, [&]() { BatchMath::TransformPoints(transform, points, transformed); });
+            const double boundsRate = measure(pointCount, [&]() { bounds = BatchMath::ComputeBounds(points); });
+            const double multiplyRate = measure(matrixCount, [&]() { BatchMath::MultiplyMatrices(matricesA.data(), matricesB.data(), matrixResults.data(), matrixCount); });
+
+            snprintf(line, sizeof(line), "  %-8s: transform %8.1f M points/s, bounds %8.1f M points/s, multiply %7.1f M matrices/s",
+                BatchMath::GetLevelName((SimdLevel)level), transformRate / 1e6, boundsRate / 1e6, multiplyRate / 1e6);
+            LOG(line);
+        }
+    }
+
+    BatchMath::SetLevel(previous);
+}
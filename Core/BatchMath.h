@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Mathmatics.h"
+
+// Instruction sets the batch kernels are built for, the best one the CPU and OS support is picked at runtime
+enum class SimdLevel
+{
+	Scalar,
+	Sse42,
+	Avx2,  // With FMA
+	Avx512 // AVX-512F
+};
+
+// Structure of arrays Vector3 storage: separate x, y and z streams, so a kernel fills a whole register from
+// one stream instead of shuffling xyz triples apart. Each stream starts on a cache line
+class Vector3Array
+{
+public:
+	Vector3Array() = default;
+	explicit Vector3Array(size_t count) { Resize(count); }
+	~Vector3Array();
+
+	Vector3Array(Vector3Array&& other) noexcept;
+	Vector3Array& operator=(Vector3Array&& other) noexcept;
+	Vector3Array(const Vector3Array&) = delete;
+	Vector3Array& operator=(const Vector3Array&) = delete;
+
+	void Resize(size_t count); // Keeps the first min(count, Size()) elements, new ones are uninitialized
+	size_t Size() const { return m_count; }
+
+	float* X() { return m_x; }
+	float* Y() { return m_y; }
+	float* Z() { return m_z; }
+	const float* X() const { return m_x; }
+	const float* Y() const { return m_y; }
+	const float* Z() const { return m_z; }
+
+	void Set(size_t index, const Vector3& value) { m_x[index] = value.x; m_y[index] = value.y; m_z[index] = value.z; }
+	Vector3 Get(size_t index) const { return { m_x[index], m_y[index], m_z[index] }; }
+
+private:
+	float* m_x = nullptr; // One allocation, y and z follow x
+	float* m_y = nullptr;
+	float* m_z = nullptr;
+	size_t m_count = 0;
+	size_t m_capacity = 0;
+};
+
+// Vectorized kernels over whole arrays, dispatched to GetLevel()
+namespace BatchMath
+{
+	SimdLevel GetSupportedLevel();
+	SimdLevel GetLevel();
+	void SetLevel(SimdLevel level); // Clamped to the supported level, mostly for benchmarks
+	const char* GetLevelName(SimdLevel level);
+
+	// out[i] = m * (in[i], 1), out is resized to match and may be in
+	void TransformPoints(const Matrix4x4& m, const Vector3Array& in, Vector3Array& out);
+
+	// out[i] = a[i] * b[i], out may alias a or b
+	void MultiplyMatrices(const Matrix4x4* a, const Matrix4x4* b, Matrix4x4* out, size_t count);
+
+	// points must not be empty
+	Bounds ComputeBounds(const Vector3Array& points);
+}
+
+// Every supported level on point counts from L1 resident to past the last level cache, logged
+void RunBatchMathBenchmark();
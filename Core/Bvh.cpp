@@ -0,0 +1,933 @@
+#include "Bvh.h"
+
+#include "Debug.h"
+#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+
+#if MATH_SIMD_SSE
+#include <immintrin.h>
+#elif MATH_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+static constexpr uint32_t SahBinCount = 16;
+static constexpr float Infinity = std::numeric_limits<float>::infinity();
+
+static Bounds EmptyBounds()
+{
+    return { { Infinity, Infinity, Infinity }, { -Infinity, -Infinity, -Infinity } };
+}
+
+static void Grow(Bounds& bounds, const Bounds& other)
+{
+    bounds.min = { std::min(bounds.min.x, other.min.x), std::min(bounds.min.y, other.min.y), std::min(bounds.min.z, other.min.z) };
+    bounds.max = { std::max(bounds.max.x, other.max.x), std::max(bounds.max.y, other.max.y), std::max(bounds.max.z, other.max.z) };
+}
+
+static void Grow(Bounds& bounds, const Vector3& point)
+{
+    bounds.min = { std::min(bounds.min.x, point.x), std::min(bounds.min.y, point.y), std::min(bounds.min.z, point.z) };
+    bounds.max = { std::max(bounds.max.x, point.x), std::max(bounds.max.y, point.y), std::max(bounds.max.z, point.z) };
+}
+
+// Half the surface area, the SAH only compares them
+static float HalfArea(const Bounds& bounds)
+{
+    const float x = bounds.max.x - bounds.min.x;
+    const float y = bounds.max.y - bounds.min.y;
+    const float z = bounds.max.z - bounds.min.z;
+    return x < 0.f ? 0.f : x * y + y * z + z * x;
+}
+
+static bool Equal(const Bounds& a, const Bounds& b)
+{
+    return a.min.x == b.min.x && a.min.y == b.min.y && a.min.z == b.min.z
+        && a.max.x == b.max.x && a.max.y == b.max.y && a.max.z == b.max.z;
+}
+
+static float Axis(const Vector3& v, uint32_t axis)
+{
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Box against the frustum: -1 outside, 0 crossing a plane, 1 fully inside
+static int ClassifyBox(const Bounds& box, const Plane planes[6])
+{
+    int result = 1;
+    for (int i = 0; i < 6; ++i)
+    {
+        const Plane& plane = planes[i];
+        const Vector3& n = plane.normal;
+        const float positive = n.x * (n.x >= 0.f ? box.max.x : box.min.x) + n.y * (n.y >= 0.f ? box.max.y : box.min.y) + n.z * (n.z >= 0.f ? box.max.z : box.min.z);
+        if (positive + plane.distance < 0.f)
+            return -1;
+        const float negative = n.x * (n.x >= 0.f ? box.min.x : box.max.x) + n.y * (n.y >= 0.f ? box.min.y : box.max.y) + n.z * (n.z >= 0.f ? box.min.z : box.max.z);
+        if (negative + plane.distance < 0.f)
+            result = 0;
+    }
+    return result;
+}
+
+static bool Overlaps(const Bounds& a, const Bounds& b)
+{
+    return a.min.x <= b.max.x && a.max.x >= b.min.x
+        && a.min.y <= b.max.y && a.max.y >= b.min.y
+        && a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// Slab test, out_distance is where the ray enters the box (0 when it starts inside)
+static bool IntersectRay(const Bounds& box, const Vector3& origin, const Vector3& invDirection, float maxDistance, float& out_distance)
+{
+    const float x1 = (box.min.x - origin.x) * invDirection.x, x2 = (box.max.x - origin.x) * invDirection.x;
+    const float y1 = (box.min.y - origin.y) * invDirection.y, y2 = (box.max.y - origin.y) * invDirection.y;
+    const float z1 = (box.min.z - origin.z) * invDirection.z, z2 = (box.max.z - origin.z) * invDirection.z;
+    const float tNear = std::max({ std::min(x1, x2), std::min(y1, y2), std::min(z1, z2), 0.f });
+    const float tFar = std::min({ std::max(x1, x2), std::max(y1, y2), std::max(z1, z2), maxDistance });
+    out_distance = tNear;
+    return tNear <= tFar;
+}
+
+// Four child boxes at once. Each returns a bitmask over the slots, empty slots have to be skipped by the caller
+
+#if MATH_SIMD_NEON
+// Lane i of a compare result to bit i, like _mm_movemask_ps
+static uint32_t MoveMask(uint32x4_t mask)
+{
+    static const uint32_t bits[4] = { 1, 2, 4, 8 };
+    return vaddvq_u32(vandq_u32(mask, vld1q_u32(bits)));
+}
+#endif
+
+static uint32_t TestNodeFrustum(const Bvh::Node& node, const Plane planes[6], uint32_t& out_insideMask)
+{
+#if MATH_SIMD_SSE
+    __m128 outside = _mm_setzero_ps();
+    __m128 crossing = _mm_setzero_ps();
+    const __m128 zero = _mm_setzero_ps();
+    for (int i = 0; i < 6; ++i)
+    {
+        // The normal's signs pick which corner is the farthest along it, same for all four boxes
+        const Vector3& n = planes[i].normal;
+        const __m128 nx = _mm_set1_ps(n.x), ny = _mm_set1_ps(n.y), nz = _mm_set1_ps(n.z);
+        const __m128 d = _mm_set1_ps(planes[i].distance);
+        const __m128 px = _mm_load_ps(n.x >= 0.f ? node.maxX : node.minX);
+        const __m128 py = _mm_load_ps(n.y >= 0.f ? node.maxY : node.minY);
+        const __m128 pz = _mm_load_ps(n.z >= 0.f ? node.maxZ : node.minZ);
+        const __m128 qx = _mm_load_ps(n.x >= 0.f ? node.minX : node.maxX);
+        const __m128 qy = _mm_load_ps(n.y >= 0.f ? node.minY : node.maxY);
+        const __m128 qz = _mm_load_ps(n.z >= 0.f ? node.minZ : node.maxZ);
+        const __m128 positive = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, px), _mm_mul_ps(ny, py)), _mm_add_ps(_mm_mul_ps(nz, pz), d));
+        const __m128 negative = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, qx), _mm_mul_ps(ny, qy)), _mm_add_ps(_mm_mul_ps(nz, qz), d));
+        outside = _mm_or_ps(outside, _mm_cmplt_ps(positive, zero));
+        crossing = _mm_or_ps(crossing, _mm_cmplt_ps(negative, zero));
+    }
+    const uint32_t visibleMask = ~(uint32_t)_mm_movemask_ps(outside) & 0xF;
+    out_insideMask = visibleMask & ~(uint32_t)_mm_movemask_ps(crossing);
+    return visibleMask;
+#elif MATH_SIMD_NEON
+    uint32x4_t outside = vdupq_n_u32(0);
+    uint32x4_t crossing = vdupq_n_u32(0);
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    for (int i = 0; i < 6; ++i)
+    {
+        const Vector3& n = planes[i].normal;
+        const float32x4_t nx = vdupq_n_f32(n.x), ny = vdupq_n_f32(n.y), nz = vdupq_n_f32(n.z);
+        const float32x4_t d = vdupq_n_f32(planes[i].distance);
+        const float32x4_t px = vld1q_f32(n.x >= 0.f ? node.maxX : node.minX);
+        const float32x4_t py = vld1q_f32(n.y >= 0.f ? node.maxY : node.minY);
+        const float32x4_t pz = vld1q_f32(n.z >= 0.f ? node.maxZ : node.minZ);
+        const float32x4_t qx = vld1q_f32(n.x >= 0.f ? node.minX : node.maxX);
+        const float32x4_t qy = vld1q_f32(n.y >= 0.f ? node.minY : node.maxY);
+        const float32x4_t qz = vld1q_f32(n.z >= 0.f ? node.minZ : node.maxZ);
+        // Same operation order as the SSE path, no fused multiply-add, so both agree on boxes touching a plane
+        const float32x4_t positive = vaddq_f32(vaddq_f32(vmulq_f32(nx, px), vmulq_f32(ny, py)), vaddq_f32(vmulq_f32(nz, pz), d));
+        const float32x4_t negative = vaddq_f32(vaddq_f32(vmulq_f32(nx, qx), vmulq_f32(ny, qy)), vaddq_f32(vmulq_f32(nz, qz), d));
+        outside = vorrq_u32(outside, vcltq_f32(positive, zero));
+        crossing = vorrq_u32(crossing, vcltq_f32(negative, zero));
+    }
+    const uint32_t visibleMask = ~MoveMask(outside) & 0xF;
+    out_insideMask = visibleMask & ~MoveMask(crossing);
+    return visibleMask;
+#else
+    uint32_t visibleMask = 0;
+    out_insideMask = 0;
+    for (uint32_t slot = 0; slot < 4; ++slot)
+    {
+        const Bounds box = { { node.minX[slot], node.minY[slot], node.minZ[slot] }, { node.maxX[slot], node.maxY[slot], node.maxZ[slot] } };
+        const int result = ClassifyBox(box, planes);
+        if (result >= 0)
+            visibleMask |= 1u << slot;
+        if (result > 0)
+            out_insideMask |= 1u << slot;
+    }
+    return visibleMask;
+#endif
+}
+
+static uint32_t TestNodeOverlap(const Bvh::Node& node, const Bounds& box)
+{
+#if MATH_SIMD_SSE
+    __m128 hit = _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.minX), _mm_set1_ps(box.max.x)), _mm_cmpge_ps(_mm_load_ps(node.maxX), _mm_set1_ps(box.min.x)));
+    hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.minY), _mm_set1_ps(box.max.y)), _mm_cmpge_ps(_mm_load_ps(node.maxY), _mm_set1_ps(box.min.y))));
+    hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmple_ps(_mm_load_ps(node.minZ), _mm_set1_ps(box.max.z)), _mm_cmpge_ps(_mm_load_ps(node.maxZ), _mm_set1_ps(box.min.z))));
+    return (uint32_t)_mm_movemask_ps(hit);
+#elif MATH_SIMD_NEON
+    uint32x4_t hit = vandq_u32(vcleq_f32(vld1q_f32(node.minX), vdupq_n_f32(box.max.x)), vcgeq_f32(vld1q_f32(node.maxX), vdupq_n_f32(box.min.x)));
+    hit = vandq_u32(hit, vandq_u32(vcleq_f32(vld1q_f32(node.minY), vdupq_n_f32(box.max.y)), vcgeq_f32(vld1q_f32(node.maxY), vdupq_n_f32(box.min.y))));
+    hit = vandq_u32(hit, vandq_u32(vcleq_f32(vld1q_f32(node.minZ), vdupq_n_f32(box.max.z)), vcgeq_f32(vld1q_f32(node.maxZ), vdupq_n_f32(box.min.z))));
+    return MoveMask(hit);
+#else
+    uint32_t mask = 0;
+    for (uint32_t slot = 0; slot < 4; ++slot)
+    {
+        const Bounds child = { { node.minX[slot], node.minY[slot], node.minZ[slot] }, { node.maxX[slot], node.maxY[slot], node.maxZ[slot] } };
+        if (Overlaps(child, box))
+            mask |= 1u << slot;
+    }
+    return mask;
+#endif
+}
+
+static uint32_t TestNodeRay(const Bvh::Node& node, const Vector3& origin, const Vector3& invDirection, float maxDistance, float out_distances[4])
+{
+#if MATH_SIMD_SSE
+    const __m128 ox = _mm_set1_ps(origin.x), oy = _mm_set1_ps(origin.y), oz = _mm_set1_ps(origin.z);
+    const __m128 ix = _mm_set1_ps(invDirection.x), iy = _mm_set1_ps(invDirection.y), iz = _mm_set1_ps(invDirection.z);
+    const __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), ox), ix), x2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), ox), ix);
+    const __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), oy), iy), y2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), oy), iy);
+    const __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), oz), iz), z2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), oz), iz);
+    const __m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(x1, x2), _mm_min_ps(y1, y2)), _mm_max_ps(_mm_min_ps(z1, z2), _mm_setzero_ps()));
+    const __m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(x1, x2), _mm_max_ps(y1, y2)), _mm_min_ps(_mm_max_ps(z1, z2), _mm_set1_ps(maxDistance)));
+    _mm_storeu_ps(out_distances, tNear);
+    return (uint32_t)_mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+#else
+    uint32_t mask = 0;
+    for (uint32_t slot = 0; slot < 4; ++slot)
+    {
+        const Bounds child = { { node.minX[slot], node.minY[slot], node.minZ[slot] }, { node.maxX[slot], node.maxY[slot], node.maxZ[slot] } };
+        if (IntersectRay(child, origin, invDirection, maxDistance, out_distances[slot]))
+            mask |= 1u << slot;
+    }
+    return mask;
+#endif
+}
+
+Bvh::~Bvh()
+{
+    FinishRebuild(true);
+}
+
+void Bvh::Build(const Bounds* bounds, uint32_t count)
+{
+    ASSERT(count < LeafBit, "Too many objects for the BVH: " + std::to_string(count));
+
+    m_nodes.clear();
+    m_nodeParents.clear();
+    m_nodeRanges.clear();
+    m_primitives.resize(count);
+    m_primitiveBounds.resize(count);
+    m_primitiveLeaves.resize(count);
+    m_objectPrimitives.resize(count);
+    if (count == 0)
+        return;
+
+    std::iota(m_primitives.begin(), m_primitives.end(), 0);
+    std::vector<Vector3> centroids(count);
+    BuildRange root{ 0, count, EmptyBounds() };
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        centroids[i] = { (bounds[i].min.x + bounds[i].max.x) * 0.5f, (bounds[i].min.y + bounds[i].max.y) * 0.5f, (bounds[i].min.z + bounds[i].max.z) * 0.5f };
+        Grow(root.bounds, bounds[i]);
+    }
+
+    // A BVH4 with small leaves ends up with about a third as many nodes as objects
+    m_nodes.reserve(count / 3 + 1);
+    m_nodeParents.reserve(count / 3 + 1);
+    m_nodeRanges.reserve(count / 3 + 1);
+    BuildNode(root, bounds, centroids, NoParent);
+
+    for (uint32_t primitive = 0; primitive < count; ++primitive)
+    {
+        m_primitiveBounds[primitive] = bounds[m_primitives[primitive]];
+        m_objectPrimitives[m_primitives[primitive]] = primitive;
+    }
+}
+
+uint32_t Bvh::BuildNode(const BuildRange& range, const Bounds* bounds, const std::vector<Vector3>& centroids, uint32_t parent)
+{
+    // Allocated before recursing so parents always come before their children
+    const uint32_t node = (uint32_t)m_nodes.size();
+    m_nodes.emplace_back();
+    m_nodeParents.push_back(parent);
+    m_nodeRanges.push_back({ range.begin, range.end - range.begin });
+
+    // Collapse two levels of binary splits into one node: keep splitting the biggest child until there are four
+    BuildRange children[4] = { range };
+    uint32_t childCount = 1;
+    while (childCount < 4)
+    {
+        int best = -1;
+        float bestArea = -1.f;
+        for (uint32_t i = 0; i < childCount; ++i)
+        {
+            const float area = HalfArea(children[i].bounds);
+            if (children[i].end - children[i].begin > MaxLeafSize && area > bestArea)
+            {
+                best = (int)i;
+                bestArea = area;
+            }
+        }
+        if (best < 0)
+            break;
+
+        BuildRange left, right;
+        SplitRange(children[best], bounds, centroids, left, right);
+        children[best] = left;
+        children[childCount++] = right;
+    }
+
+    for (uint32_t slot = 0; slot < 4; ++slot)
+    {
+        if (slot >= childCount)
+        {
+            m_nodes[node].children[slot] = EmptyChild;
+            m_nodes[node].counts[slot] = 0;
+            SetChild(node, slot, EmptyBounds());
+            continue;
+        }
+
+        const BuildRange& child = children[slot];
+        const uint32_t count = child.end - child.begin;
+        if (count <= MaxLeafSize)
+        {
+            m_nodes[node].children[slot] = LeafBit | child.begin;
+            m_nodes[node].counts[slot] = count;
+            for (uint32_t primitive = child.begin; primitive < child.end; ++primitive)
+            {
+                m_primitiveLeaves[primitive] = (node << 2) | slot;
+            }
+        }
+        else
+        {
+            // m_nodes may reallocate in here, so no references into it across the call
+            const uint32_t childNode = BuildNode(child, bounds, centroids, (node << 2) | slot);
+            m_nodes[node].children[slot] = childNode;
+            m_nodes[node].counts[slot] = 0;
+        }
+        SetChild(node, slot, child.bounds);
+    }
+    return node;
+}
+
+void Bvh::SplitRange(const BuildRange& range, const Bounds* bounds, const std::vector<Vector3>& centroids, BuildRange& out_left, BuildRange& out_right)
+{
+    Bounds centroidBounds = EmptyBounds();
+    for (uint32_t i = range.begin; i < range.end; ++i)
+    {
+        Grow(centroidBounds, centroids[m_primitives[i]]);
+    }
+
+    struct Bin
+    {
+        Bounds bounds = EmptyBounds();
+        uint32_t count = 0;
+    };
+
+    // Cheapest split over the bin boundaries of every axis, cost is area * count on each side
+    float bestCost = Infinity;
+    uint32_t bestAxis = 0;
+    uint32_t bestSplit = 0;
+    Bin axisBins[3][SahBinCount];
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        const float axisMin = Axis(centroidBounds.min, axis);
+        const float extent = Axis(centroidBounds.max, axis) - axisMin;
+        if (extent <= 0.f)
+            continue;
+
+        const float scale = SahBinCount / extent;
+        Bin* bins = axisBins[axis];
+        for (uint32_t i = range.begin; i < range.end; ++i)
+        {
+            const uint32_t object = m_primitives[i];
+            const uint32_t bin = std::min((uint32_t)((Axis(centroids[object], axis) - axisMin) * scale), SahBinCount - 1);
+            Grow(bins[bin].bounds, bounds[object]);
+            ++bins[bin].count;
+        }
+
+        // Right side areas from a backwards sweep, then the left side on the way forward
+        float rightAreas[SahBinCount];
+        uint32_t rightCounts[SahBinCount];
+        Bounds right = EmptyBounds();
+        uint32_t rightCount = 0;
+        for (uint32_t bin = SahBinCount - 1; bin > 0; --bin)
+        {
+            Grow(right, bins[bin].bounds);
+            rightCount += bins[bin].count;
+            rightAreas[bin] = HalfArea(right);
+            rightCounts[bin] = rightCount;
+        }
+
+        Bounds left = EmptyBounds();
+        uint32_t leftCount = 0;
+        for (uint32_t split = 1; split < SahBinCount; ++split)
+        {
+            Grow(left, bins[split - 1].bounds);
+            leftCount += bins[split - 1].count;
+            if (leftCount == 0 || rightCounts[split] == 0)
+                continue;
+
+            const float cost = HalfArea(left) * leftCount + rightAreas[split] * rightCounts[split];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    out_left = { range.begin, range.begin, EmptyBounds() };
+    out_right = { range.begin, range.end, EmptyBounds() };
+    if (bestCost < Infinity)
+    {
+        // The side boxes are just the bins on each side of the split
+        for (uint32_t bin = 0; bin < SahBinCount; ++bin)
+        {
+            Grow(bin < bestSplit ? out_left.bounds : out_right.bounds, axisBins[bestAxis][bin].bounds);
+        }
+
+        const float axisMin = Axis(centroidBounds.min, bestAxis);
+        const float scale = SahBinCount / (Axis(centroidBounds.max, bestAxis) - axisMin);
+        out_left.end = out_right.begin = (uint32_t)(std::partition(m_primitives.begin() + range.begin, m_primitives.begin() + range.end, [&](uint32_t object)
+        {
+            return std::min((uint32_t)((Axis(centroids[object], bestAxis) - axisMin) * scale), SahBinCount - 1) < bestSplit;
+        }) - m_primitives.begin());
+    }
+    else
+    {
+        // Every centroid in the same spot, any split is as good as another
+        out_left.end = out_right.begin = range.begin + (range.end - range.begin) / 2;
+        for (uint32_t i = range.begin; i < range.end; ++i)
+        {
+            Grow(i < out_left.end ? out_left.bounds : out_right.bounds, bounds[m_primitives[i]]);
+        }
+    }
+}
+
+void Bvh::Refit(const Bounds* bounds)
+{
+    for (uint32_t primitive = 0; primitive < (uint32_t)m_primitives.size(); ++primitive)
+    {
+        m_primitiveBounds[primitive] = bounds[m_primitives[primitive]];
+    }
+
+    // Children come after their parents, so walking backwards finishes every child before its parent
+    for (uint32_t node = (uint32_t)m_nodes.size(); node-- > 0;)
+    {
+        for (uint32_t slot = 0; slot < 4; ++slot)
+        {
+            const uint32_t child = m_nodes[node].children[slot];
+            if (child == EmptyChild)
+                continue;
+            if (child & LeafBit)
+                SetChild(node, slot, GetLeafBounds(child & ~LeafBit, m_nodes[node].counts[slot]));
+            else
+                SetChild(node, slot, GetNodeBounds(child));
+        }
+    }
+}
+
+void Bvh::Refit(const Bounds* bounds, const uint32_t* movedObjects, uint32_t movedCount)
+{
+    for (uint32_t i = 0; i < movedCount; ++i)
+    {
+        const uint32_t object = movedObjects[i];
+        const uint32_t primitive = m_objectPrimitives[object];
+        m_primitiveBounds[primitive] = bounds[object];
+
+        const uint32_t leaf = m_primitiveLeaves[primitive];
+        uint32_t node = leaf >> 2;
+        const uint32_t slot = leaf & 3;
+        SetChild(node, slot, GetLeafBounds(m_nodes[node].children[slot] & ~LeafBit, m_nodes[node].counts[slot]));
+
+        // Up until a box comes out the same, everything above it already covers it
+        while (m_nodeParents[node] != NoParent)
+        {
+            const uint32_t parent = m_nodeParents[node];
+            const Bounds nodeBounds = GetNodeBounds(node);
+            if (Equal(nodeBounds, GetChildBounds(parent >> 2, parent & 3)))
+                break;
+            SetChild(parent >> 2, parent & 3, nodeBounds);
+            node = parent >> 2;
+        }
+    }
+}
+
+void Bvh::StartRebuild(JobSystem& jobs, const Bounds* bounds, uint32_t count)
+{
+    ASSERT(m_rebuild == nullptr, "BVH rebuild already running");
+
+    m_rebuildJobs = &jobs;
+    m_rebuildBounds.assign(bounds, bounds + count);
+    m_rebuild = std::make_unique<Bvh>();
+    m_rebuildCounter = std::make_unique<JobCounter>();
+
+    Bvh* rebuild = m_rebuild.get();
+    const std::vector<Bounds>* rebuildBounds = &m_rebuildBounds;
+    jobs.Run([rebuild, rebuildBounds]
+    {
+        rebuild->Build(rebuildBounds->data(), (uint32_t)rebuildBounds->size());
+    }, m_rebuildCounter.get());
+}
+
+bool Bvh::FinishRebuild(bool wait)
+{
+    if (m_rebuild == nullptr || (!wait && !m_rebuildCounter->IsDone()))
+        return false;
+
+    // Even when it's done already, Wait makes sure the job is finished with the counter before it goes away
+    m_rebuildJobs->Wait(*m_rebuildCounter);
+
+    m_nodes.swap(m_rebuild->m_nodes);
+    m_nodeParents.swap(m_rebuild->m_nodeParents);
+    m_nodeRanges.swap(m_rebuild->m_nodeRanges);
+    m_primitives.swap(m_rebuild->m_primitives);
+    m_primitiveBounds.swap(m_rebuild->m_primitiveBounds);
+    m_primitiveLeaves.swap(m_rebuild->m_primitiveLeaves);
+    m_objectPrimitives.swap(m_rebuild->m_objectPrimitives);
+
+    m_rebuild.reset();
+    m_rebuildCounter.reset();
+    m_rebuildBounds.clear();
+    return true;
+}
+
+void Bvh::QueryFrustum(const Plane planes[6], std::vector<uint32_t>& out_objects) const
+{
+    if (m_nodes.empty())
+        return;
+
+    std::vector<uint32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+        const Node& node = m_nodes[nodeIndex];
+
+        uint32_t insideMask;
+        const uint32_t visibleMask = TestNodeFrustum(node, planes, insideMask);
+        for (uint32_t slot = 0; slot < 4; ++slot)
+        {
+            const uint32_t child = node.children[slot];
+            if (!(visibleMask & (1u << slot)) || child == EmptyChild)
+                continue;
+
+            // Fully inside: the whole subtree goes in without looking at it
+            if (insideMask & (1u << slot))
+            {
+                const uint32_t first = child & LeafBit ? child & ~LeafBit : m_nodeRanges[child].first;
+                const uint32_t count = child & LeafBit ? node.counts[slot] : m_nodeRanges[child].count;
+                out_objects.insert(out_objects.end(), m_primitives.begin() + first, m_primitives.begin() + first + count);
+            }
+            else if (child & LeafBit)
+            {
+                const uint32_t first = child & ~LeafBit;
+                for (uint32_t primitive = first; primitive < first + node.counts[slot]; ++primitive)
+                {
+                    if (ClassifyBox(m_primitiveBounds[primitive], planes) >= 0)
+                        out_objects.push_back(m_primitives[primitive]);
+                }
+            }
+            else
+            {
+                stack.push_back(child);
+            }
+        }
+    }
+}
+
+void Bvh::QueryOverlap(const Bounds& box, std::vector<uint32_t>& out_objects) const
+{
+    if (m_nodes.empty())
+        return;
+
+    std::vector<uint32_t> stack;
+    stack.reserve(64);
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+        const uint32_t nodeIndex = stack.back();
+        stack.pop_back();
+        const Node& node = m_nodes[nodeIndex];
+
+        const uint32_t mask = TestNodeOverlap(node, box);
+        for (uint32_t slot = 0; slot < 4; ++slot)
+        {
+            const uint32_t child = node.children[slot];
+            if (!(mask & (1u << slot)) || child == EmptyChild)
+                continue;
+
+            if (child & LeafBit)
+            {
+                const uint32_t first = child & ~LeafBit;
+                for (uint32_t primitive = first; primitive < first + node.counts[slot]; ++primitive)
+                {
+                    if (Overlaps(m_primitiveBounds[primitive], box))
+                        out_objects.push_back(m_primitives[primitive]);
+                }
+            }
+            else
+            {
+                stack.push_back(child);
+            }
+        }
+    }
+}
+
+bool Bvh::Raycast(const Vector3& origin, const Vector3& direction, float maxDistance, RayHit& out_hit) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    // Division by zero is fine here, the infinities fall out of the slab test the right way
+    const Vector3 invDirection = { 1.f / direction.x, 1.f / direction.y, 1.f / direction.z };
+
+    struct StackEntry
+    {
+        uint32_t node;
+        float distance;
+    };
+    std::vector<StackEntry> stack;
+    stack.reserve(64);
+    stack.push_back({ 0, 0.f });
+
+    float closest = maxDistance;
+    uint32_t closestObject = UINT32_MAX;
+    while (!stack.empty())
+    {
+        const StackEntry entry = stack.back();
+        stack.pop_back();
+        if (entry.distance > closest)
+            continue;
+
+        const Node& node = m_nodes[entry.node];
+        float distances[4];
+        const uint32_t mask = TestNodeRay(node, origin, invDirection, closest, distances);
+
+        // Nearest child ends up on top of the stack so it's visited first and tightens closest for the rest
+        StackEntry hits[4];
+        uint32_t hitCount = 0;
+        for (uint32_t slot = 0; slot < 4; ++slot)
+        {
+            const uint32_t child = node.children[slot];
+            if (!(mask & (1u << slot)) || child == EmptyChild)
+                continue;
+
+            if (child & LeafBit)
+            {
+                const uint32_t first = child & ~LeafBit;
+                for (uint32_t primitive = first; primitive < first + node.counts[slot]; ++primitive)
+                {
+                    float distance;
+                    if (IntersectRay(m_primitiveBounds[primitive], origin, invDirection, closest, distance))
+                    {
+                        closest = distance;
+                        closestObject = m_primitives[primitive];
+                    }
+                }
+                continue;
+            }
+
+            uint32_t i = hitCount++;
+            for (; i > 0 && hits[i - 1].distance < distances[slot]; --i)
+            {
+                hits[i] = hits[i - 1];
+            }
+            hits[i] = { child, distances[slot] };
+        }
+        stack.insert(stack.end(), hits, hits + hitCount);
+    }
+
+    if (closestObject == UINT32_MAX)
+        return false;
+    out_hit = { closestObject, closest };
+    return true;
+}
+
+void Bvh::SetChild(uint32_t node, uint32_t slot, const Bounds& bounds)
+{
+    Node& n = m_nodes[node];
+    n.minX[slot] = bounds.min.x;
+    n.minY[slot] = bounds.min.y;
+    n.minZ[slot] = bounds.min.z;
+    n.maxX[slot] = bounds.max.x;
+    n.maxY[slot] = bounds.max.y;
+    n.maxZ[slot] = bounds.max.z;
+}
+
+Bounds Bvh::GetChildBounds(uint32_t node, uint32_t slot) const
+{
+    const Node& n = m_nodes[node];
+    return { { n.minX[slot], n.minY[slot], n.minZ[slot] }, { n.maxX[slot], n.maxY[slot], n.maxZ[slot] } };
+}
+
+Bounds Bvh::GetNodeBounds(uint32_t node) const
+{
+    // Empty slots hold inverted boxes, they drop out of the union by themselves
+    Bounds bounds = EmptyBounds();
+    for (uint32_t slot = 0; slot < 4; ++slot)
+    {
+        Grow(bounds, GetChildBounds(node, slot));
+    }
+    return bounds;
+}
+
+Bounds Bvh::GetLeafBounds(uint32_t first, uint32_t count) const
+{
+    Bounds bounds = EmptyBounds();
+    for (uint32_t primitive = first; primitive < first + count; ++primitive)
+    {
+        Grow(bounds, m_primitiveBounds[primitive]);
+    }
+    return bounds;
+}
+
+void RunBvhBenchmark(JobSystem& jobs)
+{
+    const uint32_t objectCounts[] = { 10000, 100000, 500000 };
+    const uint32_t frustumQueries = 2000;
+    const uint32_t rayQueries = 200000;
+    const uint32_t bruteForceQueries = 20; // Brute force is slow enough that a few give a stable rate
+    const uint32_t driftFrames = 60;
+    const float worldExtent = 100.f;
+
+    LOG("BVH benchmark (" + std::to_string(jobs.GetWorkerCount()) + " workers)");
+
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::uniform_real_distribution<float> signedUnit(-1.f, 1.f);
+
+    // Views over about 1% of the world, same layout as ComputeFrustum
+    auto makeFrustum = [&](Plane out_planes[6])
+    {
+        const float halfExtent = worldExtent * 0.1f;
+        const float x = signedUnit(rng) * worldExtent;
+        const float y = signedUnit(rng) * worldExtent;
+        out_planes[0] = { { 1.f, 0.f, 0.f }, -(x - halfExtent) };
+        out_planes[1] = { { -1.f, 0.f, 0.f }, x + halfExtent };
+        out_planes[2] = { { 0.f, 1.f, 0.f }, -(y - halfExtent) };
+        out_planes[3] = { { 0.f, -1.f, 0.f }, y + halfExtent };
+        out_planes[4] = { { 0.f, 0.f, 1.f }, 0.f };
+        out_planes[5] = { { 0.f, 0.f, -1.f }, 1.f };
+    };
+
+    auto bruteForceFrustum = [](const std::vector<Bounds>& boxes, const Plane planes[6], std::vector<uint32_t>& out_objects)
+    {
+        for (uint32_t i = 0; i < (uint32_t)boxes.size(); ++i)
+        {
+            const Bounds& box = boxes[i];
+            bool inside = true;
+            for (int plane = 0; plane < 6 && inside; ++plane)
+            {
+                const Vector3& n = planes[plane].normal;
+                inside = n.x * (n.x >= 0.f ? box.max.x : box.min.x) + n.y * (n.y >= 0.f ? box.max.y : box.min.y)
+                    + n.z * (n.z >= 0.f ? box.max.z : box.min.z) + planes[plane].distance >= 0.f;
+            }
+            if (inside)
+                out_objects.push_back(i);
+        }
+    };
+
+    auto bruteForceRay = [](const std::vector<Bounds>& boxes, const Vector3& origin, const Vector3& direction, float maxDistance)
+    {
+        const Vector3 invDirection = { 1.f / direction.x, 1.f / direction.y, 1.f / direction.z };
+        float closest = maxDistance;
+        uint32_t closestObject = UINT32_MAX;
+        for (uint32_t i = 0; i < (uint32_t)boxes.size(); ++i)
+        {
+            const Bounds& box = boxes[i];
+            const float x1 = (box.min.x - origin.x) * invDirection.x, x2 = (box.max.x - origin.x) * invDirection.x;
+            const float y1 = (box.min.y - origin.y) * invDirection.y, y2 = (box.max.y - origin.y) * invDirection.y;
+            const float z1 = (box.min.z - origin.z) * invDirection.z, z2 = (box.max.z - origin.z) * invDirection.z;
+            const float tNear = std::max({ std::min(x1, x2), std::min(y1, y2), std::min(z1, z2), 0.f });
+            const float tFar = std::min({ std::max(x1, x2), std::max(y1, y2), std::max(z1, z2), closest });
+            if (tNear <= tFar && (closestObject == UINT32_MAX || tNear < closest))
+            {
+                closest = tNear;
+                closestObject = i;
+            }
+        }
+        return Bvh::RayHit{ closestObject, closest };
+    };
+
+    struct Ray
+    {
+        Vector3 origin;
+        Vector3 direction;
+    };
+    auto makeRay = [&]()
+    {
+        return Ray{ { signedUnit(rng) * worldExtent, signedUnit(rng) * worldExtent, 0.5f }, { signedUnit(rng), signedUnit(rng), signedUnit(rng) * 0.01f } };
+    };
+    const float rayLength = worldExtent * 0.2f;
+
+    auto elapsedMs = [](std::chrono::high_resolution_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    };
+
+    // Frustum queries per second, and the objects they returned in total
+    std::vector<uint32_t> results;
+    auto measureFrustum = [&](const Bvh& bvh, uint64_t& out_found)
+    {
+        out_found = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t query = 0; query < frustumQueries; ++query)
+        {
+            Plane planes[6];
+            makeFrustum(planes);
+            results.clear();
+            bvh.QueryFrustum(planes, results);
+            out_found += results.size();
+        }
+        return frustumQueries / (elapsedMs(start) / 1000.0);
+    };
+
+    for (uint32_t objectCount : objectCounts)
+    {
+        // Small boxes spread over a mostly flat world, like the scene's objects
+        std::vector<Bounds> boxes(objectCount);
+        for (Bounds& box : boxes)
+        {
+            const Vector3 center = { signedUnit(rng) * worldExtent, signedUnit(rng) * worldExtent, unit(rng) };
+            const float radius = 0.05f + unit(rng) * 0.45f;
+            box = { { center.x - radius, center.y - radius, center.z - radius }, { center.x + radius, center.y + radius, center.z + radius } };
+        }
+
+        Bvh bvh;
+        auto start = std::chrono::high_resolution_clock::now();
+        bvh.Build(boxes.data(), objectCount);
+        const double buildMs = elapsedMs(start);
+
+        char line[256];
+        snprintf(line, sizeof(line), "%u objects: %u nodes (%.1f MiB), build %.2f ms",
+            objectCount, bvh.GetNodeCount(), bvh.GetNodeCount() * sizeof(Bvh::Node) / (1024.0 * 1024.0), buildMs);
+        LOG(line);
+
+        // Same queries through both, the results have to agree
+        uint32_t mismatches = 0;
+        double bruteFrustumMs = 0.0;
+        double bruteRayMs = 0.0;
+        std::vector<uint32_t> expected;
+        for (uint32_t query = 0; query < bruteForceQueries; ++query)
+        {
+            Plane planes[6];
+            makeFrustum(planes);
+            expected.clear();
+            start = std::chrono::high_resolution_clock::now();
+            bruteForceFrustum(boxes, planes, expected);
+            bruteFrustumMs += elapsedMs(start);
+
+            results.clear();
+            bvh.QueryFrustum(planes, results);
+            std::sort(results.begin(), results.end());
+            mismatches += results != expected ? 1 : 0;
+
+            const Ray ray = makeRay();
+            start = std::chrono::high_resolution_clock::now();
+            const Bvh::RayHit expectedHit = bruteForceRay(boxes, ray.origin, ray.direction, rayLength);
+            bruteRayMs += elapsedMs(start);
+
+            // Distances rather than objects, overlapping boxes can tie
+            Bvh::RayHit hit;
+            const bool bvhHit = bvh.Raycast(ray.origin, ray.direction, rayLength, hit);
+            mismatches += bvhHit != (expectedHit.object != UINT32_MAX) || (bvhHit && hit.distance != expectedHit.distance) ? 1 : 0;
+        }
+
+        uint64_t found = 0;
+        const double frustumRate = measureFrustum(bvh, found);
+
+        uint32_t hits = 0;
+        start = std::chrono::high_resolution_clock::now();
+        for (uint32_t query = 0; query < rayQueries; ++query)
+        {
+            const Ray ray = makeRay();
+            Bvh::RayHit hit;
+            hits += bvh.Raycast(ray.origin, ray.direction, rayLength, hit) ? 1 : 0;
+        }
+        const double rayRate = rayQueries / (elapsedMs(start) / 1000.0);
+
+        const double bruteFrustumRate = bruteForceQueries / (bruteFrustumMs / 1000.0);
+        const double bruteRayRate = bruteForceQueries / (bruteRayMs / 1000.0);
+        snprintf(line, sizeof(line), "  frustum: %10.0f queries/s (brute force %8.0f, %6.1fx), %.0f objects each",
+            frustumRate, bruteFrustumRate, frustumRate / bruteFrustumRate, (double)found / frustumQueries);
+        LOG(line);
+        snprintf(line, sizeof(line), "  ray    : %10.0f queries/s (brute force %8.0f, %6.1fx), %.0f%% hit",
+            rayRate, bruteRayRate, rayRate / bruteRayRate, 100.0 * hits / rayQueries);
+        LOG(line);
+        if (mismatches != 0)
+            LOG("  " + std::to_string(mismatches) + " of " + std::to_string(bruteForceQueries * 2) + " queries disagreed with brute force");
+
+        // Every object drifts a little each frame: 1% refit incrementally, then everything refit in full
+        std::vector<uint32_t> moved;
+        for (uint32_t i = 0; i < objectCount; i += 100)
+        {
+            moved.push_back(i);
+        }
+        auto drift = [&](uint32_t object)
+        {
+            const float dx = signedUnit(rng) * 0.5f;
+            const float dy = signedUnit(rng) * 0.5f;
+            boxes[object].min.x += dx;
+            boxes[object].max.x += dx;
+            boxes[object].min.y += dy;
+            boxes[object].max.y += dy;
+        };
+
+        double incrementalMs = 0.0;
+        double fullMs = 0.0;
+        for (uint32_t frame = 0; frame < driftFrames; ++frame)
+        {
+            for (uint32_t object : moved)
+            {
+                drift(object);
+            }
+            start = std::chrono::high_resolution_clock::now();
+            bvh.Refit(boxes.data(), moved.data(), (uint32_t)moved.size());
+            incrementalMs += elapsedMs(start);
+
+            for (uint32_t object = 0; object < objectCount; ++object)
+            {
+                drift(object);
+            }
+            start = std::chrono::high_resolution_clock::now();
+            bvh.Refit(boxes.data());
+            fullMs += elapsedMs(start);
+        }
+        const double driftedRate = measureFrustum(bvh, found);
+
+        // Wall time of a background rebuild, waited on straight away here
+        start = std::chrono::high_resolution_clock::now();
+        bvh.StartRebuild(jobs, boxes.data(), objectCount);
+        bvh.FinishRebuild(true);
+        const double rebuildMs = elapsedMs(start);
+        const double rebuiltRate = measureFrustum(bvh, found);
+
+        snprintf(line, sizeof(line), "  refit  : %.3f ms for %zu moved, %.3f ms for all; rebuild %.2f ms",
+            incrementalMs / driftFrames, moved.size(), fullMs / driftFrames, rebuildMs);
+        LOG(line);
+        snprintf(line, sizeof(line), "  after %u frames of drift: %10.0f frustum queries/s, %10.0f once rebuilt",
+            driftFrames, driftedRate, rebuiltRate);
+        LOG(line);
+    }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "Mathmatics.h"
+
+class JobSystem;
+class JobCounter;
+
+// Bounding volume hierarchy over object AABBs, four children per node. Built top-down with binned SAH splits,
+// refit in place when objects move and rebuilt in the background once the refits have worn the tree down.
+// Object indices are the ones the bounds were passed in with
+class Bvh
+{
+public:
+	static constexpr uint32_t MaxLeafSize = 4;
+
+	struct RayHit
+	{
+		uint32_t object = UINT32_MAX;
+		float distance = 0.f;
+	};
+
+	Bvh() = default;
+	~Bvh();
+	Bvh(const Bvh&) = delete;
+	Bvh& operator=(const Bvh&) = delete;
+
+	void Build(const Bounds* bounds, uint32_t count);
+
+	// Same objects as the build, new bounds. The first refits every node, the second only walks up from the given objects
+	void Refit(const Bounds* bounds);
+	void Refit(const Bounds* bounds, const uint32_t* movedObjects, uint32_t movedCount);
+
+	// Builds a fresh tree from a copy of bounds on the job system, this one keeps answering queries meanwhile
+	void StartRebuild(JobSystem& jobs, const Bounds* bounds, uint32_t count);
+	// Swaps the rebuilt tree in once it's done (waiting for it when wait is set), true if it did.
+	// The new tree has the bounds from StartRebuild, Refit it if objects moved since
+	bool FinishRebuild(bool wait = false);
+	bool IsRebuilding() const { return m_rebuild != nullptr; }
+
+	// Append the indices of the objects that pass
+	void QueryFrustum(const Plane planes[6], std::vector<uint32_t>& out_objects) const;
+	void QueryOverlap(const Bounds& box, std::vector<uint32_t>& out_objects) const;
+
+	// Closest object box along the ray within maxDistance, direction doesn't need to be normalized (distance is in its units)
+	bool Raycast(const Vector3& origin, const Vector3& direction, float maxDistance, RayHit& out_hit) const;
+
+	uint32_t GetObjectCount() const { return (uint32_t)m_primitives.size(); }
+	uint32_t GetNodeCount() const { return (uint32_t)m_nodes.size(); }
+
+	// Four child boxes side by side so a single SIMD test covers all of them, 128 bytes: two cache lines
+	struct alignas(64) Node
+	{
+		float minX[4];
+		float minY[4];
+		float minZ[4];
+		float maxX[4];
+		float maxY[4];
+		float maxZ[4];
+		uint32_t children[4]; // Node index, LeafBit | first primitive, or EmptyChild
+		uint32_t counts[4];   // Primitives in a leaf child
+	};
+
+private:
+	static constexpr uint32_t LeafBit = 0x80000000u;
+	static constexpr uint32_t EmptyChild = UINT32_MAX;
+	static constexpr uint32_t NoParent = UINT32_MAX;
+
+	struct BuildRange
+	{
+		uint32_t begin = 0;
+		uint32_t end = 0;
+		Bounds bounds{};
+	};
+
+	// Primitives are packed per leaf, so a subtree covers one contiguous range of them
+	struct PrimitiveRange
+	{
+		uint32_t first = 0;
+		uint32_t count = 0;
+	};
+
+	uint32_t BuildNode(const BuildRange& range, const Bounds* bounds, const std::vector<Vector3>& centroids, uint32_t parent);
+	void SplitRange(const BuildRange& range, const Bounds* bounds, const std::vector<Vector3>& centroids, BuildRange& out_left, BuildRange& out_right);
+	void SetChild(uint32_t node, uint32_t slot, const Bounds& bounds);
+	Bounds GetChildBounds(uint32_t node, uint32_t slot) const;
+	Bounds GetNodeBounds(uint32_t node) const;
+	Bounds GetLeafBounds(uint32_t first, uint32_t count) const;
+
+	std::vector<Node> m_nodes{};                // Root first, parents before their children
+	std::vector<uint32_t> m_nodeParents{};      // (parent node << 2) | slot, NoParent for the root
+	std::vector<PrimitiveRange> m_nodeRanges{}; // Primitives under each node
+	std::vector<uint32_t> m_primitives{};       // Object indices in leaf order
+	std::vector<Bounds> m_primitiveBounds{};    // In leaf order
+	std::vector<uint32_t> m_primitiveLeaves{};  // (node << 2) | slot of the leaf holding each primitive
+	std::vector<uint32_t> m_objectPrimitives{}; // Object index -> primitive
+
+	// Background rebuild
+	JobSystem* m_rebuildJobs = nullptr;
+	std::unique_ptr<JobCounter> m_rebuildCounter{};
+	std::unique_ptr<Bvh> m_rebuild{};
+	std::vector<Bounds> m_rebuildBounds{};
+};
+
+// Build, frustum and ray query rates against brute force, refits and a background rebuild at several object counts, logged
+void RunBvhBenchmark(JobSystem& jobs);
@@ -0,0 +1,431 @@
+#include "JobSystem.h"
+
+#include "Debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+static thread_local uint32_t t_workerIndex = JobSystem::InvalidWorker;
+
+bool JobSystem::WorkStealingDeque::Push(Job* job)
+{
+    const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    const int64_t top = m_top.load(std::memory_order_acquire);
+    if (bottom - top >= (int64_t)MaxJobsPerWorker)
+        return false;
+
+    // Publishes the job (and what it captured) to thieves that acquire bottom
+    m_jobs[bottom & (MaxJobsPerWorker - 1)].store(job, std::memory_order_relaxed);
+    m_bottom.store(bottom + 1, std::memory_order_release);
+    return true;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::Pop()
+{
+    // Claim the bottom slot first, then check whether a thief got there
+    const int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Job* job = m_jobs[bottom & (MaxJobsPerWorker - 1)].load(std::memory_order_relaxed);
+    if (top == bottom)
+    {
+        // Last job, race the thieves for it
+        if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            job = nullptr;
+        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+}
+
+JobSystem::Job* JobSystem::WorkStealingDeque::Steal()
+{
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = m_bottom.load(std::memory_order_acquire);
+    if (top >= bottom)
+        return nullptr;
+
+    Job* job = m_jobs[top & (MaxJobsPerWorker - 1)].load(std::memory_order_relaxed);
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        return nullptr;
+    return job;
+}
+
+void JobSystem::Init(uint32_t threadCount)
+{
+    ASSERT(m_workers.empty(), "Job system already initialized");
+
+    if (threadCount == 0)
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+
+    m_stopping = false;
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        m_workers.push_back(std::make_unique<Worker>());
+        m_workers.back()->randomState = 0x9E3779B9u * (i + 1);
+    }
+
+    t_workerIndex = 0;
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+        m_workers[i]->thread = std::thread(&JobSystem::WorkerMain, this, i);
+    }
+}
+
+void JobSystem::Shutdown()
+{
+    if (m_workers.empty())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (std::unique_ptr<Worker>& worker : m_workers)
+    {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+    m_workers.clear();
+    t_workerIndex = InvalidWorker;
+
+    for (Job* job : m_sharedJobs)
+    {
+        delete job;
+    }
+    m_sharedJobs.clear();
+}
+
+void JobSystem::Run(std::function<void()> function, JobCounter* signal, JobCounter* dependency)
+{
+    Job* job = AllocateJob();
+    job->function = std::move(function);
+    job->signal = signal;
+    if (signal != nullptr)
+        signal->m_pending.fetch_add(1, std::memory_order_relaxed);
+
+    if (dependency != nullptr && !dependency->IsDone())
+    {
+        // Checked again under the lock, Signal takes it before releasing the continuations
+        std::lock_guard<std::mutex> lock(dependency->m_mutex);
+        if (!dependency->IsDone())
+        {
+            dependency->m_continuations.push_back(job);
+            return;
+        }
+    }
+
+    Submit(job);
+}
+
+void JobSystem::Wait(JobCounter& counter)
+{
+    while (!counter.IsDone())
+    {
+        if (Job* job = FindJob())
+            Execute(job);
+        else
+            std::this_thread::yield();
+    }
+
+    std::lock_guard<std::mutex> lock(counter.m_mutex);
+}
+
+void JobSystem::ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& body, uint32_t maxThreads)
+{
+    if (count == 0)
+        return;
+
+    batchSize = std::max(batchSize, 1u);
+    const uint32_t batchCount = (count + batchSize - 1) / batchSize;
+    const uint32_t threads = std::min({ batchCount, GetWorkerCount(), std::max(maxThreads, 1u) });
+
+    // One job per helping thread, each keeps taking the next batch, so spawn cost doesn't grow with count
+    std::atomic<uint32_t> nextBatch{ 0 };
+    auto runBatches = [&]()
+    {
+        for (uint32_t batch = nextBatch.fetch_add(1, std::memory_order_relaxed); batch < batchCount; batch = nextBatch.fetch_add(1, std::memory_order_relaxed))
+        {
+            const uint32_t begin = batch * batchSize;
+            body(begin, std::min(begin + batchSize, count));
+        }
+    };
+
+    JobCounter counter{};
+    for (uint32_t i = 1; i < threads; ++i)
+    {
+        Run(runBatches, &counter);
+    }
+    runBatches();
+    Wait(counter);
+}
+
+uint32_t JobSystem::GetWorkerIndex()
+{
+    return t_workerIndex;
+}
+
+JobSystem::Job* JobSystem::AllocateJob()
+{
+    const uint32_t workerIndex = t_workerIndex;
+    if (workerIndex == InvalidWorker || workerIndex >= m_workers.size())
+    {
+        Job* job = new Job();
+        job->heapAllocated = true;
+        return job;
+    }
+
+    // Slots are only handed out by their owner, they come back once the job has run
+    Worker& worker = *m_workers[workerIndex];
+    Job* job = &worker.jobs[worker.nextJob++ & (MaxJobsPerWorker - 1)];
+    ASSERT(!job->inUse.load(std::memory_order_acquire), "Too many pending jobs on one worker");
+    job->inUse.store(true, std::memory_order_relaxed);
+    return job;
+}
+
+void JobSystem::Submit(Job* job)
+{
+    const uint32_t workerIndex = t_workerIndex;
+    if (workerIndex != InvalidWorker && workerIndex < m_workers.size())
+    {
+        // A full deque means plenty of parallel work already, just run it here
+        if (!m_workers[workerIndex]->deque.Push(job))
+        {
+            Execute(job);
+            return;
+        }
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(m_sharedMutex);
+        m_sharedJobs.push_back(job);
+    }
+
+    // Pairs with the sleeping count in WorkerMain, one of the two sides sees the other
+    m_queuedJobs.fetch_add(1, std::memory_order_seq_cst);
+    if (m_sleepingWorkers.load(std::memory_order_seq_cst) > 0)
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_one();
+    }
+}
+
+JobSystem::Job* JobSystem::FindJob()
+{
+    if (m_queuedJobs.load(std::memory_order_relaxed) <= 0)
+        return nullptr;
+
+    Job* job = nullptr;
+    const uint32_t workerIndex = t_workerIndex;
+    const bool isWorker = workerIndex != InvalidWorker && workerIndex < m_workers.size();
+    if (isWorker)
+        job = m_workers[workerIndex]->deque.Pop();
+
+    // Steal from the others, starting at a random victim so thieves spread out
+    const uint32_t workerCount = (uint32_t)m_workers.size();
+    if (job == nullptr && workerCount > 1)
+    {
+        uint32_t start = 0;
+        if (isWorker)
+        {
+            uint32_t& state = m_workers[workerIndex]->randomState;
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            start = state;
+        }
+
+        for (uint32_t i = 0; i < workerCount && job == nullptr; ++i)
+        {
+            const uint32_t victim = (start + i) % workerCount;
+            if (victim != workerIndex)
+                job = m_workers[victim]->deque.Steal();
+        }
+    }
+
+    if (job == nullptr)
+    {
+        std::lock_guard<std::mutex> lock(m_sharedMutex);
+        if (!m_sharedJobs.empty())
+        {
+            job = m_sharedJobs.back();
+            m_sharedJobs.pop_back();
+        }
+    }
+
+    if (job != nullptr)
+        m_queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+    return job;
+}
+
+void JobSystem::Execute(Job* job)
+{
+    job->function();
+    job->function = nullptr;
+
+    JobCounter* signal = job->signal;
+    if (job->heapAllocated)
+        delete job;
+    else
+        job->inUse.store(false, std::memory_order_release);
+
+    if (signal != nullptr)
+        Signal(signal);
+}
+
+void JobSystem::Signal(JobCounter* counter)
+{
+    uint32_t pending = counter->m_pending.load(std::memory_order_relaxed);
+    while (pending > 1)
+    {
+        if (counter->m_pending.compare_exchange_weak(pending, pending - 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+            return;
+    }
+
+    // Last one: decrement under the lock so a dependent Run can't slip in between, Wait takes the lock once more
+    // before returning so the counter isn't destroyed while this still holds it
+    std::vector<Job*> continuations{};
+    {
+        std::lock_guard<std::mutex> lock(counter->m_mutex);
+        if (counter->m_pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+        continuations.swap(counter->m_continuations);
+    }
+
+    for (Job* job : continuations)
+    {
+        Submit(job);
+    }
+}
+
+void JobSystem::WorkerMain(uint32_t worker)
+{
+    t_workerIndex = worker;
+
+    const uint32_t spinCount = 64;
+    uint32_t idleSpins = 0;
+    while (!m_stopping.load(std::memory_order_relaxed))
+    {
+        if (Job* job = FindJob())
+        {
+            Execute(job);
+            idleSpins = 0;
+            continue;
+        }
+
+        // Spin briefly to keep spawn to start latency low, then sleep
+        if (++idleSpins < spinCount)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepingWorkers.fetch_add(1, std::memory_order_seq_cst);
+        m_wake.wait(lock, [this] { return m_stopping.load(std::memory_order_relaxed) || m_queuedJobs.load(std::memory_order_seq_cst) > 0; });
+        m_sleepingWorkers.fetch_sub(1, std::memory_order_relaxed);
+        idleSpins = 0;
+    }
+}
+
+void RunJobSystemBenchmark(JobSystem& jobs)
+{
+    const uint32_t spawnCount = 100000;
+    const uint32_t spawnWave = 1024; // Stays well under the per-worker pending job limit
+    const uint32_t roundTrips = 10000;
+    const uint32_t elementCount = 1 << 24;
+    const uint32_t parallelForRuns = 10;
+    const uint32_t workerCount = jobs.GetWorkerCount();
+
+    LOG("Job system benchmark (" + std::to_string(workerCount) + " workers)");
+
+    // Spawn overhead: empty jobs, spawned from this thread and run by everyone
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t spawned = 0; spawned < spawnCount; spawned += spawnWave)
+        {
+            JobCounter counter{};
+            for (uint32_t i = 0; i < spawnWave; ++i)
+            {
+                jobs.Run([] {}, &counter);
+            }
+            jobs.Wait(counter);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        const uint32_t jobs = (spawnCount + spawnWave - 1) / spawnWave * spawnWave;
+        char line[256];
+        snprintf(line, sizeof(line), "empty jobs: %8.1f ns each (spawn, run and wait, %u per wave)",
+            std::chrono::duration<double, std::nano>(end - start).count() / jobs, spawnWave);
+        LOG(line);
+    }
+
+    // Latency: one job at a time, includes waking a worker (or running it here when nobody steals it first)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < roundTrips; ++i)
+        {
+            JobCounter counter{};
+            jobs.Run([] {}, &counter);
+            jobs.Wait(counter);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        char line[256];
+        snprintf(line, sizeof(line), "round trip: %8.1f ns per Run + Wait", std::chrono::duration<double, std::nano>(end - start).count() / roundTrips);
+        LOG(line);
+    }
+
+    // Parallel-for scaling on a compute bound loop
+    std::vector<float> values(elementCount);
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        values[i] = (float)i;
+    }
+
+    std::vector<uint32_t> threadCounts{};
+    for (uint32_t threads = 1; threads < workerCount; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(workerCount);
+
+    double singleThreadMs = 0.0;
+    for (uint32_t threads : threadCounts)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t run = 0; run < parallelForRuns; ++run)
+        {
+            jobs.ParallelFor(elementCount, 16384, [&](uint32_t begin, uint32_t end)
+            {
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    values[i] = std::sqrt(values[i] * 1.0001f + 1.f);
+                }
+            }, threads);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        const double ms = std::chrono::duration<double, std::milli>(end - start).count() / parallelForRuns;
+        if (threads == 1)
+            singleThreadMs = ms;
+
+        char line[256];
+        snprintf(line, sizeof(line), "parallel for %3u threads: %8.3f ms (%5.2fx), %u elements",
+            threads, ms, ms > 0.0 ? singleThreadMs / ms : 0.0, elementCount);
+        LOG(line);
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobCounter;
+
+// Work-stealing job system: one worker thread per core, each with its own lock-free deque.
+// Workers pop their own newest job and steal the oldest job of another worker when out of work.
+// The thread that calls Init is worker 0 and only runs jobs while it waits (Wait, ParallelFor).
+class JobSystem
+{
+public:
+	static constexpr uint32_t MaxJobsPerWorker = 4096; // Jobs spawned by one worker that may be pending at once
+	static constexpr uint32_t InvalidWorker = UINT32_MAX;
+
+	~JobSystem() { Shutdown(); }
+
+	// threadCount 0: one per hardware thread, including the calling thread
+	void Init(uint32_t threadCount = 0);
+	void Shutdown();
+
+	// signal (optional) is incremented now and decremented once the job has run.
+	// The job starts only once dependency (optional) has reached zero
+	void Run(std::function<void()> job, JobCounter* signal = nullptr, JobCounter* dependency = nullptr);
+
+	// Runs other jobs until the counter reaches zero
+	void Wait(JobCounter& counter);
+
+	// Calls body(begin, end) over [0, count) in batches of batchSize and returns when all are done.
+	// Batches are handed out dynamically, at most maxThreads threads (the caller included) take part
+	void ParallelFor(uint32_t count, uint32_t batchSize, const std::function<void(uint32_t begin, uint32_t end)>& body,
+		uint32_t maxThreads = UINT32_MAX);
+
+	uint32_t GetWorkerCount() const { return (uint32_t)m_workers.size(); }
+
+	// Index of the calling thread in [0, GetWorkerCount()), InvalidWorker for threads the job system doesn't own
+	static uint32_t GetWorkerIndex();
+
+private:
+	friend class JobCounter;
+
+	struct Job
+	{
+		std::function<void()> function{};
+		JobCounter* signal = nullptr;
+		std::atomic<bool> inUse{ false };
+		bool heapAllocated = false; // Spawned from a thread outside the job system
+	};
+
+	// Chase-Lev deque: the owner pushes and pops at the bottom, thieves take from the top
+	class WorkStealingDeque
+	{
+	public:
+		bool Push(Job* job); // Owner only, false when full
+		Job* Pop();          // Owner only
+		Job* Steal();        // Any thread
+
+	private:
+		alignas(64) std::atomic<int64_t> m_top{ 0 };
+		alignas(64) std::atomic<int64_t> m_bottom{ 0 };
+		std::atomic<Job*> m_jobs[MaxJobsPerWorker]{};
+	};
+
+	struct Worker
+	{
+		WorkStealingDeque deque{};
+		Job jobs[MaxJobsPerWorker]{}; // Ring of job storage, only allocated from by the owner
+		uint32_t nextJob = 0;
+		uint32_t randomState = 0;     // Picks steal victims
+		std::thread thread{};
+	};
+
+	Job* AllocateJob();
+	void Submit(Job* job);
+	Job* FindJob();
+	void Execute(Job* job);
+	void Signal(JobCounter* counter);
+	void WorkerMain(uint32_t worker);
+
+	std::vector<std::unique_ptr<Worker>> m_workers{};
+
+	// Jobs submitted from threads without a deque
+	std::mutex m_sharedMutex{};
+	std::vector<Job*> m_sharedJobs{};
+
+	// Idle workers sleep until something is queued
+	std::atomic<int32_t> m_queuedJobs{ 0 }; // Can dip below zero while a push is being counted
+	std::atomic<uint32_t> m_sleepingWorkers{ 0 };
+	std::mutex m_sleepMutex{};
+	std::condition_variable m_wake{};
+	std::atomic<bool> m_stopping{ false };
+};
+
+// Counts pending jobs, doubles as a dependency for jobs started after it reaches zero.
+// Must outlive the jobs that signal it, Wait on it before destroying it.
+class JobCounter
+{
+public:
+	bool IsDone() const { return m_pending.load(std::memory_order_acquire) == 0; }
+
+private:
+	friend class JobSystem;
+
+	std::atomic<uint32_t> m_pending{ 0 };
+	std::mutex m_mutex{};
+	std::vector<JobSystem::Job*> m_continuations{}; // Jobs waiting for this counter to reach zero
+};
+
+// Spawn overhead, round trip latency and parallel-for scaling, logged. Needs nothing but an initialized job system
+void RunJobSystemBenchmark(JobSystem& jobs);
@@ -1,11 +1,106 @@
+#include "BatchMath.h"
+#include "Bvh.h"
+#include "JobSystem.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 #include "Renderer.h"
+#include "TransformHierarchy.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// Benchmarks that only measure the CPU, run without a window or device. False when mode isn't one of them
+static bool RunCpuBenchmark(const char* mode)
+{
+	JobSystem jobs{};
+	if (strcmp(mode, "--bench-jobs") == 0)
+	{
+		jobs.Init();
+		RunJobSystemBenchmark(jobs);
+	}
+	else if (strcmp(mode, "--bench-hierarchy") == 0)
+	{
+		jobs.Init();
+		RunHierarchyBenchmark(jobs);
+	}
+	else if (strcmp(mode, "--bench-bvh") == 0)
+	{
+		jobs.Init();
+		RunBvhBenchmark(jobs);
+	}
+	else if (strcmp(mode, "--bench-mesh-opt") == 0)
+	{
+		jobs.Init();
+		RunMeshOptimizerBenchmark(jobs);
+	}
+	else if (strcmp(mode, "--bench-lod-chain") == 0)
+		RunLodChainBenchmark();
+	else if (strcmp(mode, "--bench-math") == 0)
+		RunMathBenchmark();
+	else if (strcmp(mode, "--bench-batch") == 0)
+		RunBatchMathBenchmark();
+	else
+		return false;
+
+	return true;
+}
 
 int main(int argc, char* argv[])
 {
 	Renderer renderer{};
 
+	const char* mode = "";
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--msaa") == 0 && i + 1 < argc)
+			renderer.SetMsaaSamples((uint32_t)atoi(argv[++i]));
+		else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc)
+		{
+			const char* format = argv[++i];
+			renderer.SetPositionFormat(strcmp(format, "half") == 0 ? VertexCompression::PositionFormat::Half
+				: strcmp(format, "snorm16") == 0 ? VertexCompression::PositionFormat::Snorm16
+				: VertexCompression::PositionFormat::Float32);
+		}
+		else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc)
+			renderer.SetDeviceOverride(argv[++i]);
+		else if (strcmp(argv[i], "--record-threads") == 0 && i + 1 < argc)
+			renderer.SetRecordThreads((uint32_t)atoi(argv[++i]));
+		else if (strcmp(argv[i], "--no-render-thread") == 0)
+			renderer.SetRenderThread(false);
+		else if (strcmp(argv[i], "--no-async-compute") == 0)
+			renderer.SetAsyncCompute(false);
+		else if (strcmp(argv[i], "--dump-graph") == 0)
+			renderer.DumpRenderGraph();
+		else
+			mode = argv[i];
+	}
+
+	if (RunCpuBenchmark(mode))
+		return 0;
+
 	renderer.Init();
-	renderer.Run();
+
+	if (strcmp(mode, "--bench-instancing") == 0)
+		renderer.RunInstancingBenchmark();
+	else if (strcmp(mode, "--bench-culling") == 0)
+		renderer.RunCullingBenchmark();
+	else if (strcmp(mode, "--bench-prepass") == 0)
+		renderer.RunPrepassBenchmark();
+	else if (strcmp(mode, "--bench-recording") == 0)
+		renderer.RunRecordingBenchmark();
+	else if (strcmp(mode, "--bench-async-compute") == 0)
+		renderer.RunAsyncComputeBenchmark();
+	else if (strcmp(mode, "--bench-dispatch") == 0)
+		renderer.RunDispatchBenchmark();
+	else if (strcmp(mode, "--bench-lod") == 0)
+		renderer.RunLodBenchmark();
+	else if (strcmp(mode, "--bench-clusters") == 0)
+		renderer.RunClusterBenchmark();
+	else if (strcmp(mode, "--bench-vertex-format") == 0)
+		renderer.RunVertexFormatBenchmark();
+	else
+		renderer.Run();
+
 	renderer.Shutdown();
 
 	return 0;
@@ -0,0 +1,119 @@
+#include "Mathmatics.h"
+
+#include "Debug.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+void RunMathBenchmark()
+{
+    const uint32_t elementCount = 4096; // Power of two, small enough to stay in cache so this measures the math
+    const uint32_t repeats = 500;
+    const uint32_t runs = 3;
+
+#if MATH_SIMD_AVX
+    const char* backend = "AVX";
+#elif MATH_SIMD_SSE
+    const char* backend = "SSE";
+#elif MATH_SIMD_NEON
+    const char* backend = "NEON";
+#else
+    const char* backend = "scalar";
+#endif
+
+    // Diagonally dominant matrices so every one has a well behaved inverse
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> value(-1.f, 1.f);
+    std::vector<Matrix4x4> matrices(elementCount);
+    std::vector<Vector4> vectors(elementCount);
+    std::vector<Quaternion> rotations(elementCount);
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        for (int column = 0; column < 4; ++column)
+        {
+            matrices[i].columns[column] = { value(rng), value(rng), value(rng), value(rng) };
+            (&matrices[i].columns[column].x)[column] += 4.f;
+        }
+        vectors[i] = { value(rng), value(rng), value(rng), value(rng) + 2.f };
+        rotations[i] = Normalize(Quaternion{ value(rng), value(rng), value(rng), value(rng) + 2.f });
+    }
+    std::vector<Matrix4x4> matrixResults(elementCount);
+    std::vector<Vector4> vectorResults(elementCount);
+    std::vector<Quaternion> rotationResults(elementCount);
+
+    // Best of runs, in ns per call
+    auto measure = [&](auto&& body)
+    {
+        double best = 1e30;
+        for (uint32_t run = 0; run < runs; ++run)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (uint32_t repeat = 0; repeat < repeats; ++repeat)
+            {
+                for (uint32_t i = 0; i < elementCount; ++i)
+                {
+                    body(i, (i + 1) & (elementCount - 1));
+                }
+            }
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count() / ((double)repeats * elementCount));
+        }
+        return best;
+    };
+
+    struct MathResult
+    {
+        const char* name;
+        double simdNs;
+        double scalarNs;
+    };
+    const MathResult results[] =
+    {
+        { "Matrix multiply",
+            measure([&](uint32_t i, uint32_t j) { matrixResults[i] = Multiply(matrices[i], matrices[j]); }),
+            measure([&](uint32_t i, uint32_t j) { matrixResults[i] = MathScalar::Multiply(matrices[i], matrices[j]); }) },
+        { "Matrix inverse",
+            measure([&](uint32_t i, uint32_t) { matrixResults[i] = Inverse(matrices[i]); }),
+            measure([&](uint32_t i, uint32_t) { matrixResults[i] = MathScalar::Inverse(matrices[i]); }) },
+        { "Transform",
+            measure([&](uint32_t i, uint32_t j) { vectorResults[i] = Transform(matrices[j], vectors[i]); }),
+            measure([&](uint32_t i, uint32_t j) { vectorResults[i] = MathScalar::Transform(matrices[j], vectors[i]); }) },
+        { "Normalize",
+            measure([&](uint32_t i, uint32_t) { vectorResults[i] = Normalize(vectors[i]); }),
+            measure([&](uint32_t i, uint32_t) { vectorResults[i] = MathScalar::Normalize(vectors[i]); }) },
+        { "Quaternion multiply",
+            measure([&](uint32_t i, uint32_t j) { rotationResults[i] = Multiply(rotations[i], rotations[j]); }),
+            measure([&](uint32_t i, uint32_t j) { rotationResults[i] = MathScalar::Multiply(rotations[i], rotations[j]); }) }
+    };
+
+    LOG(std::string("Math benchmark (") + backend + " against scalar, " + std::to_string(elementCount) + " elements x " + std::to_string(repeats) + ", best of " + std::to_string(runs) + ")");
+    for (const MathResult& result : results)
+    {
+        char line[256];
+        snprintf(line, sizeof(line), "%-20s: %7.2f ns %s, %7.2f ns scalar, %5.2fx",
+            result.name, result.simdNs, backend, result.scalarNs, result.scalarNs / result.simdNs);
+        LOG(line);
+    }
+
+    // Sanity check that the two paths agree, M * inverse(M) should be the identity
+    float maxError = 0.f;
+    for (uint32_t i = 0; i < elementCount; ++i)
+    {
+        const Matrix4x4 identity = Multiply(matrices[i], Inverse(matrices[i]));
+        for (int column = 0; column < 4; ++column)
+        {
+            for (int row = 0; row < 4; ++row)
+            {
+                const float expected = row == column ? 1.f : 0.f;
+                maxError = std::max(maxError, std::abs((&identity.columns[column].x)[row] - expected));
+            }
+        }
+    }
+    char line[256];
+    snprintf(line, sizeof(line), "max |M * inverse(M) - I| = %g", maxError);
+    LOG(line);
+}
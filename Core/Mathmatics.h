@@ -1,5 +1,19 @@
 #pragma once
 
+#include <cmath>
+
+// SIMD backend, picked at compile time. Define MATH_SIMD_SCALAR to force the scalar fallback
+#if !defined(MATH_SIMD_SCALAR) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATH_SIMD_SSE 1
+#include <immintrin.h>
+#if defined(__AVX__)
+#define MATH_SIMD_AVX 1
+#endif
+#elif !defined(MATH_SIMD_SCALAR) && (defined(__aarch64__) || defined(_M_ARM64))
+#define MATH_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
 struct Vector2
 {
 	float x = 0.f;
@@ -19,4 +33,404 @@ struct Color
 	float g = 0.f;
 	float b = 0.f;
 	float a = 1.f;
-};
\ No newline at end of file
+};
+
+// Points p with dot(normal, p) + distance >= 0 are on the inside
+struct Plane
+{
+	Vector3 normal{};
+	float distance = 0.f;
+};
+
+// Axis aligned box
+struct Bounds
+{
+	Vector3 min{};
+	Vector3 max{};
+};
+
+// 16 byte aligned so it can be loaded straight into a SIMD register, and laid out like a GLSL vec4 in std140/std430
+struct alignas(16) Vector4
+{
+	float x = 0.f;
+	float y = 0.f;
+	float z = 0.f;
+	float w = 0.f;
+};
+
+// Column-major, same layout as a GLSL mat4 in std140/std430 (columns[3] holds the translation)
+struct alignas(16) Matrix4x4
+{
+	Vector4 columns[4]{};
+
+	static Matrix4x4 Identity()
+	{
+		Matrix4x4 m{};
+		m.columns[0].x = 1.f;
+		m.columns[1].y = 1.f;
+		m.columns[2].z = 1.f;
+		m.columns[3].w = 1.f;
+		return m;
+	}
+};
+
+// Rotation (x, y, z imaginary, w real), same layout as a vec4
+struct alignas(16) Quaternion
+{
+	float x = 0.f;
+	float y = 0.f;
+	float z = 0.f;
+	float w = 1.f;
+};
+
+static_assert(sizeof(Vector4) == 16 && alignof(Vector4) == 16, "Vector4 must match a GLSL vec4");
+static_assert(sizeof(Matrix4x4) == 64 && alignof(Matrix4x4) == 16, "Matrix4x4 must match a GLSL mat4");
+static_assert(sizeof(Quaternion) == 16 && alignof(Quaternion) == 16, "Quaternion must match a GLSL vec4");
+
+// Plain C++ versions, used when there is no SIMD backend and as the reference for the benchmarks
+namespace MathScalar
+{
+	inline float Dot(const Vector4& a, const Vector4& b)
+	{
+		return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+	}
+
+	// v must not be zero length
+	inline Vector4 Normalize(const Vector4& v)
+	{
+		const float length = std::sqrt(Dot(v, v));
+		return { v.x / length, v.y / length, v.z / length, v.w / length };
+	}
+
+	inline Vector4 Transform(const Matrix4x4& m, const Vector4& v)
+	{
+		const Vector4* c = m.columns;
+		return {
+			c[0].x * v.x + c[1].x * v.y + c[2].x * v.z + c[3].x * v.w,
+			c[0].y * v.x + c[1].y * v.y + c[2].y * v.z + c[3].y * v.w,
+			c[0].z * v.x + c[1].z * v.y + c[2].z * v.z + c[3].z * v.w,
+			c[0].w * v.x + c[1].w * v.y + c[2].w * v.z + c[3].w * v.w
+		};
+	}
+
+	// a * b, b is applied first
+	inline Matrix4x4 Multiply(const Matrix4x4& a, const Matrix4x4& b)
+	{
+		Matrix4x4 result;
+		for (int i = 0; i < 4; ++i)
+		{
+			result.columns[i] = Transform(a, b.columns[i]);
+		}
+		return result;
+	}
+
+	// General inverse by cofactors, m must be invertible
+	inline Matrix4x4 Inverse(const Matrix4x4& matrix)
+	{
+		const float* m = &matrix.columns[0].x;
+		float inv[16];
+		inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+		inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+		inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+		inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+		inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+		inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+		inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+		inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+		inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+		inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+		inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+		inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+		inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+		inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+		inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+		inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+		const float inverseDeterminant = 1.f / (m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12]);
+		Matrix4x4 result;
+		float* r = &result.columns[0].x;
+		for (int i = 0; i < 16; ++i)
+		{
+			r[i] = inv[i] * inverseDeterminant;
+		}
+		return result;
+	}
+
+	// a * b applies b first, then a
+	inline Quaternion Multiply(const Quaternion& a, const Quaternion& b)
+	{
+		return {
+			a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+			a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+			a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+			a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z
+		};
+	}
+
+	// q must not be zero length
+	inline Quaternion Normalize(const Quaternion& q)
+	{
+		const Vector4 v = Normalize(Vector4{ q.x, q.y, q.z, q.w });
+		return { v.x, v.y, v.z, v.w };
+	}
+}
+
+#if MATH_SIMD_SSE
+namespace MathSse
+{
+	inline __m128 Load(const Vector4& v) { return _mm_load_ps(&v.x); }
+	inline __m128 Load(const Quaternion& q) { return _mm_load_ps(&q.x); }
+
+	template<int X, int Y, int Z, int W>
+	inline __m128 Swizzle(__m128 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X)); }
+
+	template<int X, int Y, int Z, int W>
+	inline __m128 Shuffle(__m128 a, __m128 b) { return _mm_shuffle_ps(a, b, _MM_SHUFFLE(W, Z, Y, X)); } // a.X, a.Y, b.Z, b.W
+
+	// Dot product in every lane
+	inline __m128 Dot(__m128 a, __m128 b)
+	{
+		__m128 sum = _mm_mul_ps(a, b);
+		sum = _mm_add_ps(sum, Swizzle<1, 0, 3, 2>(sum));
+		return _mm_add_ps(sum, Swizzle<2, 3, 0, 1>(sum));
+	}
+
+	inline __m128 Transform(__m128 c0, __m128 c1, __m128 c2, __m128 c3, __m128 v)
+	{
+		__m128 result = _mm_mul_ps(c0, Swizzle<0, 0, 0, 0>(v));
+		result = _mm_add_ps(result, _mm_mul_ps(c1, Swizzle<1, 1, 1, 1>(v)));
+		result = _mm_add_ps(result, _mm_mul_ps(c2, Swizzle<2, 2, 2, 2>(v)));
+		return _mm_add_ps(result, _mm_mul_ps(c3, Swizzle<3, 3, 3, 3>(v)));
+	}
+
+	// 2x2 blocks for the inverse, stored row-major in one register (m00, m01, m10, m11)
+	inline __m128 Mat2Mul(__m128 a, __m128 b)
+	{
+		return _mm_add_ps(_mm_mul_ps(a, Swizzle<0, 3, 0, 3>(b)), _mm_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+	}
+	inline __m128 Mat2AdjMul(__m128 a, __m128 b) // adj(a) * b
+	{
+		return _mm_sub_ps(_mm_mul_ps(Swizzle<3, 3, 0, 0>(a), b), _mm_mul_ps(Swizzle<1, 1, 2, 2>(a), Swizzle<2, 3, 0, 1>(b)));
+	}
+	inline __m128 Mat2MulAdj(__m128 a, __m128 b) // a * adj(b)
+	{
+		return _mm_sub_ps(_mm_mul_ps(a, Swizzle<3, 0, 3, 0>(b)), _mm_mul_ps(Swizzle<1, 0, 3, 2>(a), Swizzle<2, 1, 2, 1>(b)));
+	}
+}
+#endif
+
+inline float Dot(const Vector4& a, const Vector4& b)
+{
+#if MATH_SIMD_SSE
+	return _mm_cvtss_f32(MathSse::Dot(MathSse::Load(a), MathSse::Load(b)));
+#elif MATH_SIMD_NEON
+	return vaddvq_f32(vmulq_f32(vld1q_f32(&a.x), vld1q_f32(&b.x)));
+#else
+	return MathScalar::Dot(a, b);
+#endif
+}
+
+// v must not be zero length
+inline Vector4 Normalize(const Vector4& v)
+{
+#if MATH_SIMD_SSE
+	const __m128 value = MathSse::Load(v);
+	Vector4 result;
+	_mm_store_ps(&result.x, _mm_div_ps(value, _mm_sqrt_ps(MathSse::Dot(value, value))));
+	return result;
+#elif MATH_SIMD_NEON
+	const float32x4_t value = vld1q_f32(&v.x);
+	Vector4 result;
+	vst1q_f32(&result.x, vdivq_f32(value, vdupq_n_f32(std::sqrt(vaddvq_f32(vmulq_f32(value, value))))));
+	return result;
+#else
+	return MathScalar::Normalize(v);
+#endif
+}
+
+inline Vector4 Transform(const Matrix4x4& m, const Vector4& v)
+{
+#if MATH_SIMD_SSE
+	using namespace MathSse;
+	Vector4 result;
+	_mm_store_ps(&result.x, MathSse::Transform(Load(m.columns[0]), Load(m.columns[1]), Load(m.columns[2]), Load(m.columns[3]), Load(v)));
+	return result;
+#elif MATH_SIMD_NEON
+	const float32x4_t value = vld1q_f32(&v.x);
+	float32x4_t result = vmulq_laneq_f32(vld1q_f32(&m.columns[0].x), value, 0);
+	result = vfmaq_laneq_f32(result, vld1q_f32(&m.columns[1].x), value, 1);
+	result = vfmaq_laneq_f32(result, vld1q_f32(&m.columns[2].x), value, 2);
+	result = vfmaq_laneq_f32(result, vld1q_f32(&m.columns[3].x), value, 3);
+	Vector4 out;
+	vst1q_f32(&out.x, result);
+	return out;
+#else
+	return MathScalar::Transform(m, v);
+#endif
+}
+
+// Point (w = 1)
+inline Vector3 TransformPoint(const Matrix4x4& m, const Vector3& p)
+{
+	const Vector4 result = Transform(m, Vector4{ p.x, p.y, p.z, 1.f });
+	return { result.x, result.y, result.z };
+}
+
+// a * b, b is applied first
+inline Matrix4x4 Multiply(const Matrix4x4& a, const Matrix4x4& b)
+{
+#if MATH_SIMD_AVX
+	// Two result columns per iteration, each 128 bit lane holds one
+	const __m256 a0 = _mm256_broadcast_ps((const __m128*)&a.columns[0]);
+	const __m256 a1 = _mm256_broadcast_ps((const __m128*)&a.columns[1]);
+	const __m256 a2 = _mm256_broadcast_ps((const __m128*)&a.columns[2]);
+	const __m256 a3 = _mm256_broadcast_ps((const __m128*)&a.columns[3]);
+	Matrix4x4 result;
+	for (int i = 0; i < 4; i += 2)
+	{
+		const __m256 bColumns = _mm256_loadu_ps(&b.columns[i].x);
+		__m256 r = _mm256_mul_ps(a0, _mm256_permute_ps(bColumns, 0x00));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a1, _mm256_permute_ps(bColumns, 0x55)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a2, _mm256_permute_ps(bColumns, 0xAA)));
+		r = _mm256_add_ps(r, _mm256_mul_ps(a3, _mm256_permute_ps(bColumns, 0xFF)));
+		_mm256_storeu_ps(&result.columns[i].x, r);
+	}
+	return result;
+#elif MATH_SIMD_SSE
+	using namespace MathSse;
+	const __m128 a0 = Load(a.columns[0]);
+	const __m128 a1 = Load(a.columns[1]);
+	const __m128 a2 = Load(a.columns[2]);
+	const __m128 a3 = Load(a.columns[3]);
+	Matrix4x4 result;
+	for (int i = 0; i < 4; ++i)
+	{
+		_mm_store_ps(&result.columns[i].x, MathSse::Transform(a0, a1, a2, a3, Load(b.columns[i])));
+	}
+	return result;
+#elif MATH_SIMD_NEON
+	Matrix4x4 result;
+	for (int i = 0; i < 4; ++i)
+	{
+		result.columns[i] = Transform(a, b.columns[i]);
+	}
+	return result;
+#else
+	return MathScalar::Multiply(a, b);
+#endif
+}
+
+// General inverse, m must be invertible
+inline Matrix4x4 Inverse(const Matrix4x4& m)
+{
+#if MATH_SIMD_SSE
+	// 2x2 block inverse. Works on rows or columns alike since inverse(transpose(m)) == transpose(inverse(m))
+	using namespace MathSse;
+	const __m128 c0 = Load(m.columns[0]);
+	const __m128 c1 = Load(m.columns[1]);
+	const __m128 c2 = Load(m.columns[2]);
+	const __m128 c3 = Load(m.columns[3]);
+
+	const __m128 A = _mm_movelh_ps(c0, c1);
+	const __m128 B = _mm_movehl_ps(c1, c0);
+	const __m128 C = _mm_movelh_ps(c2, c3);
+	const __m128 D = _mm_movehl_ps(c3, c2);
+
+	// Determinants of the blocks (|A|, |B|, |C|, |D|)
+	const __m128 blockDeterminants = _mm_sub_ps(
+		_mm_mul_ps(Shuffle<0, 2, 0, 2>(c0, c2), Shuffle<1, 3, 1, 3>(c1, c3)),
+		_mm_mul_ps(Shuffle<1, 3, 1, 3>(c0, c2), Shuffle<0, 2, 0, 2>(c1, c3)));
+	const __m128 detA = Swizzle<0, 0, 0, 0>(blockDeterminants);
+	const __m128 detB = Swizzle<1, 1, 1, 1>(blockDeterminants);
+	const __m128 detC = Swizzle<2, 2, 2, 2>(blockDeterminants);
+	const __m128 detD = Swizzle<3, 3, 3, 3>(blockDeterminants);
+
+	const __m128 DC = Mat2AdjMul(D, C);
+	const __m128 AB = Mat2AdjMul(A, B);
+	__m128 X = _mm_sub_ps(_mm_mul_ps(detD, A), Mat2Mul(B, DC));
+	__m128 W = _mm_sub_ps(_mm_mul_ps(detA, D), Mat2Mul(C, AB));
+	__m128 Y = _mm_sub_ps(_mm_mul_ps(detB, C), Mat2MulAdj(D, AB));
+	__m128 Z = _mm_sub_ps(_mm_mul_ps(detC, B), Mat2MulAdj(A, DC));
+
+	// |M| = |A||D| + |B||C| - tr(adj(A)B adj(D)C)
+	__m128 trace = _mm_mul_ps(AB, Swizzle<0, 2, 1, 3>(DC));
+	trace = _mm_add_ps(trace, Swizzle<1, 0, 3, 2>(trace));
+	trace = _mm_add_ps(trace, Swizzle<2, 3, 0, 1>(trace));
+	const __m128 det = _mm_sub_ps(_mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC)), trace);
+
+	const __m128 inverseDet = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), det);
+	X = _mm_mul_ps(X, inverseDet);
+	Y = _mm_mul_ps(Y, inverseDet);
+	Z = _mm_mul_ps(Z, inverseDet);
+	W = _mm_mul_ps(W, inverseDet);
+
+	// Adjugate of each block, placed back into columns
+	Matrix4x4 result;
+	_mm_store_ps(&result.columns[0].x, Shuffle<3, 1, 3, 1>(X, Y));
+	_mm_store_ps(&result.columns[1].x, Shuffle<2, 0, 2, 0>(X, Y));
+	_mm_store_ps(&result.columns[2].x, Shuffle<3, 1, 3, 1>(Z, W));
+	_mm_store_ps(&result.columns[3].x, Shuffle<2, 0, 2, 0>(Z, W));
+	return result;
+#else
+	return MathScalar::Inverse(m);
+#endif
+}
+
+// a * b applies b first, then a
+inline Quaternion Multiply(const Quaternion& a, const Quaternion& b)
+{
+#if MATH_SIMD_SSE
+	using namespace MathSse;
+	const __m128 qa = Load(a);
+	const __m128 qb = Load(b);
+	__m128 result = _mm_mul_ps(Swizzle<3, 3, 3, 3>(qa), qb);
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_mul_ps(Swizzle<0, 0, 0, 0>(qa), Swizzle<3, 2, 1, 0>(qb)), _mm_setr_ps(1.f, -1.f, 1.f, -1.f)));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_mul_ps(Swizzle<1, 1, 1, 1>(qa), Swizzle<2, 3, 0, 1>(qb)), _mm_setr_ps(1.f, 1.f, -1.f, -1.f)));
+	result = _mm_add_ps(result, _mm_mul_ps(_mm_mul_ps(Swizzle<2, 2, 2, 2>(qa), Swizzle<1, 0, 3, 2>(qb)), _mm_setr_ps(-1.f, 1.f, 1.f, -1.f)));
+	Quaternion out;
+	_mm_store_ps(&out.x, result);
+	return out;
+#elif MATH_SIMD_NEON
+	const float32x4_t qa = vld1q_f32(&a.x);
+	const float32x4_t qb = vld1q_f32(&b.x);
+	const float32x4_t yxwz = vrev64q_f32(qb);
+	const float32x4_t zwxy = vextq_f32(qb, qb, 2);
+	const float32x4_t wzyx = vextq_f32(yxwz, yxwz, 2);
+	const float signsX[4] = { 1.f, -1.f, 1.f, -1.f };
+	const float signsY[4] = { 1.f, 1.f, -1.f, -1.f };
+	const float signsZ[4] = { -1.f, 1.f, 1.f, -1.f };
+	float32x4_t result = vmulq_laneq_f32(qb, qa, 3);
+	result = vfmaq_laneq_f32(result, vmulq_f32(wzyx, vld1q_f32(signsX)), qa, 0);
+	result = vfmaq_laneq_f32(result, vmulq_f32(zwxy, vld1q_f32(signsY)), qa, 1);
+	result = vfmaq_laneq_f32(result, vmulq_f32(yxwz, vld1q_f32(signsZ)), qa, 2);
+	Quaternion out;
+	vst1q_f32(&out.x, result);
+	return out;
+#else
+	return MathScalar::Multiply(a, b);
+#endif
+}
+
+// q must not be zero length
+inline Quaternion Normalize(const Quaternion& q)
+{
+	const Vector4 v = Normalize(Vector4{ q.x, q.y, q.z, q.w });
+	return { v.x, v.y, v.z, v.w };
+}
+
+// Rotation matrix of a unit quaternion
+inline Matrix4x4 ToMatrix(const Quaternion& q)
+{
+	const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+	Matrix4x4 m = Matrix4x4::Identity();
+	m.columns[0] = { 1.f - 2.f * (yy + zz), 2.f * (xy + wz), 2.f * (xz - wy), 0.f };
+	m.columns[1] = { 2.f * (xy - wz), 1.f - 2.f * (xx + zz), 2.f * (yz + wx), 0.f };
+	m.columns[2] = { 2.f * (xz + wy), 2.f * (yz - wx), 1.f - 2.f * (xx + yy), 0.f };
+	return m;
+}
+
+// Times the SIMD backend against MathScalar and checks that the two agree, logged
+void RunMathBenchmark();
@@ -0,0 +1,485 @@
+#include "MeshOptimizer.h"
+
+#include "Debug.h"
+#include "JobSystem.h"
+#include "Renderer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+
+// The caches are FIFOs tracked with timestamps: every miss pushes the vertex with the next timestamp,
+// so a vertex is still in the cache while fewer than cacheSize others have been pushed after it.
+// Flushing the cache is just jumping the time ahead by more than its size
+static bool IsCached(uint32_t stamp, uint32_t time, uint32_t cacheSize)
+{
+    return time - stamp <= cacheSize;
+}
+
+static uint32_t Touch(uint32_t vertex, std::vector<uint32_t>& stamps, uint32_t& time, uint32_t cacheSize)
+{
+    if (IsCached(stamps[vertex], time, cacheSize))
+        return 0;
+    stamps[vertex] = time++;
+    return 1;
+}
+
+MeshOptimizer::Stats MeshOptimizer::Analyze(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexSize, uint32_t cacheSize)
+{
+    Stats stats{};
+    if (indices.empty())
+        return stats;
+
+    // Post-transform cache
+    std::vector<uint32_t> stamps(vertexCount, 0);
+    std::vector<uint8_t> used(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    uint32_t transforms = 0;
+    uint32_t usedCount = 0;
+    for (uint32_t index : indices)
+    {
+        ASSERT(index < vertexCount, "Index " + std::to_string(index) + " out of range");
+        transforms += Touch(index, stamps, time, cacheSize);
+        usedCount += used[index] ? 0 : 1;
+        used[index] = 1;
+    }
+    stats.acmr = (float)transforms / (indices.size() / 3);
+    stats.atvr = (float)transforms / usedCount;
+
+    // Vertex fetch through 64 byte lines, with a cache of a few kilobytes. A vertex can straddle two lines
+    const uint32_t lineSize = 64;
+    const uint32_t lineCacheSize = 64;
+    std::vector<uint32_t> lineStamps(((uint64_t)vertexCount * vertexSize + lineSize - 1) / lineSize, 0);
+    uint32_t lineTime = lineCacheSize + 1;
+    uint32_t lineMisses = 0;
+    for (uint32_t index : indices)
+    {
+        const uint64_t first = (uint64_t)index * vertexSize / lineSize;
+        const uint64_t last = ((uint64_t)index * vertexSize + vertexSize - 1) / lineSize;
+        for (uint64_t line = first; line <= last; ++line)
+        {
+            lineMisses += Touch((uint32_t)line, lineStamps, lineTime, lineCacheSize);
+        }
+    }
+    stats.overfetch = (float)lineMisses * lineSize / ((float)usedCount * vertexSize);
+    return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize)
+{
+    const uint32_t triangleCount = (uint32_t)indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // Triangles around each vertex, and how many of them are still to be emitted
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (uint32_t index : indices)
+    {
+        ASSERT(index < vertexCount, "Index " + std::to_string(index) + " out of range");
+        ++liveTriangles[index];
+    }
+    std::vector<uint32_t> adjacencyStarts(vertexCount + 1, 0);
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+    {
+        adjacencyStarts[vertex + 1] = adjacencyStarts[vertex] + liveTriangles[vertex];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> adjacencyFill(adjacencyStarts.begin(), adjacencyStarts.end() - 1);
+    for (uint32_t i = 0; i < (uint32_t)indices.size(); ++i)
+    {
+        adjacency[adjacencyFill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<uint32_t> stamps(vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnds;     // Recently used vertices, to resume from when a fan runs out
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    uint32_t time = cacheSize + 1;
+    uint32_t cursor = 0;
+
+    // Nothing useful in the cache: the most recent vertex with triangles left, or the next one in input order
+    auto skipDeadEnd = [&]()
+    {
+        while (!deadEnds.empty())
+        {
+            const uint32_t vertex = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[vertex] > 0)
+                return vertex;
+        }
+        while (cursor < vertexCount && liveTriangles[cursor] == 0)
+        {
+            ++cursor;
+        }
+        return cursor < vertexCount ? cursor : UINT32_MAX;
+    };
+
+    for (uint32_t fan = skipDeadEnd(); fan != UINT32_MAX;)
+    {
+        // Every remaining triangle around the fan vertex
+        candidates.clear();
+        for (uint32_t a = adjacencyStarts[fan]; a < adjacencyStarts[fan + 1]; ++a)
+        {
+            const uint32_t triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                const uint32_t vertex = indices[triangle * 3 + corner];
+                result.push_back(vertex);
+                deadEnds.push_back(vertex);
+                candidates.push_back(vertex);
+                --liveTriangles[vertex];
+                Touch(vertex, stamps, time, cacheSize);
+            }
+            emitted[triangle] = 1;
+        }
+
+        // Next fan: the oldest candidate that still stays cached through all of its remaining triangles,
+        // any candidate with triangles left otherwise
+        uint32_t next = UINT32_MAX;
+        int64_t bestPriority = -1;
+        for (uint32_t vertex : candidates)
+        {
+            if (liveTriangles[vertex] == 0)
+                continue;
+
+            int64_t priority = 0;
+            if (time - stamps[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+                priority = time - stamps[vertex];
+            if (priority > bestPriority)
+            {
+                bestPriority = priority;
+                next = vertex;
+            }
+        }
+        fan = next != UINT32_MAX ? next : skipDeadEnd();
+    }
+
+    indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vector3>& vertices, float threshold, uint32_t cacheSize)
+{
+    const uint32_t triangleCount = (uint32_t)indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    const uint32_t vertexCount = (uint32_t)vertices.size();
+    std::vector<uint32_t> stamps(vertexCount, 0);
+    uint32_t time = cacheSize + 1;
+    auto misses = [&](uint32_t triangle)
+    {
+        return Touch(indices[triangle * 3], stamps, time, cacheSize)
+            + Touch(indices[triangle * 3 + 1], stamps, time, cacheSize)
+            + Touch(indices[triangle * 3 + 2], stamps, time, cacheSize);
+    };
+
+    // Hard boundaries: a triangle missing all three vertices starts somewhere new, so moving it costs nothing
+    std::vector<uint32_t> hardStarts;
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        if (misses(triangle) == 3 || triangle == 0)
+            hardStarts.push_back(triangle);
+    }
+    hardStarts.push_back(triangleCount);
+
+    // Soft boundaries: split a cluster again wherever the part so far, with a cold cache, is already within
+    // threshold of the whole cluster's ACMR. Smaller clusters sort better for the price of a few more misses
+    std::vector<uint32_t> clusterStarts;
+    for (size_t cluster = 0; cluster + 1 < hardStarts.size(); ++cluster)
+    {
+        const uint32_t begin = hardStarts[cluster];
+        const uint32_t end = hardStarts[cluster + 1];
+
+        time += cacheSize + 1;
+        uint32_t clusterMisses = 0;
+        for (uint32_t triangle = begin; triangle < end; ++triangle)
+        {
+            clusterMisses += misses(triangle);
+        }
+        const float clusterThreshold = threshold * clusterMisses / (end - begin);
+
+        clusterStarts.push_back(begin);
+        time += cacheSize + 1;
+        uint32_t runningMisses = 0;
+        uint32_t runningTriangles = 0;
+        for (uint32_t triangle = begin; triangle + 1 < end; ++triangle)
+        {
+            runningMisses += misses(triangle);
+            ++runningTriangles;
+            if ((float)runningMisses / runningTriangles <= clusterThreshold)
+            {
+                clusterStarts.push_back(triangle + 1);
+                time += cacheSize + 1;
+                runningMisses = 0;
+                runningTriangles = 0;
+            }
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+
+    // Area weighted centroid and normal of each cluster
+    const uint32_t clusterCount = (uint32_t)clusterStarts.size() - 1;
+    std::vector<Vector3> centroids(clusterCount);
+    std::vector<Vector3> normals(clusterCount);
+    Vector3 meshCentroid{};
+    float meshArea = 0.f;
+    for (uint32_t cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        Vector3 centroid{};
+        Vector3 normal{};
+        float area = 0.f;
+        for (uint32_t triangle = clusterStarts[cluster]; triangle < clusterStarts[cluster + 1]; ++triangle)
+        {
+            const Vector3& a = vertices[indices[triangle * 3]];
+            const Vector3& b = vertices[indices[triangle * 3 + 1]];
+            const Vector3& c = vertices[indices[triangle * 3 + 2]];
+            const Vector3 ab = { b.x - a.x, b.y - a.y, b.z - a.z };
+            const Vector3 ac = { c.x - a.x, c.y - a.y, c.z - a.z };
+            const Vector3 cross = { ab.y * ac.z - ab.z * ac.y, ab.z * ac.x - ab.x * ac.z, ab.x * ac.y - ab.y * ac.x };
+            const float triangleArea = std::sqrt(cross.x * cross.x + cross.y * cross.y + cross.z * cross.z);
+
+            centroid.x += (a.x + b.x + c.x) * triangleArea;
+            centroid.y += (a.y + b.y + c.y) * triangleArea;
+            centroid.z += (a.z + b.z + c.z) * triangleArea;
+            normal.x += cross.x;
+            normal.y += cross.y;
+            normal.z += cross.z;
+            area += triangleArea;
+        }
+
+        meshCentroid.x += centroid.x;
+        meshCentroid.y += centroid.y;
+        meshCentroid.z += centroid.z;
+        meshArea += area;
+        const float scale = area > 0.f ? 1.f / (3.f * area) : 0.f;
+        centroids[cluster] = { centroid.x * scale, centroid.y * scale, centroid.z * scale };
+        const float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+        normals[cluster] = length > 0.f ? Vector3{ normal.x / length, normal.y / length, normal.z / length } : Vector3{};
+    }
+    const float meshScale = meshArea > 0.f ? 1.f / (3.f * meshArea) : 0.f;
+    meshCentroid = { meshCentroid.x * meshScale, meshCentroid.y * meshScale, meshCentroid.z * meshScale };
+
+    // Clusters facing away from the middle of the mesh are in front of the rest from wherever they're visible,
+    // so they go first. Stable, flat meshes keep the cache order
+    std::vector<float> sortKeys(clusterCount);
+    for (uint32_t cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        const Vector3& c = centroids[cluster];
+        const Vector3& n = normals[cluster];
+        sortKeys[cluster] = (c.x - meshCentroid.x) * n.x + (c.y - meshCentroid.y) * n.y + (c.z - meshCentroid.z) * n.z;
+    }
+    std::vector<uint32_t> order(clusterCount);
+    for (uint32_t cluster = 0; cluster < clusterCount; ++cluster)
+    {
+        order[cluster] = cluster;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+    for (uint32_t cluster : order)
+    {
+        result.insert(result.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+    }
+    indices.swap(result);
+}
+
+uint32_t MeshOptimizer::OptimizeVertexFetch(std::vector<Vector3>& vertices, std::vector<uint32_t>& indices)
+{
+    std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+    std::vector<Vector3> result;
+    result.reserve(vertices.size());
+    for (uint32_t& index : indices)
+    {
+        ASSERT(index < vertices.size(), "Index " + std::to_string(index) + " out of range");
+        if (remap[index] == UINT32_MAX)
+        {
+            remap[index] = (uint32_t)result.size();
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+    return (uint32_t)vertices.size();
+}
+
+MeshOptimizer::Report MeshOptimizer::Optimize(MeshData& mesh)
+{
+    Report report{};
+    const uint32_t vertexCount = (uint32_t)mesh.vertices.size();
+    report.before = Analyze(mesh.indices, vertexCount, sizeof(Vector3));
+
+    // Overdraw works on the cache order's clusters, fetch order follows the final index order
+    OptimizeVertexCache(mesh.indices, vertexCount);
+    OptimizeOverdraw(mesh.indices, mesh.vertices);
+    report.verticesRemoved = vertexCount - OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+    report.after = Analyze(mesh.indices, (uint32_t)mesh.vertices.size(), sizeof(Vector3));
+    return report;
+}
+
+void MeshOptimizer::Optimize(JobSystem& jobs, MeshData* meshes, uint32_t meshCount, Report* out_reports)
+{
+    // One mesh per batch, meshes differ too much in size for bigger batches to balance
+    jobs.ParallelFor(meshCount, 1, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            out_reports[i] = Optimize(meshes[i]);
+        }
+    });
+}
+
+void RunMeshOptimizerBenchmark(JobSystem& jobs)
+{
+    const uint32_t copiesPerShape = 8; // Each with its own shuffle, enough meshes to spread over the workers
+
+    // Triangles and vertices in random order, about the worst an exporter could hand over
+    std::mt19937 rng(1234);
+    auto shuffle = [&rng](MeshData& mesh)
+    {
+        const uint32_t triangleCount = (uint32_t)mesh.indices.size() / 3;
+        std::vector<uint32_t> triangles(triangleCount);
+        for (uint32_t i = 0; i < triangleCount; ++i)
+        {
+            triangles[i] = i;
+        }
+        std::shuffle(triangles.begin(), triangles.end(), rng);
+
+        std::vector<uint32_t> vertexOrder(mesh.vertices.size());
+        for (uint32_t i = 0; i < (uint32_t)vertexOrder.size(); ++i)
+        {
+            vertexOrder[i] = i;
+        }
+        std::shuffle(vertexOrder.begin(), vertexOrder.end(), rng);
+
+        std::vector<uint32_t> indices(mesh.indices.size());
+        for (uint32_t i = 0; i < triangleCount; ++i)
+        {
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                indices[i * 3 + corner] = vertexOrder[mesh.indices[triangles[i] * 3 + corner]];
+            }
+        }
+        std::vector<Vector3> vertices(mesh.vertices.size());
+        for (uint32_t i = 0; i < (uint32_t)vertices.size(); ++i)
+        {
+            vertices[vertexOrder[i]] = mesh.vertices[i];
+        }
+        mesh.indices.swap(indices);
+        mesh.vertices.swap(vertices);
+    };
+
+    auto makeGrid = [](uint32_t size)
+    {
+        MeshData mesh{};
+        for (uint32_t y = 0; y <= size; ++y)
+        {
+            for (uint32_t x = 0; x <= size; ++x)
+            {
+                mesh.vertices.push_back({ (float)x / size - 0.5f, (float)y / size - 0.5f, 0.f });
+            }
+        }
+        for (uint32_t y = 0; y < size; ++y)
+        {
+            for (uint32_t x = 0; x < size; ++x)
+            {
+                const uint32_t v = y * (size + 1) + x;
+                mesh.indices.insert(mesh.indices.end(), { v, v + size + 1, v + size + 2, v, v + size + 2, v + 1 });
+            }
+        }
+        return mesh;
+    };
+
+    auto makeSphere = [](uint32_t rings, uint32_t segments)
+    {
+        MeshData mesh{};
+        for (uint32_t ring = 0; ring <= rings; ++ring)
+        {
+            const float phi = 3.14159265f * ring / rings;
+            for (uint32_t segment = 0; segment <= segments; ++segment)
+            {
+                const float theta = 6.2831853f * segment / segments;
+                mesh.vertices.push_back({ std::sin(phi) * std::cos(theta) * 0.5f, std::cos(phi) * 0.5f, std::sin(phi) * std::sin(theta) * 0.5f });
+            }
+        }
+        for (uint32_t ring = 0; ring < rings; ++ring)
+        {
+            for (uint32_t segment = 0; segment < segments; ++segment)
+            {
+                const uint32_t v = ring * (segments + 1) + segment;
+                mesh.indices.insert(mesh.indices.end(), { v, v + segments + 1, v + segments + 2, v, v + segments + 2, v + 1 });
+            }
+        }
+        return mesh;
+    };
+
+    struct Shape
+    {
+        const char* name;
+        MeshData mesh;
+    };
+    std::vector<Shape> shapes;
+    shapes.push_back({ "grid 32x32", makeGrid(32) });
+    shapes.push_back({ "grid 256x256", makeGrid(256) });
+    shapes.push_back({ "sphere 32x64", makeSphere(32, 64) });
+    shapes.push_back({ "sphere 256x512", makeSphere(256, 512) });
+
+    std::vector<MeshData> meshes;
+    for (const Shape& shape : shapes)
+    {
+        for (uint32_t copy = 0; copy < copiesPerShape; ++copy)
+        {
+            meshes.push_back(shape.mesh);
+            shuffle(meshes.back());
+        }
+    }
+    std::vector<MeshData> serialMeshes = meshes;
+
+    LOG("Mesh optimizer benchmark (" + std::to_string(meshes.size()) + " meshes, " + std::to_string(jobs.GetWorkerCount()) + " workers, "
+        + std::to_string(MeshOptimizer::DefaultCacheSize) + " entry FIFO cache)");
+
+    std::vector<MeshOptimizer::Report> reports(meshes.size());
+    auto start = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < serialMeshes.size(); ++i)
+    {
+        reports[i] = MeshOptimizer::Optimize(serialMeshes[i]);
+    }
+    const double serialMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    MeshOptimizer::Optimize(jobs, meshes.data(), (uint32_t)meshes.size(), reports.data());
+    const double parallelMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // Copies of a shape only differ in their shuffle, so their average stands for the shape
+    char line[256];
+    for (size_t shape = 0; shape < shapes.size(); ++shape)
+    {
+        MeshOptimizer::Stats before{};
+        MeshOptimizer::Stats after{};
+        for (uint32_t copy = 0; copy < copiesPerShape; ++copy)
+        {
+            const MeshOptimizer::Report& report = reports[shape * copiesPerShape + copy];
+            before.acmr += report.before.acmr / copiesPerShape;
+            before.atvr += report.before.atvr / copiesPerShape;
+            before.overfetch += report.before.overfetch / copiesPerShape;
+            after.acmr += report.after.acmr / copiesPerShape;
+            after.atvr += report.after.atvr / copiesPerShape;
+            after.overfetch += report.after.overfetch / copiesPerShape;
+        }
+
+        snprintf(line, sizeof(line), "%-15s (%7zu triangles): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overfetch %5.2f -> %.2f",
+            shapes[shape].name, shapes[shape].mesh.indices.size() / 3, before.acmr, after.acmr, before.atvr, after.atvr, before.overfetch, after.overfetch);
+        LOG(line);
+    }
+    snprintf(line, sizeof(line), "Optimizing all: %.2f ms serial, %.2f ms across the job system (%.1fx)", serialMs, parallelMs, serialMs / parallelMs);
+    LOG(line);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mathmatics.h"
+
+class JobSystem;
+struct MeshData;
+
+// Index and vertex reordering for imported meshes, run once at load (or offline). Rendering is unchanged,
+// only the order the GPU sees triangles and vertices in
+namespace MeshOptimizer
+{
+	// FIFO post-transform cache the orders are tuned for and the stats are measured with
+	static constexpr uint32_t DefaultCacheSize = 16;
+
+	struct Stats
+	{
+		float acmr = 0.f;      // Average cache miss ratio: vertex shader runs per triangle, 0.5 at best, 3 at worst
+		float atvr = 0.f;      // Average transform to vertex ratio: vertex shader runs per vertex, 1 at best
+		float overfetch = 0.f; // Vertex bytes read through 64 byte lines per vertex byte, 1 at best
+	};
+
+	struct Report
+	{
+		Stats before{};
+		Stats after{};
+		uint32_t verticesRemoved = 0; // Not referenced by any triangle
+	};
+
+	Stats Analyze(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexSize, uint32_t cacheSize = DefaultCacheSize);
+
+	// Tipsify: fans around recently used vertices, preferring ones that stay in the cache for all their remaining triangles
+	void OptimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = DefaultCacheSize);
+
+	// Reorders clusters of the cache optimized order so outward facing ones go first and occlude the rest.
+	// Clusters split where the cache gets flushed, and wherever the order's ACMR stays within threshold of it
+	void OptimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<Vector3>& vertices, float threshold = 1.05f, uint32_t cacheSize = DefaultCacheSize);
+
+	// Vertices in the order the indices first use them, unused ones are dropped. Returns the new vertex count
+	uint32_t OptimizeVertexFetch(std::vector<Vector3>& vertices, std::vector<uint32_t>& indices);
+
+	// All three in order, returns the stats before and after
+	Report Optimize(MeshData& mesh);
+	void Optimize(JobSystem& jobs, MeshData* meshes, uint32_t meshCount, Report* out_reports); // Meshes in parallel
+}
+
+// Stats before and after on shuffled grids and spheres, and the time to optimize them serially and across jobs, logged
+void RunMeshOptimizerBenchmark(JobSystem& jobs);
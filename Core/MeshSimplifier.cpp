@@ -0,0 +1,424 @@
+#include "MeshSimplifier.h"
+
+#include "Debug.h"
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <string>
+
+static constexpr float BorderWeight = 10.f; // Border planes against face planes, keeps silhouettes of open meshes in place
+
+// Sum of squared distances to a set of planes, weighted by area: v'Av + 2b'v + c with A symmetric
+struct Quadric
+{
+    float a00 = 0.f, a11 = 0.f, a22 = 0.f;
+    float a10 = 0.f, a20 = 0.f, a21 = 0.f;
+    float b0 = 0.f, b1 = 0.f, b2 = 0.f;
+    float c = 0.f;
+    float weight = 0.f;
+};
+
+enum class VertexKind : uint8_t
+{
+    Manifold,
+    Border, // On an edge with one triangle, only moves along the border
+    Locked  // On an edge with more than two triangles
+};
+
+struct Collapse
+{
+    uint32_t source;
+    uint32_t target;
+    float error; // Squared, in normalized units
+};
+
+static void AddPlane(Quadric& q, const Vector3& n, float d, float weight)
+{
+    q.a00 += weight * n.x * n.x;
+    q.a11 += weight * n.y * n.y;
+    q.a22 += weight * n.z * n.z;
+    q.a10 += weight * n.y * n.x;
+    q.a20 += weight * n.z * n.x;
+    q.a21 += weight * n.z * n.y;
+    q.b0 += weight * n.x * d;
+    q.b1 += weight * n.y * d;
+    q.b2 += weight * n.z * d;
+    q.c += weight * d * d;
+    q.weight += weight;
+}
+
+static void Add(Quadric& q, const Quadric& other)
+{
+    q.a00 += other.a00;
+    q.a11 += other.a11;
+    q.a22 += other.a22;
+    q.a10 += other.a10;
+    q.a20 += other.a20;
+    q.a21 += other.a21;
+    q.b0 += other.b0;
+    q.b1 += other.b1;
+    q.b2 += other.b2;
+    q.c += other.c;
+    q.weight += other.weight;
+}
+
+// Weighted mean squared distance of v to the planes
+static float Evaluate(const Quadric& q, const Vector3& v)
+{
+    const float rx = q.a00 * v.x + q.a10 * v.y + q.a20 * v.z;
+    const float ry = q.a10 * v.x + q.a11 * v.y + q.a21 * v.z;
+    const float rz = q.a20 * v.x + q.a21 * v.y + q.a22 * v.z;
+    const float r = rx * v.x + ry * v.y + rz * v.z + 2.f * (q.b0 * v.x + q.b1 * v.y + q.b2 * v.z) + q.c;
+    return q.weight > 0.f ? std::fabs(r) / q.weight : 0.f;
+}
+
+static Vector3 Subtract(const Vector3& a, const Vector3& b)
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+static Vector3 Cross(const Vector3& a, const Vector3& b)
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+static float Dot(const Vector3& a, const Vector3& b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+    return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+}
+
+float MeshSimplifier::Simplify(std::vector<uint32_t>& indices, const std::vector<Vector3>& vertices, uint32_t targetIndexCount, float maxError,
+    const AttributeStream& attributes)
+{
+    const uint32_t vertexCount = (uint32_t)vertices.size();
+    if (indices.size() <= targetIndexCount || vertexCount == 0)
+        return 0.f;
+
+    // Positions scaled into a unit cube so the quadrics stay well conditioned in floats
+    Vector3 min = vertices[0];
+    Vector3 max = vertices[0];
+    for (const Vector3& vertex : vertices)
+    {
+        min = { std::min(min.x, vertex.x), std::min(min.y, vertex.y), std::min(min.z, vertex.z) };
+        max = { std::max(max.x, vertex.x), std::max(max.y, vertex.y), std::max(max.z, vertex.z) };
+    }
+    const float extent = std::max({ max.x - min.x, max.y - min.y, max.z - min.z });
+    const float scale = extent > 0.f ? 1.f / extent : 1.f;
+    std::vector<Vector3> positions(vertexCount);
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+    {
+        positions[vertex] = { (vertices[vertex].x - min.x) * scale, (vertices[vertex].y - min.y) * scale, (vertices[vertex].z - min.z) * scale };
+    }
+    const float maxErrorSquared = maxError == std::numeric_limits<float>::max() ? maxError : (maxError * scale) * (maxError * scale);
+
+    auto attributeError = [&attributes](uint32_t a, uint32_t b)
+    {
+        float error = 0.f;
+        for (uint32_t i = 0; i < attributes.count; ++i)
+        {
+            const float difference = attributes.values[a * attributes.count + i] - attributes.values[b * attributes.count + i];
+            error += attributes.weights[i] * difference * difference;
+        }
+        return error;
+    };
+
+    // Every triangle's plane goes to its corners, weighted by area
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i < indices.size(); i += 3)
+    {
+        ASSERT(std::max({ indices[i], indices[i + 1], indices[i + 2] }) < vertexCount, "Index out of range in triangle " + std::to_string(i / 3));
+        const Vector3& p0 = positions[indices[i]];
+        Vector3 normal = Cross(Subtract(positions[indices[i + 1]], p0), Subtract(positions[indices[i + 2]], p0));
+        const float area = std::sqrt(Dot(normal, normal));
+        if (area == 0.f)
+            continue;
+
+        normal = { normal.x / area, normal.y / area, normal.z / area };
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            AddPlane(quadrics[indices[i + corner]], normal, -Dot(normal, p0), area);
+        }
+    }
+
+    std::vector<uint64_t> edges;
+    std::vector<VertexKind> kinds(vertexCount);
+    std::vector<uint32_t> adjacencyStarts(vertexCount + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> remap(vertexCount);
+    std::vector<uint8_t> touched(vertexCount);
+    float resultError = 0.f;
+    bool firstPass = true;
+
+    // Each pass picks the cheapest collapses that don't share a vertex, applies them and rebuilds the index list.
+    // Cheaper than keeping a priority queue and the adjacency up to date through every single collapse
+    while (indices.size() > targetIndexCount)
+    {
+        // Edges with their triangle counts classify the vertices
+        edges.clear();
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            edges.push_back(EdgeKey(indices[i], indices[i + 1]));
+            edges.push_back(EdgeKey(indices[i + 1], indices[i + 2]));
+            edges.push_back(EdgeKey(indices[i + 2], indices[i]));
+        }
+        std::sort(edges.begin(), edges.end());
+
+        std::fill(kinds.begin(), kinds.end(), VertexKind::Manifold);
+        for (size_t begin = 0, end = 0; begin < edges.size(); begin = end)
+        {
+            for (end = begin + 1; end < edges.size() && edges[end] == edges[begin]; ++end) {}
+            const uint32_t a = (uint32_t)(edges[begin] >> 32);
+            const uint32_t b = (uint32_t)edges[begin];
+            const VertexKind kind = end - begin == 1 ? VertexKind::Border : end - begin > 2 ? VertexKind::Locked : VertexKind::Manifold;
+            kinds[a] = std::max(kinds[a], kind);
+            kinds[b] = std::max(kinds[b], kind);
+        }
+
+        // Border planes through each border edge, perpendicular to its triangle. Only once, borders don't change
+        if (firstPass)
+        {
+            for (size_t i = 0; i < indices.size(); i += 3)
+            {
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    const uint32_t a = indices[i + corner];
+                    const uint32_t b = indices[i + (corner + 1) % 3];
+                    const auto range = std::equal_range(edges.begin(), edges.end(), EdgeKey(a, b));
+                    if (range.second - range.first != 1)
+                        continue;
+
+                    const Vector3& p0 = positions[indices[i]];
+                    const Vector3 faceNormal = Cross(Subtract(positions[indices[i + 1]], p0), Subtract(positions[indices[i + 2]], p0));
+                    const Vector3 edge = Subtract(positions[b], positions[a]);
+                    Vector3 normal = Cross(edge, faceNormal);
+                    const float length = std::sqrt(Dot(normal, normal));
+                    if (length == 0.f)
+                        continue;
+
+                    normal = { normal.x / length, normal.y / length, normal.z / length };
+                    const float weight = Dot(edge, edge) * BorderWeight;
+                    AddPlane(quadrics[a], normal, -Dot(normal, positions[a]), weight);
+                    AddPlane(quadrics[b], normal, -Dot(normal, positions[a]), weight);
+                }
+            }
+            firstPass = false;
+        }
+
+        // Triangles around each vertex
+        std::fill(adjacencyStarts.begin(), adjacencyStarts.end(), 0);
+        for (uint32_t index : indices)
+        {
+            ++adjacencyStarts[index + 1];
+        }
+        for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+        {
+            adjacencyStarts[vertex + 1] += adjacencyStarts[vertex];
+        }
+        adjacency.resize(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i)
+        {
+            adjacency[adjacencyStarts[indices[i]]++] = (uint32_t)(i / 3);
+        }
+        for (uint32_t vertex = vertexCount; vertex > 0; --vertex)
+        {
+            adjacencyStarts[vertex] = adjacencyStarts[vertex - 1];
+        }
+        adjacencyStarts[0] = 0;
+
+        // The cheaper direction of every edge that may collapse at all
+        auto canCollapse = [&](uint32_t source, uint32_t target, bool borderEdge)
+        {
+            if (kinds[source] == VertexKind::Manifold)
+                return true;
+            return kinds[source] == VertexKind::Border && borderEdge && kinds[target] != VertexKind::Manifold;
+        };
+        auto collapseError = [&](uint32_t source, uint32_t target)
+        {
+            Quadric q = quadrics[source];
+            Add(q, quadrics[target]);
+            return Evaluate(q, positions[target]) + attributeError(source, target);
+        };
+
+        collapses.clear();
+        for (size_t begin = 0, end = 0; begin < edges.size(); begin = end)
+        {
+            for (end = begin + 1; end < edges.size() && edges[end] == edges[begin]; ++end) {}
+            if (end - begin > 2)
+                continue;
+
+            const uint32_t a = (uint32_t)(edges[begin] >> 32);
+            const uint32_t b = (uint32_t)edges[begin];
+            const bool borderEdge = end - begin == 1;
+            const float errorAB = canCollapse(a, b, borderEdge) ? collapseError(a, b) : std::numeric_limits<float>::infinity();
+            const float errorBA = canCollapse(b, a, borderEdge) ? collapseError(b, a) : std::numeric_limits<float>::infinity();
+            if (errorAB <= errorBA && errorAB <= maxErrorSquared)
+                collapses.push_back({ a, b, errorAB });
+            else if (errorBA < errorAB && errorBA <= maxErrorSquared)
+                collapses.push_back({ b, a, errorBA });
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+        for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+        {
+            remap[vertex] = vertex;
+        }
+        std::fill(touched.begin(), touched.end(), 0);
+
+        // A vertex only takes part in one collapse per pass, so remap is never chained and the adjacency stays valid
+        const uint32_t trianglesToRemove = (uint32_t)(indices.size() - targetIndexCount + 2) / 3;
+        uint32_t trianglesRemoved = 0;
+        uint32_t applied = 0;
+        for (const Collapse& collapse : collapses)
+        {
+            if (trianglesRemoved >= trianglesToRemove)
+                break;
+            if (touched[collapse.source] || touched[collapse.target])
+                continue;
+
+            // Triangles around the source keep their winding or the collapse is off
+            bool flips = false;
+            uint32_t removed = 0;
+            for (uint32_t a = adjacencyStarts[collapse.source]; a < adjacencyStarts[collapse.source + 1] && !flips; ++a)
+            {
+                const uint32_t triangle = adjacency[a];
+                uint32_t corners[3] = { remap[indices[triangle * 3]], remap[indices[triangle * 3 + 1]], remap[indices[triangle * 3 + 2]] };
+                if (corners[0] == collapse.target || corners[1] == collapse.target || corners[2] == collapse.target)
+                {
+                    ++removed;
+                    continue;
+                }
+
+                const Vector3 before = Cross(Subtract(positions[corners[1]], positions[corners[0]]), Subtract(positions[corners[2]], positions[corners[0]]));
+                for (uint32_t& corner : corners)
+                {
+                    if (corner == collapse.source)
+                        corner = collapse.target;
+                }
+                const Vector3 after = Cross(Subtract(positions[corners[1]], positions[corners[0]]), Subtract(positions[corners[2]], positions[corners[0]]));
+                flips = Dot(before, before) > 0.f && Dot(before, after) <= 0.f;
+            }
+            if (flips)
+                continue;
+
+            remap[collapse.source] = collapse.target;
+            touched[collapse.source] = 1;
+            touched[collapse.target] = 1;
+            Add(quadrics[collapse.target], quadrics[collapse.source]);
+            resultError = std::max(resultError, collapse.error);
+            trianglesRemoved += removed;
+            ++applied;
+        }
+
+        if (applied == 0)
+            break;
+
+        // Triangles that lost a corner to a collapse are gone
+        size_t written = 0;
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const uint32_t a = remap[indices[i]];
+            const uint32_t b = remap[indices[i + 1]];
+            const uint32_t c = remap[indices[i + 2]];
+            if (a == b || b == c || c == a)
+                continue;
+            indices[written++] = a;
+            indices[written++] = b;
+            indices[written++] = c;
+        }
+        indices.resize(written);
+    }
+
+    return std::sqrt(resultError) * (extent > 0.f ? extent : 1.f);
+}
+
+void MeshSimplifier::BuildLodChain(const std::vector<uint32_t>& indices, const std::vector<Vector3>& vertices, uint32_t maxLods,
+    std::vector<uint32_t>& out_indices, std::vector<Lod>& out_lods, const AttributeStream& attributes)
+{
+    out_indices = indices;
+    out_lods.assign(1, { 0, (uint32_t)indices.size(), 0.f });
+
+    // Every level starts over from the full mesh, the quadrics then measure the error against it and not the level before
+    std::vector<uint32_t> level;
+    uint32_t previousCount = (uint32_t)indices.size();
+    while (out_lods.size() < std::min(maxLods, MaxLodCount))
+    {
+        const uint32_t target = previousCount / 6 * 3;
+        if (target < 3)
+            break;
+
+        level = indices;
+        const float error = Simplify(level, vertices, target, std::numeric_limits<float>::max(), attributes);
+
+        // Stuck on borders or flips, the next level would cost as much to draw
+        if (level.empty() || level.size() > previousCount * 3 / 4)
+            break;
+
+        MeshOptimizer::OptimizeVertexCache(level, (uint32_t)vertices.size());
+        out_lods.push_back({ (uint32_t)out_indices.size(), (uint32_t)level.size(), std::max(error, out_lods.back().error) });
+        out_indices.insert(out_indices.end(), level.begin(), level.end());
+        previousCount = (uint32_t)level.size();
+    }
+}
+
+void RunLodChainBenchmark()
+{
+    const uint32_t sphereSizes[][2] = { { 32, 64 }, { 128, 256 }, { 256, 512 } }; // Rings, segments
+    const uint32_t runs = 3;
+
+    LOG("LOD chain benchmark (up to " + std::to_string(MeshSimplifier::MaxLodCount) + " levels, best of " + std::to_string(runs) + ")");
+    for (const auto& size : sphereSizes)
+    {
+        const uint32_t rings = size[0];
+        const uint32_t segments = size[1];
+
+        // The LOD benchmark's sphere, it draws the 128x256 one
+        std::vector<Vector3> vertices;
+        std::vector<uint32_t> indices;
+        for (uint32_t ring = 0; ring <= rings; ++ring)
+        {
+            const float phi = 3.14159265f * ring / rings;
+            for (uint32_t segment = 0; segment <= segments; ++segment)
+            {
+                const float theta = 6.2831853f * segment / segments;
+                vertices.push_back({ std::sin(phi) * std::cos(theta) * 0.5f, std::cos(phi) * 0.5f, std::sin(phi) * std::sin(theta) * 0.5f });
+            }
+        }
+        for (uint32_t ring = 0; ring < rings; ++ring)
+        {
+            for (uint32_t segment = 0; segment < segments; ++segment)
+            {
+                const uint32_t v = ring * (segments + 1) + segment;
+                indices.insert(indices.end(), { v, v + segments + 1, v + segments + 2, v, v + segments + 2, v + 1 });
+            }
+        }
+
+        std::vector<uint32_t> lodIndices;
+        std::vector<MeshSimplifier::Lod> lods;
+        double bestMs = 1e30;
+        for (uint32_t run = 0; run < runs; ++run)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            MeshSimplifier::BuildLodChain(indices, vertices, MeshSimplifier::MaxLodCount, lodIndices, lods);
+            bestMs = std::min(bestMs, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        }
+
+        char line[256];
+        snprintf(line, sizeof(line), "sphere %ux%u (%zu triangles): %zu LODs built in %.2f ms", rings, segments, indices.size() / 3, lods.size(), bestMs);
+        LOG(line);
+        for (size_t level = 0; level < lods.size(); ++level)
+        {
+            snprintf(line, sizeof(line), "  LOD %zu: %7u triangles, error %.5f", level, lods[level].indexCount / 3, lods[level].error);
+            LOG(line);
+        }
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mathmatics.h"
+
+// Quadric error edge collapse (Garland-Heckbert) for level of detail chains. Vertices are collapsed into one of
+// their neighbors rather than a new position, so every level reuses the original vertex buffer and only the
+// indices differ
+namespace MeshSimplifier
+{
+	static constexpr uint32_t MaxLodCount = 8;
+
+	// Per-vertex values a collapse shouldn't smear (normals, UVs, colors): count floats per vertex and one weight each.
+	// A collapse costs the weighted squared difference on top of its geometric error
+	struct AttributeStream
+	{
+		const float* values = nullptr;
+		const float* weights = nullptr;
+		uint32_t count = 0;
+	};
+
+	struct Lod
+	{
+		uint32_t firstIndex = 0; // Into the chain's indices
+		uint32_t indexCount = 0;
+		float error = 0.f;       // How far the surface may have moved from the full mesh, in mesh units
+	};
+
+	// Collapses edges until at most targetIndexCount indices are left or the cheapest collapse would move the surface
+	// by more than maxError (mesh units). Border edges only collapse along the border, collapses that flip a triangle
+	// are skipped. Returns the error reached
+	float Simplify(std::vector<uint32_t>& indices, const std::vector<Vector3>& vertices, uint32_t targetIndexCount, float maxError,
+		const AttributeStream& attributes = {});
+
+	// Level 0 is the mesh as it is, each further level aims for half the triangles of the one before, until that stops
+	// working. All levels go into out_indices back to back, each one ordered for the vertex cache
+	void BuildLodChain(const std::vector<uint32_t>& indices, const std::vector<Vector3>& vertices, uint32_t maxLods,
+		std::vector<uint32_t>& out_indices, std::vector<Lod>& out_lods, const AttributeStream& attributes = {});
+}
+
+// Chain build time, triangles and error per level on spheres of a few sizes, logged. The CPU half of the LOD benchmark
+void RunLodChainBenchmark();
@@ -0,0 +1,231 @@
+#include "MeshletBuilder.h"
+
+#include "Debug.h"
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+static constexpr uint32_t NoSlot = UINT32_MAX;
+static constexpr float ConeWeight = 0.5f; // Facing against new vertices when picking the next triangle, 1 new vertex = 1
+
+static Vector3 TriangleNormal(const Vector3& a, const Vector3& b, const Vector3& c)
+{
+    const Vector3 e0 = { b.x - a.x, b.y - a.y, b.z - a.z };
+    const Vector3 e1 = { c.x - a.x, c.y - a.y, c.z - a.z };
+    Vector3 n = { e0.y * e1.z - e0.z * e1.y, e0.z * e1.x - e0.x * e1.z, e0.x * e1.y - e0.y * e1.x };
+    const float length = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+    if (length <= 0.f)
+        return {};
+    return { n.x / length, n.y / length, n.z / length };
+}
+
+void MeshletBuilder::Build(const std::vector<uint32_t>& indices, const std::vector<Vector3>& vertices, Result& out_result)
+{
+    out_result = {};
+    const uint32_t triangleCount = (uint32_t)indices.size() / 3;
+    const uint32_t vertexCount = (uint32_t)vertices.size();
+    if (triangleCount == 0)
+        return;
+
+    // Triangles around each vertex
+    std::vector<uint32_t> adjacencyStarts(vertexCount + 1, 0);
+    for (uint32_t index : indices)
+    {
+        ASSERT(index < vertexCount, "Index " + std::to_string(index) + " out of range");
+        ++adjacencyStarts[index + 1];
+    }
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex)
+    {
+        adjacencyStarts[vertex + 1] += adjacencyStarts[vertex];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> adjacencyFill(adjacencyStarts.begin(), adjacencyStarts.end() - 1);
+    for (uint32_t i = 0; i < (uint32_t)indices.size(); ++i)
+    {
+        adjacency[adjacencyFill[indices[i]]++] = i / 3;
+    }
+
+    std::vector<Vector3> normals(triangleCount);
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle)
+    {
+        normals[triangle] = TriangleNormal(vertices[indices[triangle * 3]], vertices[indices[triangle * 3 + 1]], vertices[indices[triangle * 3 + 2]]);
+    }
+
+    std::vector<uint32_t> slots(vertexCount, NoSlot); // Meshlet vertex of each mesh vertex in the open meshlet
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    Meshlet meshlet{};
+    Vector3 normalSum{};
+    uint32_t cursor = 0;
+
+    auto newVertices = [&](uint32_t triangle)
+    {
+        return (slots[indices[triangle * 3]] == NoSlot ? 1u : 0u)
+            + (slots[indices[triangle * 3 + 1]] == NoSlot ? 1u : 0u)
+            + (slots[indices[triangle * 3 + 2]] == NoSlot ? 1u : 0u);
+    };
+
+    auto flush = [&]()
+    {
+        if (meshlet.triangleCount == 0)
+            return;
+
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+        {
+            slots[out_result.vertices[meshlet.vertexOffset + i]] = NoSlot;
+        }
+        out_result.meshlets.push_back(meshlet);
+        meshlet = {};
+        meshlet.vertexOffset = (uint32_t)out_result.vertices.size();
+        meshlet.triangleOffset = (uint32_t)out_result.triangles.size() / 3;
+        normalSum = {};
+    };
+
+    auto add = [&](uint32_t triangle)
+    {
+        for (uint32_t corner = 0; corner < 3; ++corner)
+        {
+            const uint32_t vertex = indices[triangle * 3 + corner];
+            if (slots[vertex] == NoSlot)
+            {
+                slots[vertex] = meshlet.vertexCount++;
+                out_result.vertices.push_back(vertex);
+            }
+            out_result.triangles.push_back((uint8_t)slots[vertex]);
+        }
+        ++meshlet.triangleCount;
+        normalSum = { normalSum.x + normals[triangle].x, normalSum.y + normals[triangle].y, normalSum.z + normals[triangle].z };
+        emitted[triangle] = 1;
+    };
+
+    // Cheapest triangle that still fits around the given meshlet vertices
+    uint32_t best = UINT32_MAX;
+    float bestScore = 0.f;
+    auto consider = [&](uint32_t vertex, const Vector3& axis)
+    {
+        for (uint32_t a = adjacencyStarts[vertex]; a < adjacencyStarts[vertex + 1]; ++a)
+        {
+            const uint32_t triangle = adjacency[a];
+            if (emitted[triangle])
+                continue;
+
+            const uint32_t extra = newVertices(triangle);
+            if (meshlet.vertexCount + extra > MaxVertices)
+                continue;
+
+            const Vector3& n = normals[triangle];
+            const float score = extra + ConeWeight * (1.f - (n.x * axis.x + n.y * axis.y + n.z * axis.z));
+            if (best == UINT32_MAX || score < bestScore)
+            {
+                best = triangle;
+                bestScore = score;
+            }
+        }
+    };
+
+    uint32_t last = UINT32_MAX;
+    for (uint32_t added = 0; added < triangleCount; ++added)
+    {
+        best = UINT32_MAX;
+        if (last != UINT32_MAX)
+        {
+            const float length = std::sqrt(normalSum.x * normalSum.x + normalSum.y * normalSum.y + normalSum.z * normalSum.z);
+            const Vector3 axis = length > 0.f ? Vector3{ normalSum.x / length, normalSum.y / length, normalSum.z / length } : Vector3{};
+
+            // Around the last triangle first, the whole meshlet border only when that ran dry
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                consider(indices[last * 3 + corner], axis);
+            }
+            for (uint32_t i = 0; i < meshlet.vertexCount && best == UINT32_MAX; ++i)
+            {
+                consider(out_result.vertices[meshlet.vertexOffset + i], axis);
+            }
+        }
+
+        // Nothing connected left: continue with the next triangle in index order
+        if (best == UINT32_MAX)
+        {
+            while (emitted[cursor])
+            {
+                ++cursor;
+            }
+            best = cursor;
+            if (meshlet.vertexCount + newVertices(best) > MaxVertices)
+                flush();
+        }
+
+        add(best);
+        last = best;
+        if (meshlet.triangleCount == MaxTriangles)
+        {
+            flush();
+            last = UINT32_MAX;
+        }
+    }
+    flush();
+
+    out_result.bounds.reserve(out_result.meshlets.size());
+    for (const Meshlet& m : out_result.meshlets)
+    {
+        out_result.bounds.push_back(ComputeBounds(out_result, m, vertices));
+    }
+}
+
+MeshletBuilder::CullBounds MeshletBuilder::ComputeBounds(const Result& result, const Meshlet& meshlet, const std::vector<Vector3>& vertices)
+{
+    CullBounds bounds{};
+    if (meshlet.vertexCount == 0)
+        return bounds;
+
+    // Sphere around the AABB center, like the mesh bounds
+    Vector3 min = vertices[result.vertices[meshlet.vertexOffset]];
+    Vector3 max = min;
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        const Vector3& v = vertices[result.vertices[meshlet.vertexOffset + i]];
+        min = { std::min(min.x, v.x), std::min(min.y, v.y), std::min(min.z, v.z) };
+        max = { std::max(max.x, v.x), std::max(max.y, v.y), std::max(max.z, v.z) };
+    }
+    bounds.center = { (min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f };
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        const Vector3& v = vertices[result.vertices[meshlet.vertexOffset + i]];
+        const float dx = v.x - bounds.center.x;
+        const float dy = v.y - bounds.center.y;
+        const float dz = v.z - bounds.center.z;
+        bounds.radius = std::max(bounds.radius, std::sqrt(dx * dx + dy * dy + dz * dz));
+    }
+
+    // Normal cone: the average normal, opened to the widest triangle. If every normal is within angle t of the axis,
+    // all of them face away from any direction within 90 - t degrees of it, so the cutoff is cos(90 - t) = sin(t)
+    std::vector<Vector3> normals(meshlet.triangleCount);
+    Vector3 axis{};
+    for (uint32_t triangle = 0; triangle < meshlet.triangleCount; ++triangle)
+    {
+        const uint8_t* corners = &result.triangles[(meshlet.triangleOffset + triangle) * 3];
+        normals[triangle] = TriangleNormal(vertices[result.vertices[meshlet.vertexOffset + corners[0]]],
+            vertices[result.vertices[meshlet.vertexOffset + corners[1]]],
+            vertices[result.vertices[meshlet.vertexOffset + corners[2]]]);
+        axis = { axis.x + normals[triangle].x, axis.y + normals[triangle].y, axis.z + normals[triangle].z };
+    }
+    const float length = std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+    if (length <= 0.f)
+        return bounds;
+    bounds.coneAxis = { axis.x / length, axis.y / length, axis.z / length };
+
+    float minDot = 1.f;
+    for (const Vector3& n : normals)
+    {
+        // Degenerate triangles (no normal) never rasterize, they don't widen the cone
+        if (n.x == 0.f && n.y == 0.f && n.z == 0.f)
+            continue;
+        minDot = std::min(minDot, n.x * bounds.coneAxis.x + n.y * bounds.coneAxis.y + n.z * bounds.coneAxis.z);
+    }
+
+    // Close to a hemisphere or wider, there is no direction left it all faces away from
+    if (minDot <= 0.1f)
+        return bounds;
+    bounds.coneCutoff = std::sqrt(1.f - minDot * minDot);
+    return bounds;
+}
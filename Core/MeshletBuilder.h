@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mathmatics.h"
+
+// Splits indexed meshes into small clusters (meshlets) that can be culled on their own, by bounds and by facing,
+// and drawn either from an index buffer the culling fills or directly by mesh shaders
+namespace MeshletBuilder
+{
+	// Per meshlet, within what a mesh shader workgroup can output on any device
+	static constexpr uint32_t MaxVertices = 64;
+	static constexpr uint32_t MaxTriangles = 124;
+
+	struct Meshlet
+	{
+		uint32_t vertexOffset = 0;   // Into Result::vertices
+		uint32_t triangleOffset = 0; // Into Result::triangles, in triangles
+		uint32_t vertexCount = 0;
+		uint32_t triangleCount = 0;
+	};
+
+	// Bounding sphere and normal cone, in mesh units
+	struct CullBounds
+	{
+		Vector3 center{};
+		float radius = 0.f;
+		Vector3 coneAxis{};     // Average facing of the triangles
+		float coneCutoff = 1.f; // Every triangle faces away from a view direction d with dot(d, coneAxis) > coneCutoff, 1 never culls
+	};
+
+	struct Result
+	{
+		std::vector<Meshlet> meshlets{};
+		std::vector<CullBounds> bounds{};    // One per meshlet
+		std::vector<uint32_t> vertices{};    // Mesh vertex of each meshlet vertex
+		std::vector<uint8_t> triangles{};    // Three meshlet vertices per triangle
+	};
+
+	// Grows each meshlet from its first triangle over shared vertices, preferring triangles that add the fewest new
+	// vertices and face the same way as the meshlet so far. Every triangle ends up in exactly one meshlet
+	void Build(const std::vector<uint32_t>& indices, const std::vector<Vector3>& vertices, Result& out_result);
+
+	CullBounds ComputeBounds(const Result& result, const Meshlet& meshlet, const std::vector<Vector3>& vertices);
+}
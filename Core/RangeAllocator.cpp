@@ -0,0 +1,91 @@
+#include "RangeAllocator.h"
+
+#include "Debug.h"
+
+#include <iterator>
+
+void RangeAllocator::Init(uint64_t capacity)
+{
+    m_freeRanges.clear();
+    m_capacity = capacity;
+    m_used = 0;
+
+    if (capacity > 0)
+    {
+        m_freeRanges[0] = capacity;
+    }
+}
+
+void RangeAllocator::Grow(uint64_t newCapacity)
+{
+    ASSERT(newCapacity >= m_capacity, "RangeAllocator can only grow");
+
+    const uint64_t added = newCapacity - m_capacity;
+    if (added == 0)
+        return;
+
+    const uint64_t oldCapacity = m_capacity;
+    m_capacity = newCapacity;
+
+    // The new space is a free range at the end, merge it with a free range that already touches the end
+    m_used += added;
+    Free(oldCapacity, added);
+}
+
+uint64_t RangeAllocator::Allocate(uint64_t size)
+{
+    if (size == 0)
+        return InvalidOffset;
+
+    for (auto it = m_freeRanges.begin(); it != m_freeRanges.end(); ++it)
+    {
+        if (it->second < size)
+            continue;
+
+        const uint64_t offset = it->first;
+        const uint64_t remaining = it->second - size;
+        m_freeRanges.erase(it);
+
+        if (remaining > 0)
+        {
+            m_freeRanges[offset + size] = remaining;
+        }
+
+        m_used += size;
+        return offset;
+    }
+
+    return InvalidOffset;
+}
+
+void RangeAllocator::Free(uint64_t offset, uint64_t size)
+{
+    if (size == 0)
+        return;
+
+    ASSERT(offset + size <= m_capacity, "Freed range is outside of the allocator");
+    ASSERT(size <= m_used, "Freed more than was allocated");
+    m_used -= size;
+
+    auto next = m_freeRanges.lower_bound(offset);
+
+    // Merge with the following free range
+    if (next != m_freeRanges.end() && offset + size == next->first)
+    {
+        size += next->second;
+        next = m_freeRanges.erase(next);
+    }
+
+    // Merge with the preceding free range
+    if (next != m_freeRanges.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += size;
+            return;
+        }
+    }
+
+    m_freeRanges[offset] = size;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+
+// First-fit sub-range allocator over [0, capacity), free neighbours are merged on Free.
+// Units are up to the caller (bytes, vertices, indices...)
+class RangeAllocator
+{
+public:
+	static constexpr uint64_t InvalidOffset = UINT64_MAX;
+
+	void Init(uint64_t capacity);
+	void Grow(uint64_t newCapacity);
+
+	// Returns InvalidOffset if no free range is large enough
+	uint64_t Allocate(uint64_t size);
+	void Free(uint64_t offset, uint64_t size);
+
+	uint64_t GetCapacity() const { return m_capacity; }
+	uint64_t GetUsed() const { return m_used; }
+
+private:
+	std::map<uint64_t, uint64_t> m_freeRanges{}; // offset -> size
+	uint64_t m_capacity = 0;
+	uint64_t m_used = 0;
+};
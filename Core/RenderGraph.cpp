@@ -0,0 +1,840 @@
+#include "RenderGraph.h"
+
+#include "Debug.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    constexpr VkAccessFlags2 WriteAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT
+        | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
+    VkImageAspectFlags GetFormatAspect(VkFormat format)
+    {
+        switch (format)
+        {
+        case VK_FORMAT_D16_UNORM:
+        case VK_FORMAT_X8_D24_UNORM_PACK32:
+        case VK_FORMAT_D32_SFLOAT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT;
+        case VK_FORMAT_D24_UNORM_S8_UINT:
+        case VK_FORMAT_D32_SFLOAT_S8_UINT:
+            return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+        default:
+            return VK_IMAGE_ASPECT_COLOR_BIT;
+        }
+    }
+
+    std::string FormatMegabytes(VkDeviceSize bytes)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.2f MB", bytes / (1024.0 * 1024.0));
+        return text;
+    }
+}
+
+void RenderGraph::Init(const VulkanDispatch& vk, VkDevice device, VkPhysicalDevice gpu, PFN_vkCmdPipelineBarrier2KHR barrier2)
+{
+    m_vk = &vk;
+    m_device = device;
+    m_vkCmdPipelineBarrier2 = barrier2;
+    m_vk->vkGetPhysicalDeviceMemoryProperties(gpu, &m_memoryProperties);
+}
+
+void RenderGraph::Destroy()
+{
+    DestroyTransients();
+    Reset();
+    m_device = nullptr;
+}
+
+void RenderGraph::Reset()
+{
+    m_resources.clear();
+    m_passes.clear();
+    m_order.clear();
+    m_finalBarriers.clear();
+}
+
+RenderGraph::ResourceId RenderGraph::ImportImage(const std::string& name, VkImage image, VkFormat format, uint32_t mipLevels,
+    ResourceUsage initialUsage, ResourceUsage finalUsage, bool keepContents)
+{
+    Resource& resource = m_resources.emplace_back();
+    resource.name = name;
+    resource.isImage = true;
+    resource.imported = true;
+    resource.imageDesc.format = format;
+    resource.imageDesc.mipLevels = mipLevels;
+    resource.aspect = GetFormatAspect(format);
+    resource.initialUsage = initialUsage;
+    resource.finalUsage = finalUsage;
+    resource.keepContents = keepContents;
+    resource.image = image;
+    resource.output = finalUsage != ResourceUsage::None;
+    return (ResourceId)m_resources.size() - 1;
+}
+
+RenderGraph::ResourceId RenderGraph::ImportBuffer(const std::string& name, VkBuffer buffer, ResourceUsage initialUsage, ResourceUsage finalUsage)
+{
+    Resource& resource = m_resources.emplace_back();
+    resource.name = name;
+    resource.imported = true;
+    resource.initialUsage = initialUsage;
+    resource.finalUsage = finalUsage;
+    resource.buffer = buffer;
+    resource.output = finalUsage != ResourceUsage::None;
+    return (ResourceId)m_resources.size() - 1;
+}
+
+RenderGraph::ResourceId RenderGraph::CreateImage(const std::string& name, const ImageDesc& desc)
+{
+    Resource& resource = m_resources.emplace_back();
+    resource.name = name;
+    resource.isImage = true;
+    resource.imageDesc = desc;
+    resource.aspect = GetFormatAspect(desc.format);
+    return (ResourceId)m_resources.size() - 1;
+}
+
+RenderGraph::ResourceId RenderGraph::CreateBuffer(const std::string& name, const BufferDesc& desc)
+{
+    Resource& resource = m_resources.emplace_back();
+    resource.name = name;
+    resource.bufferDesc = desc;
+    return (ResourceId)m_resources.size() - 1;
+}
+
+void RenderGraph::MarkOutput(ResourceId resource)
+{
+    m_resources[resource].output = true;
+}
+
+RenderGraph::PassId RenderGraph::AddPass(const std::string& name, std::function<void(VkCommandBuffer)> execute)
+{
+    Pass& pass = m_passes.emplace_back();
+    pass.name = name;
+    pass.execute = std::move(execute);
+    return (PassId)m_passes.size() - 1;
+}
+
+void RenderGraph::Read(PassId pass, ResourceId resource, ResourceUsage usage)
+{
+    AddAccess(pass, resource, usage, true, false);
+}
+
+void RenderGraph::Write(PassId pass, ResourceId resource, ResourceUsage usage)
+{
+    AddAccess(pass, resource, usage, false, true);
+}
+
+void RenderGraph::ReadWrite(PassId pass, ResourceId resource, ResourceUsage usage)
+{
+    AddAccess(pass, resource, usage, true, true);
+}
+
+void RenderGraph::AddAccess(PassId pass, ResourceId resource, ResourceUsage usage, bool read, bool write)
+{
+    ASSERT(pass < m_passes.size() && resource < m_resources.size(), "Render graph access to an unknown pass or resource");
+    ASSERT(!write || GetUsageInfo(usage, m_resources[resource].aspect).writes, "Render graph write with a read-only usage");
+
+    Access& access = m_passes[pass].accesses.emplace_back();
+    access.resource = resource;
+    access.usage = usage;
+    access.read = read;
+    access.write = write;
+}
+
+void RenderGraph::Compile()
+{
+    CullPasses();
+    OrderPasses();
+    PlaceTransients();
+    BuildBarriers();
+}
+
+void RenderGraph::CullPasses()
+{
+    // Walk backwards from the outputs: a pass survives if a later survivor (or an output) needs something it writes.
+    // A discarding write satisfies the need, so earlier writers of the same resource aren't kept alive through it
+    std::vector<bool> needed(m_resources.size());
+    for (size_t i = 0; i < m_resources.size(); ++i)
+    {
+        needed[i] = m_resources[i].output;
+    }
+
+    for (size_t p = m_passes.size(); p-- > 0;)
+    {
+        Pass& pass = m_passes[p];
+        pass.culled = true;
+        for (const Access& access : pass.accesses)
+        {
+            if (access.write && needed[access.resource])
+                pass.culled = false;
+        }
+        if (pass.culled)
+            continue;
+
+        for (const Access& access : pass.accesses)
+        {
+            if (access.write && !access.read)
+                needed[access.resource] = false;
+        }
+        for (const Access& access : pass.accesses)
+        {
+            if (access.read)
+                needed[access.resource] = true;
+        }
+    }
+}
+
+void RenderGraph::OrderPasses()
+{
+    // Declaration order defines the dependencies (reads see the latest earlier write, writes wait for earlier
+    // reads and writes). Passes run by dependency level, so independent passes end up next to each other
+    std::vector<uint32_t> lastWriter(m_resources.size(), UINT32_MAX);
+    std::vector<std::vector<uint32_t>> readers(m_resources.size());
+
+    m_order.clear();
+    for (uint32_t p = 0; p < m_passes.size(); ++p)
+    {
+        Pass& pass = m_passes[p];
+        if (pass.culled)
+            continue;
+
+        pass.level = 0;
+        for (const Access& access : pass.accesses)
+        {
+            if (lastWriter[access.resource] != UINT32_MAX)
+                pass.level = std::max(pass.level, m_passes[lastWriter[access.resource]].level + 1);
+            if (access.write)
+            {
+                for (uint32_t reader : readers[access.resource])
+                    pass.level = std::max(pass.level, m_passes[reader].level + 1);
+            }
+        }
+        for (const Access& access : pass.accesses)
+        {
+            if (access.write)
+            {
+                lastWriter[access.resource] = p;
+                readers[access.resource].clear();
+            }
+            else
+            {
+                readers[access.resource].push_back(p);
+            }
+        }
+        m_order.push_back(p);
+    }
+
+    std::stable_sort(m_order.begin(), m_order.end(), [&](uint32_t a, uint32_t b) { return m_passes[a].level < m_passes[b].level; });
+}
+
+void RenderGraph::PlaceTransients()
+{
+    for (uint32_t i = 0; i < m_order.size(); ++i)
+    {
+        for (const Access& access : m_passes[m_order[i]].accesses)
+        {
+            Resource& resource = m_resources[access.resource];
+            resource.firstPass = std::min(resource.firstPass, i);
+            resource.lastPass = std::max(resource.lastPass, i);
+        }
+    }
+
+    // Same transients with the same lifetimes as last frame: keep the physical resources
+    const std::string signature = GetTransientSignature();
+    if (signature != m_transientSignature)
+    {
+        DestroyTransients();
+        m_transientSignature = signature;
+        CreateTransients();
+        ++m_transientGeneration;
+    }
+
+    // Hand out the physical resources, in declaration order of the used transients
+    uint32_t transient = 0;
+    for (Resource& resource : m_resources)
+    {
+        if (resource.imported || resource.firstPass == UINT32_MAX)
+            continue;
+
+        if (resource.isImage)
+        {
+            resource.image = m_transientImages[transient];
+            resource.view = m_transientViews[transient];
+        }
+        else
+        {
+            resource.buffer = m_transientBuffers[transient];
+        }
+        resource.size = m_transientSizes[transient];
+
+        for (uint32_t b = 0; b < m_blocks.size(); ++b)
+        {
+            const std::vector<ResourceId>& residents = m_blocks[b].residents;
+            if (std::find(residents.begin(), residents.end(), transient) != residents.end())
+            {
+                resource.block = b;
+            }
+        }
+        ++transient;
+    }
+
+    // Residents are sorted by lifetime, each one waits for the one before it to be done with the memory
+    std::vector<ResourceId> transientIds{};
+    for (ResourceId id = 0; id < m_resources.size(); ++id)
+    {
+        if (!m_resources[id].imported && m_resources[id].firstPass != UINT32_MAX)
+            transientIds.push_back(id);
+    }
+    for (const MemoryBlock& block : m_blocks)
+    {
+        for (size_t r = 1; r < block.residents.size(); ++r)
+        {
+            m_resources[transientIds[block.residents[r]]].aliasPredecessor = transientIds[block.residents[r - 1]];
+        }
+    }
+}
+
+std::string RenderGraph::GetTransientSignature() const
+{
+    std::string signature{};
+    for (const Resource& resource : m_resources)
+    {
+        if (resource.imported || resource.firstPass == UINT32_MAX)
+            continue;
+
+        const ImageDesc& image = resource.imageDesc;
+        signature += resource.isImage
+            ? "I" + std::to_string(image.format) + "," + std::to_string(image.width) + "x" + std::to_string(image.height)
+                + "," + std::to_string(image.mipLevels) + "," + std::to_string(image.samples) + "," + std::to_string(image.usage)
+            : "B" + std::to_string(resource.bufferDesc.size) + "," + std::to_string(resource.bufferDesc.usage);
+        signature += ":" + std::to_string(resource.firstPass) + "-" + std::to_string(resource.lastPass) + ";";
+    }
+    return signature;
+}
+
+void RenderGraph::CreateTransients()
+{
+    std::vector<ResourceId> transientIds{};
+    std::vector<VkMemoryRequirements> requirements{};
+    for (ResourceId id = 0; id < m_resources.size(); ++id)
+    {
+        const Resource& resource = m_resources[id];
+        if (resource.imported || resource.firstPass == UINT32_MAX)
+            continue;
+
+        VkMemoryRequirements& req = requirements.emplace_back();
+        transientIds.push_back(id);
+        if (resource.isImage)
+        {
+            VkImageCreateInfo imageInfo{};
+            imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            imageInfo.imageType = VK_IMAGE_TYPE_2D;
+            imageInfo.format = resource.imageDesc.format;
+            imageInfo.extent = { resource.imageDesc.width, resource.imageDesc.height, 1 };
+            imageInfo.mipLevels = resource.imageDesc.mipLevels;
+            imageInfo.arrayLayers = 1;
+            imageInfo.samples = resource.imageDesc.samples;
+            imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+            imageInfo.usage = resource.imageDesc.usage;
+            imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+            VkImage image = nullptr;
+            VkResult result = m_vk->vkCreateImage(m_device, &imageInfo, nullptr, &image);
+            ASSERT(result == VK_SUCCESS, "Could not create render graph image " + resource.name);
+            m_vk->vkGetImageMemoryRequirements(m_device, image, &req);
+            m_transientImages.push_back(image);
+            m_transientBuffers.push_back(nullptr);
+        }
+        else
+        {
+            VkBufferCreateInfo bufferInfo{};
+            bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            bufferInfo.size = resource.bufferDesc.size;
+            bufferInfo.usage = resource.bufferDesc.usage;
+            bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+            VkBuffer buffer = nullptr;
+            VkResult result = m_vk->vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer);
+            ASSERT(result == VK_SUCCESS, "Could not create render graph buffer " + resource.name);
+            m_vk->vkGetBufferMemoryRequirements(m_device, buffer, &req);
+            m_transientImages.push_back(nullptr);
+            m_transientBuffers.push_back(buffer);
+        }
+    }
+
+    // Largest first, each transient goes into the first block whose residents are all dead (or not born yet)
+    // while it's alive. Everything is bound at offset 0, so a block is as large as its largest resident
+    std::vector<uint32_t> bySize(transientIds.size());
+    for (uint32_t i = 0; i < bySize.size(); ++i)
+        bySize[i] = i;
+    std::stable_sort(bySize.begin(), bySize.end(), [&](uint32_t a, uint32_t b) { return requirements[a].size > requirements[b].size; });
+
+    m_bytesRequested = 0;
+    m_transientSizes.resize(transientIds.size());
+    for (uint32_t transient : bySize)
+    {
+        const Resource& resource = m_resources[transientIds[transient]];
+        const VkMemoryRequirements& req = requirements[transient];
+        m_bytesRequested += req.size;
+        m_transientSizes[transient] = req.size;
+
+        MemoryBlock* target = nullptr;
+        for (MemoryBlock& block : m_blocks)
+        {
+            if ((block.memoryTypeBits & req.memoryTypeBits) == 0)
+                continue;
+
+            const bool overlaps = std::any_of(block.residents.begin(), block.residents.end(), [&](uint32_t other)
+            {
+                const Resource& resident = m_resources[transientIds[other]];
+                return resident.firstPass <= resource.lastPass && resource.firstPass <= resident.lastPass;
+            });
+            if (!overlaps)
+            {
+                target = &block;
+                break;
+            }
+        }
+        if (target == nullptr)
+            target = &m_blocks.emplace_back();
+
+        target->size = std::max(target->size, req.size);
+        target->alignment = std::max(target->alignment, req.alignment);
+        target->memoryTypeBits &= req.memoryTypeBits;
+        target->residents.push_back(transient);
+    }
+
+    m_bytesAllocated = 0;
+    for (MemoryBlock& block : m_blocks)
+    {
+        std::sort(block.residents.begin(), block.residents.end(), [&](uint32_t a, uint32_t b)
+        {
+            return m_resources[transientIds[a]].firstPass < m_resources[transientIds[b]].firstPass;
+        });
+
+        uint32_t memoryType = UINT32_MAX;
+        for (uint32_t i = 0; i < m_memoryProperties.memoryTypeCount && memoryType == UINT32_MAX; ++i)
+        {
+            if ((block.memoryTypeBits & (1u << i)) && (m_memoryProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+                memoryType = i;
+        }
+        ASSERT(memoryType != UINT32_MAX, "No device local memory type for render graph transients");
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = block.size;
+        allocInfo.memoryTypeIndex = memoryType;
+        VkResult result = m_vk->vkAllocateMemory(m_device, &allocInfo, nullptr, &block.memory);
+        ASSERT(result == VK_SUCCESS, "Could not allocate render graph memory");
+        m_bytesAllocated += block.size;
+
+        for (uint32_t transient : block.residents)
+        {
+            if (m_transientImages[transient] != nullptr)
+                m_vk->vkBindImageMemory(m_device, m_transientImages[transient], block.memory, 0);
+            else
+                m_vk->vkBindBufferMemory(m_device, m_transientBuffers[transient], block.memory, 0);
+        }
+    }
+
+    for (uint32_t transient = 0; transient < transientIds.size(); ++transient)
+    {
+        VkImageView view = nullptr;
+        if (m_transientImages[transient] != nullptr)
+        {
+            const Resource& resource = m_resources[transientIds[transient]];
+
+            VkImageViewCreateInfo viewInfo{};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.image = m_transientImages[transient];
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.format = resource.imageDesc.format;
+            viewInfo.subresourceRange.aspectMask = resource.aspect;
+            viewInfo.subresourceRange.levelCount = resource.imageDesc.mipLevels;
+            viewInfo.subresourceRange.layerCount = 1;
+
+            VkResult result = m_vk->vkCreateImageView(m_device, &viewInfo, nullptr, &view);
+            ASSERT(result == VK_SUCCESS, "Could not create render graph image view " + resource.name);
+        }
+        m_transientViews.push_back(view);
+    }
+}
+
+void RenderGraph::DestroyTransients()
+{
+    // Called with the frame's previous submit finished (fence waited before recording)
+    for (VkImageView view : m_transientViews)
+    {
+        if (view != nullptr)
+            m_vk->vkDestroyImageView(m_device, view, nullptr);
+    }
+    for (VkImage image : m_transientImages)
+    {
+        if (image != nullptr)
+            m_vk->vkDestroyImage(m_device, image, nullptr);
+    }
+    for (VkBuffer buffer : m_transientBuffers)
+    {
+        if (buffer != nullptr)
+            m_vk->vkDestroyBuffer(m_device, buffer, nullptr);
+    }
+    for (MemoryBlock& block : m_blocks)
+    {
+        m_vk->vkFreeMemory(m_device, block.memory, nullptr);
+    }
+    m_transientViews.clear();
+    m_transientImages.clear();
+    m_transientBuffers.clear();
+    m_transientSizes.clear();
+    m_blocks.clear();
+    m_transientSignature.clear();
+    m_bytesRequested = 0;
+    m_bytesAllocated = 0;
+}
+
+void RenderGraph::BuildBarriers()
+{
+    std::vector<ResourceState> states(m_resources.size());
+    std::vector<ResourceUsage> lastUsage(m_resources.size(), ResourceUsage::None);
+    for (size_t i = 0; i < m_resources.size(); ++i)
+    {
+        const Resource& resource = m_resources[i];
+        if (!resource.imported)
+            continue;
+
+        const UsageInfo info = GetUsageInfo(resource.initialUsage, resource.aspect);
+        ResourceState& state = states[i];
+        state.writeStages = info.writes ? info.stages : 0;
+        state.writeAccess = info.access & WriteAccessMask;
+        state.readStages = info.writes ? 0 : info.stages;
+        state.layout = resource.keepContents ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+        lastUsage[i] = resource.initialUsage;
+    }
+
+    for (PassId p : m_order)
+    {
+        Pass& pass = m_passes[p];
+        pass.barriers.clear();
+        for (const Access& access : pass.accesses)
+        {
+            const Resource& resource = m_resources[access.resource];
+            ResourceState& state = states[access.resource];
+
+            // First use of aliased memory: the previous resident has to be done with it
+            if (resource.aliasPredecessor != UINT32_MAX && resource.firstPass != UINT32_MAX && m_order[resource.firstPass] == p
+                && lastUsage[access.resource] == ResourceUsage::None)
+            {
+                const ResourceState& previous = states[resource.aliasPredecessor];
+                state.writeStages = previous.writeStages | previous.readStages;
+                state.writeAccess = previous.writeAccess;
+            }
+
+            AddBarrier(pass.barriers, access.resource, state, lastUsage[access.resource], access.usage);
+            lastUsage[access.resource] = access.usage;
+        }
+    }
+
+    m_finalBarriers.clear();
+    for (ResourceId i = 0; i < m_resources.size(); ++i)
+    {
+        if (m_resources[i].imported && m_resources[i].finalUsage != ResourceUsage::None)
+        {
+            AddBarrier(m_finalBarriers, i, states[i], lastUsage[i], m_resources[i].finalUsage);
+        }
+    }
+}
+
+void RenderGraph::AddBarrier(std::vector<Barrier>& barriers, ResourceId resource, ResourceState& state, ResourceUsage from, ResourceUsage to)
+{
+    const Resource& target = m_resources[resource];
+    const UsageInfo info = GetUsageInfo(to, target.aspect);
+    const bool layoutChange = target.isImage && info.layout != state.layout;
+
+    Barrier barrier{};
+    barrier.resource = resource;
+    barrier.from = from;
+    barrier.to = to;
+    barrier.dstStages = info.stages;
+    barrier.dstAccess = info.access;
+    barrier.oldLayout = state.layout;
+    barrier.newLayout = info.layout;
+
+    if (layoutChange || info.writes)
+    {
+        // Writes (and layout transitions) wait for every earlier access
+        barrier.srcStages = state.writeStages | state.readStages;
+        barrier.srcAccess = state.writeAccess;
+        if (layoutChange || barrier.srcStages != 0)
+            barriers.push_back(barrier);
+
+        state.writeStages = info.stages;
+        state.writeAccess = info.access & WriteAccessMask;
+        state.readStages = info.writes ? 0 : info.stages;
+        state.visibleStages = info.writes ? 0 : info.stages;
+        state.visibleAccess = info.writes ? 0 : info.access;
+        if (target.isImage)
+            state.layout = info.layout;
+        return;
+    }
+
+    // Reads only need a barrier when the last write isn't visible to this stage yet
+    if (state.writeStages != 0 && ((info.stages & ~state.visibleStages) || (info.access & ~state.visibleAccess)))
+    {
+        barrier.srcStages = state.writeStages;
+        barrier.srcAccess = state.writeAccess;
+        barriers.push_back(barrier);
+
+        state.visibleStages |= info.stages;
+        state.visibleAccess |= info.access;
+    }
+    state.readStages |= info.stages;
+}
+
+void RenderGraph::Execute(VkCommandBuffer cmd)
+{
+    for (PassId p : m_order)
+    {
+        RecordBarriers(cmd, m_passes[p].barriers);
+        m_passes[p].execute(cmd);
+    }
+    RecordBarriers(cmd, m_finalBarriers);
+}
+
+void RenderGraph::RecordBarriers(VkCommandBuffer cmd, const std::vector<Barrier>& barriers) const
+{
+    if (barriers.empty())
+        return;
+
+    auto getRange = [](const Resource& resource)
+    {
+        VkImageSubresourceRange range{};
+        range.aspectMask = resource.aspect;
+        range.levelCount = resource.imageDesc.mipLevels;
+        range.layerCount = 1;
+        return range;
+    };
+
+    // Everything before a pass goes out in one call
+    if (m_vkCmdPipelineBarrier2 != nullptr)
+    {
+        std::vector<VkImageMemoryBarrier2> imageBarriers{};
+        std::vector<VkBufferMemoryBarrier2> bufferBarriers{};
+        for (const Barrier& barrier : barriers)
+        {
+            const Resource& resource = m_resources[barrier.resource];
+            if (resource.isImage)
+            {
+                VkImageMemoryBarrier2& imageBarrier = imageBarriers.emplace_back();
+                imageBarrier = {};
+                imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+                imageBarrier.srcStageMask = barrier.srcStages;
+                imageBarrier.srcAccessMask = barrier.srcAccess;
+                imageBarrier.dstStageMask = barrier.dstStages;
+                imageBarrier.dstAccessMask = barrier.dstAccess;
+                imageBarrier.oldLayout = barrier.oldLayout;
+                imageBarrier.newLayout = barrier.newLayout;
+                imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                imageBarrier.image = resource.image;
+                imageBarrier.subresourceRange = getRange(resource);
+            }
+            else
+            {
+                VkBufferMemoryBarrier2& bufferBarrier = bufferBarriers.emplace_back();
+                bufferBarrier = {};
+                bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2;
+                bufferBarrier.srcStageMask = barrier.srcStages;
+                bufferBarrier.srcAccessMask = barrier.srcAccess;
+                bufferBarrier.dstStageMask = barrier.dstStages;
+                bufferBarrier.dstAccessMask = barrier.dstAccess;
+                bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                bufferBarrier.buffer = resource.buffer;
+                bufferBarrier.size = VK_WHOLE_SIZE;
+            }
+        }
+
+        VkDependencyInfo dependencyInfo{};
+        dependencyInfo.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+        dependencyInfo.bufferMemoryBarrierCount = (uint32_t)bufferBarriers.size();
+        dependencyInfo.pBufferMemoryBarriers = bufferBarriers.data();
+        dependencyInfo.imageMemoryBarrierCount = (uint32_t)imageBarriers.size();
+        dependencyInfo.pImageMemoryBarriers = imageBarriers.data();
+        m_vkCmdPipelineBarrier2(cmd, &dependencyInfo);
+        return;
+    }
+
+    // Without synchronization2 the stages of the whole batch are merged, all the bits used fit the 32 bit flags
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+    std::vector<VkImageMemoryBarrier> imageBarriers{};
+    std::vector<VkBufferMemoryBarrier> bufferBarriers{};
+    for (const Barrier& barrier : barriers)
+    {
+        const Resource& resource = m_resources[barrier.resource];
+        srcStages |= (VkPipelineStageFlags)barrier.srcStages;
+        dstStages |= (VkPipelineStageFlags)barrier.dstStages;
+        if (resource.isImage)
+        {
+            VkImageMemoryBarrier& imageBarrier = imageBarriers.emplace_back();
+            imageBarrier = {};
+            imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            imageBarrier.srcAccessMask = (VkAccessFlags)barrier.srcAccess;
+            imageBarrier.dstAccessMask = (VkAccessFlags)barrier.dstAccess;
+            imageBarrier.oldLayout = barrier.oldLayout;
+            imageBarrier.newLayout = barrier.newLayout;
+            imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            imageBarrier.image = resource.image;
+            imageBarrier.subresourceRange = getRange(resource);
+        }
+        else
+        {
+            VkBufferMemoryBarrier& bufferBarrier = bufferBarriers.emplace_back();
+            bufferBarrier = {};
+            bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            bufferBarrier.srcAccessMask = (VkAccessFlags)barrier.srcAccess;
+            bufferBarrier.dstAccessMask = (VkAccessFlags)barrier.dstAccess;
+            bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            bufferBarrier.buffer = resource.buffer;
+            bufferBarrier.size = VK_WHOLE_SIZE;
+        }
+    }
+
+    m_vk->vkCmdPipelineBarrier(cmd, srcStages != 0 ? srcStages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dstStages != 0 ? dstStages : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr, (uint32_t)bufferBarriers.size(), bufferBarriers.data(), (uint32_t)imageBarriers.size(), imageBarriers.data());
+}
+
+std::string RenderGraph::Dump() const
+{
+    std::string text = "Render graph: " + std::to_string(m_order.size()) + " passes, "
+        + std::to_string(m_passes.size() - m_order.size()) + " culled\n";
+
+    auto dumpBarriers = [&](const std::vector<Barrier>& barriers)
+    {
+        for (const Barrier& barrier : barriers)
+        {
+            const Resource& resource = m_resources[barrier.resource];
+            text += "      barrier " + resource.name + ": " + GetUsageName(barrier.from) + " -> " + GetUsageName(barrier.to);
+            if (barrier.from == ResourceUsage::None && resource.aliasPredecessor != UINT32_MAX)
+                text += " (memory from " + m_resources[resource.aliasPredecessor].name + ")";
+            text += "\n";
+        }
+    };
+
+    for (uint32_t i = 0; i < m_order.size(); ++i)
+    {
+        const Pass& pass = m_passes[m_order[i]];
+        text += "  " + std::to_string(i) + " " + pass.name + " (level " + std::to_string(pass.level) + ")\n";
+        dumpBarriers(pass.barriers);
+    }
+    if (!m_finalBarriers.empty())
+    {
+        text += "  end of frame\n";
+        dumpBarriers(m_finalBarriers);
+    }
+    for (const Pass& pass : m_passes)
+    {
+        if (pass.culled)
+            text += "  culled: " + pass.name + "\n";
+    }
+
+    const VkDeviceSize saved = m_bytesRequested - m_bytesAllocated;
+    text += "Transients: " + FormatMegabytes(m_bytesRequested) + " requested, " + FormatMegabytes(m_bytesAllocated)
+        + " allocated in " + std::to_string(m_blocks.size()) + " block(s), " + FormatMegabytes(saved) + " saved by aliasing\n";
+    for (const Resource& resource : m_resources)
+    {
+        if (resource.imported || resource.firstPass == UINT32_MAX)
+            continue;
+
+        text += "  " + resource.name + ": block " + std::to_string(resource.block) + " (" + FormatMegabytes(resource.size)
+            + "), passes " + std::to_string(resource.firstPass) + "-" + std::to_string(resource.lastPass) + "\n";
+    }
+    return text;
+}
+
+VkImage RenderGraph::GetImage(ResourceId resource) const
+{
+    return m_resources[resource].image;
+}
+
+VkImageView RenderGraph::GetImageView(ResourceId resource) const
+{
+    return m_resources[resource].view;
+}
+
+VkBuffer RenderGraph::GetBuffer(ResourceId resource) const
+{
+    return m_resources[resource].buffer;
+}
+
+RenderGraph::UsageInfo RenderGraph::GetUsageInfo(ResourceUsage usage, VkImageAspectFlags aspect)
+{
+    const bool depth = (aspect & VK_IMAGE_ASPECT_DEPTH_BIT) != 0;
+
+    UsageInfo info{};
+    switch (usage)
+    {
+    case ResourceUsage::None:
+        break;
+    case ResourceUsage::TransferWrite:
+        info = { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+        break;
+    case ResourceUsage::ComputeRead:
+        info = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT,
+            depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false };
+        break;
+    case ResourceUsage::ComputeReadWrite:
+        info = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true };
+        break;
+    case ResourceUsage::IndirectRead:
+        info = { VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+        break;
+    case ResourceUsage::IndexRead:
+        info = { VK_PIPELINE_STAGE_2_VERTEX_INPUT_BIT, VK_ACCESS_2_INDEX_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED, false };
+        break;
+    case ResourceUsage::MeshShaderReadWrite:
+        info = { VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true };
+        break;
+    case ResourceUsage::ColorAttachment:
+        info = { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+        break;
+    case ResourceUsage::DepthAttachment:
+        info = { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true };
+        break;
+    case ResourceUsage::HostRead:
+        info = { VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL, false };
+        break;
+    case ResourceUsage::Present:
+        info = { VK_PIPELINE_STAGE_2_BOTTOM_OF_PIPE_BIT, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, false };
+        break;
+    }
+    return info;
+}
+
+const char* RenderGraph::GetUsageName(ResourceUsage usage)
+{
+    switch (usage)
+    {
+    case ResourceUsage::None: return "None";
+    case ResourceUsage::TransferWrite: return "TransferWrite";
+    case ResourceUsage::ComputeRead: return "ComputeRead";
+    case ResourceUsage::ComputeReadWrite: return "ComputeReadWrite";
+    case ResourceUsage::IndirectRead: return "IndirectRead";
+    case ResourceUsage::IndexRead: return "IndexRead";
+    case ResourceUsage::MeshShaderReadWrite: return "MeshShaderReadWrite";
+    case ResourceUsage::ColorAttachment: return "ColorAttachment";
+    case ResourceUsage::DepthAttachment: return "DepthAttachment";
+    case ResourceUsage::HostRead: return "HostRead";
+    case ResourceUsage::Present: return "Present";
+    }
+    return "?";
+}
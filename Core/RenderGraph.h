@@ -0,0 +1,210 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "VulkanDispatch.h"
+
+// How a pass touches a resource, picks the stages, access and image layout used for barriers
+enum class ResourceUsage
+{
+	None,             // Not touched yet, contents undefined
+	TransferWrite,
+	ComputeRead,      // Sampled / read-only storage (SHADER_READ_ONLY or DEPTH_STENCIL_READ_ONLY)
+	ComputeReadWrite, // Storage (GENERAL)
+	IndirectRead,
+	IndexRead,
+	MeshShaderReadWrite, // Storage buffers in task shaders
+	ColorAttachment,
+	DepthAttachment,
+	HostRead,         // Read back after the submit's fence
+	Present
+};
+
+// Frame graph: passes declare what they read and write, Compile culls passes nothing depends on,
+// orders the rest, works out the barriers between them and places transient resources, aliasing
+// memory between transients whose lifetimes don't overlap.
+// Rebuilt every frame (Reset, declare, Compile, Execute), physical transients are kept while the layout doesn't change.
+class RenderGraph
+{
+public:
+	using ResourceId = uint32_t;
+	using PassId = uint32_t;
+
+	struct ImageDesc
+	{
+		VkFormat format = VK_FORMAT_UNDEFINED;
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t mipLevels = 1;
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+		VkImageUsageFlags usage = 0;
+	};
+
+	struct BufferDesc
+	{
+		VkDeviceSize size = 0;
+		VkBufferUsageFlags usage = 0;
+	};
+
+	// barrier2 is vkCmdPipelineBarrier2KHR, when null barriers go through vkCmdPipelineBarrier. vk must outlive the graph
+	void Init(const VulkanDispatch& vk, VkDevice device, VkPhysicalDevice gpu, PFN_vkCmdPipelineBarrier2KHR barrier2);
+	void Destroy();
+
+	void Reset();
+
+	// Imported resources are owned by the caller. Their state when the frame starts is initialUsage
+	// (keepContents false: layout undefined), finalUsage (if not None) is applied after the last pass
+	ResourceId ImportImage(const std::string& name, VkImage image, VkFormat format, uint32_t mipLevels,
+		ResourceUsage initialUsage, ResourceUsage finalUsage = ResourceUsage::None, bool keepContents = true);
+	ResourceId ImportBuffer(const std::string& name, VkBuffer buffer, ResourceUsage initialUsage, ResourceUsage finalUsage = ResourceUsage::None);
+
+	// Transient resources only live for the frame, may share memory with others
+	ResourceId CreateImage(const std::string& name, const ImageDesc& desc);
+	ResourceId CreateBuffer(const std::string& name, const BufferDesc& desc);
+
+	// Keeps the passes that write this resource (and what they depend on) from being culled
+	void MarkOutput(ResourceId resource);
+
+	PassId AddPass(const std::string& name, std::function<void(VkCommandBuffer)> execute);
+	void Read(PassId pass, ResourceId resource, ResourceUsage usage);
+	void Write(PassId pass, ResourceId resource, ResourceUsage usage); // Previous contents are discarded
+	void ReadWrite(PassId pass, ResourceId resource, ResourceUsage usage);
+
+	void Compile();
+	void Execute(VkCommandBuffer cmd);
+
+	// Compiled passes, barriers and transient placement, call after Compile
+	std::string Dump() const;
+
+	// Physical handles, transients are only valid after Compile
+	VkImage GetImage(ResourceId resource) const;
+	VkImageView GetImageView(ResourceId resource) const;
+	VkBuffer GetBuffer(ResourceId resource) const;
+
+	// Changes whenever the physical transients are recreated (views and descriptors pointing at them go stale)
+	uint32_t GetTransientGeneration() const { return m_transientGeneration; }
+	VkDeviceSize GetTransientBytesRequested() const { return m_bytesRequested; }
+	VkDeviceSize GetTransientBytesAllocated() const { return m_bytesAllocated; }
+
+private:
+	struct UsageInfo
+	{
+		VkPipelineStageFlags2 stages = 0;
+		VkAccessFlags2 access = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		bool writes = false;
+	};
+
+	// Synchronization state of a resource while walking the compiled passes
+	struct ResourceState
+	{
+		VkPipelineStageFlags2 writeStages = 0;   // Last write (or layout transition)
+		VkAccessFlags2 writeAccess = 0;
+		VkPipelineStageFlags2 readStages = 0;    // Reads since the last write
+		VkPipelineStageFlags2 visibleStages = 0; // Where the last write has been made visible
+		VkAccessFlags2 visibleAccess = 0;
+		VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	struct Resource
+	{
+		std::string name{};
+		bool isImage = false;
+		bool imported = false;
+		bool output = false;
+		ImageDesc imageDesc{};
+		BufferDesc bufferDesc{};
+		VkImageAspectFlags aspect = 0;
+		ResourceUsage initialUsage = ResourceUsage::None;
+		ResourceUsage finalUsage = ResourceUsage::None;
+		bool keepContents = true;
+
+		VkImage image = nullptr;
+		VkImageView view = nullptr;
+		VkBuffer buffer = nullptr;
+
+		// Compile results, transients only
+		uint32_t firstPass = UINT32_MAX; // Execution order
+		uint32_t lastPass = 0;
+		uint32_t block = UINT32_MAX;
+		uint32_t aliasPredecessor = UINT32_MAX; // Previous resource in the same block
+		VkDeviceSize size = 0;                  // Memory requirement
+	};
+
+	struct Access
+	{
+		ResourceId resource = 0;
+		ResourceUsage usage = ResourceUsage::None;
+		bool read = false;
+		bool write = false;
+	};
+
+	struct Barrier
+	{
+		ResourceId resource = 0;
+		ResourceUsage from = ResourceUsage::None;
+		ResourceUsage to = ResourceUsage::None;
+		VkPipelineStageFlags2 srcStages = 0;
+		VkAccessFlags2 srcAccess = 0;
+		VkPipelineStageFlags2 dstStages = 0;
+		VkAccessFlags2 dstAccess = 0;
+		VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		VkImageLayout newLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	};
+
+	struct Pass
+	{
+		std::string name{};
+		std::function<void(VkCommandBuffer)> execute{};
+		std::vector<Access> accesses{};
+		std::vector<Barrier> barriers{}; // Recorded before the pass
+		bool culled = false;
+		uint32_t level = 0;              // Longest dependency chain leading to this pass
+	};
+
+	// One allocation shared by transients with disjoint lifetimes
+	struct MemoryBlock
+	{
+		VkDeviceMemory memory = nullptr;
+		VkDeviceSize size = 0;
+		VkDeviceSize alignment = 1;
+		uint32_t memoryTypeBits = UINT32_MAX;
+		std::vector<uint32_t> residents{}; // Transient ordinals, by first use
+	};
+
+	static UsageInfo GetUsageInfo(ResourceUsage usage, VkImageAspectFlags aspect);
+	static const char* GetUsageName(ResourceUsage usage);
+	void AddAccess(PassId pass, ResourceId resource, ResourceUsage usage, bool read, bool write);
+	void CullPasses();
+	void OrderPasses();
+	void PlaceTransients();
+	void CreateTransients();
+	void DestroyTransients();
+	std::string GetTransientSignature() const;
+	void BuildBarriers();
+	void AddBarrier(std::vector<Barrier>& barriers, ResourceId resource, ResourceState& state, ResourceUsage from, ResourceUsage to);
+	void RecordBarriers(VkCommandBuffer cmd, const std::vector<Barrier>& barriers) const;
+
+	const VulkanDispatch* m_vk = nullptr;
+	VkDevice m_device = nullptr;
+	VkPhysicalDeviceMemoryProperties m_memoryProperties{};
+	PFN_vkCmdPipelineBarrier2KHR m_vkCmdPipelineBarrier2 = nullptr;
+
+	std::vector<Resource> m_resources{};
+	std::vector<Pass> m_passes{};
+	std::vector<PassId> m_order{};             // Surviving passes in execution order
+	std::vector<Barrier> m_finalBarriers{};    // Imports moved to their final usage
+	std::vector<MemoryBlock> m_blocks{};
+	std::string m_transientSignature{};        // Physical transients are rebuilt when this changes
+	std::vector<VkImage> m_transientImages{};  // Kept in sync with the signature, by transient order
+	std::vector<VkImageView> m_transientViews{};
+	std::vector<VkBuffer> m_transientBuffers{};
+	std::vector<VkDeviceSize> m_transientSizes{};
+	uint32_t m_transientGeneration = 0;
+	VkDeviceSize m_bytesRequested = 0;
+	VkDeviceSize m_bytesAllocated = 0;
+};
@@ -3,30 +3,48 @@
 #include "Debug.h"
 
 #include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
 #include <fstream>
+#include <random>
 #include <vector>
 
+#include "BatchMath.h"
 #include "Mathmatics.h"
 
 void Renderer::Init()
 {
+    m_jobs.Init();
     CreateWindow();
     CreateDevice();
     VkFormat swapchainFormat{};
     CreateSwapchain(swapchainFormat);
+    CreateRenderTargets(swapchainFormat);
     CreateRenderPass(swapchainFormat);
+    CreateGeometryPool();
     CreateBuffers();
+    CreateDescriptors();
     CreatePipeline();
+    CreateCullPipeline();
     CreateFramebuffers();
+
+    SetCullMode(CullMode::Gpu);
+
+    if (m_useRenderThread)
+    {
+        m_renderThread = std::thread(&Renderer::RenderThreadMain, this);
+    }
 }
 
 void Renderer::Shutdown()
 {
-    vkDeviceWaitIdle(m_device);
+    StopRenderThread();
+    m_vk.vkDeviceWaitIdle(m_device);
 
     for (VkFramebuffer& framebuffer : m_framebuffers)
     {
-        vkDestroyFramebuffer(m_device, framebuffer, nullptr);
+        m_vk.vkDestroyFramebuffer(m_device, framebuffer, nullptr);
     }
     m_framebuffers.clear();
 
@@ -38,68 +56,191 @@ void Renderer::Shutdown()
 
     for (VkSemaphore& semaphore : m_recycledSemaphores)
     {
-        vkDestroySemaphore(m_device, semaphore, nullptr);
+        m_vk.vkDestroySemaphore(m_device, semaphore, nullptr);
     }
     m_recycledSemaphores.clear();
 
     if (m_graphicsPipeline != nullptr)
     {
-        vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
+        m_vk.vkDestroyPipeline(m_device, m_graphicsPipeline, nullptr);
         m_graphicsPipeline = nullptr;
     }
 
+    for (VkPipeline* pipeline : { &m_instancedPipeline, &m_graphicsEqualPipeline, &m_depthPrepassPipeline })
+    {
+        if (*pipeline != nullptr)
+        {
+            m_vk.vkDestroyPipeline(m_device, *pipeline, nullptr);
+            *pipeline = nullptr;
+        }
+    }
+
+    if (m_cullPipeline != nullptr)
+    {
+        m_vk.vkDestroyPipeline(m_device, m_cullPipeline, nullptr);
+        m_cullPipeline = nullptr;
+    }
+
+    if (m_cullPipelineLayout != nullptr)
+    {
+        m_vk.vkDestroyPipelineLayout(m_device, m_cullPipelineLayout, nullptr);
+        m_cullPipelineLayout = nullptr;
+    }
+
+    for (VkPipeline* pipeline : { &m_clusterCullPipeline, &m_meshShaderPipeline })
+    {
+        if (*pipeline != nullptr)
+        {
+            m_vk.vkDestroyPipeline(m_device, *pipeline, nullptr);
+            *pipeline = nullptr;
+        }
+    }
+
+    for (VkPipelineLayout* layout : { &m_clusterCullPipelineLayout, &m_meshShaderPipelineLayout })
+    {
+        if (*layout != nullptr)
+        {
+            m_vk.vkDestroyPipelineLayout(m_device, *layout, nullptr);
+            *layout = nullptr;
+        }
+    }
+
+    if (m_hizPipeline != nullptr)
+    {
+        m_vk.vkDestroyPipeline(m_device, m_hizPipeline, nullptr);
+        m_hizPipeline = nullptr;
+    }
+
+    if (m_hizPipelineLayout != nullptr)
+    {
+        m_vk.vkDestroyPipelineLayout(m_device, m_hizPipelineLayout, nullptr);
+        m_hizPipelineLayout = nullptr;
+    }
+
+    if (m_pointSampler != nullptr)
+    {
+        m_vk.vkDestroySampler(m_device, m_pointSampler, nullptr);
+        m_pointSampler = nullptr;
+    }
+
     if (m_pipelineLayout != nullptr)
     {
-        vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+        m_vk.vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
         m_pipelineLayout = nullptr;
     }
 
-    if (m_indexBuffer.handle != nullptr)
+    if (m_descriptorPool != nullptr)
+    {
+        m_vk.vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+        m_descriptorPool = nullptr;
+    }
+
+    if (m_descriptorSetLayout != nullptr)
+    {
+        m_vk.vkDestroyDescriptorSetLayout(m_device, m_descriptorSetLayout, nullptr);
+        m_descriptorSetLayout = nullptr;
+    }
+
+    if (m_cullDescriptorSetLayout != nullptr)
+    {
+        m_vk.vkDestroyDescriptorSetLayout(m_device, m_cullDescriptorSetLayout, nullptr);
+        m_cullDescriptorSetLayout = nullptr;
+    }
+
+    if (m_hizDescriptorSetLayout != nullptr)
+    {
+        m_vk.vkDestroyDescriptorSetLayout(m_device, m_hizDescriptorSetLayout, nullptr);
+        m_hizDescriptorSetLayout = nullptr;
+    }
+
+    if (m_meshletDescriptorSetLayout != nullptr)
+    {
+        m_vk.vkDestroyDescriptorSetLayout(m_device, m_meshletDescriptorSetLayout, nullptr);
+        m_meshletDescriptorSetLayout = nullptr;
+    }
+
+    if (m_visibilityBufferMemory != nullptr)
+    {
+        m_vk.vkUnmapMemory(m_device, m_visibilityBuffer.memory);
+        m_visibilityBufferMemory = nullptr;
+    }
+    DestroyBuffer(m_visibilityBuffer);
+    m_visibilityObjectCount = 0;
+
+    if (m_instanceRing.memory != nullptr)
     {
-        vkDestroyBuffer(m_device, m_indexBuffer.handle, nullptr);
-        m_indexBuffer.handle = nullptr;
+        m_vk.vkUnmapMemory(m_device, m_instanceRing.buffer.memory);
+        m_instanceRing.memory = nullptr;
     }
+    DestroyBuffer(m_instanceRing.buffer);
+    m_instanceRing.segmentSize = 0;
 
-    if (m_vertexBuffer.handle != nullptr)
+    RetireUploads(true);
+    for (VkSemaphore semaphore : m_uploadSemaphores)
     {
-        vkDestroyBuffer(m_device, m_vertexBuffer.handle, nullptr);
-        m_vertexBuffer.handle = nullptr;
+        m_vk.vkDestroySemaphore(m_device, semaphore, nullptr);
+    }
+    m_uploadSemaphores.clear();
+    m_uploadAcquires.clear();
+    if (m_transferCmdPool != nullptr)
+    {
+        m_vk.vkDestroyCommandPool(m_device, m_transferCmdPool, nullptr);
+        m_transferCmdPool = nullptr;
     }
 
-    if (m_renderPass != nullptr)
+    m_meshes.clear();
+    DestroyPoolBuffer(m_geometryPool.vertices);
+    DestroyPoolBuffer(m_geometryPool.indices16);
+    DestroyPoolBuffer(m_geometryPool.indices32);
+    DestroyPoolBuffer(m_geometryPool.meshlets);
+    DestroyPoolBuffer(m_geometryPool.meshletVertices);
+    DestroyPoolBuffer(m_geometryPool.meshletTriangles);
+
+    for (VkRenderPass* renderPass : { &m_renderPass, &m_firstPhaseRenderPass, &m_secondPhaseRenderPass })
     {
-        vkDestroyRenderPass(m_device, m_renderPass, nullptr);
-        m_renderPass = nullptr;
+        if (*renderPass != nullptr)
+        {
+            m_vk.vkDestroyRenderPass(m_device, *renderPass, nullptr);
+            *renderPass = nullptr;
+        }
     }
 
     for (VkImageView& imageView : m_imageViews)
     {
-        (vkDestroyImageView(m_device, imageView, nullptr));
+        (m_vk.vkDestroyImageView(m_device, imageView, nullptr));
     }
     m_imageViews.clear();
 
     if (m_swapchain != nullptr)
     {
-        vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
+        m_vk.vkDestroySwapchainKHR(m_device, m_swapchain, nullptr);
         m_swapchain = nullptr;
     }
 
     if (m_surface != nullptr)
     {
-        vkDestroySurfaceKHR(m_vulkan, m_surface, nullptr);
+        m_vk.vkDestroySurfaceKHR(m_vulkan, m_surface, nullptr);
         m_surface = nullptr;
     }
 
     if (m_device != nullptr)
     {
-        vkDestroyDevice(m_device, nullptr);
+        m_vk.vkDestroyDevice(m_device, nullptr);
     }
 
     m_graphicsFamilyIndex = -1;
+    m_presentFamilyIndex = -1;
+    m_transferFamilyIndex = -1;
+    m_computeFamilyIndex = -1;
+    m_pendingVisibilitySemaphore = nullptr;
 
-    vkDestroyInstance(m_vulkan, nullptr);
+    m_vk.vkDestroyInstance(m_vulkan, nullptr);
     glfwDestroyWindow(m_window);
     glfwTerminate();
+
+    // A pending rebuild is a job, it has to be done before the workers go
+    m_objectBvh.FinishRebuild(true);
+    m_jobs.Shutdown();
 }
 
 void Renderer::Run()
@@ -111,556 +252,4065 @@ void Renderer::Run()
     }
 }
 
-VkShaderModule Renderer::LoadShader(const std::filesystem::path& path)
+void Renderer::RunInstancingBenchmark()
 {
-    std::ifstream file(path, std::ios::binary | std::ios::ate);
-    ASSERT(file.is_open(), "Shader file at " + path.generic_string() + " was not found");
+    const uint32_t framesPerStep = 120;
+    const uint32_t maxInstances = 1000000;
 
-    size_t size = file.tellg();
-    file.seekg(std::ios::beg);
+    // Only draw the benchmark instances
+    std::vector<DrawItem> sceneDrawItems = std::move(m_drawItems);
+    m_drawItems.clear();
+    ++m_drawItemsVersion;
 
-    std::vector<uint8_t> buffer(size);
-    file.read((char*)buffer.data(), size);
+    LOG("Instancing benchmark (" + std::to_string(framesPerStep) + " frames per step, includes present wait)");
+    for (uint32_t instanceCount = 1; instanceCount <= maxInstances; instanceCount *= 10)
+    {
+        // Lay the instances out on a square grid covering the screen
+        const uint32_t side = (uint32_t)std::ceil(std::sqrt((double)instanceCount));
+        const float cellSize = 2.f / side;
+        std::vector<InstanceData> instances(instanceCount);
+        for (uint32_t i = 0; i < instanceCount; ++i)
+        {
+            const uint32_t x = i % side;
+            const uint32_t y = i / side;
+            instances[i].position = { -1.f + cellSize * (x + 0.5f), -1.f + cellSize * (y + 0.5f), 0.f };
+            instances[i].scale = cellSize * 0.8f;
+            instances[i].color = VertexCompression::PackUnorm8({ (float)x / side, (float)y / side, 1.f, 1.f });
+        }
 
-    file.close();
+        double frameSeconds = 0.0;
+        double uploadSeconds = 0.0;
+        uint64_t uploadBytes = 0;
+        uint32_t frames = 0;
+        for (; frames < framesPerStep && !glfwWindowShouldClose(m_window); ++frames)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            glfwPollEvents();
+            DrawInstanced(0, instances.data(), instanceCount);
+            Update(1/60.f);
+            auto end = std::chrono::high_resolution_clock::now();
+
+            frameSeconds += std::chrono::duration<double>(end - start).count();
+            const RenderStats stats = GetRenderStats();
+            uploadSeconds += stats.instanceUploadSeconds;
+            uploadBytes += stats.instanceUploadBytes;
+        }
 
-    VkShaderModuleCreateInfo moduleInfo{};
-    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    moduleInfo.codeSize = size;
-    moduleInfo.pCode = (uint32_t*)buffer.data();
+        if (frames == 0)
+            break;
 
-    VkShaderModule module = nullptr;
-    VkResult result = vkCreateShaderModule(m_device, &moduleInfo, nullptr, &module);
-    ASSERT(result == VK_SUCCESS, "Unable to create shader module from " + path.generic_string());
+        char line[256];
+        snprintf(line, sizeof(line), "%8u instances: %8.3f ms/frame, %8.3f MB/frame uploaded at %8.2f GB/s",
+            instanceCount,
+            frameSeconds * 1000.0 / frames,
+            uploadBytes / (1024.0 * 1024.0) / frames,
+            uploadSeconds > 0.0 ? uploadBytes / uploadSeconds / (1024.0 * 1024.0 * 1024.0) : 0.0);
+        LOG(line);
+    }
 
-    return module;
+    m_drawItems = std::move(sceneDrawItems);
+    ++m_drawItemsVersion;
 }
 
-void Renderer::InitPerFrameData(PerFrameData& perFrame)
+void Renderer::RunCullingBenchmark()
 {
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    VkResult result = vkCreateFence(m_device, &fenceInfo, nullptr, &perFrame.queueSubmitFence);
-    ASSERT(result == VK_SUCCESS, "Could not create Queue Submit Fence");
+    const uint32_t framesPerStep = 60;
+    const uint32_t objectCounts[3] = { 10000, 100000, 1000000 };
 
-    VkCommandPoolCreateInfo cmdPoolInfo{};
-    cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
-    cmdPoolInfo.queueFamilyIndex = m_graphicsFamilyIndex;
-    result = vkCreateCommandPool(m_device, &cmdPoolInfo, nullptr, &perFrame.primaryCmdPool);
-    ASSERT(result == VK_SUCCESS, "Could not create primary command pool");
+    std::vector<ObjectData> sceneObjects = std::move(m_objects);
+    std::vector<DrawItem> sceneDrawItems = std::move(m_drawItems);
+    const CullMode sceneCullMode = m_settings.cullMode;
+    const bool sceneOcclusionCulling = m_settings.occlusionCulling;
 
-    VkCommandBufferAllocateInfo cmdBufferInfo{};
-    cmdBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    cmdBufferInfo.commandPool = perFrame.primaryCmdPool;
-    cmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    cmdBufferInfo.commandBufferCount = 1;
-    result = vkAllocateCommandBuffers(m_device, &cmdBufferInfo, &perFrame.primaryCmdBuffer);
+    struct CullStep
+    {
+        CullMode mode;
+        bool occlusion;
+        const char* name;
+    };
+    const CullStep steps[3] =
+    {
+        { CullMode::Cpu, false, "CPU frustum" },
+        { CullMode::Gpu, false, "GPU frustum" },
+        { CullMode::Gpu, true, "GPU frustum + Hi-Z" }
+    };
+
+    // Objects scattered over a 20x20 area, the camera sees 2x2 of it (~1% visible)
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> positionDist(-10.f, 10.f);
+    std::uniform_real_distribution<float> depthDist(0.1f, 0.9f);
+
+    LOG("Culling benchmark (" + std::to_string(framesPerStep) + " frames per step, GPU time from timestamps)");
+    for (uint32_t objectCount : objectCounts)
+    {
+        m_objects.resize(objectCount);
+        for (ObjectData& object : m_objects)
+        {
+            object.position = { positionDist(rng), positionDist(rng), depthDist(rng) };
+            object.scale = 0.05f;
+            object.color = { 1.f, 1.f, 1.f, 1.f };
+        }
+        m_drawItems = { { 0, 0, objectCount, 0 } };
+        ++m_drawItemsVersion;
+
+        for (const CullStep& step : steps)
+        {
+            const CullMode mode = step.mode;
+            SetCullMode(mode);
+            SetOcclusionCulling(step.occlusion);
+            if (m_settings.cullMode != mode)
+                continue;
+
+            // Skip the first frames in flight, GPU results are read back a few frames late (one more behind the render thread)
+            const uint32_t warmupFrames = (uint32_t)m_perFrameData.size() + 1;
+            double cullMs = 0.0;
+            double frameMs = 0.0;
+            uint64_t visible = 0;
+            uint64_t occlusionCulled = 0;
+            uint32_t frames = 0;
+            for (uint32_t frame = 0; frame < framesPerStep + warmupFrames && !glfwWindowShouldClose(m_window); ++frame)
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                glfwPollEvents();
+                Update(1/60.f);
+                auto end = std::chrono::high_resolution_clock::now();
+
+                if (frame < warmupFrames)
+                    continue;
+
+                frameMs += std::chrono::duration<double, std::milli>(end - start).count();
+                const CullStats cullStats = GetCullStats();
+                cullMs += mode == CullMode::Cpu ? cullStats.cpuCullMs : cullStats.gpuCullMs;
+                visible += cullStats.visibleObjects;
+                occlusionCulled += cullStats.occlusionCulled;
+                ++frames;
+            }
+
+            if (frames == 0)
+                break;
+
+            char line[256];
+            snprintf(line, sizeof(line), "%8u objects, %-18s: %8.3f ms cull, %8.3f ms/frame, %8llu drawn, %8llu occluded",
+                objectCount,
+                step.name,
+                cullMs / frames,
+                frameMs / frames,
+                (unsigned long long)(visible / frames),
+                (unsigned long long)(occlusionCulled / frames));
+            LOG(line);
+        }
+    }
+
+    m_objects = std::move(sceneObjects);
+    m_drawItems = std::move(sceneDrawItems);
+    ++m_drawItemsVersion;
+    SetCullMode(sceneCullMode);
+    SetOcclusionCulling(sceneOcclusionCulling);
 }
 
-void Renderer::CreateWindow()
+void Renderer::RunPrepassBenchmark()
 {
-    // Initialize GLFW Window
-    glfwInit();
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+    const uint32_t framesPerStep = 120;
+    const uint32_t quadCount = 512;
+    const uint32_t quadMesh = 1;
+
+    std::vector<ObjectData> sceneObjects = std::move(m_objects);
+    std::vector<DrawItem> sceneDrawItems = std::move(m_drawItems);
+    const CullMode sceneCullMode = m_settings.cullMode;
+    const bool sceneDepthPrepass = m_settings.depthPrepass;
+
+    // Large overlapping quads submitted back to front, the worst case for overdraw without a prepass
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> positionDist(-1.f, 1.f);
+    std::uniform_real_distribution<float> scaleDist(0.4f, 0.8f);
+    m_objects.resize(quadCount);
+    for (uint32_t i = 0; i < quadCount; ++i)
+    {
+        const float depth = 0.9f - 0.8f * i / quadCount;
+        m_objects[i].position = { positionDist(rng), positionDist(rng), depth };
+        m_objects[i].scale = scaleDist(rng);
+        m_objects[i].color = { depth, 1.f - depth, 0.5f, 1.f };
+    }
+    m_drawItems = { { quadMesh, 0, quadCount, 0 } };
+    ++m_drawItemsVersion;
 
-    m_window = glfwCreateWindow(m_windowWidth, m_windowHeight, m_windowName.c_str(), nullptr, nullptr);
+    // No culling keeps the submission order fixed
+    SetCullMode(CullMode::None);
 
-    // Create Vulkan Instance
-    VkApplicationInfo appInfo{};
-    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    appInfo.pApplicationName = m_windowName.c_str();
-    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.pEngineName = nullptr;
-    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    if (!m_supportsPipelineStatistics)
+    {
+        LOG("pipelineStatisticsQuery unsupported, fragment counts will read 0");
+    }
 
-    VkInstanceCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-    createInfo.pApplicationInfo = &appInfo;
+    const double pixelCount = (double)m_windowWidth * m_windowHeight;
+    double overdraw[2] = {};
 
-    uint32_t glfwExtensionCount{};
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    createInfo.enabledExtensionCount = glfwExtensionCount;
-    createInfo.ppEnabledExtensionNames = glfwExtensions;
-    createInfo.enabledLayerCount = 0;
+    LOG("Depth prepass benchmark (" + std::to_string(quadCount) + " overlapping quads, " + std::to_string(framesPerStep) + " frames per step)");
+    for (bool prepass : { false, true })
+    {
+        SetDepthPrepass(prepass);
+
+        // Skip the first frames in flight, GPU results are read back a few frames late (one more behind the render thread)
+        const uint32_t warmupFrames = (uint32_t)m_perFrameData.size() + 1;
+        double gpuMs = 0.0;
+        double fragments = 0.0;
+        uint32_t frames = 0;
+        for (uint32_t frame = 0; frame < framesPerStep + warmupFrames && !glfwWindowShouldClose(m_window); ++frame)
+        {
+            glfwPollEvents();
+            Update(1/60.f);
 
-    VkResult result = vkCreateInstance(&createInfo, nullptr, &m_vulkan);
-    ASSERT(result == VK_SUCCESS, "Unable to create Vulkan instance");
-    result = glfwCreateWindowSurface(m_vulkan, m_window, nullptr, &m_surface);
-}
+            if (frame < warmupFrames)
+                continue;
 
-void Renderer::CreateDevice()
-{
-    // Get GPU's (Physical Devices)
-    uint32_t deviceCount{};
-    vkEnumeratePhysicalDevices(m_vulkan, &deviceCount, nullptr); // Just a test
-    ASSERT(deviceCount != 0, "Could not find GPU's with Vulkan support");
+            const FrameStats frameStats = GetRenderStats().frame;
+            gpuMs += frameStats.gpuFrameMs;
+            fragments += (double)frameStats.fragmentInvocations;
+            ++frames;
+        }
 
-    std::vector<VkPhysicalDevice> devices(deviceCount);
-    vkEnumeratePhysicalDevices(m_vulkan, &deviceCount, devices.data());
+        if (frames == 0)
+            break;
+
+        overdraw[prepass ? 1 : 0] = fragments / frames / pixelCount;
 
-    for (VkPhysicalDevice device : devices)
+        char line[256];
+        snprintf(line, sizeof(line), "prepass %-3s: %8.3f ms GPU/frame, %12.0f fragments shaded/frame, %6.2f shaded per pixel",
+            prepass ? "on" : "off",
+            gpuMs / frames,
+            fragments / frames,
+            overdraw[prepass ? 1 : 0]);
+        LOG(line);
+    }
+
+    if (overdraw[1] > 0.0)
     {
-        VkPhysicalDeviceProperties props{};
-        vkGetPhysicalDeviceProperties(device, &props);
-        LOG(std::string("Device found: ") + props.deviceName);
+        char line[128];
+        snprintf(line, sizeof(line), "Fragment shading reduced %.2fx by the prepass", overdraw[0] / overdraw[1]);
+        LOG(line);
     }
-    LOG("Selecting first device");
-    m_gpu = devices[0];
 
-    uint32_t deviceExtensionCount{};
-    vkEnumerateDeviceExtensionProperties(m_gpu, nullptr, &deviceExtensionCount, nullptr);
-    std::vector<VkExtensionProperties> deviceExtensions(deviceExtensionCount);
-    vkEnumerateDeviceExtensionProperties(m_gpu, nullptr, &deviceExtensionCount, deviceExtensions.data());
-    std::vector<const char*> requiredExtensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME };
-    for (const char* req : requiredExtensions)
+    m_objects = std::move(sceneObjects);
+    m_drawItems = std::move(sceneDrawItems);
+    ++m_drawItemsVersion;
+    SetCullMode(sceneCullMode);
+    SetDepthPrepass(sceneDepthPrepass);
+}
+
+void Renderer::RunRecordingBenchmark()
+{
+    const uint32_t framesPerStep = 60;
+    const uint32_t drawCount = 100000;
+    const uint32_t maxThreads = m_jobs.GetWorkerCount();
+
+    std::vector<ObjectData> sceneObjects = std::move(m_objects);
+    std::vector<DrawItem> sceneDrawItems = std::move(m_drawItems);
+    const CullMode sceneCullMode = m_settings.cullMode;
+    const uint32_t sceneRecordThreads = m_settings.recordThreads;
+
+    // One object per draw item and a material each, so no two items share a draw call
+    const uint32_t side = (uint32_t)std::ceil(std::sqrt((double)drawCount));
+    const float cellSize = 2.f / side;
+    m_objects.resize(drawCount);
+    m_drawItems.resize(drawCount);
+    for (uint32_t i = 0; i < drawCount; ++i)
     {
-        ASSERT(std::find_if(deviceExtensions.begin(),
-            deviceExtensions.end(),
-            [=](const VkExtensionProperties& ext) { return strcmp(req, ext.extensionName) == 0; }
-        ) != deviceExtensions.end(), "Required extensions not found: " + std::string(req));
+        const uint32_t x = i % side;
+        const uint32_t y = i / side;
+        m_objects[i].position = { -1.f + cellSize * (x + 0.5f), -1.f + cellSize * (y + 0.5f), 0.5f };
+        m_objects[i].scale = cellSize * 0.4f;
+        m_objects[i].color = { (float)x / side, (float)y / side, 1.f, 1.f };
+        m_drawItems[i] = { 0, i, 1, i };
     }
-    
+    ++m_drawItemsVersion;
+    SetCullMode(CullMode::None);
 
-    // Create Logical Device (interface)
+    std::vector<uint32_t> threadCounts{};
+    for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
 
-    VkDeviceQueueCreateInfo queueCreateInfo{};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = 0;
-    queueCreateInfo.queueCount = 1;
-    float queuePriority = 1.f;
-    queueCreateInfo.pQueuePriorities = &queuePriority;
+    LOG("Recording benchmark (" + std::to_string(drawCount) + " draws, " + std::to_string(framesPerStep) + " frames per step, 1 thread records inline)");
+    double singleThreadMs = 0.0;
+    for (uint32_t threads : threadCounts)
+    {
+        SetRecordThreads(threads);
+
+        // Skip the first frames in flight, they allocate the worker pools and secondaries (one more behind the render thread)
+        const uint32_t warmupFrames = (uint32_t)m_perFrameData.size() + 1;
+        double recordMs = 0.0;
+        double frameMs = 0.0;
+        uint32_t frames = 0;
+        for (uint32_t frame = 0; frame < framesPerStep + warmupFrames && !glfwWindowShouldClose(m_window); ++frame)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            glfwPollEvents();
+            Update(1/60.f);
+            auto end = std::chrono::high_resolution_clock::now();
 
-    VkPhysicalDeviceFeatures deviceFeatures{};
+            if (frame < warmupFrames)
+                continue;
 
-    VkDeviceCreateInfo deviceInfo{};
-    deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceInfo.pQueueCreateInfos = &queueCreateInfo;
-    deviceInfo.queueCreateInfoCount = 1;
-    deviceInfo.pEnabledFeatures = &deviceFeatures;
-    deviceInfo.enabledExtensionCount = (uint32_t)requiredExtensions.size();
-    deviceInfo.ppEnabledExtensionNames = requiredExtensions.data();
+            recordMs += GetRenderStats().sceneRecordMs;
+            frameMs += std::chrono::duration<double, std::milli>(end - start).count();
+            ++frames;
+        }
 
-    VkResult result = vkCreateDevice(m_gpu, &deviceInfo, nullptr, &m_device);
-    ASSERT(result == VK_SUCCESS, "Could not create Vulkan logical device");
+        if (frames == 0)
+            break;
+
+        if (threads == 1)
+            singleThreadMs = recordMs / frames;
 
-    vkGetDeviceQueue(m_device, 0, 0, &m_deviceQueue);
+        char line[256];
+        snprintf(line, sizeof(line), "%3u threads: %8.3f ms recording (%5.2fx), %8.3f ms/frame",
+            threads,
+            recordMs / frames,
+            recordMs > 0.0 ? singleThreadMs * frames / recordMs : 0.0,
+            frameMs / frames);
+        LOG(line);
+    }
+
+    m_objects = std::move(sceneObjects);
+    m_drawItems = std::move(sceneDrawItems);
+    ++m_drawItemsVersion;
+    SetCullMode(sceneCullMode);
+    SetRecordThreads(sceneRecordThreads);
 }
 
-void Renderer::CreateSwapchain(VkFormat& out_swapchainFormat)
+void Renderer::RunDispatchBenchmark()
 {
-    // Query Capabilities
-    VkSurfaceCapabilitiesKHR capabilities{};
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_gpu, m_surface, &capabilities);
+    const uint32_t drawsPerBuffer = 100000;
+    const uint32_t buffersPerRun = 20;
+    const uint32_t runs = 3;
 
-    uint32_t formatCount{};
-    vkGetPhysicalDeviceSurfaceFormatsKHR(m_gpu, m_surface, &formatCount, nullptr); // call with null to get count
-    std::vector<VkSurfaceFormatKHR> formats(formatCount);
-    vkGetPhysicalDeviceSurfaceFormatsKHR(m_gpu, m_surface, &formatCount, formats.data()); // populate
+    WaitForRenderThread();
 
-    uint32_t presentModeCount{};
-    vkGetPhysicalDeviceSurfacePresentModesKHR(m_gpu, m_surface, &presentModeCount, nullptr);
-    std::vector<VkPresentModeKHR> presentModes(presentModeCount);
-    vkGetPhysicalDeviceSurfacePresentModesKHR(m_gpu, m_surface, &presentModeCount, presentModes.data());
+    // Recorded only, never submitted. Zero instance draws keep it valid without any real geometry
+    VkCommandPoolCreateInfo cmdPoolInfo{};
+    cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    cmdPoolInfo.queueFamilyIndex = m_graphicsFamilyIndex;
+    VkCommandPool cmdPool = nullptr;
+    VkResult result = m_vk.vkCreateCommandPool(m_device, &cmdPoolInfo, nullptr, &cmdPool);
+    ASSERT(result == VK_SUCCESS, "Could not create command pool");
 
-    // Select Format and Presentation Mode
-    VkSurfaceFormatKHR surfaceFormat = formats[0]; // default to first if prefered (SRGB) not found;
-    for (const VkSurfaceFormatKHR& format : formats)
+    VkCommandBufferAllocateInfo cmdBufferInfo{};
+    cmdBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmdBufferInfo.commandPool = cmdPool;
+    cmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmdBufferInfo.commandBufferCount = 1;
+    VkCommandBuffer cmd = nullptr;
+    m_vk.vkAllocateCommandBuffers(m_device, &cmdBufferInfo, &cmd);
+
+    struct DispatchPath
     {
-        if (format.format == VK_FORMAT_R8G8B8A8_SRGB && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
-        {
-            surfaceFormat = format;
-            break;
-        }
-    }
-    out_swapchainFormat = surfaceFormat.format; // Carry forward to Render Pass Creation
+        const char* name;
+        PFN_vkCmdPushConstants pushConstants;
+        PFN_vkCmdDrawIndexed drawIndexed;
+    };
+    const DispatchPath paths[2] =
+    {
+        { "loader trampoline", vkCmdPushConstants, vkCmdDrawIndexed },
+        { "device table", m_vk.vkCmdPushConstants, m_vk.vkCmdDrawIndexed }
+    };
 
-    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR; // prefer mailbox/triple buffering (hybrid), fallback to FIFO (aka vsync on) (immediate == vsync off)
-    for (const VkPresentModeKHR& mode : presentModes)
+    VkClearValue clearValues[2]{};
+    VkRenderPassBeginInfo passBeginInfo{};
+    passBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    passBeginInfo.renderPass = m_renderPass;
+    passBeginInfo.framebuffer = m_framebuffers[0];
+    passBeginInfo.renderArea.extent = { m_windowWidth, m_windowHeight };
+    passBeginInfo.clearValueCount = 2;
+    passBeginInfo.pClearValues = clearValues;
+
+    LOG("Dispatch benchmark (" + std::to_string(drawsPerBuffer * buffersPerRun) + " push constant + draw pairs per run, best of " + std::to_string(runs) + ")");
+    double callsPerSecond[2] = {};
+    for (uint32_t run = 0; run < runs; ++run)
     {
-        if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
+        // Alternate the paths so neither gets a warmer cache
+        for (uint32_t pathIndex = 0; pathIndex < 2; ++pathIndex)
         {
-            presentMode = mode;
-            break;
+            const DispatchPath& path = paths[pathIndex];
+            DrawPushConstants pushConstants{};
+            double seconds = 0.0;
+            for (uint32_t buffer = 0; buffer < buffersPerRun; ++buffer)
+            {
+                m_vk.vkResetCommandPool(m_device, cmdPool, 0);
+                VkCommandBufferBeginInfo beginInfo{};
+                beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+                beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+                m_vk.vkBeginCommandBuffer(cmd, &beginInfo);
+                m_vk.vkCmdBeginRenderPass(cmd, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+                m_vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+
+                auto start = std::chrono::high_resolution_clock::now();
+                for (uint32_t draw = 0; draw < drawsPerBuffer; ++draw)
+                {
+                    pushConstants.objectOffset = draw;
+                    path.pushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+                    path.drawIndexed(cmd, 0, 0, 0, 0, 0);
+                }
+                auto end = std::chrono::high_resolution_clock::now();
+                seconds += std::chrono::duration<double>(end - start).count();
+
+                m_vk.vkCmdEndRenderPass(cmd);
+                m_vk.vkEndCommandBuffer(cmd);
+            }
+            callsPerSecond[pathIndex] = std::max(callsPerSecond[pathIndex], 2.0 * drawsPerBuffer * buffersPerRun / seconds);
         }
     }
 
-    // Set swapchain resolution
-    VkExtent2D extent = capabilities.currentExtent;
-    if (capabilities.currentExtent.width == UINT32_MAX)
+    for (uint32_t pathIndex = 0; pathIndex < 2; ++pathIndex)
     {
-        extent.width = std::clamp(m_windowWidth, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-        extent.height = std::clamp(m_windowHeight, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+        char line[256];
+        snprintf(line, sizeof(line), "%-18s: %8.2f M calls/s, %6.2f ns/call",
+            paths[pathIndex].name,
+            callsPerSecond[pathIndex] / 1e6,
+            1e9 / callsPerSecond[pathIndex]);
+        LOG(line);
     }
 
-    // Choose image count (prefer triple buffering)
-    uint32_t imageCount = capabilities.minImageCount + 1;
-    if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount)
+    char line[256];
+    snprintf(line, sizeof(line), "direct calls %.2fx the loader's rate", callsPerSecond[1] / callsPerSecond[0]);
+    LOG(line);
+
+    m_vk.vkDestroyCommandPool(m_device, cmdPool, nullptr);
+}
+
+void Renderer::RunLodBenchmark()
+{
+    const uint32_t framesPerStep = 60;
+    const uint32_t objectCount = 20000;
+    const uint32_t rings = 128;
+    const uint32_t segments = 256;
+
+    std::vector<ObjectData> sceneObjects = std::move(m_objects);
+    std::vector<DrawItem> sceneDrawItems = std::move(m_drawItems);
+    const CullMode sceneCullMode = m_settings.cullMode;
+    const float sceneLodError = m_settings.lodErrorPixels;
+
+    // A dense sphere, far more triangles than a few dozen pixels of it can show
+    MeshData sphere{};
+    for (uint32_t ring = 0; ring <= rings; ++ring)
     {
-        imageCount = capabilities.maxImageCount;
+        const float phi = 3.14159265f * ring / rings;
+        for (uint32_t segment = 0; segment <= segments; ++segment)
+        {
+            const float theta = 6.2831853f * segment / segments;
+            sphere.vertices.push_back({ std::sin(phi) * std::cos(theta) * 0.5f, std::cos(phi) * 0.5f, std::sin(phi) * std::sin(theta) * 0.5f });
+        }
+    }
+    for (uint32_t ring = 0; ring < rings; ++ring)
+    {
+        for (uint32_t segment = 0; segment < segments; ++segment)
+        {
+            const uint32_t v = ring * (segments + 1) + segment;
+            sphere.indices.insert(sphere.indices.end(), { v, v + segments + 1, v + segments + 2, v, v + segments + 2, v + 1 });
+        }
     }
 
-    // Create the swapchain
-    VkSwapchainCreateInfoKHR swapchainInfo{};
-    swapchainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-    swapchainInfo.surface = m_surface;
-    swapchainInfo.minImageCount = imageCount;
-    swapchainInfo.imageFormat = surfaceFormat.format;
-    swapchainInfo.imageColorSpace = surfaceFormat.colorSpace;
-    swapchainInfo.imageExtent = extent;
-    swapchainInfo.imageArrayLayers = 1;
-    swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // specifies that the image can be used to create a VkImageView suitable for use as a color or resolve attachment in a VkFramebuffer.
-    swapchainInfo.preTransform = capabilities.currentTransform;
-    swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR; // indicates the alpha compositing mode to use when this surface is composited together with other surfaces on certain window systems.
-    swapchainInfo.clipped = VK_TRUE;
-    swapchainInfo.oldSwapchain = nullptr;
+    auto start = std::chrono::high_resolution_clock::now();
+    const uint32_t sphereMesh = ImportMesh(sphere);
+    const double importMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
 
+    char line[256];
+    const Mesh& mesh = m_meshes[sphereMesh];
+    snprintf(line, sizeof(line), "LOD benchmark (%u objects, %u LODs built in %.2f ms)", objectCount, mesh.lodCount, importMs);
+    LOG(line);
+    for (uint32_t level = 0; level < mesh.lodCount; ++level)
+    {
+        snprintf(line, sizeof(line), "LOD %u: %7u triangles, error %.5f", level, mesh.lods[level].indexCount / 3, mesh.lods[level].error);
+        LOG(line);
+    }
 
-    uint32_t queueFamilyCount{};
-    vkGetPhysicalDeviceQueueFamilyProperties(m_gpu, &queueFamilyCount, nullptr);
-    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(m_gpu, &queueFamilyCount, queueFamilies.data());
+    // Small spheres over the whole view, each only a few pixels to a few dozen across
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> positionDist(-1.f, 1.f);
+    std::uniform_real_distribution<float> depthDist(0.1f, 0.9f);
+    std::uniform_real_distribution<float> scaleDist(0.005f, 0.05f);
+    m_objects.resize(objectCount);
+    for (ObjectData& object : m_objects)
+    {
+        object.position = { positionDist(rng), positionDist(rng), depthDist(rng) };
+        object.scale = scaleDist(rng);
+        object.color = { 1.f, 1.f, 1.f, 1.f };
+    }
+    m_drawItems = { { sphereMesh, 0, objectCount, 0 } };
+    ++m_drawItemsVersion;
+    SetCullMode(CullMode::Cpu);
 
-    int i = 0;
-    int graphicsFamily = -1;
-    int presentFamily = -1;
-    for (const VkQueueFamilyProperties& queueFamily : queueFamilies)
+    const float lodErrors[3] = { 0.f, 1.f, 4.f };
+    for (float lodError : lodErrors)
     {
-        if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
-            graphicsFamily = i;
+        SetLodError(lodError);
 
-        VkBool32 presentSupport = false;
-        vkGetPhysicalDeviceSurfaceSupportKHR(m_gpu, i, m_surface, &presentSupport);
-        if (presentSupport)
-            presentFamily = i;
-    }
+        const uint32_t warmupFrames = (uint32_t)m_perFrameData.size() + 1;
+        double frameMs = 0.0;
+        uint64_t triangles = 0;
+        uint32_t frames = 0;
+        for (uint32_t frame = 0; frame < framesPerStep + warmupFrames && !glfwWindowShouldClose(m_window); ++frame)
+        {
+            start = std::chrono::high_resolution_clock::now();
+            glfwPollEvents();
+            Update(1/60.f);
+            auto end = std::chrono::high_resolution_clock::now();
 
-    ASSERT(graphicsFamily >= 0, "Graphics family not found");
-    ASSERT(presentFamily >= 0, "Present family not found");
-    m_graphicsFamilyIndex = graphicsFamily;
+            if (frame < warmupFrames)
+                continue;
 
-    // Handle queue family sharing if graphics and present queues differ
-    uint32_t queueFamilyIndices[2] = { graphicsFamily, presentFamily };
-    if (graphicsFamily != presentFamily)
+            frameMs += std::chrono::duration<double, std::milli>(end - start).count();
+            triangles += GetCullStats().drawnTriangles;
+            ++frames;
+        }
+
+        if (frames == 0)
+            break;
+
+        snprintf(line, sizeof(line), "%-18s: %10llu triangles drawn, %8.3f ms/frame",
+            lodError > 0.f ? (std::to_string((int)lodError) + " px error").c_str() : "full detail",
+            (unsigned long long)(triangles / frames),
+            frameMs / frames);
+        LOG(line);
+    }
+
+    m_objects = std::move(sceneObjects);
+    m_drawItems = std::move(sceneDrawItems);
+    ++m_drawItemsVersion;
+    SetCullMode(sceneCullMode);
+    SetLodError(sceneLodError);
+    ReleaseMesh(sphereMesh);
+}
+
+void Renderer::RunClusterBenchmark()
+{
+    const uint32_t framesPerStep = 60;
+    const uint32_t gridSize = 24;
+    const uint32_t rings = 128;
+    const uint32_t segments = 256;
+
+    std::vector<ObjectData> sceneObjects = std::move(m_objects);
+    std::vector<DrawItem> sceneDrawItems = std::move(m_drawItems);
+    const CullMode sceneCullMode = m_settings.cullMode;
+    const float sceneLodError = m_settings.lodErrorPixels;
+    const bool sceneClusterCulling = m_settings.clusterCulling;
+
+    // A dense sphere, half of it always faces away
+    MeshData sphere{};
+    sphere.maxLods = 1;
+    for (uint32_t ring = 0; ring <= rings; ++ring)
+    {
+        const float phi = 3.14159265f * ring / rings;
+        for (uint32_t segment = 0; segment <= segments; ++segment)
+        {
+            const float theta = 6.2831853f * segment / segments;
+            sphere.vertices.push_back({ std::sin(phi) * std::cos(theta) * 0.5f, std::cos(phi) * 0.5f, std::sin(phi) * std::sin(theta) * 0.5f });
+        }
+    }
+    for (uint32_t ring = 0; ring < rings; ++ring)
+    {
+        for (uint32_t segment = 0; segment < segments; ++segment)
+        {
+            const uint32_t v = ring * (segments + 1) + segment;
+            sphere.indices.insert(sphere.indices.end(), { v, v + segments + 1, v + segments + 2, v, v + segments + 2, v + 1 });
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    const uint32_t sphereMesh = ImportMesh(sphere);
+    const double importMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    const Mesh& mesh = m_meshes[sphereMesh];
+    const uint64_t meshTriangles = mesh.lods[0].indexCount / 3;
+    const uint32_t objectCount = gridSize * gridSize;
+
+    char line[256];
+    snprintf(line, sizeof(line), "Cluster benchmark (%u objects, %llu triangles each, %u meshlets of %.1f triangles, imported in %.2f ms)",
+        objectCount, (unsigned long long)meshTriangles, mesh.meshletCount, mesh.meshletCount > 0 ? (double)meshTriangles / mesh.meshletCount : 0.0, importMs);
+    LOG(line);
+
+    // Large spheres on a grid wider than the view, the outer ones straddle the edges or are off screen
+    m_objects.resize(objectCount);
+    for (uint32_t y = 0; y < gridSize; ++y)
+    {
+        for (uint32_t x = 0; x < gridSize; ++x)
+        {
+            ObjectData& object = m_objects[y * gridSize + x];
+            object.position = { -1.5f + 3.f * (x + 0.5f) / gridSize, -1.5f + 3.f * (y + 0.5f) / gridSize, 0.5f };
+            object.scale = 0.25f;
+            object.color = { 1.f, 1.f, 1.f, 1.f };
+        }
+    }
+    m_drawItems = { { sphereMesh, 0, objectCount, 0 } };
+    ++m_drawItemsVersion;
+    SetCullMode(CullMode::Gpu);
+    SetLodError(0.f);
+
+    for (bool clusters : { false, true })
+    {
+        SetClusterCulling(clusters);
+        if (m_settings.cullMode != CullMode::Gpu)
+        {
+            LOG("Cluster benchmark needs GPU culling");
+            break;
+        }
+
+        const uint32_t warmupFrames = (uint32_t)m_perFrameData.size() + 1;
+        double gpuMs = 0.0;
+        uint64_t total = 0;
+        uint64_t drawn = 0;
+        uint64_t coneCulled = 0;
+        uint32_t frames = 0;
+        for (uint32_t frame = 0; frame < framesPerStep + warmupFrames && !glfwWindowShouldClose(m_window); ++frame)
+        {
+            glfwPollEvents();
+            Update(1/60.f);
+
+            if (frame < warmupFrames)
+                continue;
+
+            // Object culling doesn't count triangles, every object it keeps draws the whole mesh
+            const RenderStats stats = GetRenderStats();
+            gpuMs += stats.frame.gpuFrameMs;
+            if (clusters)
+            {
+                total += stats.cull.clusterTriangles;
+                drawn += stats.cull.drawnTriangles;
+                coneCulled += stats.cull.coneCulledTriangles;
+            }
+            else
+            {
+                total += objectCount * meshTriangles;
+                drawn += stats.cull.visibleObjects * meshTriangles;
+            }
+            ++frames;
+        }
+
+        if (frames == 0 || total == 0)
+            break;
+
+        const double frustumPercent = 100.0 * (double)(total - std::min(total, drawn + coneCulled)) / total;
+        const double conePercent = 100.0 * (double)coneCulled / total;
+        snprintf(line, sizeof(line), "%-24s: %10llu triangles drawn, %5.1f%% frustum culled, %5.1f%% backface culled, %8.3f ms GPU",
+            !clusters ? "objects" : m_meshShaderPipeline != nullptr ? "clusters (mesh shaders)" : "clusters (compute)",
+            (unsigned long long)(drawn / frames), frustumPercent, conePercent, gpuMs / frames);
+        LOG(line);
+    }
+
+    m_objects = std::move(sceneObjects);
+    m_drawItems = std::move(sceneDrawItems);
+    ++m_drawItemsVersion;
+    SetCullMode(sceneCullMode);
+    SetLodError(sceneLodError);
+    SetClusterCulling(sceneClusterCulling);
+    ReleaseMesh(sphereMesh);
+}
+
+void Renderer::RunVertexFormatBenchmark()
+{
+    const uint32_t frames = 120;
+    const uint32_t gridSize = 16;
+    const uint32_t rings = 256;
+    const uint32_t segments = 512;
+
+    std::vector<ObjectData> sceneObjects = std::move(m_objects);
+    std::vector<DrawItem> sceneDrawItems = std::move(m_drawItems);
+    const CullMode sceneCullMode = m_settings.cullMode;
+    const float sceneLodError = m_settings.lodErrorPixels;
+    const bool sceneClusterCulling = m_settings.clusterCulling;
+
+    // Dense spheres, small on screen: vertex fetch and shading dominate, not fragments
+    MeshData sphere{};
+    sphere.maxLods = 1;
+    for (uint32_t ring = 0; ring <= rings; ++ring)
+    {
+        const float phi = 3.14159265f * ring / rings;
+        for (uint32_t segment = 0; segment <= segments; ++segment)
+        {
+            const float theta = 6.2831853f * segment / segments;
+            sphere.vertices.push_back({ std::sin(phi) * std::cos(theta) * 0.5f + 3.f, std::cos(phi) * 0.5f - 2.f, std::sin(phi) * std::sin(theta) * 0.5f });
+        }
+    }
+    for (uint32_t ring = 0; ring < rings; ++ring)
+    {
+        for (uint32_t segment = 0; segment < segments; ++segment)
+        {
+            const uint32_t v = ring * (segments + 1) + segment;
+            sphere.indices.insert(sphere.indices.end(), { v, v + segments + 1, v + segments + 2, v, v + segments + 2, v + 1 });
+        }
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "Vertex format benchmark (%u objects, %zu vertices and %zu triangles each)",
+        gridSize * gridSize, sphere.vertices.size(), sphere.indices.size() / 3);
+    LOG(line);
+
+    // Every format on the CPU for size and precision, the pipelines are built for one of them
+    for (VertexCompression::PositionFormat format : { VertexCompression::PositionFormat::Float32, VertexCompression::PositionFormat::Half, VertexCompression::PositionFormat::Snorm16 })
+    {
+        std::vector<uint8_t> data;
+        const VertexCompression::Dequantization dequantization = VertexCompression::EncodePositions(sphere.vertices, format, data);
+        const uint32_t stride = VertexCompression::GetPositionStride(format);
+        float maxError = 0.f;
+        for (size_t i = 0; i < sphere.vertices.size(); ++i)
+        {
+            const Vector3 decoded = VertexCompression::DecodePosition(&data[i * stride], format, dequantization);
+            maxError = std::max({ maxError, std::abs(decoded.x - sphere.vertices[i].x), std::abs(decoded.y - sphere.vertices[i].y), std::abs(decoded.z - sphere.vertices[i].z) });
+        }
+        snprintf(line, sizeof(line), "%-8s: %2u bytes/vertex, %6.2f MB, max error %.2e (mesh 1 unit across)%s",
+            VertexCompression::GetPositionFormatName(format), stride, data.size() / (1024.0 * 1024.0), maxError, format == m_positionFormat ? " (in use)" : "");
+        LOG(line);
+    }
+
+    const uint32_t sphereMesh = ImportMesh(sphere);
+    const uint32_t objectCount = gridSize * gridSize;
+    m_objects.resize(objectCount);
+    for (uint32_t y = 0; y < gridSize; ++y)
+    {
+        for (uint32_t x = 0; x < gridSize; ++x)
+        {
+            // The mesh sits off center, the dequantization offset has to land it back on the grid
+            ObjectData& object = m_objects[y * gridSize + x];
+            object.position = { -0.9f + 1.8f * (x + 0.5f) / gridSize - 3.f * 0.1f, -0.9f + 1.8f * (y + 0.5f) / gridSize + 2.f * 0.1f, 0.5f };
+            object.scale = 0.1f;
+            object.color = { 1.f, 1.f, 1.f, 1.f };
+        }
+    }
+    m_drawItems = { { sphereMesh, 0, objectCount, 0 } };
+    ++m_drawItemsVersion;
+    SetCullMode(CullMode::None);
+    SetLodError(0.f);
+    SetClusterCulling(false);
+
+    const uint32_t warmupFrames = (uint32_t)m_perFrameData.size() + 1;
+    double gpuMs = 0.0;
+    uint32_t measured = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame = 0; frame < frames + warmupFrames && !glfwWindowShouldClose(m_window); ++frame)
+    {
+        if (frame == warmupFrames)
+            start = std::chrono::high_resolution_clock::now();
+
+        glfwPollEvents();
+        Update(1/60.f);
+
+        if (frame < warmupFrames)
+            continue;
+        gpuMs += GetRenderStats().frame.gpuFrameMs;
+        ++measured;
+    }
+    const double frameMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if (measured > 0)
+    {
+        snprintf(line, sizeof(line), "%-8s: %8.3f ms/frame, %8.3f ms GPU (run with --vertex-format float|half|snorm16 to compare)",
+            VertexCompression::GetPositionFormatName(m_positionFormat), frameMs / measured, gpuMs / measured);
+        LOG(line);
+    }
+
+    m_objects = std::move(sceneObjects);
+    m_drawItems = std::move(sceneDrawItems);
+    ++m_drawItemsVersion;
+    SetCullMode(sceneCullMode);
+    SetLodError(sceneLodError);
+    SetClusterCulling(sceneClusterCulling);
+    ReleaseMesh(sphereMesh);
+}
+
+void Renderer::RunAsyncComputeBenchmark()
+{
+    const uint32_t framesPerStep = 120;
+    const uint32_t objectCount = 1000000;
+
+    if (m_computeQueue == m_deviceQueue)
+    {
+        LOG("No compute-only queue family, culling always runs on the graphics queue");
+        return;
+    }
+
+    std::vector<ObjectData> sceneObjects = std::move(m_objects);
+    std::vector<DrawItem> sceneDrawItems = std::move(m_drawItems);
+    const CullMode sceneCullMode = m_settings.cullMode;
+    const bool sceneOcclusionCulling = m_settings.occlusionCulling;
+    const bool sceneAsyncCompute = m_settings.asyncCompute;
+
+    // Same scene as the culling benchmark, large enough for the cull to take a while
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> positionDist(-10.f, 10.f);
+    std::uniform_real_distribution<float> depthDist(0.1f, 0.9f);
+    m_objects.resize(objectCount);
+    for (ObjectData& object : m_objects)
+    {
+        object.position = { positionDist(rng), positionDist(rng), depthDist(rng) };
+        object.scale = 0.05f;
+        object.color = { 1.f, 1.f, 1.f, 1.f };
+    }
+    m_drawItems = { { 0, 0, objectCount, 0 } };
+    ++m_drawItemsVersion;
+    SetCullMode(CullMode::Gpu);
+
+    LOG("Async compute benchmark (" + std::to_string(objectCount) + " objects, " + std::to_string(framesPerStep) + " frames per step)");
+    for (bool occlusion : { false, true })
+    {
+        SetOcclusionCulling(occlusion);
+        for (bool async : { false, true })
+        {
+            SetAsyncCompute(async);
+
+            // Skip the first frames in flight, GPU results are read back a few frames late (one more behind the render thread)
+            const uint32_t warmupFrames = (uint32_t)m_perFrameData.size() + 1;
+            double frameMs = 0.0;
+            double graphicsMs = 0.0;
+            double cullMs = 0.0;
+            double computeMs = 0.0;
+            double overlapMs = 0.0;
+            uint32_t frames = 0;
+            for (uint32_t frame = 0; frame < framesPerStep + warmupFrames && !glfwWindowShouldClose(m_window); ++frame)
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                glfwPollEvents();
+                Update(1/60.f);
+                auto end = std::chrono::high_resolution_clock::now();
+
+                if (frame < warmupFrames)
+                    continue;
+
+                const RenderStats stats = GetRenderStats();
+                frameMs += std::chrono::duration<double, std::milli>(end - start).count();
+                graphicsMs += stats.frame.gpuFrameMs;
+                cullMs += stats.cull.gpuCullMs;
+                computeMs += stats.frame.asyncComputeMs;
+                overlapMs += stats.frame.queueOverlapMs;
+                ++frames;
+            }
+
+            if (frames == 0)
+                break;
+
+            char line[256];
+            snprintf(line, sizeof(line), "%-18s async %-3s: %8.3f ms/frame, %8.3f ms graphics queue, %8.3f ms cull, %8.3f ms on compute queue, %8.3f ms overlapped (%5.1f%%)",
+                occlusion ? "GPU frustum + Hi-Z" : "GPU frustum",
+                async ? "on" : "off",
+                frameMs / frames,
+                graphicsMs / frames,
+                cullMs / frames,
+                computeMs / frames,
+                overlapMs / frames,
+                computeMs > 0.0 ? 100.0 * overlapMs / computeMs : 0.0);
+            LOG(line);
+        }
+    }
+
+    m_objects = std::move(sceneObjects);
+    m_drawItems = std::move(sceneDrawItems);
+    ++m_drawItemsVersion;
+    SetCullMode(sceneCullMode);
+    SetOcclusionCulling(sceneOcclusionCulling);
+    SetAsyncCompute(sceneAsyncCompute);
+}
+
+void Renderer::SetCullMode(CullMode mode)
+{
+    if (mode == CullMode::Gpu && (m_vkCmdDrawIndexedIndirectCount == nullptr || m_cullPipeline == nullptr))
+    {
+        LOG("GPU culling needs VK_KHR_draw_indirect_count, falling back to CPU culling");
+        mode = CullMode::Cpu;
+    }
+
+    // Culled draws select their object through firstInstance
+    if (mode != CullMode::None && !m_supportsIndirectFirstInstance)
+    {
+        LOG("Culling needs drawIndirectFirstInstance, culling disabled");
+        mode = CullMode::None;
+    }
+
+    m_settings.cullMode = mode;
+    ++m_drawItemsVersion;
+}
+
+void Renderer::SetOcclusionCulling(bool enabled)
+{
+    if (enabled && !m_depthSampleable)
+    {
+        LOG("Occlusion culling needs a sampleable depth format, disabled");
+        enabled = false;
+    }
+
+    m_settings.occlusionCulling = enabled;
+    ++m_drawItemsVersion;
+}
+
+void Renderer::SetDepthPrepass(bool enabled)
+{
+    m_settings.depthPrepass = enabled;
+}
+
+void Renderer::SetAsyncCompute(bool enabled)
+{
+    m_settings.asyncCompute = enabled;
+}
+
+void Renderer::SetLodError(float pixels)
+{
+    m_settings.lodErrorPixels = std::max(pixels, 0.f);
+}
+
+void Renderer::SetClusterCulling(bool enabled)
+{
+    m_settings.clusterCulling = enabled;
+    ++m_drawItemsVersion;
+}
+
+void Renderer::SetMsaaSamples(uint32_t samples)
+{
+    ASSERT(m_device == nullptr, "MSAA samples must be set before Init");
+    m_requestedMsaaSamples = samples;
+}
+
+void Renderer::SetPositionFormat(VertexCompression::PositionFormat format)
+{
+    ASSERT(m_device == nullptr, "Position format must be set before Init");
+    m_positionFormat = format;
+}
+
+void Renderer::SetDeviceOverride(const std::string& device)
+{
+    ASSERT(m_device == nullptr, "Device override must be set before Init");
+    m_deviceOverride = device;
+}
+
+void Renderer::SetRenderThread(bool enabled)
+{
+    ASSERT(m_device == nullptr, "Render thread must be set before Init");
+    m_useRenderThread = enabled;
+}
+
+void Renderer::DumpRenderGraph()
+{
+    m_dumpRenderGraph = true;
+}
+
+void Renderer::SetRecordThreads(uint32_t threads)
+{
+    m_settings.recordThreads = std::max(threads, 1u);
+}
+
+uint32_t Renderer::ImportMesh(const MeshData& meshData)
+{
+    ASSERT(!meshData.vertices.empty() && !meshData.indices.empty(), "Cannot import an empty mesh");
+
+    // Every level of detail in one index allocation, full detail first. Built before waiting, the render thread keeps going
+    std::vector<uint32_t> lodIndices;
+    std::vector<MeshSimplifier::Lod> lods;
+    MeshSimplifier::BuildLodChain(meshData.indices, meshData.vertices, std::max(meshData.maxLods, 1u), lodIndices, lods);
+
+    // Clusters of the full detail level, for culling below object granularity
+    MeshletBuilder::Result meshlets{};
+    MeshletBuilder::Build(std::vector<uint32_t>(lodIndices.begin() + lods[0].firstIndex, lodIndices.begin() + lods[0].firstIndex + lods[0].indexCount), meshData.vertices, meshlets);
+
+    // Meshes and the geometry pool are read while recording
+    WaitForRenderThread();
+
+    Mesh mesh{};
+    mesh.vertexCount = (uint32_t)meshData.vertices.size();
+    mesh.indexCount = (uint32_t)meshData.indices.size();
+    mesh.lodIndexCount = (uint32_t)lodIndices.size();
+    mesh.lodCount = (uint32_t)lods.size();
+
+    // Bounds, LODs and meshlets above and below use the imported positions, only the vertex stream is compressed
+    std::vector<uint8_t> positions;
+    mesh.positionDequantization = VertexCompression::EncodePositions(meshData.vertices, m_positionFormat, positions);
+    mesh.vertexOffset = AllocateFromPool(m_geometryPool.vertices, positions.data(), mesh.vertexCount);
+
+    // Bounding sphere around the AABB center, used for culling
+    Vector3 min = meshData.vertices[0];
+    Vector3 max = meshData.vertices[0];
+    for (const Vector3& vertex : meshData.vertices)
+    {
+        min = { std::min(min.x, vertex.x), std::min(min.y, vertex.y), std::min(min.z, vertex.z) };
+        max = { std::max(max.x, vertex.x), std::max(max.y, vertex.y), std::max(max.z, vertex.z) };
+    }
+    mesh.boundsCenter = { (min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f };
+    for (const Vector3& vertex : meshData.vertices)
+    {
+        const float dx = vertex.x - mesh.boundsCenter.x;
+        const float dy = vertex.y - mesh.boundsCenter.y;
+        const float dz = vertex.z - mesh.boundsCenter.z;
+        mesh.boundsRadius = std::max(mesh.boundsRadius, std::sqrt(dx * dx + dy * dy + dz * dz));
+    }
+
+    // Indices are relative to the mesh's vertexOffset, so every index fits in 16 bits when there are
+    // at most 65536 vertices, halving index memory and bandwidth
+    if (meshData.vertices.size() <= 0x10000)
+    {
+        std::vector<uint16_t> narrowIndices(lodIndices.begin(), lodIndices.end());
+        mesh.indexType = VK_INDEX_TYPE_UINT16;
+        mesh.firstIndex = AllocateFromPool(m_geometryPool.indices16, narrowIndices.data(), mesh.lodIndexCount);
+    }
+    else
+    {
+        mesh.indexType = VK_INDEX_TYPE_UINT32;
+        mesh.firstIndex = AllocateFromPool(m_geometryPool.indices32, lodIndices.data(), mesh.lodIndexCount);
+    }
+    for (uint32_t level = 0; level < mesh.lodCount; ++level)
+    {
+        mesh.lods[level] = { mesh.firstIndex + lods[level].firstIndex, lods[level].indexCount, lods[level].error };
+    }
+
+    // Meshlet triangles packed into one uint each, the cluster data points at them by pool offset
+    std::vector<uint32_t> packedTriangles(meshlets.triangles.size() / 3);
+    for (size_t triangle = 0; triangle < packedTriangles.size(); ++triangle)
+    {
+        const uint8_t* corners = &meshlets.triangles[triangle * 3];
+        packedTriangles[triangle] = corners[0] | (corners[1] << 8) | (corners[2] << 16);
+    }
+    mesh.meshletCount = (uint32_t)meshlets.meshlets.size();
+    mesh.meshletVertexCount = (uint32_t)meshlets.vertices.size();
+    mesh.meshletTriangleCount = (uint32_t)packedTriangles.size();
+    mesh.meshletVertexOffset = AllocateFromPool(m_geometryPool.meshletVertices, meshlets.vertices.data(), mesh.meshletVertexCount);
+    mesh.meshletTriangleOffset = AllocateFromPool(m_geometryPool.meshletTriangles, packedTriangles.data(), mesh.meshletTriangleCount);
+
+    std::vector<MeshletCullData> meshletData(mesh.meshletCount);
+    for (uint32_t i = 0; i < mesh.meshletCount; ++i)
+    {
+        const MeshletBuilder::Meshlet& meshlet = meshlets.meshlets[i];
+        const MeshletBuilder::CullBounds& bounds = meshlets.bounds[i];
+        meshletData[i] = { bounds.center, bounds.radius, bounds.coneAxis, bounds.coneCutoff,
+            mesh.meshletVertexOffset + meshlet.vertexOffset, mesh.meshletTriangleOffset + meshlet.triangleOffset, meshlet.vertexCount, meshlet.triangleCount };
+    }
+    mesh.firstMeshlet = AllocateFromPool(m_geometryPool.meshlets, meshletData.data(), mesh.meshletCount);
+
+    // The copies overlap with rendering, the next frame waits for them before drawing
+    SubmitUploads();
+
+    m_meshes.push_back(mesh);
+    return (uint32_t)m_meshes.size() - 1;
+}
+
+void Renderer::OptimizeMeshes(MeshData* meshes, uint32_t meshCount)
+{
+    // The job system is shared with the render thread's culling and recording
+    WaitForRenderThread();
+
+    std::vector<MeshOptimizer::Report> reports(meshCount);
+    auto start = std::chrono::high_resolution_clock::now();
+    MeshOptimizer::Optimize(m_jobs, meshes, meshCount, reports.data());
+    auto end = std::chrono::high_resolution_clock::now();
+
+    for (uint32_t i = 0; i < meshCount; ++i)
+    {
+        const MeshOptimizer::Report& report = reports[i];
+        char line[256];
+        snprintf(line, sizeof(line), "Mesh %u: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, overfetch %.2f -> %.2f, %u unused vertices removed",
+            i, report.before.acmr, report.after.acmr, report.before.atvr, report.after.atvr, report.before.overfetch, report.after.overfetch, report.verticesRemoved);
+        LOG(line);
+    }
+    LOG("Optimized " + std::to_string(meshCount) + " meshes in " + std::to_string(std::chrono::duration<double, std::milli>(end - start).count()) + " ms");
+}
+
+void Renderer::ReleaseMesh(uint32_t meshId)
+{
+    ASSERT(meshId < m_meshes.size(), "Invalid mesh id " + std::to_string(meshId));
+    WaitForRenderThread();
+
+    // Frames the render thread already submitted may still read the geometry on the GPU,
+    // the ranges can only be handed out again once those are done
+    std::vector<VkFence> fences{};
+    for (const PerFrameData& perFrame : m_perFrameData)
+    {
+        if (perFrame.queueSubmitFence != nullptr)
+            fences.push_back(perFrame.queueSubmitFence);
+    }
+    if (!fences.empty())
+        m_vk.vkWaitForFences(m_device, (uint32_t)fences.size(), fences.data(), true, UINT64_MAX);
+
+    // The id stays reserved (empty) so other mesh ids remain valid
+    Mesh& mesh = m_meshes[meshId];
+    PoolBuffer& indexPool = mesh.indexType == VK_INDEX_TYPE_UINT16 ? m_geometryPool.indices16 : m_geometryPool.indices32;
+    m_geometryPool.vertices.ranges.Free(mesh.vertexOffset, mesh.vertexCount);
+    indexPool.ranges.Free(mesh.firstIndex, mesh.lodIndexCount);
+    m_geometryPool.meshlets.ranges.Free(mesh.firstMeshlet, mesh.meshletCount);
+    m_geometryPool.meshletVertices.ranges.Free(mesh.meshletVertexOffset, mesh.meshletVertexCount);
+    m_geometryPool.meshletTriangles.ranges.Free(mesh.meshletTriangleOffset, mesh.meshletTriangleCount);
+    mesh = Mesh{};
+}
+
+void Renderer::DrawInstanced(uint32_t meshId, const InstanceData* instances, uint32_t instanceCount)
+{
+    if (instanceCount == 0)
+        return;
+
+    ASSERT(meshId < m_meshes.size(), "Invalid mesh id " + std::to_string(meshId));
+
+    InstanceBatch batch{};
+    batch.meshId = meshId;
+    batch.firstInstance = (uint32_t)m_instanceData.size();
+    batch.instanceCount = instanceCount;
+    m_instanceBatches.push_back(batch);
+    m_instanceData.insert(m_instanceData.end(), instances, instances + instanceCount);
+}
+
+uint32_t Renderer::AddSceneNode(uint32_t parent, const NodeTransform& local, uint32_t meshId, const Color& color)
+{
+    ASSERT(parent == TransformHierarchy::InvalidNode || parent < m_sceneNodeCount, "Invalid parent scene node " + std::to_string(parent));
+    ASSERT(meshId == TransformHierarchy::NoMesh || meshId < m_meshes.size(), "Invalid mesh id " + std::to_string(meshId));
+
+    // Ids match the render thread's hierarchy, it applies the adds in the same order
+    SceneNodeEdit edit{};
+    edit.type = SceneNodeEdit::Type::Add;
+    edit.node = m_sceneNodeCount++;
+    edit.parent = parent;
+    edit.local = local;
+    edit.meshId = meshId;
+    edit.color = color;
+    m_sceneNodeEdits.push_back(edit);
+    return edit.node;
+}
+
+void Renderer::SetSceneNodeTransform(uint32_t node, const NodeTransform& local)
+{
+    ASSERT(node < m_sceneNodeCount, "Invalid scene node " + std::to_string(node));
+
+    SceneNodeEdit edit{};
+    edit.type = SceneNodeEdit::Type::SetTransform;
+    edit.node = node;
+    edit.local = local;
+    m_sceneNodeEdits.push_back(edit);
+}
+
+void Renderer::ClearSceneNodes()
+{
+    // Earlier edits would only be thrown away
+    m_sceneNodeEdits.clear();
+    SceneNodeEdit edit{};
+    edit.type = SceneNodeEdit::Type::Clear;
+    m_sceneNodeEdits.push_back(edit);
+    m_sceneNodeCount = 0;
+}
+
+VkShaderModule Renderer::LoadShader(const std::filesystem::path& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    ASSERT(file.is_open(), "Shader file at " + path.generic_string() + " was not found");
+
+    size_t size = file.tellg();
+    file.seekg(std::ios::beg);
+
+    std::vector<uint8_t> buffer(size);
+    file.read((char*)buffer.data(), size);
+
+    file.close();
+
+    VkShaderModuleCreateInfo moduleInfo{};
+    moduleInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    moduleInfo.codeSize = size;
+    moduleInfo.pCode = (uint32_t*)buffer.data();
+
+    VkShaderModule module = nullptr;
+    VkResult result = m_vk.vkCreateShaderModule(m_device, &moduleInfo, nullptr, &module);
+    ASSERT(result == VK_SUCCESS, "Unable to create shader module from " + path.generic_string());
+
+    return module;
+}
+
+void Renderer::InitPerFrameData(PerFrameData& perFrame)
+{
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    VkResult result = m_vk.vkCreateFence(m_device, &fenceInfo, nullptr, &perFrame.queueSubmitFence);
+    ASSERT(result == VK_SUCCESS, "Could not create Queue Submit Fence");
+
+    VkCommandPoolCreateInfo cmdPoolInfo{};
+    cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    cmdPoolInfo.queueFamilyIndex = m_graphicsFamilyIndex;
+    result = m_vk.vkCreateCommandPool(m_device, &cmdPoolInfo, nullptr, &perFrame.primaryCmdPool);
+    ASSERT(result == VK_SUCCESS, "Could not create primary command pool");
+
+    VkCommandBufferAllocateInfo cmdBufferInfo{};
+    cmdBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmdBufferInfo.commandPool = perFrame.primaryCmdPool;
+    cmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmdBufferInfo.commandBufferCount = 1;
+    result = m_vk.vkAllocateCommandBuffers(m_device, &cmdBufferInfo, &perFrame.primaryCmdBuffer);
+
+    if (m_computeQueue != m_deviceQueue)
+    {
+        cmdPoolInfo.queueFamilyIndex = m_computeFamilyIndex;
+        result = m_vk.vkCreateCommandPool(m_device, &cmdPoolInfo, nullptr, &perFrame.computeCmdPool);
+        ASSERT(result == VK_SUCCESS, "Could not create compute command pool");
+
+        cmdBufferInfo.commandPool = perFrame.computeCmdPool;
+        result = m_vk.vkAllocateCommandBuffers(m_device, &cmdBufferInfo, &perFrame.computeCmdBuffer);
+        ASSERT(result == VK_SUCCESS, "Could not allocate compute command buffer");
+
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        for (VkSemaphore* semaphore : { &perFrame.computeSemaphore, &perFrame.visibilitySemaphore })
+        {
+            result = m_vk.vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, semaphore);
+            ASSERT(result == VK_SUCCESS, "Could not create async compute semaphore");
+        }
+    }
+
+    perFrame.renderGraph.Init(m_vk, m_device, m_gpu, m_vkCmdPipelineBarrier2);
+
+    if (m_gpuProperties.limits.timestampComputeAndGraphics)
+    {
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        queryPoolInfo.queryCount = 6; // Around each cull dispatch (phase 2 includes the Hi-Z build), then the whole frame
+        result = m_vk.vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &perFrame.timestampQueryPool);
+        ASSERT(result == VK_SUCCESS, "Could not create timestamp query pool");
+    }
+
+    // Fragment shader invocations measure overdraw
+    if (m_supportsPipelineStatistics)
+    {
+        VkQueryPoolCreateInfo queryPoolInfo{};
+        queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        queryPoolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        queryPoolInfo.queryCount = 1;
+        queryPoolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        result = m_vk.vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &perFrame.statisticsQueryPool);
+        ASSERT(result == VK_SUCCESS, "Could not create pipeline statistics query pool");
+    }
+}
+
+void Renderer::CreateWindow()
+{
+    // Initialize GLFW Window
+    glfwInit();
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+
+    m_window = glfwCreateWindow(m_windowWidth, m_windowHeight, m_windowName.c_str(), nullptr, nullptr);
+
+    // Create Vulkan Instance
+    VkApplicationInfo appInfo{};
+    appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    appInfo.pApplicationName = m_windowName.c_str();
+    appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.pEngineName = nullptr;
+    appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+    appInfo.apiVersion = VK_API_VERSION_1_1; // vkGetPhysicalDeviceFeatures2 for the mesh shader query
+
+    VkInstanceCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    createInfo.pApplicationInfo = &appInfo;
+
+    uint32_t glfwExtensionCount{};
+    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+    createInfo.enabledExtensionCount = glfwExtensionCount;
+    createInfo.ppEnabledExtensionNames = glfwExtensions;
+    createInfo.enabledLayerCount = 0;
+
+    VkResult result = vkCreateInstance(&createInfo, nullptr, &m_vulkan);
+    ASSERT(result == VK_SUCCESS, "Unable to create Vulkan instance");
+    m_vk.LoadInstance(m_vulkan);
+    result = glfwCreateWindowSurface(m_vulkan, m_window, nullptr, &m_surface);
+}
+
+Renderer::QueueFamilies Renderer::FindQueueFamilies(VkPhysicalDevice device) const
+{
+    uint32_t queueFamilyCount{};
+    m_vk.vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    m_vk.vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
+
+    QueueFamilies families{};
+    for (uint32_t i = 0; i < queueFamilyCount; ++i)
+    {
+        const VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if (queueFamilies[i].queueCount == 0)
+            continue;
+
+        VkBool32 presentSupport = VK_FALSE;
+        m_vk.vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupport);
+
+        // Prefer a graphics family that can present, one queue does both and the swapchain stays exclusive
+        if ((flags & VK_QUEUE_GRAPHICS_BIT) && (families.graphics < 0 || (presentSupport && families.present != families.graphics)))
+        {
+            families.graphics = (int32_t)i;
+            if (presentSupport)
+                families.present = (int32_t)i;
+        }
+        if (presentSupport && families.present < 0)
+            families.present = (int32_t)i;
+
+        // A compute-only family runs culling while the graphics queue rasterizes, it needs timestamps for the cull stats
+        if ((flags & VK_QUEUE_COMPUTE_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && queueFamilies[i].timestampValidBits > 0 && families.compute < 0)
+            families.compute = (int32_t)i;
+
+        // A transfer-only family is usually backed by the copy engines, staging copies on it run alongside rendering
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) && families.transfer < 0)
+            families.transfer = (int32_t)i;
+    }
+    return families;
+}
+
+int64_t Renderer::ScorePhysicalDevice(VkPhysicalDevice device) const
+{
+    // Hard requirements: presenting to the window and a graphics queue
+    uint32_t extensionCount{};
+    m_vk.vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    m_vk.vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+    const bool hasSwapchain = std::any_of(extensions.begin(), extensions.end(),
+        [](const VkExtensionProperties& ext) { return strcmp(ext.extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME) == 0; });
+
+    const QueueFamilies families = FindQueueFamilies(device);
+    if (!hasSwapchain || families.graphics < 0 || families.present < 0)
+        return -1;
+
+    uint32_t formatCount{};
+    m_vk.vkGetPhysicalDeviceSurfaceFormatsKHR(device, m_surface, &formatCount, nullptr);
+    if (formatCount == 0)
+        return -1;
+
+    // Device type first, then local memory, features with fallbacks only break ties between similar devices
+    VkPhysicalDeviceProperties props{};
+    m_vk.vkGetPhysicalDeviceProperties(device, &props);
+    int64_t typeRank = 0;
+    switch (props.deviceType)
+    {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   typeRank = 4; break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: typeRank = 3; break;
+    case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    typeRank = 2; break;
+    case VK_PHYSICAL_DEVICE_TYPE_CPU:            typeRank = 1; break;
+    default:                                     typeRank = 0; break;
+    }
+
+    VkPhysicalDeviceMemoryProperties memoryProps{};
+    m_vk.vkGetPhysicalDeviceMemoryProperties(device, &memoryProps);
+    VkDeviceSize localMemory = 0;
+    for (uint32_t i = 0; i < memoryProps.memoryHeapCount; ++i)
+    {
+        if (memoryProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            localMemory += memoryProps.memoryHeaps[i].size;
+    }
+
+    VkPhysicalDeviceFeatures features{};
+    m_vk.vkGetPhysicalDeviceFeatures(device, &features);
+    int64_t featureScore = 0;
+    featureScore += features.multiDrawIndirect ? 256 : 0;
+    featureScore += features.drawIndirectFirstInstance ? 256 : 0;
+    featureScore += features.pipelineStatisticsQuery ? 64 : 0;
+    featureScore += families.compute >= 0 ? 64 : 0;
+    featureScore += families.transfer >= 0 ? 64 : 0;
+
+    return typeRank * 1000000000ll + (int64_t)(localMemory >> 20) + featureScore;
+}
+
+void Renderer::SelectPhysicalDevice()
+{
+    uint32_t deviceCount{};
+    m_vk.vkEnumeratePhysicalDevices(m_vulkan, &deviceCount, nullptr);
+    ASSERT(deviceCount != 0, "Could not find GPU's with Vulkan support");
+
+    std::vector<VkPhysicalDevice> devices(deviceCount);
+    m_vk.vkEnumeratePhysicalDevices(m_vulkan, &deviceCount, devices.data());
+
+    // Override: a device index, or a case insensitive part of the device name
+    auto lower = [](std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return text;
+    };
+    const bool overrideByIndex = !m_deviceOverride.empty() && std::all_of(m_deviceOverride.begin(), m_deviceOverride.end(), [](unsigned char c) { return std::isdigit(c) != 0; });
+    const std::string overrideName = lower(m_deviceOverride);
+
+    int32_t selected = -1;
+    int64_t bestScore = -1;
+    for (uint32_t i = 0; i < deviceCount; ++i)
+    {
+        VkPhysicalDeviceProperties props{};
+        m_vk.vkGetPhysicalDeviceProperties(devices[i], &props);
+        const int64_t score = ScorePhysicalDevice(devices[i]);
+        LOG("Device found: [" + std::to_string(i) + "] " + props.deviceName + (score < 0 ? " (unsuitable)" : ", score " + std::to_string(score)));
+
+        if (!m_deviceOverride.empty())
+        {
+            const bool matches = overrideByIndex
+                ? (uint32_t)std::stoul(m_deviceOverride) == i
+                : lower(props.deviceName).find(overrideName) != std::string::npos;
+            if (matches && selected < 0)
+            {
+                ASSERT(score >= 0, std::string("Requested device can't run the renderer: ") + props.deviceName);
+                selected = (int32_t)i;
+            }
+        }
+        else if (score > bestScore)
+        {
+            bestScore = score;
+            selected = (int32_t)i;
+        }
+    }
+    ASSERT(selected >= 0, m_deviceOverride.empty() ? std::string("No suitable GPU found") : "No device matches " + m_deviceOverride);
+
+    m_gpu = devices[selected];
+    m_vk.vkGetPhysicalDeviceProperties(m_gpu, &m_gpuProperties);
+    LOG(std::string("Selected device: ") + m_gpuProperties.deviceName);
+}
+
+void Renderer::CreateDevice()
+{
+    SelectPhysicalDevice();
+
+    uint32_t deviceExtensionCount{};
+    m_vk.vkEnumerateDeviceExtensionProperties(m_gpu, nullptr, &deviceExtensionCount, nullptr);
+    std::vector<VkExtensionProperties> deviceExtensions(deviceExtensionCount);
+    m_vk.vkEnumerateDeviceExtensionProperties(m_gpu, nullptr, &deviceExtensionCount, deviceExtensions.data());
+    auto hasExtension = [&](const char* name)
+    {
+        return std::find_if(deviceExtensions.begin(),
+            deviceExtensions.end(),
+            [=](const VkExtensionProperties& ext) { return strcmp(name, ext.extensionName) == 0; }
+        ) != deviceExtensions.end();
+    };
+
+    std::vector<const char*> requiredExtensions{ VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+    for (const char* req : requiredExtensions)
+    {
+        ASSERT(hasExtension(req), "Required extensions not found: " + std::string(req));
+    }
+
+    // Optional: lets the GPU read the indirect draw count from a buffer
+    const bool hasDrawIndirectCount = hasExtension(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if (hasDrawIndirectCount)
+    {
+        requiredExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+
+    // Optional: per-barrier stage masks for the render graph, otherwise it merges them into vkCmdPipelineBarrier calls
+    const bool hasSynchronization2 = hasExtension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    if (hasSynchronization2)
+    {
+        requiredExtensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+    }
+
+    // Optional: task and mesh shaders for cluster culling, compiled to SPIR-V 1.4 which the instance's 1.1 doesn't cover
+    bool hasMeshShader = hasExtension(VK_EXT_MESH_SHADER_EXTENSION_NAME) && hasExtension(VK_KHR_SPIRV_1_4_EXTENSION_NAME)
+        && hasExtension(VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME) && VK_API_VERSION_MINOR(m_gpuProperties.apiVersion) >= 1;
+    if (hasMeshShader)
+    {
+        VkPhysicalDeviceMeshShaderFeaturesEXT supportedMeshFeatures{};
+        supportedMeshFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+        VkPhysicalDeviceFeatures2 supportedFeatures2{};
+        supportedFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        supportedFeatures2.pNext = &supportedMeshFeatures;
+        m_vk.vkGetPhysicalDeviceFeatures2(m_gpu, &supportedFeatures2);
+        hasMeshShader = supportedMeshFeatures.taskShader == VK_TRUE && supportedMeshFeatures.meshShader == VK_TRUE;
+    }
+    if (hasMeshShader)
+    {
+        requiredExtensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+        requiredExtensions.push_back(VK_KHR_SPIRV_1_4_EXTENSION_NAME);
+        requiredExtensions.push_back(VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME);
+    }
+
+
+    // Create Logical Device (interface)
+
+    const QueueFamilies families = FindQueueFamilies(m_gpu);
+    m_graphicsFamilyIndex = families.graphics;
+    m_presentFamilyIndex = families.present;
+    const int32_t transferFamily = families.transfer;
+    const int32_t computeFamily = families.compute;
+
+    // One queue per distinct family
+    float queuePriority = 1.f;
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos{};
+    for (int32_t family : { families.graphics, families.present, transferFamily, computeFamily })
+    {
+        const bool seen = std::any_of(queueCreateInfos.begin(), queueCreateInfos.end(),
+            [=](const VkDeviceQueueCreateInfo& info) { return (int32_t)info.queueFamilyIndex == family; });
+        if (family < 0 || seen)
+            continue;
+
+        VkDeviceQueueCreateInfo queueCreateInfo{};
+        queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        queueCreateInfo.queueFamilyIndex = (uint32_t)family;
+        queueCreateInfo.queueCount = 1;
+        queueCreateInfo.pQueuePriorities = &queuePriority;
+        queueCreateInfos.push_back(queueCreateInfo);
+    }
+
+    VkPhysicalDeviceFeatures supportedFeatures{};
+    m_vk.vkGetPhysicalDeviceFeatures(m_gpu, &supportedFeatures);
+
+    // Needed to submit many draws per indirect call, and to offset gl_InstanceIndex per indirect draw
+    VkPhysicalDeviceFeatures deviceFeatures{};
+    deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+    deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+    m_supportsMultiDrawIndirect = supportedFeatures.multiDrawIndirect == VK_TRUE;
+    m_supportsIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+
+    // Optional: fragment invocation counts for overdraw stats
+    deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+    m_supportsPipelineStatistics = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+    deviceFeatures.inheritedQueries = supportedFeatures.inheritedQueries;
+    m_supportsInheritedQueries = supportedFeatures.inheritedQueries == VK_TRUE;
+
+    // Always supported when the extension is
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features{};
+    synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+    synchronization2Features.synchronization2 = VK_TRUE;
+
+    VkPhysicalDeviceMeshShaderFeaturesEXT meshShaderFeatures{};
+    meshShaderFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT;
+    meshShaderFeatures.taskShader = VK_TRUE;
+    meshShaderFeatures.meshShader = VK_TRUE;
+
+    void* featureChain = nullptr;
+    if (hasMeshShader)
+    {
+        meshShaderFeatures.pNext = featureChain;
+        featureChain = &meshShaderFeatures;
+    }
+    if (hasSynchronization2)
+    {
+        synchronization2Features.pNext = featureChain;
+        featureChain = &synchronization2Features;
+    }
+
+    VkDeviceCreateInfo deviceInfo{};
+    deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    deviceInfo.pNext = featureChain;
+    deviceInfo.pQueueCreateInfos = queueCreateInfos.data();
+    deviceInfo.queueCreateInfoCount = (uint32_t)queueCreateInfos.size();
+    deviceInfo.pEnabledFeatures = &deviceFeatures;
+    deviceInfo.enabledExtensionCount = (uint32_t)requiredExtensions.size();
+    deviceInfo.ppEnabledExtensionNames = requiredExtensions.data();
+
+    VkResult result = m_vk.vkCreateDevice(m_gpu, &deviceInfo, nullptr, &m_device);
+    ASSERT(result == VK_SUCCESS, "Could not create Vulkan logical device");
+    m_vk.LoadDevice(m_device);
+
+    m_vk.vkGetDeviceQueue(m_device, (uint32_t)m_graphicsFamilyIndex, 0, &m_deviceQueue);
+    m_vk.vkGetDeviceQueue(m_device, (uint32_t)m_presentFamilyIndex, 0, &m_presentQueue);
+
+    if (transferFamily >= 0)
+    {
+        m_vk.vkGetDeviceQueue(m_device, (uint32_t)transferFamily, 0, &m_transferQueue);
+        m_transferFamilyIndex = transferFamily;
+        LOG("Uploading through dedicated transfer queue family " + std::to_string(transferFamily));
+    }
+    else
+    {
+        m_transferQueue = m_deviceQueue;
+        m_transferFamilyIndex = m_graphicsFamilyIndex;
+        LOG("No dedicated transfer queue family, uploading through the graphics queue");
+    }
+
+    if (computeFamily >= 0)
+    {
+        m_vk.vkGetDeviceQueue(m_device, (uint32_t)computeFamily, 0, &m_computeQueue);
+        m_computeFamilyIndex = computeFamily;
+        LOG("Culling on async compute queue family " + std::to_string(computeFamily));
+    }
+    else
+    {
+        m_computeQueue = m_deviceQueue;
+        m_computeFamilyIndex = m_graphicsFamilyIndex;
+        LOG("No compute-only queue family, culling on the graphics queue");
+    }
+
+    VkCommandPoolCreateInfo transferPoolInfo{};
+    transferPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    transferPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    transferPoolInfo.queueFamilyIndex = (uint32_t)m_transferFamilyIndex;
+    result = m_vk.vkCreateCommandPool(m_device, &transferPoolInfo, nullptr, &m_transferCmdPool);
+    ASSERT(result == VK_SUCCESS, "Could not create transfer command pool");
+
+    if (hasDrawIndirectCount)
+    {
+        m_vkCmdDrawIndexedIndirectCount = (PFN_vkCmdDrawIndexedIndirectCount)m_vk.vkGetDeviceProcAddr(m_device, "vkCmdDrawIndexedIndirectCountKHR");
+    }
+    if (hasSynchronization2)
+    {
+        m_vkCmdPipelineBarrier2 = (PFN_vkCmdPipelineBarrier2KHR)m_vk.vkGetDeviceProcAddr(m_device, "vkCmdPipelineBarrier2KHR");
+    }
+
+    // Uploaded geometry is read by vertex fetch and cluster culling, and by task and mesh shaders when they draw
+    m_geometryReadStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    if (hasMeshShader)
+    {
+        m_vkCmdDrawMeshTasks = (PFN_vkCmdDrawMeshTasksEXT)m_vk.vkGetDeviceProcAddr(m_device, "vkCmdDrawMeshTasksEXT");
+        m_geometryReadStages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT | VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+        LOG("Cluster culling can use mesh shaders");
+    }
+}
+
+void Renderer::CreateSwapchain(VkFormat& out_swapchainFormat)
+{
+    // Query Capabilities
+    VkSurfaceCapabilitiesKHR capabilities{};
+    m_vk.vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_gpu, m_surface, &capabilities);
+
+    uint32_t formatCount{};
+    m_vk.vkGetPhysicalDeviceSurfaceFormatsKHR(m_gpu, m_surface, &formatCount, nullptr); // call with null to get count
+    std::vector<VkSurfaceFormatKHR> formats(formatCount);
+    m_vk.vkGetPhysicalDeviceSurfaceFormatsKHR(m_gpu, m_surface, &formatCount, formats.data()); // populate
+
+    uint32_t presentModeCount{};
+    m_vk.vkGetPhysicalDeviceSurfacePresentModesKHR(m_gpu, m_surface, &presentModeCount, nullptr);
+    std::vector<VkPresentModeKHR> presentModes(presentModeCount);
+    m_vk.vkGetPhysicalDeviceSurfacePresentModesKHR(m_gpu, m_surface, &presentModeCount, presentModes.data());
+
+    // Select Format and Presentation Mode
+    VkSurfaceFormatKHR surfaceFormat = formats[0]; // default to first if prefered (SRGB) not found;
+    for (const VkSurfaceFormatKHR& format : formats)
+    {
+        if (format.format == VK_FORMAT_R8G8B8A8_SRGB && format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR)
+        {
+            surfaceFormat = format;
+            break;
+        }
+    }
+    out_swapchainFormat = surfaceFormat.format; // Carry forward to Render Pass Creation
+    m_swapchainFormat = surfaceFormat.format;
+
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR; // prefer mailbox/triple buffering (hybrid), fallback to FIFO (aka vsync on) (immediate == vsync off)
+    for (const VkPresentModeKHR& mode : presentModes)
+    {
+        if (mode == VK_PRESENT_MODE_MAILBOX_KHR)
+        {
+            presentMode = mode;
+            break;
+        }
+    }
+
+    // Set swapchain resolution
+    VkExtent2D extent = capabilities.currentExtent;
+    if (capabilities.currentExtent.width == UINT32_MAX)
+    {
+        extent.width = std::clamp(m_windowWidth, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+        extent.height = std::clamp(m_windowHeight, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+    }
+
+    // Choose image count (prefer triple buffering)
+    uint32_t imageCount = capabilities.minImageCount + 1;
+    if (capabilities.maxImageCount > 0 && imageCount > capabilities.maxImageCount)
+    {
+        imageCount = capabilities.maxImageCount;
+    }
+
+    // Create the swapchain
+    VkSwapchainCreateInfoKHR swapchainInfo{};
+    swapchainInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    swapchainInfo.surface = m_surface;
+    swapchainInfo.minImageCount = imageCount;
+    swapchainInfo.imageFormat = surfaceFormat.format;
+    swapchainInfo.imageColorSpace = surfaceFormat.colorSpace;
+    swapchainInfo.imageExtent = extent;
+    swapchainInfo.imageArrayLayers = 1;
+    swapchainInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; // specifies that the image can be used to create a VkImageView suitable for use as a color or resolve attachment in a VkFramebuffer.
+    swapchainInfo.preTransform = capabilities.currentTransform;
+    swapchainInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR; // indicates the alpha compositing mode to use when this surface is composited together with other surfaces on certain window systems.
+    swapchainInfo.clipped = VK_TRUE;
+    swapchainInfo.oldSwapchain = nullptr;
+
+
+    // Handle queue family sharing if graphics and present queues differ (families were picked in CreateDevice)
+    uint32_t queueFamilyIndices[2] = { (uint32_t)m_graphicsFamilyIndex, (uint32_t)m_presentFamilyIndex };
+    if (m_graphicsFamilyIndex != m_presentFamilyIndex)
+    {
+        swapchainInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+        swapchainInfo.queueFamilyIndexCount = 2;
+        swapchainInfo.pQueueFamilyIndices = queueFamilyIndices;
+    }
+    else
+    {
+        swapchainInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        swapchainInfo.queueFamilyIndexCount = 0;
+        swapchainInfo.pQueueFamilyIndices = nullptr;
+    }
+
+    VkResult result = m_vk.vkCreateSwapchainKHR(m_device, &swapchainInfo, nullptr, &m_swapchain);
+    ASSERT(result == VK_SUCCESS, "Vulkan swapchain could not be created");
+
+    m_vk.vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, nullptr);
+    m_swapchainImages.resize(imageCount);
+    m_vk.vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, m_swapchainImages.data());
+
+    m_perFrameData.clear();
+    m_perFrameData.resize(imageCount);
+    for (size_t i = 0; i < imageCount; ++i)
+    {
+        InitPerFrameData(m_perFrameData[i]);
+    }
+
+    m_imageViews.clear();
+    for (size_t i = 0; i < imageCount; ++i)
+    {
+        VkImageViewCreateInfo imgViewInfo{};
+        imgViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        imgViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        imgViewInfo.format = out_swapchainFormat;
+        imgViewInfo.image = m_swapchainImages[i];
+        imgViewInfo.subresourceRange.levelCount = 1;
+        imgViewInfo.subresourceRange.layerCount = 1;
+        imgViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        imgViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
+        imgViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
+        imgViewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
+        imgViewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+
+        VkImageView imageView{};
+        result = m_vk.vkCreateImageView(m_device, &imgViewInfo, nullptr, &imageView);
+        ASSERT(result == VK_SUCCESS, "Could not create Image view " + std::to_string(i));
+        m_imageViews.push_back(imageView);
+    }
+
+}
+
+void Renderer::CreateRenderTargets(const VkFormat swapchainFormat)
+{
+    // Highest supported sample count not above the requested one
+    const VkSampleCountFlags supportedSamples = m_gpuProperties.limits.framebufferColorSampleCounts & m_gpuProperties.limits.framebufferDepthSampleCounts;
+    m_msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+    for (VkSampleCountFlagBits samples : { VK_SAMPLE_COUNT_8_BIT, VK_SAMPLE_COUNT_4_BIT, VK_SAMPLE_COUNT_2_BIT })
+    {
+        if (static_cast<uint32_t>(samples) <= m_requestedMsaaSamples && (supportedSamples & samples))
+        {
+            m_msaaSamples = samples;
+            break;
+        }
+    }
+    if (static_cast<uint32_t>(m_msaaSamples) != m_requestedMsaaSamples)
+    {
+        LOG("MSAA " + std::to_string(m_requestedMsaaSamples) + "x unsupported, using " + std::to_string(m_msaaSamples) + "x");
+    }
+
+    // Pick the first supported format in order of preference, favouring ones that can also be sampled (Hi-Z)
+    const VkFormat candidates[] =
+    {
+        VK_FORMAT_D32_SFLOAT,
+        VK_FORMAT_D32_SFLOAT_S8_UINT,
+        VK_FORMAT_X8_D24_UNORM_PACK32,
+        VK_FORMAT_D24_UNORM_S8_UINT,
+        VK_FORMAT_D16_UNORM
+    };
+
+    m_depthFormat = VK_FORMAT_UNDEFINED;
+    m_depthSampleable = false;
+    const VkFormatFeatureFlags featureSets[2] =
+    {
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT,
+        VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
+    };
+    for (const VkFormatFeatureFlags requiredFeatures : featureSets)
+    {
+        for (VkFormat format : candidates)
+        {
+            VkFormatProperties formatProperties{};
+            m_vk.vkGetPhysicalDeviceFormatProperties(m_gpu, format, &formatProperties);
+            if ((formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures)
+            {
+                m_depthFormat = format;
+                m_depthSampleable = (requiredFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+                break;
+            }
+        }
+        if (m_depthFormat != VK_FORMAT_UNDEFINED)
+            break;
+    }
+    ASSERT(m_depthFormat != VK_FORMAT_UNDEFINED, "No supported depth format");
+
+    if (!m_depthSampleable)
+    {
+        LOG("Depth format can't be sampled, occlusion culling disabled");
+        m_settings.occlusionCulling = false;
+    }
+
+    // Multisampled targets only live inside the render pass (nothing is stored), so there's no depth left to build the Hi-Z from
+    const bool msaa = m_msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+    if (msaa && m_depthSampleable)
+    {
+        LOG("Occlusion culling is unavailable with MSAA");
+        m_depthSampleable = false;
+        m_settings.occlusionCulling = false;
+    }
+
+    const bool hasStencil = m_depthFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || m_depthFormat == VK_FORMAT_D24_UNORM_S8_UINT;
+    const VkImageAspectFlags attachmentAspect = hasStencil ? VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT : VK_IMAGE_ASPECT_DEPTH_BIT;
+
+    // Hi-Z level 0 is the depth extent rounded down to powers of two, so every level halves exactly
+    m_hizExtent.width = 1;
+    while (m_hizExtent.width * 2 <= m_windowWidth)
+        m_hizExtent.width *= 2;
+    m_hizExtent.height = 1;
+    while (m_hizExtent.height * 2 <= m_windowHeight)
+        m_hizExtent.height *= 2;
+
+    m_hizMipLevels = 1;
+    while ((std::max(m_hizExtent.width, m_hizExtent.height) >> m_hizMipLevels) > 0)
+        ++m_hizMipLevels;
+
+    for (PerFrameData& perFrame : m_perFrameData)
+    {
+        if (msaa)
+        {
+            // Transient: on tile based GPUs these never leave tile memory
+            CreateImage(perFrame.msaaColorImage, swapchainFormat,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT,
+                m_windowWidth, m_windowHeight, 1, m_msaaSamples);
+            CreateImage(perFrame.depthImage, m_depthFormat,
+                VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, attachmentAspect,
+                m_windowWidth, m_windowHeight, 1, m_msaaSamples);
+            continue;
+        }
+
+        CreateImage(perFrame.depthImage, m_depthFormat,
+            VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | (m_depthSampleable ? VK_IMAGE_USAGE_SAMPLED_BIT : 0), attachmentAspect,
+            m_windowWidth, m_windowHeight, 1);
+
+        if (!m_depthSampleable)
+            continue;
+
+        // The Hi-Z itself is a render graph transient
+        perFrame.depthSampleView = CreateImageView(perFrame.depthImage.handle, m_depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1);
+    }
+}
+
+void Renderer::CreateRenderPass(const VkFormat swapchainFormat)
+{
+    m_renderPass = CreateMainRenderPass(swapchainFormat, false, false);
+
+    // Occlusion culling splits the frame around the Hi-Z build, all three passes are compatible.
+    // Not available with MSAA, the multisampled targets are never stored.
+    if (m_msaaSamples == VK_SAMPLE_COUNT_1_BIT)
+    {
+        m_firstPhaseRenderPass = CreateMainRenderPass(swapchainFormat, false, true);
+        m_secondPhaseRenderPass = CreateMainRenderPass(swapchainFormat, true, false);
+    }
+}
+
+VkRenderPass Renderer::CreateMainRenderPass(const VkFormat swapchainFormat, bool loadContents, bool storeDepth)
+{
+    const bool msaa = m_msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+    ASSERT(!msaa || (!loadContents && !storeDepth), "MSAA only supports the single pass layout");
+
+    // Attachments start and end in their attachment layouts, the render graph does the transitions
+    // (and the present transition) with its own barriers, so there are no external dependencies here
+
+    VkAttachmentDescription attachments[3]{};
+
+    VkAttachmentDescription& colorAttachment = attachments[0];
+    colorAttachment.format = swapchainFormat;
+    colorAttachment.samples = m_msaaSamples;
+    colorAttachment.loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // Not using
+    colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; // Not using
+    colorAttachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    // MSAA: the multisampled color is resolved into the swapchain image at the end of the subpass and then dropped
+    VkAttachmentDescription& resolveAttachment = attachments[2];
+    if (msaa)
+    {
+        resolveAttachment = colorAttachment;
+        resolveAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
+        resolveAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+        colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    }
+
+    // Depth is only kept when a later pass (Hi-Z build, second phase) needs it
+    VkAttachmentDescription& depthAttachment = attachments[1];
+    depthAttachment.format = m_depthFormat;
+    depthAttachment.samples = m_msaaSamples;
+    depthAttachment.loadOp = loadContents ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthAttachment.storeOp = storeDepth ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachment.initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference colorReference{};
+    colorReference.attachment = 0;
+    colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference depthReference{};
+    depthReference.attachment = 1;
+    depthReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentReference resolveReference{};
+    resolveReference.attachment = 2;
+    resolveReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpass{};
+    subpass.flags = 0;
+    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+    subpass.colorAttachmentCount = 1;
+    subpass.pColorAttachments = &colorReference;
+    subpass.pResolveAttachments = msaa ? &resolveReference : nullptr;
+    subpass.pDepthStencilAttachment = &depthReference;
+
+    VkRenderPassCreateInfo renderPassInfo{};
+    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    renderPassInfo.attachmentCount = msaa ? 3 : 2;
+    renderPassInfo.pAttachments = attachments;
+    renderPassInfo.subpassCount = 1;
+    renderPassInfo.pSubpasses = &subpass;
+    renderPassInfo.dependencyCount = 0;
+    renderPassInfo.pDependencies = nullptr;
+
+    VkRenderPass renderPass = nullptr;
+    VkResult result = m_vk.vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &renderPass);
+    ASSERT(result == VK_SUCCESS, "Could not create render pass");
+    return renderPass;
+}
+
+void Renderer::CreateBuffers()
+{
+    MeshData triangle{};
+    triangle.vertices =
+    {
+        {-0.5f, -0.5f, 0.0f},
+        {0.0f, 0.5f, 0.0f},
+        {0.5f, -0.5f, 0.0f}
+    };
+    triangle.indices = { 0, 1, 2 };
+    const uint32_t triangleMesh = ImportMesh(triangle);
+
+    MeshData quad{};
+    quad.vertices =
+    {
+        {-0.5f, -0.5f, 0.0f},
+        {-0.5f, 0.5f, 0.0f},
+        {0.5f, 0.5f, 0.0f},
+        {0.5f, -0.5f, 0.0f}
+    };
+    quad.indices = { 0, 1, 2, 0, 2, 3 };
+    const uint32_t quadMesh = ImportMesh(quad);
+
+    // Scene: a grid of triangles, each one an object in the object buffer
+    const uint32_t gridSize = 32;
+    const float cellSize = 2.f / gridSize;
+    m_objects.clear();
+    m_objects.reserve(gridSize * gridSize);
+    for (uint32_t y = 0; y < gridSize; ++y)
+    {
+        for (uint32_t x = 0; x < gridSize; ++x)
+        {
+            ObjectData object{};
+            object.position = { -1.f + cellSize * (x + 0.5f), -1.f + cellSize * (y + 0.5f), 0.f };
+            object.scale = cellSize * 0.8f;
+            object.color = { (float)x / gridSize, (float)y / gridSize, 1.f, 1.f };
+            m_objects.push_back(object);
+        }
+    }
+
+    // Split into one draw per material, each draw covers many objects with a single call
+    const uint32_t half = (uint32_t)m_objects.size() / 2;
+    m_drawItems.clear();
+    m_drawItems.push_back({ triangleMesh, 0, half, 0 });
+    m_drawItems.push_back({ quadMesh, half, (uint32_t)m_objects.size() - half, 1 });
+    ++m_drawItemsVersion;
+}
+
+void Renderer::CreateDescriptors()
+{
+    // Task and mesh shaders read objects and meshlets where the vertex shader would
+    const VkShaderStageFlags meshStages = m_vkCmdDrawMeshTasks != nullptr ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : 0;
+
+    // Set 0, Binding 0: per-frame object buffer (read in the vertex shader)
+    VkDescriptorSetLayoutBinding objectBinding{};
+    objectBinding.binding = 0;
+    objectBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    objectBinding.descriptorCount = 1;
+    objectBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | meshStages;
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = 1;
+    setLayoutInfo.pBindings = &objectBinding;
+    VkResult result = m_vk.vkCreateDescriptorSetLayout(m_device, &setLayoutInfo, nullptr, &m_descriptorSetLayout);
+    ASSERT(result == VK_SUCCESS, "Could not create descriptor set layout");
+
+    // Set 1 of cluster culling and mesh shading: meshlets, meshlet vertices, meshlet triangles, vertex positions,
+    // cluster indices out, draw counts (the task shader's counters)
+    VkDescriptorSetLayoutBinding meshletBindings[6]{};
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        meshletBindings[i].binding = i;
+        meshletBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        meshletBindings[i].descriptorCount = 1;
+        meshletBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT | meshStages;
+    }
+    setLayoutInfo.bindingCount = 6;
+    setLayoutInfo.pBindings = meshletBindings;
+    result = m_vk.vkCreateDescriptorSetLayout(m_device, &setLayoutInfo, nullptr, &m_meshletDescriptorSetLayout);
+    ASSERT(result == VK_SUCCESS, "Could not create meshlet descriptor set layout");
+
+    // One set per frame in flight
+    const uint32_t frameCount = (uint32_t)m_perFrameData.size();
+
+    // Per frame: object set (1 buffer), cull set (7 buffers, Hi-Z), meshlet set (6 buffers) and one Hi-Z build set
+    // per mip (source, destination)
+    VkDescriptorPoolSize poolSizes[3]{};
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[0].descriptorCount = frameCount * 14;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[1].descriptorCount = frameCount * (1 + m_hizMipLevels);
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    poolSizes[2].descriptorCount = frameCount * m_hizMipLevels;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.maxSets = frameCount * (3 + m_hizMipLevels);
+    poolInfo.poolSizeCount = 3;
+    poolInfo.pPoolSizes = poolSizes;
+    result = m_vk.vkCreateDescriptorPool(m_device, &poolInfo, nullptr, &m_descriptorPool);
+    ASSERT(result == VK_SUCCESS, "Could not create descriptor pool");
+
+    for (PerFrameData& perFrame : m_perFrameData)
+    {
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = m_descriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &m_descriptorSetLayout;
+        result = m_vk.vkAllocateDescriptorSets(m_device, &setInfo, &perFrame.descriptorSet);
+        ASSERT(result == VK_SUCCESS, "Could not allocate descriptor set");
+
+        setInfo.pSetLayouts = &m_meshletDescriptorSetLayout;
+        result = m_vk.vkAllocateDescriptorSets(m_device, &setInfo, &perFrame.meshletDescriptorSet);
+        ASSERT(result == VK_SUCCESS, "Could not allocate meshlet descriptor set");
+
+        ReserveObjectBuffer(perFrame, m_objects.size());
+    }
+}
+
+
+void Renderer::CreatePipeline()
+{
+    // Per-draw constants (object offset, material id)
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(DrawPushConstants);
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_descriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    VkResult result = m_vk.vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &m_pipelineLayout);
+    ASSERT(result == VK_SUCCESS, "Could not create pipeline layout");
+    
+    // Vertex input built at compile time from the streams in Renderer.h, for the positions ImportMesh stores
+    VkPipelineVertexInputStateCreateInfo meshVertexInput{};
+    VkPipelineVertexInputStateCreateInfo instancedVertexInput{};
+    switch (m_positionFormat)
+    {
+    case VertexCompression::PositionFormat::Float32:
+        meshVertexInput = PipelineVertexInputs<FloatPositionStream>::Mesh::CreateInfo();
+        instancedVertexInput = PipelineVertexInputs<FloatPositionStream>::Instanced::CreateInfo();
+        break;
+    case VertexCompression::PositionFormat::Half:
+        meshVertexInput = PipelineVertexInputs<HalfPositionStream>::Mesh::CreateInfo();
+        instancedVertexInput = PipelineVertexInputs<HalfPositionStream>::Instanced::CreateInfo();
+        break;
+    case VertexCompression::PositionFormat::Snorm16:
+        meshVertexInput = PipelineVertexInputs<Snorm16PositionStream>::Mesh::CreateInfo();
+        instancedVertexInput = PipelineVertexInputs<Snorm16PositionStream>::Instanced::CreateInfo();
+        break;
+    }
+    ASSERT(meshVertexInput.pVertexBindingDescriptions[0].stride == m_geometryPool.vertices.elementSize, "Position stream and vertex pool strides differ");
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo = meshVertexInput;
+
+    // Specify triangles
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
+    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+    // Rasterizer Options
+    VkPipelineRasterizationStateCreateInfo rasterizerInfo{};
+    rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizerInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizerInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizerInfo.lineWidth = 1.f;
+
+    // Color writing (no blending)
+    VkPipelineColorBlendAttachmentState blendAttachment{};
+    blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo blendInfo{};
+    blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    blendInfo.attachmentCount = 1;
+    blendInfo.pAttachments = &blendAttachment;
+
+    // Specify Viewport and scissor (scissor is the clipping area)
+    VkPipelineViewportStateCreateInfo viewportInfo{};
+    viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportInfo.viewportCount = 1;
+    viewportInfo.scissorCount = 1; // must be same as viewport count
+
+    // Depth Testing (closer z wins), Stencil (disabled)
+    VkPipelineDepthStencilStateCreateInfo depthStencilInfo{};
+    depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthStencilInfo.depthTestEnable = VK_TRUE;
+    depthStencilInfo.depthWriteEnable = VK_TRUE;
+    depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    // Multisampling (matches the render pass)
+    VkPipelineMultisampleStateCreateInfo multisampleInfo{};
+    multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleInfo.rasterizationSamples = m_msaaSamples;
+
+    // Specify that that the viewport and scissor will dynamic (not a part of the pipeline)
+    VkDynamicState dynamics[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+
+    VkPipelineDynamicStateCreateInfo dynamicInfo{};
+    dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicInfo.pDynamicStates = dynamics;
+    dynamicInfo.dynamicStateCount = 2;
+
+    // Load Shaders
+    VkPipelineShaderStageCreateInfo shaderStages[2] = { VkPipelineShaderStageCreateInfo(), VkPipelineShaderStageCreateInfo() };
+
+    //Vertex
+    VkPipelineShaderStageCreateInfo& vertexShader = shaderStages[0];
+    vertexShader.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertexShader.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertexShader.module = LoadShader("Assets/Shaders/bin/basic.vert.spirv");
+    vertexShader.pName = "main";
+
+    //Fragment (Pixel)
+    VkPipelineShaderStageCreateInfo& fragmentShader = shaderStages[1];
+    fragmentShader.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragmentShader.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragmentShader.module = LoadShader("Assets/Shaders/bin/basic.frag.spirv");
+    fragmentShader.pName = "main";
+
+    VkGraphicsPipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.stageCount = 2; // vert & frag
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
+    pipelineInfo.pRasterizationState = &rasterizerInfo;
+    pipelineInfo.pColorBlendState = &blendInfo;
+    pipelineInfo.pMultisampleState = &multisampleInfo;
+    pipelineInfo.pViewportState = &viewportInfo;
+    pipelineInfo.pDepthStencilState = &depthStencilInfo;
+    pipelineInfo.pDynamicState = &dynamicInfo;
+
+    pipelineInfo.renderPass = m_renderPass;
+    pipelineInfo.layout = m_pipelineLayout;
+
+    result = m_vk.vkCreateGraphicsPipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_graphicsPipeline);
+    ASSERT(result == VK_SUCCESS, "Could not create Vulkan graphics pipeline");
+
+    // After a depth prepass depth is already final, so only the front-most fragment of each pixel passes
+    depthStencilInfo.depthWriteEnable = VK_FALSE;
+    depthStencilInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+    result = m_vk.vkCreateGraphicsPipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_graphicsEqualPipeline);
+    ASSERT(result == VK_SUCCESS, "Could not create Vulkan depth equal graphics pipeline");
+
+    depthStencilInfo.depthWriteEnable = VK_TRUE;
+    depthStencilInfo.depthCompareOp = VK_COMPARE_OP_LESS;
+
+    m_vk.vkDestroyShaderModule(m_device, vertexShader.module, nullptr);
+
+    // Instanced variant: same state, plus a second vertex stream advanced once per instance
+    vertexInputInfo = instancedVertexInput;
+
+    vertexShader.module = LoadShader("Assets/Shaders/bin/instanced.vert.spirv");
+
+    result = m_vk.vkCreateGraphicsPipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_instancedPipeline);
+    ASSERT(result == VK_SUCCESS, "Could not create Vulkan instanced graphics pipeline");
+
+    m_vk.vkDestroyShaderModule(m_device, vertexShader.module, nullptr);
+
+    // Depth prepass: position only, no fragment shader and no color writes
+    vertexInputInfo = meshVertexInput;
+    blendAttachment.colorWriteMask = 0;
+    pipelineInfo.stageCount = 1;
+
+    vertexShader.module = LoadShader("Assets/Shaders/bin/depth.vert.spirv");
+
+    result = m_vk.vkCreateGraphicsPipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_depthPrepassPipeline);
+    ASSERT(result == VK_SUCCESS, "Could not create Vulkan depth prepass pipeline");
+
+    m_vk.vkDestroyShaderModule(m_device, vertexShader.module, nullptr);
+
+    // Cluster culling with mesh shaders: task shaders cull, mesh shaders fetch and emit, same fragment shader and state
+    if (m_vkCmdDrawMeshTasks != nullptr)
+    {
+        pushConstantRange.stageFlags = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+        pushConstantRange.size = sizeof(ClusterDrawPushConstants);
+
+        const VkDescriptorSetLayout setLayouts[2] = { m_descriptorSetLayout, m_meshletDescriptorSetLayout };
+        layoutInfo.setLayoutCount = 2;
+        layoutInfo.pSetLayouts = setLayouts;
+        result = m_vk.vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &m_meshShaderPipelineLayout);
+        ASSERT(result == VK_SUCCESS, "Could not create mesh shader pipeline layout");
+
+        VkPipelineShaderStageCreateInfo meshStages[3]{};
+        meshStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        meshStages[0].stage = VK_SHADER_STAGE_TASK_BIT_EXT;
+        meshStages[0].module = LoadShader("Assets/Shaders/bin/cluster.task.spirv");
+        meshStages[0].pName = "main";
+        meshStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+        meshStages[1].stage = VK_SHADER_STAGE_MESH_BIT_EXT;
+        meshStages[1].module = LoadShader("Assets/Shaders/bin/cluster.mesh.spirv");
+        meshStages[1].pName = "main";
+
+        // Mesh shaders fetch positions from the pool themselves, decoding them the way the vertex input would
+        const uint32_t positionFormatId = (uint32_t)m_positionFormat;
+        VkSpecializationMapEntry specializationEntry{ 0, 0, sizeof(uint32_t) };
+        VkSpecializationInfo specializationInfo{};
+        specializationInfo.mapEntryCount = 1;
+        specializationInfo.pMapEntries = &specializationEntry;
+        specializationInfo.dataSize = sizeof(positionFormatId);
+        specializationInfo.pData = &positionFormatId;
+        meshStages[1].pSpecializationInfo = &specializationInfo;
+        meshStages[2] = fragmentShader;
+
+        blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+        pipelineInfo.stageCount = 3;
+        pipelineInfo.pStages = meshStages;
+        pipelineInfo.pVertexInputState = nullptr;
+        pipelineInfo.pInputAssemblyState = nullptr;
+        pipelineInfo.layout = m_meshShaderPipelineLayout;
+
+        result = m_vk.vkCreateGraphicsPipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_meshShaderPipeline);
+        ASSERT(result == VK_SUCCESS, "Could not create Vulkan mesh shader pipeline");
+
+        m_vk.vkDestroyShaderModule(m_device, meshStages[0].module, nullptr);
+        m_vk.vkDestroyShaderModule(m_device, meshStages[1].module, nullptr);
+    }
+
+    //Pipelines are created, we can now delete the shader modules
+    m_vk.vkDestroyShaderModule(m_device, fragmentShader.module, nullptr);
+}
+
+void Renderer::CreateCullPipeline()
+{
+    // Set 0: objects, per-object cull data, mesh table, group offsets, indirect commands out, draw counts out,
+    // visibility (read and written), Hi-Z
+    VkDescriptorSetLayoutBinding bindings[8]{};
+    for (uint32_t i = 0; i < 8; ++i)
+    {
+        bindings[i].binding = i;
+        bindings[i].descriptorType = i == 7 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        bindings[i].descriptorCount = 1;
+        bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo setLayoutInfo{};
+    setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    setLayoutInfo.bindingCount = 8;
+    setLayoutInfo.pBindings = bindings;
+    VkResult result = m_vk.vkCreateDescriptorSetLayout(m_device, &setLayoutInfo, nullptr, &m_cullDescriptorSetLayout);
+    ASSERT(result == VK_SUCCESS, "Could not create cull descriptor set layout");
+
+    VkPushConstantRange pushConstantRange{};
+    pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    pushConstantRange.offset = 0;
+    pushConstantRange.size = sizeof(CullPushConstants);
+
+    VkPipelineLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutInfo.setLayoutCount = 1;
+    layoutInfo.pSetLayouts = &m_cullDescriptorSetLayout;
+    layoutInfo.pushConstantRangeCount = 1;
+    layoutInfo.pPushConstantRanges = &pushConstantRange;
+    result = m_vk.vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &m_cullPipelineLayout);
+    ASSERT(result == VK_SUCCESS, "Could not create cull pipeline layout");
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = LoadShader("Assets/Shaders/bin/cull.comp.spirv");
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = m_cullPipelineLayout;
+
+    result = m_vk.vkCreateComputePipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_cullPipeline);
+    ASSERT(result == VK_SUCCESS, "Could not create cull compute pipeline");
+
+    m_vk.vkDestroyShaderModule(m_device, pipelineInfo.stage.module, nullptr);
+
+    // Cluster culling: the cull set plus the meshlet set, one workgroup per object
+    const VkDescriptorSetLayout clusterSetLayouts[2] = { m_cullDescriptorSetLayout, m_meshletDescriptorSetLayout };
+    pushConstantRange.size = sizeof(ClusterCullPushConstants);
+    layoutInfo.setLayoutCount = 2;
+    layoutInfo.pSetLayouts = clusterSetLayouts;
+    result = m_vk.vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &m_clusterCullPipelineLayout);
+    ASSERT(result == VK_SUCCESS, "Could not create cluster cull pipeline layout");
+
+    pipelineInfo.stage.module = LoadShader("Assets/Shaders/bin/cluster.comp.spirv");
+    pipelineInfo.layout = m_clusterCullPipelineLayout;
+    result = m_vk.vkCreateComputePipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_clusterCullPipeline);
+    ASSERT(result == VK_SUCCESS, "Could not create cluster cull compute pipeline");
+
+    m_vk.vkDestroyShaderModule(m_device, pipelineInfo.stage.module, nullptr);
+    layoutInfo.setLayoutCount = 1;
+
+    // Hi-Z build: each mip is the max of its footprint in the level above (or the depth buffer)
+    VkDescriptorSetLayoutBinding hizBindings[2]{};
+    hizBindings[0].binding = 0;
+    hizBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    hizBindings[0].descriptorCount = 1;
+    hizBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    hizBindings[1].binding = 1;
+    hizBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+    hizBindings[1].descriptorCount = 1;
+    hizBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    setLayoutInfo.bindingCount = 2;
+    setLayoutInfo.pBindings = hizBindings;
+    result = m_vk.vkCreateDescriptorSetLayout(m_device, &setLayoutInfo, nullptr, &m_hizDescriptorSetLayout);
+    ASSERT(result == VK_SUCCESS, "Could not create Hi-Z descriptor set layout");
+
+    pushConstantRange.size = sizeof(DepthPyramidPushConstants);
+    layoutInfo.pSetLayouts = &m_hizDescriptorSetLayout;
+    result = m_vk.vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &m_hizPipelineLayout);
+    ASSERT(result == VK_SUCCESS, "Could not create Hi-Z pipeline layout");
+
+    pipelineInfo.stage.module = LoadShader("Assets/Shaders/bin/hiz.comp.spirv");
+    pipelineInfo.layout = m_hizPipelineLayout;
+    result = m_vk.vkCreateComputePipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_hizPipeline);
+    ASSERT(result == VK_SUCCESS, "Could not create Hi-Z compute pipeline");
+
+    m_vk.vkDestroyShaderModule(m_device, pipelineInfo.stage.module, nullptr);
+
+    // Texels are fetched directly, the sampler only has to exist
+    VkSamplerCreateInfo samplerInfo{};
+    samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerInfo.magFilter = VK_FILTER_NEAREST;
+    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.maxLod = (float)m_hizMipLevels;
+    result = m_vk.vkCreateSampler(m_device, &samplerInfo, nullptr, &m_pointSampler);
+    ASSERT(result == VK_SUCCESS, "Could not create point sampler");
+
+    for (PerFrameData& perFrame : m_perFrameData)
+    {
+        VkDescriptorSetAllocateInfo setInfo{};
+        setInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setInfo.descriptorPool = m_descriptorPool;
+        setInfo.descriptorSetCount = 1;
+        setInfo.pSetLayouts = &m_cullDescriptorSetLayout;
+        result = m_vk.vkAllocateDescriptorSets(m_device, &setInfo, &perFrame.cullDescriptorSet);
+        ASSERT(result == VK_SUCCESS, "Could not allocate cull descriptor set");
+
+        // Written by UpdateDepthPyramidViews once the render graph has placed the Hi-Z
+        if (!m_depthSampleable)
+            continue;
+
+        perFrame.hizDescriptorSets.resize(m_hizMipLevels);
+        for (uint32_t level = 0; level < m_hizMipLevels; ++level)
+        {
+            setInfo.pSetLayouts = &m_hizDescriptorSetLayout;
+            result = m_vk.vkAllocateDescriptorSets(m_device, &setInfo, &perFrame.hizDescriptorSets[level]);
+            ASSERT(result == VK_SUCCESS, "Could not allocate Hi-Z descriptor set");
+        }
+    }
+}
+
+void Renderer::UpdateDepthPyramidViews(PerFrameData& perFrame, VkImage hizImage, VkImageView hizView)
+{
+    // Only called while the frame's previous submit is done, nothing uses the old views or sets
+    for (VkImageView& view : perFrame.hizMipViews)
+    {
+        m_vk.vkDestroyImageView(m_device, view, nullptr);
+    }
+    perFrame.hizMipViews.clear();
+    perFrame.hizView = hizView;
+    if (hizImage == nullptr)
+        return;
+
+    perFrame.hizMipViews.resize(m_hizMipLevels);
+    for (uint32_t level = 0; level < m_hizMipLevels; ++level)
+    {
+        perFrame.hizMipViews[level] = CreateImageView(hizImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, level, 1);
+    }
+
+    for (uint32_t level = 0; level < m_hizMipLevels; ++level)
+    {
+        VkDescriptorImageInfo sourceInfo{};
+        sourceInfo.sampler = m_pointSampler;
+        sourceInfo.imageView = level == 0 ? perFrame.depthSampleView : perFrame.hizMipViews[level - 1];
+        sourceInfo.imageLayout = level == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+        VkDescriptorImageInfo destinationInfo{};
+        destinationInfo.imageView = perFrame.hizMipViews[level];
+        destinationInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+        VkWriteDescriptorSet writes[2]{};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = perFrame.hizDescriptorSets[level];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[0].pImageInfo = &sourceInfo;
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = perFrame.hizDescriptorSets[level];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+        writes[1].pImageInfo = &destinationInfo;
+        m_vk.vkUpdateDescriptorSets(m_device, 2, writes, 0, nullptr);
+    }
+
+    // The cull pass samples the finished pyramid
+    VkDescriptorImageInfo hizInfo{};
+    hizInfo.sampler = m_pointSampler;
+    hizInfo.imageView = hizView;
+    hizInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = perFrame.cullDescriptorSet;
+    write.dstBinding = 7;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &hizInfo;
+    m_vk.vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+}
+
+void Renderer::CreateFramebuffers()
+{
+    m_framebuffers.clear();
+
+    for (size_t i = 0; i < m_imageViews.size(); ++i)
+    {
+        // Frame data is indexed by swapchain image, so each framebuffer gets its frame's depth buffer.
+        // With MSAA the swapchain image is the resolve target.
+        const bool msaa = m_msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+        VkImageView attachments[3] = { m_imageViews[i], m_perFrameData[i].depthImage.view, nullptr };
+        if (msaa)
+        {
+            attachments[0] = m_perFrameData[i].msaaColorImage.view;
+            attachments[2] = m_imageViews[i];
+        }
+
+        VkFramebufferCreateInfo framebufferInfo{};
+        framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+        framebufferInfo.renderPass = m_renderPass;
+        framebufferInfo.attachmentCount = msaa ? 3 : 2;
+        framebufferInfo.pAttachments = attachments;
+        framebufferInfo.width = m_windowWidth;
+        framebufferInfo.height = m_windowHeight;
+        framebufferInfo.layers = 1;
+
+        VkFramebuffer framebuffer;
+        VkResult result = m_vk.vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &framebuffer);
+        ASSERT(result == VK_SUCCESS, "Could not create framebuffer");
+
+        m_framebuffers.push_back(framebuffer);
+    }
+}
+
+void Renderer::CreateOrResizeBuffer(Buffer& buffer, uint64_t newSize, VkMemoryPropertyFlags properties)
+{
+    if (buffer.handle != nullptr)
+    {
+        m_vk.vkDestroyBuffer(m_device, buffer.handle, nullptr);
+    }
+    if (buffer.memory != nullptr)
+    {
+        m_vk.vkFreeMemory(m_device, buffer.memory, nullptr);
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = newSize;
+    bufferInfo.usage = buffer.usageFlags;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    // No ownership transfers needed for buffers both queues touch every frame
+    const uint32_t queueFamilies[2] = { (uint32_t)m_graphicsFamilyIndex, (uint32_t)m_computeFamilyIndex };
+    if (buffer.concurrent && m_computeFamilyIndex != m_graphicsFamilyIndex)
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = queueFamilies;
+    }
+    VkResult result = m_vk.vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer.handle);
+    ASSERT(result == VK_SUCCESS, "Could not create buffer");
+
+    VkMemoryRequirements req;
+    m_vk.vkGetBufferMemoryRequirements(m_device, buffer.handle, &req);
+
+    // Allignment if req'd
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = req.size;
+    allocInfo.memoryTypeIndex = FindMemoryType(req.memoryTypeBits, properties);
+    ASSERT(allocInfo.memoryTypeIndex != UINT32_MAX, "No suitable memory type for buffer");
+    result = m_vk.vkAllocateMemory(m_device, &allocInfo, nullptr, &buffer.memory);
+    ASSERT(result == VK_SUCCESS, "Could not allocate buffer memory");
+
+    result = m_vk.vkBindBufferMemory(m_device, buffer.handle, buffer.memory, 0);
+    ASSERT(result == VK_SUCCESS, "Could not bind buffer memory");
+
+    buffer.size = req.size;
+}
+
+void Renderer::DestroyBuffer(Buffer& buffer)
+{
+    if (buffer.handle != nullptr)
+    {
+        m_vk.vkDestroyBuffer(m_device, buffer.handle, nullptr);
+        buffer.handle = nullptr;
+    }
+    if (buffer.memory != nullptr)
+    {
+        m_vk.vkFreeMemory(m_device, buffer.memory, nullptr);
+        buffer.memory = nullptr;
+    }
+    buffer.size = 0;
+}
+
+uint32_t Renderer::FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const
+{
+    VkPhysicalDeviceMemoryProperties gpuProperties;
+    m_vk.vkGetPhysicalDeviceMemoryProperties(m_gpu, &gpuProperties);
+    for (uint32_t i = 0; i < gpuProperties.memoryTypeCount; ++i)
+    {
+        if ((gpuProperties.memoryTypes[i].propertyFlags & properties) == properties && typeBits & (1 << i))
+            return i;
+    }
+    return UINT32_MAX;
+}
+
+void Renderer::CreateImage(Image& image, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, uint32_t width, uint32_t height, uint32_t mipLevels,
+    VkSampleCountFlagBits samples)
+{
+    VkImageCreateInfo imageInfo{};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = format;
+    imageInfo.extent = { width, height, 1 };
+    imageInfo.mipLevels = mipLevels;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = samples;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = m_vk.vkCreateImage(m_device, &imageInfo, nullptr, &image.handle);
+    ASSERT(result == VK_SUCCESS, "Could not create image");
+
+    VkMemoryRequirements req;
+    m_vk.vkGetImageMemoryRequirements(m_device, image.handle, &req);
+
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = req.size;
+    allocInfo.memoryTypeIndex = UINT32_MAX;
+
+    // Transient attachments can be backed lazily (tile memory only) where the driver offers it
+    if (usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT)
+    {
+        allocInfo.memoryTypeIndex = FindMemoryType(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT);
+    }
+    if (allocInfo.memoryTypeIndex == UINT32_MAX)
+    {
+        allocInfo.memoryTypeIndex = FindMemoryType(req.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    ASSERT(allocInfo.memoryTypeIndex != UINT32_MAX, "No device local memory type for image");
+
+    result = m_vk.vkAllocateMemory(m_device, &allocInfo, nullptr, &image.memory);
+    ASSERT(result == VK_SUCCESS, "Could not allocate image memory");
+
+    result = m_vk.vkBindImageMemory(m_device, image.handle, image.memory, 0);
+    ASSERT(result == VK_SUCCESS, "Could not bind image memory");
+
+    image.view = CreateImageView(image.handle, format, aspect, 0, mipLevels);
+}
+
+VkImageView Renderer::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t baseMipLevel, uint32_t levelCount)
+{
+    VkImageViewCreateInfo viewInfo{};
+    viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.format = format;
+    viewInfo.image = image;
+    viewInfo.subresourceRange.aspectMask = aspect;
+    viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+    viewInfo.subresourceRange.levelCount = levelCount;
+    viewInfo.subresourceRange.layerCount = 1;
+
+    VkImageView view = nullptr;
+    VkResult result = m_vk.vkCreateImageView(m_device, &viewInfo, nullptr, &view);
+    ASSERT(result == VK_SUCCESS, "Could not create image view");
+    return view;
+}
+
+void Renderer::DestroyImage(Image& image)
+{
+    if (image.view != nullptr)
+    {
+        m_vk.vkDestroyImageView(m_device, image.view, nullptr);
+        image.view = nullptr;
+    }
+    if (image.handle != nullptr)
+    {
+        m_vk.vkDestroyImage(m_device, image.handle, nullptr);
+        image.handle = nullptr;
+    }
+    if (image.memory != nullptr)
+    {
+        m_vk.vkFreeMemory(m_device, image.memory, nullptr);
+        image.memory = nullptr;
+    }
+}
+
+void Renderer::CreateGeometryPool()
+{
+    // Mesh shaders fetch positions themselves
+    const VkBufferUsageFlags vertexUsage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | (m_vkCmdDrawMeshTasks != nullptr ? VK_BUFFER_USAGE_STORAGE_BUFFER_BIT : 0);
+    InitPoolBuffer(m_geometryPool.vertices, vertexUsage, VertexCompression::GetPositionStride(m_positionFormat), 1 << 20);
+    InitPoolBuffer(m_geometryPool.indices16, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sizeof(uint16_t), 1 << 21);
+    InitPoolBuffer(m_geometryPool.indices32, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, sizeof(uint32_t), 1 << 20);
+    InitPoolBuffer(m_geometryPool.meshlets, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(MeshletCullData), 1 << 14);
+    InitPoolBuffer(m_geometryPool.meshletVertices, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t), 1 << 20);
+    InitPoolBuffer(m_geometryPool.meshletTriangles, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t), 1 << 20);
+}
+
+void Renderer::InitPoolBuffer(PoolBuffer& pool, VkBufferUsageFlags usage, uint32_t elementSize, uint32_t capacity)
+{
+    pool.buffer.usageFlags = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    pool.elementSize = elementSize;
+    pool.readAccess = 0;
+    if (usage & VK_BUFFER_USAGE_INDEX_BUFFER_BIT)
+        pool.readAccess |= VK_ACCESS_INDEX_READ_BIT;
+    if (usage & VK_BUFFER_USAGE_VERTEX_BUFFER_BIT)
+        pool.readAccess |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+        pool.readAccess |= VK_ACCESS_SHADER_READ_BIT;
+    pool.ranges.Init(capacity);
+    CreateOrResizeBuffer(pool.buffer, (VkDeviceSize)capacity * elementSize, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+uint32_t Renderer::AllocateFromPool(PoolBuffer& pool, const void* data, uint32_t count)
+{
+    uint64_t offset = pool.ranges.Allocate(count);
+    if (offset == RangeAllocator::InvalidOffset)
+    {
+        // Out of space: move everything into a buffer twice the size (or large enough for this request).
+        // Copied on the graphics queue, which owns the old contents once the uploads in flight are acquired
+        const uint64_t newCapacity = std::max(pool.ranges.GetCapacity() * 2, pool.ranges.GetCapacity() + count);
+        SubmitUploads();
+        m_vk.vkDeviceWaitIdle(m_device);
+
+        Buffer newBuffer{};
+        newBuffer.usageFlags = pool.buffer.usageFlags;
+        CreateOrResizeBuffer(newBuffer, newCapacity * pool.elementSize, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        VkCommandPoolCreateInfo cmdPoolInfo{};
+        cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        cmdPoolInfo.queueFamilyIndex = m_graphicsFamilyIndex;
+        VkCommandPool cmdPool = nullptr;
+        VkResult result = m_vk.vkCreateCommandPool(m_device, &cmdPoolInfo, nullptr, &cmdPool);
+        ASSERT(result == VK_SUCCESS, "Could not create command pool");
+
+        VkCommandBufferAllocateInfo cmdBufferInfo{};
+        cmdBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmdBufferInfo.commandPool = cmdPool;
+        cmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        cmdBufferInfo.commandBufferCount = 1;
+        VkCommandBuffer cmd = nullptr;
+        m_vk.vkAllocateCommandBuffers(m_device, &cmdBufferInfo, &cmd);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        m_vk.vkBeginCommandBuffer(cmd, &beginInfo);
+
+        // The transfer queue is idle, the semaphores only matter for frames that wait on them.
+        // The copy below reads the uploaded ranges, the frames still read the other pools' uploads
+        AcquireUploads(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT | m_geometryReadStages, VK_ACCESS_TRANSFER_READ_BIT);
+        for (VkSemaphore semaphore : m_uploadSemaphores)
+        {
+            m_vk.vkDestroySemaphore(m_device, semaphore, nullptr);
+        }
+        m_uploadSemaphores.clear();
+
+        VkBufferCopy region{};
+        region.size = pool.ranges.GetCapacity() * pool.elementSize;
+        m_vk.vkCmdCopyBuffer(cmd, pool.buffer.handle, newBuffer.handle, 1, &region);
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = pool.readAccess;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = newBuffer.handle;
+        barrier.size = VK_WHOLE_SIZE;
+        m_vk.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, m_geometryReadStages, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+        m_vk.vkEndCommandBuffer(cmd);
+
+        VkSubmitInfo submitInfo{};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &cmd;
+        result = m_vk.vkQueueSubmit(m_deviceQueue, 1, &submitInfo, nullptr);
+        ASSERT(result == VK_SUCCESS, "Could not submit geometry pool copy");
+        m_vk.vkQueueWaitIdle(m_deviceQueue);
+        m_vk.vkDestroyCommandPool(m_device, cmdPool, nullptr);
+
+        DestroyBuffer(pool.buffer);
+        pool.buffer = newBuffer;
+        pool.ranges.Grow(newCapacity);
+
+        offset = pool.ranges.Allocate(count);
+        ASSERT(offset != RangeAllocator::InvalidOffset, "Could not allocate from geometry pool");
+    }
+
+    QueueUpload(pool.buffer.handle, offset * pool.elementSize, data, (VkDeviceSize)count * pool.elementSize, pool.readAccess);
+
+    return (uint32_t)offset;
+}
+
+void Renderer::DestroyPoolBuffer(PoolBuffer& pool)
+{
+    DestroyBuffer(pool.buffer);
+    pool.ranges.Init(0);
+}
+
+void Renderer::QueueUpload(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, VkAccessFlags dstAccess)
+{
+    UploadCopy copy{};
+    copy.dst = dst;
+    copy.srcOffset = m_uploadStaging.size();
+    copy.dstOffset = dstOffset;
+    copy.size = size;
+    copy.dstAccess = dstAccess;
+    m_uploadCopies.push_back(copy);
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    m_uploadStaging.insert(m_uploadStaging.end(), bytes, bytes + size);
+}
+
+void Renderer::SubmitUploads()
+{
+    RetireUploads(false);
+    if (m_uploadCopies.empty())
+        return;
+
+    PendingUpload upload{};
+    upload.staging.usageFlags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    void* stagingMemory = nullptr;
+    ReserveMappedBuffer(upload.staging, &stagingMemory, m_uploadStaging.size());
+    memcpy(stagingMemory, m_uploadStaging.data(), m_uploadStaging.size());
+    FlushMappedBuffer(upload.staging);
+    m_vk.vkUnmapMemory(m_device, upload.staging.memory);
+
+    VkCommandBufferAllocateInfo cmdBufferInfo{};
+    cmdBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    cmdBufferInfo.commandPool = m_transferCmdPool;
+    cmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmdBufferInfo.commandBufferCount = 1;
+    VkResult result = m_vk.vkAllocateCommandBuffers(m_device, &cmdBufferInfo, &upload.cmd);
+    ASSERT(result == VK_SUCCESS, "Could not allocate transfer command buffer");
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    m_vk.vkBeginCommandBuffer(upload.cmd, &beginInfo);
+
+    // A dedicated family has to hand the ranges over: released here, acquired by the next frame on the graphics queue.
+    // Otherwise the copies run on the graphics queue ahead of the frame and a plain barrier covers them
+    const bool dedicated = m_transferFamilyIndex != m_graphicsFamilyIndex;
+    std::vector<VkBufferMemoryBarrier> releases{};
+    for (const UploadCopy& copy : m_uploadCopies)
+    {
+        VkBufferCopy region{};
+        region.srcOffset = copy.srcOffset;
+        region.dstOffset = copy.dstOffset;
+        region.size = copy.size;
+        m_vk.vkCmdCopyBuffer(upload.cmd, upload.staging.handle, copy.dst, 1, &region);
+
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcQueueFamilyIndex = dedicated ? (uint32_t)m_transferFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = dedicated ? (uint32_t)m_graphicsFamilyIndex : VK_QUEUE_FAMILY_IGNORED;
+        barrier.buffer = copy.dst;
+        barrier.offset = copy.dstOffset;
+        barrier.size = copy.size;
+        if (dedicated)
+        {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            releases.push_back(barrier);
+            barrier.srcAccessMask = 0;
+        }
+        else
+        {
+            barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        }
+        barrier.dstAccessMask = copy.dstAccess;
+        m_uploadAcquires.push_back(barrier);
+    }
+    if (!releases.empty())
+    {
+        m_vk.vkCmdPipelineBarrier(upload.cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, (uint32_t)releases.size(), releases.data(), 0, nullptr);
+    }
+    m_vk.vkEndCommandBuffer(upload.cmd);
+
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    result = m_vk.vkCreateFence(m_device, &fenceInfo, nullptr, &upload.fence);
+    ASSERT(result == VK_SUCCESS, "Could not create upload fence");
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &upload.cmd;
+    VkSemaphore semaphore = nullptr;
+    if (dedicated)
+    {
+        VkSemaphoreCreateInfo semaphoreInfo{};
+        semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        result = m_vk.vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &semaphore);
+        ASSERT(result == VK_SUCCESS, "Could not create upload semaphore");
+        m_uploadSemaphores.push_back(semaphore);
+
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &semaphore;
+    }
+    result = m_vk.vkQueueSubmit(m_transferQueue, 1, &submitInfo, upload.fence);
+    ASSERT(result == VK_SUCCESS, "Could not submit uploads");
+
+    m_pendingUploads.push_back(upload);
+    m_uploadCopies.clear();
+    m_uploadStaging.clear();
+}
+
+void Renderer::RetireUploads(bool wait)
+{
+    auto finished = [&](PendingUpload& upload)
+    {
+        if (wait)
+            m_vk.vkWaitForFences(m_device, 1, &upload.fence, true, UINT64_MAX);
+        else if (m_vk.vkGetFenceStatus(m_device, upload.fence) != VK_SUCCESS)
+            return false;
+
+        m_vk.vkDestroyFence(m_device, upload.fence, nullptr);
+        m_vk.vkFreeCommandBuffers(m_device, m_transferCmdPool, 1, &upload.cmd);
+        DestroyBuffer(upload.staging);
+        return true;
+    };
+    m_pendingUploads.erase(std::remove_if(m_pendingUploads.begin(), m_pendingUploads.end(), finished), m_pendingUploads.end());
+}
+
+void Renderer::AcquireUploads(VkCommandBuffer cmd, VkPipelineStageFlags dstStages, VkAccessFlags extraAccess)
+{
+    if (m_uploadAcquires.empty())
+        return;
+
+    for (VkBufferMemoryBarrier& barrier : m_uploadAcquires)
+    {
+        barrier.dstAccessMask |= extraAccess;
+    }
+
+    // With a dedicated family the semaphore wait is at dstStages, the acquire chains onto it
+    const VkPipelineStageFlags srcStages = m_transferFamilyIndex != m_graphicsFamilyIndex ? dstStages : VK_PIPELINE_STAGE_TRANSFER_BIT;
+    m_vk.vkCmdPipelineBarrier(cmd, srcStages, dstStages, 0, 0, nullptr, (uint32_t)m_uploadAcquires.size(), m_uploadAcquires.data(), 0, nullptr);
+    m_uploadAcquires.clear();
+}
+
+void Renderer::ReserveMappedBuffer(Buffer& buffer, void** mappedMemory, VkDeviceSize size)
+{
+    if (buffer.handle != nullptr && size <= buffer.size)
+        return;
+
+    if (*mappedMemory != nullptr)
+    {
+        m_vk.vkUnmapMemory(m_device, buffer.memory);
+        *mappedMemory = nullptr;
+    }
+
+    // Grow geometrically so a growing scene doesn't reallocate every frame
+    CreateOrResizeBuffer(buffer, std::max(size, buffer.size * 2));
+
+    VkResult result = m_vk.vkMapMemory(m_device, buffer.memory, 0, VK_WHOLE_SIZE, 0, mappedMemory);
+    ASSERT(result == VK_SUCCESS, "Could not map buffer memory");
+}
+
+void Renderer::FlushMappedBuffer(const Buffer& buffer)
+{
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = buffer.memory;
+    range.size = VK_WHOLE_SIZE;
+    VkResult result = m_vk.vkFlushMappedMemoryRanges(m_device, 1, &range); // Flushing writes data to GPU
+    ASSERT(result == VK_SUCCESS, "Could not flush buffer memory");
+}
+
+void Renderer::ReserveObjectBuffer(PerFrameData& perFrame, size_t objectCount)
+{
+    perFrame.objectBuffer.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    ReserveMappedBuffer(perFrame.objectBuffer, (void**)&perFrame.objectBufferMemory, std::max<size_t>(objectCount, 1) * sizeof(ObjectData));
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = perFrame.objectBuffer.handle;
+    bufferInfo.offset = 0;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = perFrame.descriptorSet;
+    write.dstBinding = 0;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    write.pBufferInfo = &bufferInfo;
+    m_vk.vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+}
+
+void Renderer::ReserveInstanceRing(VkDeviceSize bytesPerFrame)
+{
+    if (bytesPerFrame <= m_instanceRing.segmentSize)
+        return;
+
+    // Growing reallocates the whole ring, so every frame using it must be done
+    m_vk.vkDeviceWaitIdle(m_device);
+
+    if (m_instanceRing.memory != nullptr)
+    {
+        m_vk.vkUnmapMemory(m_device, m_instanceRing.buffer.memory);
+        m_instanceRing.memory = nullptr;
+    }
+
+    // Segments are aligned to the non-coherent atom so each frame can flush just its own range
+    const VkDeviceSize atom = std::max<VkDeviceSize>(m_gpuProperties.limits.nonCoherentAtomSize, 1);
+    VkDeviceSize segmentSize = std::max(bytesPerFrame, m_instanceRing.segmentSize * 2);
+    segmentSize = (segmentSize + atom - 1) / atom * atom;
+
+    m_instanceRing.buffer.usageFlags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    CreateOrResizeBuffer(m_instanceRing.buffer, segmentSize * m_perFrameData.size());
+    m_instanceRing.segmentSize = segmentSize;
+
+    VkResult result = m_vk.vkMapMemory(m_device, m_instanceRing.buffer.memory, 0, VK_WHOLE_SIZE, 0, (void**)(&m_instanceRing.memory));
+    ASSERT(result == VK_SUCCESS, "Could not map instance ring buffer memory");
+}
+
+VkDeviceSize Renderer::UploadInstanceData(uint32_t index)
+{
+    m_instanceUploadBytes = 0;
+    m_instanceUploadSeconds = 0.0;
+    m_sceneUpdateMs = 0.0;
+    m_sceneNodesUpdated = 0;
+    m_sceneNodeBatches.clear();
+
+    const uint32_t immediateCount = (uint32_t)m_frame->instanceData.size();
+    const uint32_t sceneNodeCount = m_sceneHierarchy.GetNodeCount();
+    if (immediateCount + sceneNodeCount == 0)
+        return 0;
+
+    const VkDeviceSize bytes = (VkDeviceSize)(immediateCount + sceneNodeCount) * sizeof(InstanceData);
+    ReserveInstanceRing(bytes);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    const VkDeviceSize segmentOffset = index * m_instanceRing.segmentSize;
+    InstanceData* instances = (InstanceData*)(m_instanceRing.memory + segmentOffset);
+    if (immediateCount > 0)
+        memcpy(instances, m_frame->instanceData.data(), immediateCount * sizeof(InstanceData));
+
+    // Scene nodes write their instances into the ring as their world matrices come out, no staging copy
+    if (sceneNodeCount > 0)
+    {
+        auto updateStart = std::chrono::high_resolution_clock::now();
+        m_sceneNodesUpdated = m_sceneHierarchy.Update(m_jobs, instances + immediateCount);
+        auto updateEnd = std::chrono::high_resolution_clock::now();
+        m_sceneUpdateMs = std::chrono::duration<double, std::milli>(updateEnd - updateStart).count();
+
+        for (const TransformHierarchy::MeshRun& run : m_sceneHierarchy.GetMeshRuns())
+        {
+            InstanceBatch batch{};
+            batch.meshId = run.meshId;
+            batch.firstInstance = immediateCount + run.firstSlot;
+            batch.instanceCount = run.count;
+            m_sceneNodeBatches.push_back(batch);
+        }
+    }
+
+    const VkDeviceSize atom = std::max<VkDeviceSize>(m_gpuProperties.limits.nonCoherentAtomSize, 1);
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = m_instanceRing.buffer.memory;
+    range.offset = segmentOffset;
+    range.size = std::min((bytes + atom - 1) / atom * atom, m_instanceRing.segmentSize);
+    VkResult result = m_vk.vkFlushMappedMemoryRanges(m_device, 1, &range);
+    ASSERT(result == VK_SUCCESS, "Could not flush instance ring buffer memory");
+
+    auto end = std::chrono::high_resolution_clock::now();
+    m_instanceUploadBytes = bytes;
+    m_instanceUploadSeconds = std::chrono::duration<double>(end - start).count();
+
+    return segmentOffset;
+}
+
+void Renderer::UploadObjectData(PerFrameData& perFrame)
+{
+    if (m_frame->objects.empty())
+        return;
+
+    // Safe to (re)allocate here, the frame's fence was waited on in NextImage
+    if (m_frame->objects.size() * sizeof(ObjectData) > perFrame.objectBuffer.size)
+    {
+        ReserveObjectBuffer(perFrame, m_frame->objects.size());
+    }
+
+    memcpy(perFrame.objectBufferMemory, m_frame->objects.data(), m_frame->objects.size() * sizeof(ObjectData));
+    FlushMappedBuffer(perFrame.objectBuffer);
+}
+
+DrawPushConstants Renderer::GetDrawPushConstants(uint32_t objectOffset, uint32_t materialId, const VertexCompression::Dequantization& dequantization) const
+{
+    DrawPushConstants pushConstants{};
+    pushConstants.objectOffset = objectOffset;
+    pushConstants.materialId = materialId;
+    pushConstants.cameraPosition = m_frame->camera.position;
+    pushConstants.cameraZoom = m_frame->camera.zoom;
+    pushConstants.positionScale = dequantization.scale;
+    pushConstants.positionOffset = dequantization.offset;
+    return pushConstants;
+}
+
+void Renderer::ComputeFrustum(Plane out_planes[6]) const
+{
+    const float halfExtent = 1.f / m_frame->camera.zoom;
+    out_planes[0] = { { 1.f, 0.f, 0.f }, -(m_frame->camera.position.x - halfExtent) }; // Left
+    out_planes[1] = { { -1.f, 0.f, 0.f }, m_frame->camera.position.x + halfExtent };   // Right
+    out_planes[2] = { { 0.f, 1.f, 0.f }, -(m_frame->camera.position.y - halfExtent) }; // Bottom
+    out_planes[3] = { { 0.f, -1.f, 0.f }, m_frame->camera.position.y + halfExtent };   // Top
+    out_planes[4] = { { 0.f, 0.f, 1.f }, 0.f };                                 // Near
+    out_planes[5] = { { 0.f, 0.f, -1.f }, 1.f };                                // Far
+}
+
+bool Renderer::IsTwoPhaseCulling() const
+{
+    return m_cullMode == CullMode::Gpu && m_occlusionCulling && !m_clusterCulling;
+}
+
+bool Renderer::IsGpuCulling() const
+{
+    return m_cullMode == CullMode::Gpu && !m_indirectGroups.empty() && !m_frame->objects.empty();
+}
+
+bool Renderer::IsClusterCulling() const
+{
+    return m_clusterCulling && IsGpuCulling();
+}
+
+bool Renderer::IsMeshShaderCulling() const
+{
+    return IsClusterCulling() && m_meshShaderPipeline != nullptr;
+}
+
+void Renderer::BuildDrawGroups()
+{
+    if (m_groupedDrawItemsVersion == m_frame->drawItemsVersion && m_objectCullData.size() == m_frame->objects.size())
+        return;
+
+    m_groupedDrawItemsVersion = m_frame->drawItemsVersion;
+    m_indirectGroups.clear();
+
+    // Group by index type (one index buffer bind each) then material (one push constant each). Compressed positions
+    // also split groups by mesh, the dequantization goes in the push constants too
+    m_drawOrder.resize(m_frame->drawItems.size());
+    for (uint32_t i = 0; i < m_drawOrder.size(); ++i)
+    {
+        m_drawOrder[i] = i;
+    }
+    std::sort(m_drawOrder.begin(), m_drawOrder.end(), [&](uint32_t a, uint32_t b)
+        {
+            const VkIndexType typeA = m_meshes[m_frame->drawItems[a].meshId].indexType;
+            const VkIndexType typeB = m_meshes[m_frame->drawItems[b].meshId].indexType;
+            if (typeA != typeB)
+                return typeA < typeB;
+            if (m_frame->drawItems[a].materialId != m_frame->drawItems[b].materialId)
+                return m_frame->drawItems[a].materialId < m_frame->drawItems[b].materialId;
+            return m_frame->drawItems[a].meshId < m_frame->drawItems[b].meshId;
+        });
+
+    m_objectCullData.assign(m_frame->objects.size(), ObjectCullData{});
+
+    // Two-phase culling gives every group a second region for the objects drawn after the Hi-Z build
+    const uint32_t regions = IsTwoPhaseCulling() ? 2 : 1;
+
+    uint32_t commandCount = 0;
+    for (uint32_t itemIndex : m_drawOrder)
+    {
+        const DrawItem& item = m_frame->drawItems[itemIndex];
+        const Mesh& mesh = m_meshes[item.meshId];
+
+        if (m_indirectGroups.empty()
+            || m_indirectGroups.back().indexType != mesh.indexType
+            || m_indirectGroups.back().materialId != item.materialId
+            || !VertexCompression::SameDequantization(m_indirectGroups.back().positionDequantization, mesh.positionDequantization))
+        {
+            IndirectDrawGroup group{};
+            group.indexType = mesh.indexType;
+            group.materialId = item.materialId;
+            group.positionDequantization = mesh.positionDequantization;
+            group.firstCommand = commandCount;
+            m_indirectGroups.push_back(group);
+        }
+
+        // Without culling an item is one instanced command, with culling every object may become a command
+        const uint32_t itemCommands = m_cullMode == CullMode::None ? 1 : item.objectCount;
+        m_indirectGroups.back().commandCount += itemCommands;
+        commandCount += itemCommands * regions;
+
+        const uint32_t groupIndex = (uint32_t)m_indirectGroups.size() - 1;
+        for (uint32_t object = item.firstObject; object < item.firstObject + item.objectCount; ++object)
+        {
+            m_objectCullData[object] = { item.meshId, groupIndex };
+        }
+    }
+}
+
+VkDeviceSize Renderer::GetDrawCountBufferSize() const
+{
+    return (DrawCountOffset + m_indirectGroups.size() * 2) * sizeof(uint32_t);
+}
+
+void Renderer::WriteIndirectCommands(PerFrameData& perFrame)
+{
+    BuildDrawGroups();
+    if (m_indirectGroups.empty())
+        return;
+
+    const IndirectDrawGroup& lastGroup = m_indirectGroups.back();
+    const uint32_t totalCommands = lastGroup.firstCommand + lastGroup.commandCount * (IsTwoPhaseCulling() ? 2 : 1);
+
+    perFrame.indirectBuffer.usageFlags = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    perFrame.indirectBuffer.concurrent = true;
+    ReserveMappedBuffer(perFrame.indirectBuffer, (void**)&perFrame.indirectBufferMemory, totalCommands * sizeof(VkDrawIndexedIndirectCommand));
+
+    // Culling counters, then one count per group and phase, read by vkCmdDrawIndexedIndirectCount
+    perFrame.drawCountBuffer.usageFlags = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    perFrame.drawCountBuffer.concurrent = true;
+    ReserveMappedBuffer(perFrame.drawCountBuffer, (void**)&perFrame.drawCountBufferMemory, GetDrawCountBufferSize());
+
+    // The camera maps world units straight to NDC, so an error of e world units covers e * zoom * height / 2 pixels
+    // wherever the object is. The larger window side keeps it conservative
+    m_lodErrorScale = m_lodErrorPixels > 0.f ? m_frame->camera.zoom * std::max(m_windowWidth, m_windowHeight) * 0.5f / m_lodErrorPixels : 0.f;
+
+    if (m_cullMode == CullMode::Cpu)
+    {
+        CullObjectsCpu(perFrame);
+        return;
+    }
+
+    if (m_cullMode == CullMode::Gpu)
+    {
+        UploadCullInputs(perFrame);
+        if (IsClusterCulling())
+            UploadClusterInputs(perFrame);
+        return;
+    }
+
+    // No culling: one command per draw item, firstInstance selects the object, the shader reads objects[gl_InstanceIndex]
+    for (uint32_t i = 0; i < m_drawOrder.size(); ++i)
+    {
+        const DrawItem& item = m_frame->drawItems[m_drawOrder[i]];
+        const Mesh& mesh = m_meshes[item.meshId];
+
+        VkDrawIndexedIndirectCommand& command = perFrame.indirectBufferMemory[i];
+        command.indexCount = mesh.indexCount;
+        command.instanceCount = item.objectCount;
+        command.firstIndex = mesh.firstIndex;
+        command.vertexOffset = (int32_t)mesh.vertexOffset;
+        command.firstInstance = item.firstObject;
+    }
+
+    memset(perFrame.drawCountBufferMemory, 0, GetDrawCountBufferSize());
+    for (uint32_t i = 0; i < m_indirectGroups.size(); ++i)
+    {
+        m_indirectGroups[i].drawCount = m_indirectGroups[i].commandCount;
+        perFrame.drawCountBufferMemory[DrawCountOffset + i * 2] = m_indirectGroups[i].commandCount;
+    }
+
+    FlushMappedBuffer(perFrame.indirectBuffer);
+    FlushMappedBuffer(perFrame.drawCountBuffer);
+}
+
+void Renderer::CullObjectsCpu(PerFrameData& perFrame)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    Plane planes[6];
+    ComputeFrustum(planes);
+
+    for (IndirectDrawGroup& group : m_indirectGroups)
+    {
+        group.drawCount = 0;
+    }
+
+    // World boxes around the bounding spheres in parallel, noting which ones moved since the last cull.
+    // With the frustum's planes on the axes a box is culled exactly when its sphere would be
+    const uint32_t objectCount = (uint32_t)m_frame->objects.size();
+    const bool build = objectCount != m_objectBvh.GetObjectCount();
+    m_objectBounds.resize(objectCount);
+    m_objectMoved.resize(objectCount);
+    m_jobs.ParallelFor(objectCount, 4096, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            // Objects outside the draw groups still get a box so the tree covers every index, they're dropped below
+            const ObjectCullData& cull = m_objectCullData[i];
+            Bounds box{};
+            if (cull.drawGroup != UINT32_MAX)
+            {
+                const ObjectData& object = m_frame->objects[i];
+                const Mesh& mesh = m_meshes[cull.meshId];
+                const float radius = mesh.boundsRadius * object.scale;
+                const Vector3 center =
+                {
+                    mesh.boundsCenter.x * object.scale + object.position.x,
+                    mesh.boundsCenter.y * object.scale + object.position.y,
+                    mesh.boundsCenter.z * object.scale + object.position.z
+                };
+                box = { { center.x - radius, center.y - radius, center.z - radius }, { center.x + radius, center.y + radius, center.z + radius } };
+            }
+
+            const Bounds& previous = m_objectBounds[i];
+            m_objectMoved[i] = !build && (box.min.x != previous.min.x || box.min.y != previous.min.y || box.min.z != previous.min.z
+                || box.max.x != previous.max.x || box.max.y != previous.max.y || box.max.z != previous.max.z);
+            m_objectBounds[i] = box;
+        }
+    });
+
+    // Refit while the objects move, refits keep the boxes tight but not the tree, so rebuild it in the background every so often
+    if (build)
     {
-        swapchainInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-        swapchainInfo.queueFamilyIndexCount = 2;
-        swapchainInfo.pQueueFamilyIndices = queueFamilyIndices;
+        m_objectBvh.FinishRebuild(true);
+        m_objectBvh.Build(m_objectBounds.data(), objectCount);
+        m_bvhRefitFrames = 0;
     }
     else
     {
-        swapchainInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-        swapchainInfo.queueFamilyIndexCount = 0;
-        swapchainInfo.pQueueFamilyIndices = nullptr;
-    }
+        m_movedObjects.clear();
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            if (m_objectMoved[i])
+                m_movedObjects.push_back(i);
+        }
 
-    VkResult result = vkCreateSwapchainKHR(m_device, &swapchainInfo, nullptr, &m_swapchain);
-    ASSERT(result == VK_SUCCESS, "Vulkan swapchain could not be created");
+        // The rebuilt tree has the boxes from when it started
+        if (m_objectBvh.FinishRebuild())
+            m_objectBvh.Refit(m_objectBounds.data());
+        else if (m_movedObjects.size() > objectCount / 8)
+            m_objectBvh.Refit(m_objectBounds.data());
+        else if (!m_movedObjects.empty())
+            m_objectBvh.Refit(m_objectBounds.data(), m_movedObjects.data(), (uint32_t)m_movedObjects.size());
 
-    vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, nullptr);
-    std::vector<VkImage> swapchainImages(imageCount);
-    vkGetSwapchainImagesKHR(m_device, m_swapchain, &imageCount, swapchainImages.data());
+        if (!m_movedObjects.empty() && ++m_bvhRefitFrames >= BvhRebuildInterval && !m_objectBvh.IsRebuilding())
+        {
+            m_objectBvh.StartRebuild(m_jobs, m_objectBounds.data(), objectCount);
+            m_bvhRefitFrames = 0;
+        }
+    }
 
-    m_perFrameData.clear();
-    m_perFrameData.resize(imageCount);
-    for (size_t i = 0; i < imageCount; ++i)
+    m_bvhVisibleObjects.clear();
+    m_objectBvh.QueryFrustum(planes, m_bvhVisibleObjects);
+    m_cpuCullVisible.assign(objectCount, 0);
+    for (uint32_t i : m_bvhVisibleObjects)
     {
-        InitPerFrameData(m_perFrameData[i]);
+        m_cpuCullVisible[i] = m_objectCullData[i].drawGroup != UINT32_MAX ? 1 : 0;
     }
 
-    m_imageViews.clear();
-    for (size_t i = 0; i < imageCount; ++i)
+    // Compaction walks the objects in order so command order doesn't depend on the tree
+    uint32_t visible = 0;
+    uint64_t drawnTriangles = 0;
+    for (uint32_t i = 0; i < objectCount; ++i)
     {
-        VkImageViewCreateInfo imgViewInfo{};
-        imgViewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-        imgViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        imgViewInfo.format = out_swapchainFormat;
-        imgViewInfo.image = swapchainImages[i];
-        imgViewInfo.subresourceRange.levelCount = 1;
-        imgViewInfo.subresourceRange.layerCount = 1;
-        imgViewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        imgViewInfo.components.r = VK_COMPONENT_SWIZZLE_R;
-        imgViewInfo.components.g = VK_COMPONENT_SWIZZLE_G;
-        imgViewInfo.components.b = VK_COMPONENT_SWIZZLE_B;
-        imgViewInfo.components.a = VK_COMPONENT_SWIZZLE_A;
+        if (!m_cpuCullVisible[i])
+            continue;
+
+        // Compact survivors to the front of their group
+        const ObjectCullData& cull = m_objectCullData[i];
+        const Mesh& mesh = m_meshes[cull.meshId];
+        const MeshLod& lod = mesh.lods[SelectLod(mesh, m_frame->objects[i].scale)];
+        IndirectDrawGroup& group = m_indirectGroups[cull.drawGroup];
+        VkDrawIndexedIndirectCommand& command = perFrame.indirectBufferMemory[group.firstCommand + group.drawCount++];
+        command.indexCount = lod.indexCount;
+        command.instanceCount = 1;
+        command.firstIndex = lod.firstIndex;
+        command.vertexOffset = (int32_t)mesh.vertexOffset;
+        command.firstInstance = i;
+        drawnTriangles += lod.indexCount / 3;
+        ++visible;
+    }
 
-        VkImageView imageView{};
-        result = vkCreateImageView(m_device, &imgViewInfo, nullptr, &imageView);
-        ASSERT(result == VK_SUCCESS, "Could not create Image view " + std::to_string(i));
-        m_imageViews.push_back(imageView);
+    memset(perFrame.drawCountBufferMemory, 0, GetDrawCountBufferSize());
+    perFrame.drawCountBufferMemory[FrustumCulledCounter] = (uint32_t)m_frame->objects.size() - visible;
+    for (uint32_t i = 0; i < m_indirectGroups.size(); ++i)
+    {
+        perFrame.drawCountBufferMemory[DrawCountOffset + i * 2] = m_indirectGroups[i].drawCount;
     }
 
+    FlushMappedBuffer(perFrame.indirectBuffer);
+    FlushMappedBuffer(perFrame.drawCountBuffer);
+
+    auto end = std::chrono::high_resolution_clock::now();
+    m_cullStats.cpuCullMs = std::chrono::duration<double, std::milli>(end - start).count();
+    m_cullStats.visibleObjects = visible;
+    m_cullStats.totalObjects = (uint32_t)m_frame->objects.size();
+    m_cullStats.frustumCulled = (uint32_t)m_frame->objects.size() - visible;
+    m_cullStats.occlusionCulled = 0;
+    m_cullStats.drawnFirstPhase = visible;
+    m_cullStats.drawnSecondPhase = 0;
+    m_cullStats.drawnTriangles = drawnTriangles;
+    m_cullStats.clusterTriangles = 0;
+    m_cullStats.coneCulledTriangles = 0;
 }
 
-void Renderer::CreateRenderPass(const VkFormat swapchainFormat)
+uint32_t Renderer::SelectLod(const Mesh& mesh, float objectScale) const
 {
-    VkAttachmentDescription attachment{};
-    attachment.format = swapchainFormat;
-    attachment.samples = VK_SAMPLE_COUNT_1_BIT; // No multisampling
-    attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE; // Not using
-    attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE; // Not using
-    attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    if (m_lodErrorScale <= 0.f)
+        return 0;
 
-    VkAttachmentReference colorReference{};
-    colorReference.attachment = 0;
-    colorReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    // Errors only grow down the chain
+    for (uint32_t level = mesh.lodCount - 1; level > 0; --level)
+    {
+        if (mesh.lods[level].error * objectScale * m_lodErrorScale <= 1.f)
+            return level;
+    }
+    return 0;
+}
 
-    VkSubpassDescription subpass{};
-    subpass.flags = 0;
-    subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-    subpass.colorAttachmentCount = 1;
-    subpass.pColorAttachments = &colorReference;
+void Renderer::UploadCullInputs(PerFrameData& perFrame)
+{
+    perFrame.cullObjectBuffer.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    perFrame.cullObjectBuffer.concurrent = true;
+    ReserveMappedBuffer(perFrame.cullObjectBuffer, (void**)&perFrame.cullObjectBufferMemory, std::max<size_t>(m_objectCullData.size(), 1) * sizeof(ObjectCullData));
+    memcpy(perFrame.cullObjectBufferMemory, m_objectCullData.data(), m_objectCullData.size() * sizeof(ObjectCullData));
+    FlushMappedBuffer(perFrame.cullObjectBuffer);
+
+    perFrame.meshCullBuffer.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    perFrame.meshCullBuffer.concurrent = true;
+    ReserveMappedBuffer(perFrame.meshCullBuffer, (void**)&perFrame.meshCullBufferMemory, m_meshes.size() * sizeof(MeshCullData));
+    for (uint32_t i = 0; i < m_meshes.size(); ++i)
+    {
+        MeshCullData& meshCull = perFrame.meshCullBufferMemory[i];
+        meshCull.boundsCenter = m_meshes[i].boundsCenter;
+        meshCull.boundsRadius = m_meshes[i].boundsRadius;
+        meshCull.indexCount = m_meshes[i].indexCount;
+        meshCull.firstIndex = m_meshes[i].firstIndex;
+        meshCull.vertexOffset = (int32_t)m_meshes[i].vertexOffset;
+        meshCull.firstMeshlet = m_meshes[i].firstMeshlet;
+        meshCull.meshletCount = m_meshes[i].meshletCount;
+
+        // Errors pre-scaled for this frame's camera, the shader only multiplies by the object's scale
+        meshCull.lodCount = m_lodErrorScale > 0.f ? m_meshes[i].lodCount : 1;
+        for (uint32_t level = 0; level < meshCull.lodCount; ++level)
+        {
+            const MeshLod& lod = m_meshes[i].lods[level];
+            meshCull.lods[level] = { lod.firstIndex, lod.indexCount, lod.error * m_lodErrorScale, 0 };
+        }
+    }
+    FlushMappedBuffer(perFrame.meshCullBuffer);
+
+    perFrame.drawGroupBuffer.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    perFrame.drawGroupBuffer.concurrent = true;
+    ReserveMappedBuffer(perFrame.drawGroupBuffer, (void**)&perFrame.drawGroupBufferMemory, m_indirectGroups.size() * 2 * sizeof(uint32_t));
+    for (uint32_t i = 0; i < m_indirectGroups.size(); ++i)
+    {
+        perFrame.drawGroupBufferMemory[i * 2] = m_indirectGroups[i].firstCommand;
+        perFrame.drawGroupBufferMemory[i * 2 + 1] = m_indirectGroups[i].commandCount;
+    }
+    FlushMappedBuffer(perFrame.drawGroupBuffer);
 
-    VkSubpassDependency subpassDependency{};
-    subpassDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    subpassDependency.dstSubpass = 0;
-    subpassDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpassDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    subpassDependency.srcAccessMask = 0;
-    subpassDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    // Visibility carries over between frames, so it's shared and only reset when the object count changes.
+    // Starting with everything visible makes the first frame draw the frustum set in phase 1.
+    if (m_visibilityObjectCount != m_frame->objects.size())
+    {
+        m_vk.vkDeviceWaitIdle(m_device);
+        m_visibilityBuffer.usageFlags = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        m_visibilityBuffer.concurrent = true;
+        ReserveMappedBuffer(m_visibilityBuffer, (void**)&m_visibilityBufferMemory, std::max<size_t>(m_frame->objects.size(), 1) * sizeof(uint32_t));
+        std::fill(m_visibilityBufferMemory, m_visibilityBufferMemory + m_frame->objects.size(), 1u);
+        FlushMappedBuffer(m_visibilityBuffer);
+        m_visibilityObjectCount = m_frame->objects.size();
+    }
 
-    VkRenderPassCreateInfo renderPassInfo{};
-    renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    renderPassInfo.attachmentCount = 1;
-    renderPassInfo.pAttachments = &attachment;
-    renderPassInfo.subpassCount = 1;
-    renderPassInfo.pSubpasses = &subpass;
-    renderPassInfo.dependencyCount = 1;
-    renderPassInfo.pDependencies = &subpassDependency;
+    // Buffers may have been reallocated, the set isn't in use (fence waited in NextImage)
+    const Buffer* buffers[7] =
+    {
+        &perFrame.objectBuffer,
+        &perFrame.cullObjectBuffer,
+        &perFrame.meshCullBuffer,
+        &perFrame.drawGroupBuffer,
+        &perFrame.indirectBuffer,
+        &perFrame.drawCountBuffer,
+        &m_visibilityBuffer
+    };
+
+    VkDescriptorBufferInfo bufferInfos[7]{};
+    VkWriteDescriptorSet writes[8]{};
+    for (uint32_t i = 0; i < 7; ++i)
+    {
+        bufferInfos[i].buffer = buffers[i]->handle;
+        bufferInfos[i].offset = 0;
+        bufferInfos[i].range = VK_WHOLE_SIZE;
+
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = perFrame.cullDescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
 
-    VkResult result = vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_renderPass);
+    VkDescriptorImageInfo hizInfo{};
+    hizInfo.sampler = m_pointSampler;
+    hizInfo.imageView = perFrame.hizView;
+    hizInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    writes[7].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[7].dstSet = perFrame.cullDescriptorSet;
+    writes[7].dstBinding = 7;
+    writes[7].descriptorCount = 1;
+    writes[7].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[7].pImageInfo = &hizInfo;
+    m_vk.vkUpdateDescriptorSets(m_device, perFrame.hizView != nullptr ? 8 : 7, writes, 0, nullptr);
 }
 
-void Renderer::CreateBuffers()
+void Renderer::UploadClusterInputs(PerFrameData& perFrame)
 {
-    m_vertexBuffer.usageFlags = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-    m_indexBuffer.usageFlags = VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    // Every object of every draw item goes in at full detail
+    m_clusterTriangles = 0;
+    for (const DrawItem& item : m_frame->drawItems)
+    {
+        m_clusterTriangles += (uint64_t)item.objectCount * (m_meshes[item.meshId].lods[0].indexCount / 3);
+    }
 
-    Vector3 vertexData[3] =
+    // Compute cluster culling appends the surviving triangles here, the worst case is everything in the frustum
+    // and facing the camera. Task shaders draw without it, the descriptor only has to point somewhere
+    uint32_t capacity = 3;
+    if (!IsMeshShaderCulling())
     {
-        {-0.5f, -0.5f, 0.0f},
-        {0.0f, 0.5f, 0.0f},
-        {0.5f, -0.5f, 0.0f}
+        capacity = (uint32_t)std::min<uint64_t>(std::max<uint64_t>(m_clusterTriangles * 3, 3), MaxClusterIndices);
+        if (capacity == MaxClusterIndices && perFrame.clusterIndexCapacity != capacity)
+            LOG("Cluster index buffer capped at " + std::to_string(MaxClusterIndices) + " indices, objects past it are skipped");
+    }
+    if (perFrame.clusterIndexBuffer.handle == nullptr || perFrame.clusterIndexCapacity < capacity)
+    {
+        perFrame.clusterIndexBuffer.usageFlags = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+        CreateOrResizeBuffer(perFrame.clusterIndexBuffer, (VkDeviceSize)capacity * sizeof(uint32_t), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+    perFrame.clusterIndexCapacity = std::max(perFrame.clusterIndexCapacity, capacity);
+
+    const Buffer* buffers[6] =
+    {
+        &m_geometryPool.meshlets.buffer,
+        &m_geometryPool.meshletVertices.buffer,
+        &m_geometryPool.meshletTriangles.buffer,
+        &m_geometryPool.vertices.buffer,
+        &perFrame.clusterIndexBuffer,
+        &perFrame.drawCountBuffer
     };
 
-    uint32_t indexData[3] = { 0, 1, 2 };
+    VkDescriptorBufferInfo bufferInfos[6]{};
+    VkWriteDescriptorSet writes[6]{};
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        bufferInfos[i].buffer = buffers[i]->handle;
+        bufferInfos[i].offset = 0;
+        bufferInfos[i].range = VK_WHOLE_SIZE;
+
+        writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[i].dstSet = perFrame.meshletDescriptorSet;
+        writes[i].dstBinding = i;
+        writes[i].descriptorCount = 1;
+        writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    m_vk.vkUpdateDescriptorSets(m_device, 6, writes, 0, nullptr);
+
+    perFrame.pendingClusterTriangles = m_clusterTriangles;
+    perFrame.pendingMeshShaderCull = IsMeshShaderCulling();
+}
+
+void Renderer::ReadGpuCullResults(PerFrameData& perFrame)
+{
+    if (perFrame.pendingCullGroups == 0)
+        return;
 
-    CreateOrResizeBuffer(m_vertexBuffer, sizeof(vertexData));
-    CreateOrResizeBuffer(m_indexBuffer, sizeof(indexData));
+    // The frame's fence has been waited on, the counts written by the cull pass are final
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = perFrame.drawCountBuffer.memory;
+    range.size = VK_WHOLE_SIZE;
+    m_vk.vkInvalidateMappedMemoryRanges(m_device, 1, &range);
+
+    const uint32_t* counts = perFrame.drawCountBufferMemory;
+    m_cullStats.drawnFirstPhase = 0;
+    m_cullStats.drawnSecondPhase = 0;
+    m_cullStats.drawnTriangles = 0;
+    for (uint32_t i = 0; i < perFrame.pendingCullGroups; ++i)
+    {
+        m_cullStats.drawnFirstPhase += counts[DrawCountOffset + i * 2];
+        m_cullStats.drawnSecondPhase += counts[DrawCountOffset + i * 2 + 1];
+    }
+    m_cullStats.visibleObjects = m_cullStats.drawnFirstPhase + m_cullStats.drawnSecondPhase;
+    m_cullStats.totalObjects = (uint32_t)m_frame->objects.size();
+    m_cullStats.frustumCulled = counts[FrustumCulledCounter];
+    m_cullStats.occlusionCulled = counts[OcclusionCulledCounter];
+
+    // Cluster culling counts triangles too, objects only when they're culled whole. Task shaders write no commands,
+    // every object they didn't cull drew something
+    m_cullStats.clusterTriangles = perFrame.pendingClusterTriangles;
+    m_cullStats.coneCulledTriangles = 0;
+    if (perFrame.pendingClusterTriangles > 0)
+    {
+        const uint32_t drawnIndices = perFrame.pendingMeshShaderCull ? counts[ClusterIndexCounter] : std::min(counts[ClusterIndexCounter], perFrame.clusterIndexCapacity);
+        m_cullStats.drawnTriangles = drawnIndices / 3;
+        m_cullStats.coneCulledTriangles = counts[ConeCulledCounter];
+        if (perFrame.pendingMeshShaderCull)
+        {
+            m_cullStats.visibleObjects = m_cullStats.totalObjects - std::min(m_cullStats.frustumCulled, m_cullStats.totalObjects);
+            m_cullStats.drawnFirstPhase = m_cullStats.visibleObjects;
+        }
+    }
 
-    Vector3* vertexBufferMemory;
-    VkResult result = vkMapMemory(m_device, m_vertexBuffer.memory, 0, sizeof(vertexData), 0, (void**)(&vertexBufferMemory));
-    ASSERT(result == VK_SUCCESS, "Could not map vertex buffer memory");
-    memcpy(vertexBufferMemory, vertexData, sizeof(vertexData));
+    if (perFrame.timestampQueryPool != nullptr && perFrame.timestampCount > 0)
+    {
+        uint64_t timestamps[4]{};
+        VkResult result = m_vk.vkGetQueryPoolResults(m_device, perFrame.timestampQueryPool, 0, perFrame.timestampCount,
+            sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+        {
+            uint64_t ticks = 0;
+            for (uint32_t i = 0; i < perFrame.timestampCount; i += 2)
+            {
+                ticks += timestamps[i + 1] - timestamps[i];
+            }
+            m_cullStats.gpuCullMs = ticks * (double)m_gpuProperties.limits.timestampPeriod / 1e6;
+        }
+    }
 
-    uint32_t* indexBufferMemory;
-    result = vkMapMemory(m_device, m_indexBuffer.memory, 0, sizeof(indexData), 0, (void**)(&indexBufferMemory));
-    ASSERT(result == VK_SUCCESS, "Could not map index buffer memory");
-    memcpy(indexBufferMemory, indexData, sizeof(indexData));
+    perFrame.pendingCullGroups = 0;
+    perFrame.pendingClusterTriangles = 0;
+    perFrame.pendingMeshShaderCull = false;
+}
 
-    VkMappedMemoryRange ranges[2]{};
-    ranges[0].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    ranges[0].memory = m_vertexBuffer.memory;
-    ranges[0].size = VK_WHOLE_SIZE;
-    ranges[1].sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    ranges[1].memory = m_indexBuffer.memory;
-    ranges[1].size = VK_WHOLE_SIZE;
+void Renderer::RecordCulling(VkCommandBuffer cmd, PerFrameData& perFrame, CullPhase phase)
+{
+    // Phase 2 timestamps also cover the Hi-Z build recorded just before it
+    const uint32_t firstQuery = phase == CullPhase::Second ? 2 : 0;
+    if (phase != CullPhase::Second && perFrame.timestampQueryPool != nullptr)
+    {
+        m_vk.vkCmdResetQueryPool(cmd, perFrame.timestampQueryPool, 0, 4);
+        m_vk.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, perFrame.timestampQueryPool, 0);
+    }
 
-    result = vkFlushMappedMemoryRanges(m_device, 2, ranges); // Flushing writes data to GPU
-    ASSERT(result == VK_SUCCESS, "Could not flush vertex and index buffer memory");
+    CullPushConstants pushConstants{};
+    ComputeFrustum(pushConstants.frustumPlanes);
+    pushConstants.objectCount = (uint32_t)m_frame->objects.size();
+    pushConstants.phase = phase;
+    pushConstants.cameraPosition = m_frame->camera.position;
+    pushConstants.cameraZoom = m_frame->camera.zoom;
+    pushConstants.hizMipLevels = m_hizMipLevels;
+    pushConstants.hizWidth = m_hizExtent.width;
+    pushConstants.hizHeight = m_hizExtent.height;
+
+    m_vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipeline);
+    m_vk.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cullPipelineLayout, 0, 1, &perFrame.cullDescriptorSet, 0, nullptr);
+    m_vk.vkCmdPushConstants(cmd, m_cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullPushConstants), &pushConstants);
+    m_vk.vkCmdDispatch(cmd, (pushConstants.objectCount + 63) / 64, 1, 1);
+
+    if (perFrame.timestampQueryPool != nullptr)
+    {
+        m_vk.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, perFrame.timestampQueryPool, firstQuery + 1);
+        perFrame.timestampCount = firstQuery + 2;
+    }
 
-    vkUnmapMemory(m_device, m_vertexBuffer.memory);
-    vkUnmapMemory(m_device, m_indexBuffer.memory);
+    perFrame.pendingCullGroups = (uint32_t)m_indirectGroups.size();
 }
 
+void Renderer::RecordClusterCulling(VkCommandBuffer cmd, PerFrameData& perFrame)
+{
+    if (perFrame.timestampQueryPool != nullptr)
+    {
+        m_vk.vkCmdResetQueryPool(cmd, perFrame.timestampQueryPool, 0, 4);
+        m_vk.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, perFrame.timestampQueryPool, 0);
+    }
+
+    ClusterCullPushConstants pushConstants{};
+    ComputeFrustum(pushConstants.frustumPlanes);
+    pushConstants.objectCount = (uint32_t)m_frame->objects.size();
+    pushConstants.indexCapacity = perFrame.clusterIndexCapacity;
 
-void Renderer::CreatePipeline()
+    // One workgroup per object, wrapped into rows past the dispatch limit
+    const uint32_t groupsX = std::min(pushConstants.objectCount, 65535u);
+    const uint32_t groupsY = (pushConstants.objectCount + groupsX - 1) / groupsX;
+
+    const VkDescriptorSet sets[2] = { perFrame.cullDescriptorSet, perFrame.meshletDescriptorSet };
+    m_vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_clusterCullPipeline);
+    m_vk.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_clusterCullPipelineLayout, 0, 2, sets, 0, nullptr);
+    m_vk.vkCmdPushConstants(cmd, m_clusterCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullPushConstants), &pushConstants);
+    m_vk.vkCmdDispatch(cmd, groupsX, groupsY, 1);
+
+    if (perFrame.timestampQueryPool != nullptr)
+    {
+        m_vk.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, perFrame.timestampQueryPool, 1);
+        perFrame.timestampCount = 2;
+    }
+
+    perFrame.pendingCullGroups = (uint32_t)m_indirectGroups.size();
+}
+
+void Renderer::SubmitAsyncCulling(PerFrameData& perFrame)
 {
-    VkPipelineLayoutCreateInfo layoutInfo{};
-    layoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    VkResult result = vkCreatePipelineLayout(m_device, &layoutInfo, nullptr, &m_pipelineLayout);
-    ASSERT(result == VK_SUCCESS, "Could not create pipeline layout");
-    
-    // Set up Vertex/Index buffer binding
-    VkVertexInputBindingDescription bindingDesc[1]{};
-    bindingDesc[0].stride = sizeof(Vector3);
-    bindingDesc[0].binding = 0;
-    bindingDesc[0].inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    VkVertexInputAttributeDescription attributeDesc[1]{}; // Add More for more attributes in a vertex (pos, uv, col, etc)
-    attributeDesc[0].location = 0;
-    attributeDesc[0].binding = bindingDesc[0].binding;
-    attributeDesc[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDesc[0].offset = 0;
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.pVertexBindingDescriptions = bindingDesc;
-    vertexInputInfo.vertexAttributeDescriptionCount = 1;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDesc;
+    VkCommandBuffer cmd = perFrame.computeCmdBuffer;
 
-    // Specify triangles
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyInfo{};
-    inputAssemblyInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    m_vk.vkBeginCommandBuffer(cmd, &beginInfo);
 
-    // Rasterizer Options
-    VkPipelineRasterizationStateCreateInfo rasterizerInfo{};
-    rasterizerInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizerInfo.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizerInfo.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizerInfo.lineWidth = 1.f;
+    // Same as the graph's clear and cull passes
+    m_vk.vkCmdFillBuffer(cmd, perFrame.drawCountBuffer.handle, 0, GetDrawCountBufferSize(), 0);
 
-    // Color writing (no blending)
-    VkPipelineColorBlendAttachmentState blendAttachment{};
-    blendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+    VkMemoryBarrier clearBarrier{};
+    clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    m_vk.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
 
-    VkPipelineColorBlendStateCreateInfo blendInfo{};
-    blendInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    blendInfo.attachmentCount = 1;
-    blendInfo.pAttachments = &blendAttachment;
+    RecordCulling(cmd, perFrame, IsTwoPhaseCulling() ? CullPhase::First : CullPhase::Single);
+    m_vk.vkEndCommandBuffer(cmd);
 
-    // Specify Viewport and scissor (scissor is the clipping area)
-    VkPipelineViewportStateCreateInfo viewportInfo{};
-    viewportInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportInfo.viewportCount = 1;
-    viewportInfo.scissorCount = 1; // must be same as viewport count
+    // Visibility from the last frame is written on the graphics queue
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmd;
+    if (m_pendingVisibilitySemaphore != nullptr)
+    {
+        submitInfo.waitSemaphoreCount = 1;
+        submitInfo.pWaitSemaphores = &m_pendingVisibilitySemaphore;
+        submitInfo.pWaitDstStageMask = &waitStage;
+    }
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &perFrame.computeSemaphore;
+    VkResult result = m_vk.vkQueueSubmit(m_computeQueue, 1, &submitInfo, nullptr);
+    ASSERT(result == VK_SUCCESS, "Could not submit async culling");
 
-    // Depth Testing Stencil (disabled)
-    VkPipelineDepthStencilStateCreateInfo depthStencilInfo{};
-    depthStencilInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    m_pendingVisibilitySemaphore = nullptr;
+}
 
-    // Multisampling (diabled)
-    VkPipelineMultisampleStateCreateInfo multisampleInfo{};
-    multisampleInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampleInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+void Renderer::RecordDepthPyramid(VkCommandBuffer cmd, PerFrameData& perFrame)
+{
+    if (perFrame.timestampQueryPool != nullptr)
+    {
+        m_vk.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, perFrame.timestampQueryPool, 2);
+    }
 
-    // Specify that that the viewport and scissor will dynamic (not a part of the pipeline)
-    VkDynamicState dynamics[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    // The render graph has moved the pyramid to GENERAL, only the levels need ordering here
+    m_vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_hizPipeline);
 
-    VkPipelineDynamicStateCreateInfo dynamicInfo{};
-    dynamicInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicInfo.pDynamicStates = dynamics;
-    dynamicInfo.dynamicStateCount = 2;
+    DepthPyramidPushConstants pushConstants{};
+    pushConstants.sourceWidth = m_windowWidth;
+    pushConstants.sourceHeight = m_windowHeight;
+    for (uint32_t level = 0; level < m_hizMipLevels; ++level)
+    {
+        pushConstants.destinationWidth = std::max(m_hizExtent.width >> level, 1u);
+        pushConstants.destinationHeight = std::max(m_hizExtent.height >> level, 1u);
+
+        m_vk.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_hizPipelineLayout, 0, 1, &perFrame.hizDescriptorSets[level], 0, nullptr);
+        m_vk.vkCmdPushConstants(cmd, m_hizPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthPyramidPushConstants), &pushConstants);
+        m_vk.vkCmdDispatch(cmd, (pushConstants.destinationWidth + 7) / 8, (pushConstants.destinationHeight + 7) / 8, 1);
+
+        // The next level reads this one, the graph orders the last one against the cull pass
+        VkMemoryBarrier levelBarrier{};
+        levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        m_vk.vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+        pushConstants.sourceWidth = pushConstants.destinationWidth;
+        pushConstants.sourceHeight = pushConstants.destinationHeight;
+    }
+}
 
-    // Load Shaders
-    VkPipelineShaderStageCreateInfo shaderStages[2] = { VkPipelineShaderStageCreateInfo(), VkPipelineShaderStageCreateInfo() };
+void Renderer::BeginMainPass(VkCommandBuffer cmd, uint32_t index, VkRenderPass renderPass, VkSubpassContents contents)
+{
+    VkClearValue clearValues[2]{};
+    clearValues[0].color = { 0.01f, 0.01f, 0.01f, 1.f };
+    clearValues[1].depthStencil = { 1.f, 0 };
 
-    //Vertex
-    VkPipelineShaderStageCreateInfo& vertexShader = shaderStages[0];
-    vertexShader.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertexShader.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertexShader.module = LoadShader("Assets/Shaders/bin/basic.vert.spirv");
-    vertexShader.pName = "main";
+    VkRenderPassBeginInfo passBeginInfo{};
+    passBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+    passBeginInfo.renderPass = renderPass;
+    passBeginInfo.framebuffer = m_framebuffers[index];
+    passBeginInfo.renderArea.extent.width = m_windowWidth;
+    passBeginInfo.renderArea.extent.height = m_windowHeight;
+    passBeginInfo.clearValueCount = 2;
+    passBeginInfo.pClearValues = clearValues;
+    m_vk.vkCmdBeginRenderPass(cmd, &passBeginInfo, contents);
+}
 
-    //Fragment (Pixel)
-    VkPipelineShaderStageCreateInfo& fragmentShader = shaderStages[1];
-    fragmentShader.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragmentShader.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragmentShader.module = LoadShader("Assets/Shaders/bin/basic.frag.spirv");
-    fragmentShader.pName = "main";
+// Secondaries inherit none of this, each one sets it again
+void Renderer::SetMainPassState(VkCommandBuffer cmd, uint32_t index)
+{
+    VkViewport viewport{};
+    viewport.y = m_windowHeight;
+    viewport.width = m_windowWidth;
+    viewport.height = -viewport.y;
+    viewport.minDepth = 0.f;
+    viewport.maxDepth = 1.f;
+    m_vk.vkCmdSetViewport(cmd, 0, 1, &viewport);
 
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2; // vert & frag
-    pipelineInfo.pStages = shaderStages;
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssemblyInfo;
-    pipelineInfo.pRasterizationState = &rasterizerInfo;
-    pipelineInfo.pColorBlendState = &blendInfo;
-    pipelineInfo.pMultisampleState = &multisampleInfo;
-    pipelineInfo.pViewportState = &viewportInfo;
-    pipelineInfo.pDepthStencilState = &depthStencilInfo;
-    pipelineInfo.pDynamicState = &dynamicInfo;
+    VkRect2D scissor{};
+    scissor.extent.width = m_windowWidth;
+    scissor.extent.height = m_windowHeight;
+    m_vk.vkCmdSetScissor(cmd, 0, 1, &scissor);
 
-    pipelineInfo.renderPass = m_renderPass;
-    pipelineInfo.layout = m_pipelineLayout;
+    m_vk.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &m_perFrameData[index].descriptorSet, 0, nullptr);
+}
 
-    result = vkCreateGraphicsPipelines(m_device, nullptr, 1, &pipelineInfo, nullptr, &m_graphicsPipeline);
-    ASSERT(result == VK_SUCCESS, "Could not create Vulkan graphics pipeline");
+void Renderer::RecordMainPass(VkCommandBuffer cmd, uint32_t index, VkRenderPass renderPass, uint32_t phase, bool instanced, VkDeviceSize instanceOffset)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (m_recordThreads > 1)
+    {
+        BeginMainPass(cmd, index, renderPass, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        RecordSceneParallel(cmd, index, renderPass, phase, instanced, instanceOffset);
+    }
+    else
+    {
+        BeginMainPass(cmd, index, renderPass, VK_SUBPASS_CONTENTS_INLINE);
+        SetMainPassState(cmd, index);
+        RecordScene(cmd, index, phase);
+        if (instanced)
+            RecordInstancedDraws(cmd, instanceOffset);
+    }
+    m_vk.vkCmdEndRenderPass(cmd);
 
-    //Pipeline is created, we can now delete the shader modules
-    vkDestroyShaderModule(m_device, vertexShader.module, nullptr);
-    vkDestroyShaderModule(m_device, fragmentShader.module, nullptr);
+    auto end = std::chrono::high_resolution_clock::now();
+    m_sceneRecordMs += std::chrono::duration<double, std::milli>(end - start).count();
 }
 
-void Renderer::CreateFramebuffers()
+void Renderer::RecordScene(VkCommandBuffer cmd, uint32_t index, uint32_t phase)
 {
-    m_framebuffers.clear();
+    // Mesh shaders have no position-only variant, clusters are drawn once
+    const bool depthPrepass = m_depthPrepass && !IsMeshShaderCulling();
+    if (depthPrepass)
+    {
+        m_vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_depthPrepassPipeline);
+        RecordDrawItems(cmd, m_perFrameData[index], phase);
+    }
 
-    for (VkImageView& imageView : m_imageViews)
+    m_vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPrepass ? m_graphicsEqualPipeline : m_graphicsPipeline);
+    RecordDrawItems(cmd, m_perFrameData[index], phase);
+}
+
+void Renderer::RecordSceneParallel(VkCommandBuffer cmd, uint32_t index, VkRenderPass renderPass, uint32_t phase, bool instanced, VkDeviceSize instanceOffset)
+{
+    // One pool per job system worker, plus one for the render thread, which helps while it waits
+    PerFrameData& perFrame = m_perFrameData[index];
+    const uint32_t workerCount = m_jobs.GetWorkerCount();
+    while (perFrame.recordWorkers.size() < workerCount + 1)
     {
-        VkFramebufferCreateInfo framebufferInfo{};
-        framebufferInfo.renderPass = m_renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.pAttachments = &imageView;
-        framebufferInfo.width = m_windowWidth;
-        framebufferInfo.height = m_windowHeight;
-        framebufferInfo.layers = 1;
+        VkCommandPoolCreateInfo cmdPoolInfo{};
+        cmdPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        cmdPoolInfo.queueFamilyIndex = m_graphicsFamilyIndex;
+
+        RecordWorker worker{};
+        VkResult result = m_vk.vkCreateCommandPool(m_device, &cmdPoolInfo, nullptr, &worker.pool);
+        ASSERT(result == VK_SUCCESS, "Could not create worker command pool");
+        perFrame.recordWorkers.push_back(worker);
+    }
 
-        VkFramebuffer framebuffer;
-        VkResult result = vkCreateFramebuffer(m_device, &framebufferInfo, nullptr, &framebuffer);
-        ASSERT(result == VK_SUCCESS, "Could not create framebuffer");
+    // Each job records a contiguous slice of the draw list, once per pipeline, into the pool of the worker it runs on.
+    // Every prepass slice has to execute before the first shading slice
+    const uint32_t sliceCount = m_recordThreads;
+    const uint32_t drawCount = GetDrawListSize();
+    const uint32_t sliceSize = (drawCount + sliceCount - 1) / sliceCount;
+    const bool depthPrepass = m_depthPrepass && !IsMeshShaderCulling();
+    const uint32_t pipelineCount = depthPrepass ? 2 : 1;
+    const VkPipeline pipelines[2] =
+    {
+        depthPrepass ? m_depthPrepassPipeline : m_graphicsPipeline,
+        m_graphicsEqualPipeline
+    };
+
+    std::vector<VkCommandBuffer> secondaries(pipelineCount * sliceCount + 1, nullptr);
+    m_jobs.ParallelFor(sliceCount, 1, [&](uint32_t firstSlice, uint32_t endSlice)
+    {
+        const uint32_t worker = JobSystem::GetWorkerIndex();
+        RecordWorker& recordWorker = perFrame.recordWorkers[worker != JobSystem::InvalidWorker ? worker : workerCount];
+
+        for (uint32_t slice = firstSlice; slice < endSlice; ++slice)
+        {
+            const uint32_t first = std::min(drawCount, slice * sliceSize);
+            const uint32_t count = std::min(drawCount - first, sliceSize);
+            if (count > 0)
+            {
+                for (uint32_t pipeline = 0; pipeline < pipelineCount; ++pipeline)
+                {
+                    VkCommandBuffer secondary = BeginSecondary(recordWorker, index, renderPass);
+                    m_vk.vkCmdBindPipeline(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[pipeline]);
+                    RecordDrawItems(secondary, perFrame, phase, first, count);
+                    m_vk.vkEndCommandBuffer(secondary);
+                    secondaries[pipeline * sliceCount + slice] = secondary;
+                }
+            }
+
+            // Instanced draws go after the whole scene, the last slice is the smallest
+            if (instanced && slice == sliceCount - 1 && (!m_frame->instanceBatches.empty() || !m_sceneNodeBatches.empty()))
+            {
+                VkCommandBuffer secondary = BeginSecondary(recordWorker, index, renderPass);
+                RecordInstancedDraws(secondary, instanceOffset);
+                m_vk.vkEndCommandBuffer(secondary);
+                secondaries.back() = secondary;
+            }
+        }
+    }, sliceCount);
+
+    secondaries.erase(std::remove(secondaries.begin(), secondaries.end(), nullptr), secondaries.end());
+    if (!secondaries.empty())
+    {
+        m_vk.vkCmdExecuteCommands(cmd, (uint32_t)secondaries.size(), secondaries.data());
+    }
+}
+
+VkCommandBuffer Renderer::BeginSecondary(RecordWorker& worker, uint32_t index, VkRenderPass renderPass)
+{
+    if (worker.usedCmdBuffers == worker.secondaryCmdBuffers.size())
+    {
+        VkCommandBufferAllocateInfo cmdBufferInfo{};
+        cmdBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        cmdBufferInfo.commandPool = worker.pool;
+        cmdBufferInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        cmdBufferInfo.commandBufferCount = 1;
+
+        VkCommandBuffer secondary = nullptr;
+        VkResult result = m_vk.vkAllocateCommandBuffers(m_device, &cmdBufferInfo, &secondary);
+        ASSERT(result == VK_SUCCESS, "Could not allocate secondary command buffer");
+        worker.secondaryCmdBuffers.push_back(secondary);
+    }
+    VkCommandBuffer secondary = worker.secondaryCmdBuffers[worker.usedCmdBuffers++];
+
+    // Must match the statistics query left active in the primary
+    VkCommandBufferInheritanceInfo inheritanceInfo{};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = renderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = m_framebuffers[index];
+    if (m_perFrameData[index].statisticsQueryPool != nullptr && m_supportsInheritedQueries)
+        inheritanceInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    m_vk.vkBeginCommandBuffer(secondary, &beginInfo);
+
+    SetMainPassState(secondary, index);
+    return secondary;
+}
+
+uint32_t Renderer::GetDrawListSize() const
+{
+    // Without drawIndirectFirstInstance every draw item is a direct draw, otherwise every group an indirect call.
+    // Task shaders are launched per draw item
+    if (IsMeshShaderCulling())
+        return (uint32_t)m_frame->drawItems.size();
+    return (uint32_t)(m_supportsIndirectFirstInstance ? m_indirectGroups.size() : m_frame->drawItems.size());
+}
+
+void Renderer::ReadFrameStats(PerFrameData& perFrame)
+{
+    if (!perFrame.frameQueriesPending)
+        return;
+
+    // The frame's fence has been waited on, results are available
+    if (perFrame.timestampQueryPool != nullptr)
+    {
+        const double tickMs = (double)m_gpuProperties.limits.timestampPeriod / 1e6;
+        uint64_t timestamps[2]{};
+        VkResult result = m_vk.vkGetQueryPoolResults(m_device, perFrame.timestampQueryPool, 4, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+        {
+            m_frameStats.gpuFrameMs = (timestamps[1] - timestamps[0]) * tickMs;
+
+            // Both queues share the device timebase. The async cull can overlap the previous frame's graphics
+            // work as well as the start of its own (everything before the indirect draws)
+            uint64_t cull[2]{};
+            m_frameStats.asyncComputeMs = 0.0;
+            m_frameStats.queueOverlapMs = 0.0;
+            if (perFrame.asyncCull && m_vk.vkGetQueryPoolResults(m_device, perFrame.timestampQueryPool, 0, 2, sizeof(cull), cull, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
+            {
+                auto overlap = [&](const uint64_t* graphics)
+                {
+                    const uint64_t begin = std::max(cull[0], graphics[0]);
+                    const uint64_t end = std::min(cull[1], graphics[1]);
+                    return end > begin ? end - begin : 0;
+                };
+                const uint64_t overlapTicks = std::min(overlap(m_lastGraphicsTimestamps) + overlap(timestamps), cull[1] - cull[0]);
+                m_frameStats.asyncComputeMs = (cull[1] - cull[0]) * tickMs;
+                m_frameStats.queueOverlapMs = overlapTicks * tickMs;
+            }
+            m_lastGraphicsTimestamps[0] = timestamps[0];
+            m_lastGraphicsTimestamps[1] = timestamps[1];
+        }
+    }
 
-        m_framebuffers.push_back(framebuffer);
+    if (perFrame.statisticsQueryWritten)
+    {
+        uint64_t fragmentInvocations = 0;
+        VkResult result = m_vk.vkGetQueryPoolResults(m_device, perFrame.statisticsQueryPool, 0, 1, sizeof(fragmentInvocations), &fragmentInvocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS)
+        {
+            m_frameStats.fragmentInvocations = fragmentInvocations;
+        }
     }
+
+    perFrame.frameQueriesPending = false;
 }
 
-void Renderer::CreateOrResizeBuffer(Buffer& buffer, uint64_t newSize)
+void Renderer::RecordDrawItems(VkCommandBuffer cmd, PerFrameData& perFrame, uint32_t phase, uint32_t first, uint32_t count)
 {
-    if (buffer.handle != nullptr)
+    if (m_frame->drawItems.empty())
+        return;
+
+    if (IsMeshShaderCulling())
     {
-        vkDestroyBuffer(m_device, buffer.handle, nullptr);
+        RecordMeshShaderDraws(cmd, perFrame, first, count);
+        return;
     }
-    if (buffer.memory != nullptr)
+
+    uint64_t offset{ 0 };
+    m_vk.vkCmdBindVertexBuffers(cmd, 0, 1, &m_geometryPool.vertices.buffer.handle, &offset);
+
+    if (!m_supportsIndirectFirstInstance)
     {
-        vkFreeMemory(m_device, buffer.memory, nullptr);
+        // Fallback: one direct draw per item, the object offset goes through push constants
+        VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+        const uint32_t end = (uint32_t)std::min<uint64_t>((uint64_t)first + count, m_frame->drawItems.size());
+        for (uint32_t itemIndex = first; itemIndex < end; ++itemIndex)
+        {
+            const DrawItem& item = m_frame->drawItems[itemIndex];
+            const Mesh& mesh = m_meshes[item.meshId];
+            if (mesh.indexType != boundIndexType)
+            {
+                const PoolBuffer& indexPool = mesh.indexType == VK_INDEX_TYPE_UINT16 ? m_geometryPool.indices16 : m_geometryPool.indices32;
+                m_vk.vkCmdBindIndexBuffer(cmd, indexPool.buffer.handle, 0, mesh.indexType);
+                boundIndexType = mesh.indexType;
+            }
+
+            // Each instance reads objects[objectOffset + gl_InstanceIndex], no re-binding between draws
+            DrawPushConstants pushConstants = GetDrawPushConstants(item.firstObject, item.materialId, mesh.positionDequantization);
+            m_vk.vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+            m_vk.vkCmdDrawIndexed(cmd, mesh.indexCount, item.objectCount, mesh.firstIndex, (int32_t)mesh.vertexOffset, 0);
+        }
+        return;
     }
 
-    VkBufferCreateInfo bufferInfo{};
-    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = newSize;
-    bufferInfo.usage = buffer.usageFlags;
-    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    VkResult result = vkCreateBuffer(m_device, &bufferInfo, nullptr, &buffer.handle);
-    ASSERT(result == VK_SUCCESS, "Could not create buffer");
+    // Cluster culling wrote every group's triangles into one buffer, mesh-relative like the pools
+    const bool clusterIndices = IsClusterCulling();
+    if (clusterIndices)
+        m_vk.vkCmdBindIndexBuffer(cmd, perFrame.clusterIndexBuffer.handle, 0, VK_INDEX_TYPE_UINT32);
 
-    VkMemoryRequirements req;
-    vkGetBufferMemoryRequirements(m_device, buffer.handle, &req);
+    VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    const uint32_t end = (uint32_t)std::min<uint64_t>((uint64_t)first + count, m_indirectGroups.size());
+    for (uint32_t i = first; i < end; ++i)
+    {
+        const IndirectDrawGroup& group = m_indirectGroups[i];
+        if (!clusterIndices && group.indexType != boundIndexType)
+        {
+            const PoolBuffer& indexPool = group.indexType == VK_INDEX_TYPE_UINT16 ? m_geometryPool.indices16 : m_geometryPool.indices32;
+            m_vk.vkCmdBindIndexBuffer(cmd, indexPool.buffer.handle, 0, group.indexType);
+            boundIndexType = group.indexType;
+        }
 
-    // Allignment if req'd
+        // The object index is carried by each command's firstInstance
+        DrawPushConstants pushConstants = GetDrawPushConstants(0, group.materialId, group.positionDequantization);
+        m_vk.vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
 
-    VkPhysicalDeviceMemoryProperties gpuProperties;
-    vkGetPhysicalDeviceMemoryProperties(m_gpu, &gpuProperties);
-    uint32_t memoryType = UINT32_MAX;
-    for (uint32_t i = 0; i < gpuProperties.memoryTypeCount; ++i)
-    {
-        if ((gpuProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
-            == VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT && req.memoryTypeBits & (1 << i))
+        // The count buffer holds how many of the group's commands survived culling, commandCount is the upper bound.
+        // Phase 1 commands (two-phase culling) follow the phase 0 ones in the group's region.
+        const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+        const VkDeviceSize commandOffset = (group.firstCommand + phase * group.commandCount) * stride;
+        const VkDeviceSize countOffset = (DrawCountOffset + i * 2 + phase) * sizeof(uint32_t);
+        if (m_vkCmdDrawIndexedIndirectCount != nullptr)
         {
-            memoryType = i;
-            break;
+            m_vkCmdDrawIndexedIndirectCount(cmd, perFrame.indirectBuffer.handle, commandOffset,
+                perFrame.drawCountBuffer.handle, countOffset, group.commandCount, stride);
+        }
+        else if (m_supportsMultiDrawIndirect)
+        {
+            m_vk.vkCmdDrawIndexedIndirect(cmd, perFrame.indirectBuffer.handle, commandOffset, group.drawCount, stride);
+        }
+        else
+        {
+            for (uint32_t command = 0; command < group.drawCount; ++command)
+            {
+                m_vk.vkCmdDrawIndexedIndirect(cmd, perFrame.indirectBuffer.handle, commandOffset + command * stride, 1, stride);
+            }
         }
     }
+}
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = req.size;
-    allocInfo.memoryTypeIndex = memoryType;
-    result = vkAllocateMemory(m_device, &allocInfo, nullptr, &buffer.memory);
-    ASSERT(result == VK_SUCCESS, "Could not allocate buffer memory");
+void Renderer::RecordMeshShaderDraws(VkCommandBuffer cmd, PerFrameData& perFrame, uint32_t first, uint32_t count)
+{
+    m_vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_meshShaderPipeline);
+    const VkDescriptorSet sets[2] = { perFrame.descriptorSet, perFrame.meshletDescriptorSet };
+    m_vk.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_meshShaderPipelineLayout, 0, 2, sets, 0, nullptr);
 
-    result = vkBindBufferMemory(m_device, buffer.handle, buffer.memory, 0);
-    ASSERT(result == VK_SUCCESS, "Could not bind buffer memory");
+    // A task workgroup per 32 clusters (x) of each object (y), objects in chunks within the dispatch limit
+    const uint32_t end = (uint32_t)std::min<uint64_t>((uint64_t)first + count, m_frame->drawItems.size());
+    for (uint32_t itemIndex = first; itemIndex < end; ++itemIndex)
+    {
+        const DrawItem& item = m_frame->drawItems[itemIndex];
+        const Mesh& mesh = m_meshes[item.meshId];
+
+        ClusterDrawPushConstants pushConstants{};
+        pushConstants.materialId = item.materialId;
+        pushConstants.cameraPosition = m_frame->camera.position;
+        pushConstants.cameraZoom = m_frame->camera.zoom;
+        pushConstants.firstMeshlet = mesh.firstMeshlet;
+        pushConstants.meshletCount = mesh.meshletCount;
+        pushConstants.vertexOffset = (int32_t)mesh.vertexOffset;
+        pushConstants.boundsCenter = mesh.boundsCenter;
+        pushConstants.boundsRadius = mesh.boundsRadius;
+        pushConstants.positionOffset = mesh.positionDequantization.offset;
+        pushConstants.positionScale = mesh.positionDequantization.scale;
+
+        for (uint32_t object = 0; object < item.objectCount; object += 65535)
+        {
+            pushConstants.objectOffset = item.firstObject + object;
+            m_vk.vkCmdPushConstants(cmd, m_meshShaderPipelineLayout, VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT,
+                0, sizeof(ClusterDrawPushConstants), &pushConstants);
+            m_vkCmdDrawMeshTasks(cmd, (mesh.meshletCount + 31) / 32, std::min(item.objectCount - object, 65535u), 1);
+        }
+    }
 
-    buffer.size = req.size;
+    // The layouts differ in push constants, set 0 has to be bound again for the vertex pipelines after this
+    m_vk.vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipelineLayout, 0, 1, &perFrame.descriptorSet, 0, nullptr);
 }
 
 VkResult Renderer::NextImage(uint32_t& imageIndex)
@@ -671,7 +4321,7 @@ VkResult Renderer::NextImage(uint32_t& imageIndex)
     {
         VkSemaphoreCreateInfo semaphoreInfo{};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        result = vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &aquireSemaphore);
+        result = m_vk.vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &aquireSemaphore);
         ASSERT(result == VK_SUCCESS, "Could not create new semaphore");
     }
     else
@@ -680,7 +4330,7 @@ VkResult Renderer::NextImage(uint32_t& imageIndex)
         m_recycledSemaphores.pop_back();
     }
 
-    result = vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, aquireSemaphore, nullptr, &imageIndex);
+    result = m_vk.vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, aquireSemaphore, nullptr, &imageIndex);
 
     if (result != VK_SUCCESS)
     {
@@ -690,13 +4340,31 @@ VkResult Renderer::NextImage(uint32_t& imageIndex)
 
     if (m_perFrameData[imageIndex].queueSubmitFence != nullptr)
     {
-        vkWaitForFences(m_device, 1, &m_perFrameData[imageIndex].queueSubmitFence, true, UINT64_MAX);
-        vkResetFences(m_device, 1, &m_perFrameData[imageIndex].queueSubmitFence);
+        m_vk.vkWaitForFences(m_device, 1, &m_perFrameData[imageIndex].queueSubmitFence, true, UINT64_MAX);
+        m_vk.vkResetFences(m_device, 1, &m_perFrameData[imageIndex].queueSubmitFence);
+    }
+
+    for (VkSemaphore semaphore : m_perFrameData[imageIndex].uploadSemaphores)
+    {
+        m_vk.vkDestroySemaphore(m_device, semaphore, nullptr);
     }
+    m_perFrameData[imageIndex].uploadSemaphores.clear();
 
     if (m_perFrameData[imageIndex].primaryCmdPool != nullptr)
     {
-        vkResetCommandPool(m_device, m_perFrameData[imageIndex].primaryCmdPool, 0);
+        m_vk.vkResetCommandPool(m_device, m_perFrameData[imageIndex].primaryCmdPool, 0);
+    }
+
+    // The graphics submit waited on the async cull, so the fence covers it too
+    if (m_perFrameData[imageIndex].computeCmdPool != nullptr)
+    {
+        m_vk.vkResetCommandPool(m_device, m_perFrameData[imageIndex].computeCmdPool, 0);
+    }
+
+    for (RecordWorker& worker : m_perFrameData[imageIndex].recordWorkers)
+    {
+        m_vk.vkResetCommandPool(m_device, worker.pool, 0);
+        worker.usedCmdBuffers = 0;
     }
 
     VkSemaphore oldSemaphore = m_perFrameData[imageIndex].swapchainAcquireSemaphore;
@@ -713,6 +4381,88 @@ VkResult Renderer::NextImage(uint32_t& imageIndex)
 
 void Renderer::Update(const float deltaTime)
 {
+    // Snapshot this frame's state into the producer slot, the render thread works from the copy
+    // while the main thread carries on with the next frame. Slots keep their capacity, so this is copies, not allocations
+    FrameSnapshot& snapshot = m_frames.GetWriteSlot();
+    snapshot.objects = m_objects;
+    if (snapshot.drawItemsVersion != m_drawItemsVersion)
+    {
+        snapshot.drawItems = m_drawItems;
+        snapshot.drawItemsVersion = m_drawItemsVersion;
+    }
+    snapshot.instanceData.swap(m_instanceData);
+    snapshot.instanceBatches.swap(m_instanceBatches);
+    snapshot.sceneNodeEdits.swap(m_sceneNodeEdits);
+    m_instanceData.clear();
+    m_instanceBatches.clear();
+    m_sceneNodeEdits.clear();
+    snapshot.camera = m_camera;
+    snapshot.settings = m_settings;
+
+    if (!m_renderThread.joinable())
+    {
+        m_frames.Publish();
+        m_frames.Acquire();
+        RenderFrame(m_frames.GetReadSlot());
+        return;
+    }
+
+    // Stay at most one frame ahead: the previous snapshot has to be picked up before this one replaces it
+    {
+        std::unique_lock<std::mutex> lock(m_renderMutex);
+        m_renderWake.wait(lock, [this] { return !m_frames.HasFresh(); });
+        m_frames.Publish();
+    }
+    m_renderWake.notify_all();
+}
+
+void Renderer::RenderThreadMain()
+{
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_renderMutex);
+            m_renderThreadBusy = false;
+            m_renderWake.notify_all();
+            m_renderWake.wait(lock, [this] { return m_stopRenderThread || m_frames.HasFresh(); });
+            if (!m_frames.Acquire())
+                return;
+            m_renderThreadBusy = true;
+        }
+        m_renderWake.notify_all();
+
+        RenderFrame(m_frames.GetReadSlot());
+    }
+}
+
+void Renderer::RenderFrame(const FrameSnapshot& frame)
+{
+    m_frame = &frame;
+    m_cullMode = frame.settings.cullMode;
+    m_occlusionCulling = frame.settings.occlusionCulling;
+    m_depthPrepass = frame.settings.depthPrepass;
+    m_recordThreads = frame.settings.recordThreads;
+    m_asyncCompute = frame.settings.asyncCompute;
+    m_lodErrorPixels = frame.settings.lodErrorPixels;
+    m_clusterCulling = frame.settings.clusterCulling;
+
+    // Applied even if the frame ends up skipped, later snapshots only carry what changed after this one
+    for (const SceneNodeEdit& edit : frame.sceneNodeEdits)
+    {
+        switch (edit.type)
+        {
+        case SceneNodeEdit::Type::Add:
+            m_sceneHierarchy.AddNode(edit.parent, edit.local, edit.meshId, edit.color);
+            break;
+        case SceneNodeEdit::Type::SetTransform:
+            m_sceneHierarchy.SetLocalTransform(edit.node, edit.local);
+            break;
+        case SceneNodeEdit::Type::Clear:
+            m_sceneHierarchy.Clear();
+            break;
+        }
+    }
+
     uint32_t imageIndex{};
     VkResult result = NextImage(imageIndex);
     if (result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR)
@@ -725,6 +4475,7 @@ void Renderer::Update(const float deltaTime)
     if (result != VK_SUCCESS)
     {
         LOG("Could not get next image, idling...");
+        m_frame = nullptr;
         return;
     }
 
@@ -740,58 +4491,335 @@ void Renderer::Update(const float deltaTime)
     {
         LOG("Failed to present swapchain image");
     }
+
+    {
+        std::lock_guard<std::mutex> lock(m_statsMutex);
+        m_renderStats.cull = m_cullStats;
+        m_renderStats.frame = m_frameStats;
+        m_renderStats.sceneRecordMs = m_sceneRecordMs;
+        m_renderStats.instanceUploadBytes = m_instanceUploadBytes;
+        m_renderStats.instanceUploadSeconds = m_instanceUploadSeconds;
+        m_renderStats.sceneUpdateMs = m_sceneUpdateMs;
+        m_renderStats.sceneNodesUpdated = m_sceneNodesUpdated;
+    }
+    m_frame = nullptr;
 }
 
-void Renderer::Render(uint32_t index)
+void Renderer::WaitForRenderThread()
 {
-    VkFramebuffer framebuffer = m_framebuffers[index];
+    if (!m_renderThread.joinable())
+        return;
 
-    VkCommandBuffer cmd = m_perFrameData[index].primaryCmdBuffer;
+    std::unique_lock<std::mutex> lock(m_renderMutex);
+    m_renderWake.wait(lock, [this] { return !m_renderThreadBusy && !m_frames.HasFresh(); });
+}
 
-    VkCommandBufferBeginInfo cmdBeginInfo{};
-    cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    vkBeginCommandBuffer(cmd, &cmdBeginInfo);
+void Renderer::StopRenderThread()
+{
+    if (!m_renderThread.joinable())
+        return;
 
-    VkClearValue clearValue{};
-    clearValue.color = { 0.01f, 0.01f, 0.01f, 1.f };
+    // Whatever was published still gets rendered
+    WaitForRenderThread();
+    {
+        std::lock_guard<std::mutex> lock(m_renderMutex);
+        m_stopRenderThread = true;
+    }
+    m_renderWake.notify_all();
+    m_renderThread.join();
+    m_stopRenderThread = false;
+}
 
-    VkRenderPassBeginInfo passBeginInfo{};
-    passBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-    passBeginInfo.renderPass = m_renderPass;
-    passBeginInfo.framebuffer = framebuffer;
-    passBeginInfo.renderArea.extent.width = m_windowWidth;
-    passBeginInfo.renderArea.extent.height = m_windowHeight;
-    passBeginInfo.clearValueCount = 1;
-    passBeginInfo.pClearValues = &clearValue;
-    vkCmdBeginRenderPass(cmd, &passBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+Renderer::RenderStats Renderer::GetRenderStats()
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_renderStats;
+}
+
+Renderer::CullStats Renderer::GetCullStats() const
+{
+    std::lock_guard<std::mutex> lock(m_statsMutex);
+    return m_renderStats.cull;
+}
+
+void Renderer::BuildRenderGraph(uint32_t index, VkDeviceSize instanceOffset)
+{
+    PerFrameData& perFrame = m_perFrameData[index];
+    RenderGraph& graph = perFrame.renderGraph;
+    graph.Reset();
+
+    const bool msaa = m_msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+    const bool gpuCull = IsGpuCulling();
+    const bool twoPhase = gpuCull && IsTwoPhaseCulling();
+    const bool clusterCull = IsClusterCulling();
+    const bool meshShaderCull = IsMeshShaderCulling();
+
+    // The acquire semaphore is waited on at color output, the swapchain's transition has to wait there too
+    const RenderGraph::ResourceId swapchain = graph.ImportImage("Swapchain", m_swapchainImages[index], m_swapchainFormat, 1,
+        ResourceUsage::ColorAttachment, ResourceUsage::Present, false);
+    const RenderGraph::ResourceId depth = graph.ImportImage("Depth", perFrame.depthImage.handle, m_depthFormat, 1,
+        ResourceUsage::DepthAttachment, ResourceUsage::None, false);
+    const RenderGraph::ResourceId msaaColor = msaa
+        ? graph.ImportImage("MSAA color", perFrame.msaaColorImage.handle, m_swapchainFormat, 1, ResourceUsage::ColorAttachment, ResourceUsage::None, false)
+        : UINT32_MAX;
+
+    // Draw counts are read back for stats, visibility carries over to the next frame's cull
+    RenderGraph::ResourceId indirect = UINT32_MAX;
+    RenderGraph::ResourceId drawCounts = UINT32_MAX;
+    RenderGraph::ResourceId visibility = UINT32_MAX;
+    RenderGraph::ResourceId clusterIndices = UINT32_MAX;
+    if (gpuCull && perFrame.asyncCull)
+    {
+        // Culled on the async compute queue, the submit waits on its semaphore
+        indirect = graph.ImportBuffer("Indirect commands", perFrame.indirectBuffer.handle, ResourceUsage::ComputeReadWrite);
+        drawCounts = graph.ImportBuffer("Draw counts", perFrame.drawCountBuffer.handle, ResourceUsage::ComputeReadWrite, ResourceUsage::HostRead);
+        visibility = graph.ImportBuffer("Visibility", m_visibilityBuffer.handle, ResourceUsage::ComputeReadWrite);
+        graph.MarkOutput(visibility);
+    }
+    else if (gpuCull)
+    {
+        indirect = graph.ImportBuffer("Indirect commands", perFrame.indirectBuffer.handle, ResourceUsage::IndirectRead);
+        drawCounts = graph.ImportBuffer("Draw counts", perFrame.drawCountBuffer.handle, ResourceUsage::IndirectRead, ResourceUsage::HostRead);
+        visibility = graph.ImportBuffer("Visibility", m_visibilityBuffer.handle, ResourceUsage::ComputeReadWrite);
+        graph.MarkOutput(visibility);
+
+        const RenderGraph::PassId clearPass = graph.AddPass("Clear draw counts", [this, &perFrame](VkCommandBuffer cmd)
+        {
+            // Counters start at zero, the shader appends with atomicAdd
+            m_vk.vkCmdFillBuffer(cmd, perFrame.drawCountBuffer.handle, 0, GetDrawCountBufferSize(), 0);
+        });
+        graph.Write(clearPass, drawCounts, ResourceUsage::TransferWrite);
+
+        if (meshShaderCull)
+        {
+            // Task shaders cull inside the main pass, only the counters are cleared up front
+            perFrame.pendingCullGroups = (uint32_t)m_indirectGroups.size();
+            perFrame.timestampCount = 0;
+        }
+        else if (clusterCull)
+        {
+            clusterIndices = graph.ImportBuffer("Cluster indices", perFrame.clusterIndexBuffer.handle, ResourceUsage::IndexRead);
+
+            const RenderGraph::PassId cullPass = graph.AddPass("Cull clusters", [this, &perFrame](VkCommandBuffer cmd)
+            {
+                RecordClusterCulling(cmd, perFrame);
+            });
+            graph.ReadWrite(cullPass, drawCounts, ResourceUsage::ComputeReadWrite);
+            graph.Write(cullPass, indirect, ResourceUsage::ComputeReadWrite);
+            graph.Write(cullPass, clusterIndices, ResourceUsage::ComputeReadWrite);
+        }
+        else
+        {
+            const RenderGraph::PassId cullPass = graph.AddPass(twoPhase ? "Cull (first phase)" : "Cull", [this, &perFrame, twoPhase](VkCommandBuffer cmd)
+            {
+                RecordCulling(cmd, perFrame, twoPhase ? CullPhase::First : CullPhase::Single);
+            });
+            graph.ReadWrite(cullPass, drawCounts, ResourceUsage::ComputeReadWrite);
+            graph.Write(cullPass, indirect, ResourceUsage::ComputeReadWrite);
+            if (twoPhase)
+                graph.Read(cullPass, visibility, ResourceUsage::ComputeRead);
+        }
+    }
+
+    // Both phases draw into the same targets, instanced draws go last
+    auto declareMainPass = [&](RenderGraph::PassId pass, bool load)
+    {
+        const ResourceUsage color = ResourceUsage::ColorAttachment;
+        if (msaa)
+        {
+            graph.Write(pass, msaaColor, color);
+            graph.Write(pass, swapchain, color); // Resolve target
+        }
+        else if (load)
+        {
+            graph.ReadWrite(pass, swapchain, color);
+        }
+        else
+        {
+            graph.Write(pass, swapchain, color);
+        }
+
+        if (load)
+            graph.ReadWrite(pass, depth, ResourceUsage::DepthAttachment);
+        else
+            graph.Write(pass, depth, ResourceUsage::DepthAttachment);
+
+        if (meshShaderCull)
+        {
+            graph.ReadWrite(pass, drawCounts, ResourceUsage::MeshShaderReadWrite);
+        }
+        else if (gpuCull)
+        {
+            graph.Read(pass, indirect, ResourceUsage::IndirectRead);
+            graph.Read(pass, drawCounts, ResourceUsage::IndirectRead);
+            if (clusterCull)
+                graph.Read(pass, clusterIndices, ResourceUsage::IndexRead);
+        }
+    };
+
+    const RenderGraph::PassId mainPass = graph.AddPass(twoPhase ? "Main (first phase)" : "Main", [this, index, instanceOffset, twoPhase](VkCommandBuffer cmd)
+    {
+        RecordMainPass(cmd, index, twoPhase ? m_firstPhaseRenderPass : m_renderPass, 0, !twoPhase, instanceOffset);
+    });
+    declareMainPass(mainPass, false);
+
+    // Two-phase occlusion culling: build the Hi-Z from what was just drawn, test everything else against it
+    RenderGraph::ResourceId hiz = UINT32_MAX;
+    if (twoPhase)
+    {
+        RenderGraph::ImageDesc hizDesc{};
+        hizDesc.format = VK_FORMAT_R32_SFLOAT;
+        hizDesc.width = m_hizExtent.width;
+        hizDesc.height = m_hizExtent.height;
+        hizDesc.mipLevels = m_hizMipLevels;
+        hizDesc.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        hiz = graph.CreateImage("Hi-Z", hizDesc);
+
+        const RenderGraph::PassId hizPass = graph.AddPass("Hi-Z build", [this, &perFrame](VkCommandBuffer cmd)
+        {
+            RecordDepthPyramid(cmd, perFrame);
+        });
+        graph.Read(hizPass, depth, ResourceUsage::ComputeRead);
+        graph.Write(hizPass, hiz, ResourceUsage::ComputeReadWrite);
+
+        const RenderGraph::PassId cullPass = graph.AddPass("Cull (second phase)", [this, &perFrame](VkCommandBuffer cmd)
+        {
+            RecordCulling(cmd, perFrame, CullPhase::Second);
+        });
+        graph.Read(cullPass, hiz, ResourceUsage::ComputeRead);
+        graph.ReadWrite(cullPass, drawCounts, ResourceUsage::ComputeReadWrite);
+        graph.Write(cullPass, indirect, ResourceUsage::ComputeReadWrite);
+        graph.ReadWrite(cullPass, visibility, ResourceUsage::ComputeReadWrite);
+
+        const RenderGraph::PassId secondPass = graph.AddPass("Main (second phase)", [this, index, instanceOffset](VkCommandBuffer cmd)
+        {
+            RecordMainPass(cmd, index, m_secondPhaseRenderPass, 1, true, instanceOffset);
+        });
+        declareMainPass(secondPass, true);
+    }
+
+    graph.Compile();
+
+    // New Hi-Z placement (or none this frame): rebuild its views and descriptors
+    const uint32_t hizGeneration = twoPhase ? graph.GetTransientGeneration() : UINT32_MAX;
+    if (hizGeneration != perFrame.hizGeneration)
+    {
+        UpdateDepthPyramidViews(perFrame, twoPhase ? graph.GetImage(hiz) : nullptr, twoPhase ? graph.GetImageView(hiz) : nullptr);
+        perFrame.hizGeneration = hizGeneration;
+    }
+
+    if (m_dumpRenderGraph.exchange(false))
+    {
+        LOG(graph.Dump());
+    }
+}
+
+void Renderer::RecordInstancedDraws(VkCommandBuffer cmd, VkDeviceSize instanceOffset)
+{
+    if (m_frame->instanceBatches.empty() && m_sceneNodeBatches.empty())
+        return;
 
-    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_graphicsPipeline);
+    // Per-instance attributes come from this frame's segment of the ring buffer
+    m_vk.vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_instancedPipeline);
 
+    DrawPushConstants pushConstants = GetDrawPushConstants(0, 0);
+    m_vk.vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+    VertexCompression::Dequantization pushedDequantization{};
     uint64_t offset{ 0 };
-    vkCmdBindVertexBuffers(cmd, 0, 1, &m_vertexBuffer.handle, &offset);
-    //vkCmdBindIndexBuffers(cmd, 0, 1, &m_indexBuffer.handle, &offset);
+    m_vk.vkCmdBindVertexBuffers(cmd, 0, 1, &m_geometryPool.vertices.buffer.handle, &offset);
+    m_vk.vkCmdBindVertexBuffers(cmd, 1, 1, &m_instanceRing.buffer.handle, &instanceOffset);
 
-    VkViewport viewport{};
-    viewport.y = m_windowHeight;
-    viewport.width = m_windowWidth;
-    viewport.height = -viewport.y;
-    viewport.minDepth = 0.f;
-    viewport.maxDepth = 1.f;
-    vkCmdSetViewport(cmd, 0, 1, &viewport);
+    // DrawInstanced batches first, then the scene nodes, both index the same ring segment
+    const std::vector<InstanceBatch>* batchLists[2] = { &m_frame->instanceBatches, &m_sceneNodeBatches };
+    VkIndexType boundIndexType = VK_INDEX_TYPE_MAX_ENUM;
+    for (const std::vector<InstanceBatch>* batches : batchLists)
+    {
+        for (const InstanceBatch& batch : *batches)
+        {
+            const Mesh& mesh = m_meshes[batch.meshId];
+            if (mesh.indexType != boundIndexType)
+            {
+                const PoolBuffer& indexPool = mesh.indexType == VK_INDEX_TYPE_UINT16 ? m_geometryPool.indices16 : m_geometryPool.indices32;
+                m_vk.vkCmdBindIndexBuffer(cmd, indexPool.buffer.handle, 0, mesh.indexType);
+                boundIndexType = mesh.indexType;
+            }
+
+            // Compressed positions: every mesh scales its own back, only pushed when that changes
+            if (!VertexCompression::SameDequantization(mesh.positionDequantization, pushedDequantization))
+            {
+                pushConstants = GetDrawPushConstants(0, 0, mesh.positionDequantization);
+                m_vk.vkCmdPushConstants(cmd, m_pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(DrawPushConstants), &pushConstants);
+                pushedDequantization = mesh.positionDequantization;
+            }
+            m_vk.vkCmdDrawIndexed(cmd, mesh.indexCount, batch.instanceCount, mesh.firstIndex, (int32_t)mesh.vertexOffset, batch.firstInstance);
+        }
+    }
+}
 
-    VkRect2D scissor{};
-    scissor.extent.width = m_windowWidth;
-    scissor.extent.height = m_windowHeight;
-    vkCmdSetScissor(cmd, 0, 1, &scissor);
+void Renderer::Render(uint32_t index)
+{
+    VkCommandBuffer cmd = m_perFrameData[index].primaryCmdBuffer;
+
+    UploadObjectData(m_perFrameData[index]);
+    const VkDeviceSize instanceOffset = UploadInstanceData(index);
+
+    ReadFrameStats(m_perFrameData[index]);
+    if (m_supportsIndirectFirstInstance)
+    {
+        ReadGpuCullResults(m_perFrameData[index]);
+        WriteIndirectCommands(m_perFrameData[index]);
+    }
+
+    // Culling only needs host data (and last frame's visibility), on the async compute queue it can run
+    // while the previous frame is still rasterizing. Submitted first so it gets a head start.
+    // Not cluster culling, the meshlet pools belong to the graphics family
+    m_perFrameData[index].asyncCull = m_asyncCompute && m_computeQueue != m_deviceQueue && IsGpuCulling() && !IsClusterCulling();
+    if (m_perFrameData[index].asyncCull)
+    {
+        SubmitAsyncCulling(m_perFrameData[index]);
+    }
+
+    VkCommandBufferBeginInfo cmdBeginInfo{};
+    cmdBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmdBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    m_vk.vkBeginCommandBuffer(cmd, &cmdBeginInfo);
+
+    // Geometry uploaded since the last frame
+    PerFrameData& perFrame = m_perFrameData[index];
+    AcquireUploads(cmd, m_geometryReadStages);
+    perFrame.uploadSemaphores.swap(m_uploadSemaphores);
+
+    // Whole frame GPU time and fragment count (overdraw)
+    if (perFrame.timestampQueryPool != nullptr)
+    {
+        m_vk.vkCmdResetQueryPool(cmd, perFrame.timestampQueryPool, 4, 2);
+        m_vk.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, perFrame.timestampQueryPool, 4);
+    }
+    // Secondaries can only run inside an active query with inheritedQueries
+    const bool statisticsQuery = perFrame.statisticsQueryPool != nullptr && (m_recordThreads == 1 || m_supportsInheritedQueries);
+    if (statisticsQuery)
+    {
+        m_vk.vkCmdResetQueryPool(cmd, perFrame.statisticsQueryPool, 0, 1);
+        m_vk.vkCmdBeginQuery(cmd, perFrame.statisticsQueryPool, 0, 0);
+    }
 
-    // Draw Commands
-    vkCmdDraw(cmd, 3, 1, 0, 0);
+    perFrame.statisticsQueryWritten = statisticsQuery;
 
-    // End Drawing
-    vkCmdEndRenderPass(cmd);
+    m_sceneRecordMs = 0.0;
+    BuildRenderGraph(index, instanceOffset);
+    perFrame.renderGraph.Execute(cmd);
+
+    if (statisticsQuery)
+    {
+        m_vk.vkCmdEndQuery(cmd, perFrame.statisticsQueryPool, 0);
+    }
+    if (perFrame.timestampQueryPool != nullptr)
+    {
+        m_vk.vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, perFrame.timestampQueryPool, 5);
+    }
+    perFrame.frameQueriesPending = true;
 
-    VkResult result = vkEndCommandBuffer(cmd);
+    VkResult result = m_vk.vkEndCommandBuffer(cmd);
     ASSERT(result == VK_SUCCESS, "Could not end command buffer");
 
     // Send to Queue
@@ -799,21 +4827,48 @@ void Renderer::Render(uint32_t index)
     {
         VkSemaphoreCreateInfo semaphoreInfo{};
         semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        result = vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_perFrameData[index].swapchainReleaseSemaphore);
+        result = m_vk.vkCreateSemaphore(m_device, &semaphoreInfo, nullptr, &m_perFrameData[index].swapchainReleaseSemaphore);
+    }
+
+    std::vector<VkSemaphore> waitSemaphores{ m_perFrameData[index].swapchainAcquireSemaphore };
+    std::vector<VkPipelineStageFlags> waitStageMasks{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+    for (VkSemaphore semaphore : perFrame.uploadSemaphores)
+    {
+        waitSemaphores.push_back(semaphore);
+        waitStageMasks.push_back(m_geometryReadStages);
+    }
+    if (perFrame.asyncCull)
+    {
+        // The second cull phase reads the counts and visibility too
+        waitSemaphores.push_back(perFrame.computeSemaphore);
+        waitStageMasks.push_back(VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    }
+    else if (m_pendingVisibilitySemaphore != nullptr)
+    {
+        // Nothing on the compute queue took it, a binary semaphore has to be waited on before it's signaled again
+        waitSemaphores.push_back(m_pendingVisibilitySemaphore);
+        waitStageMasks.push_back(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        m_pendingVisibilitySemaphore = nullptr;
+    }
+
+    // The next async cull reads the visibility this frame writes
+    std::vector<VkSemaphore> signalSemaphores{ m_perFrameData[index].swapchainReleaseSemaphore };
+    if (m_asyncCompute && m_computeQueue != m_deviceQueue && IsGpuCulling() && IsTwoPhaseCulling())
+    {
+        signalSemaphores.push_back(perFrame.visibilitySemaphore);
+        m_pendingVisibilitySemaphore = perFrame.visibilitySemaphore;
     }
 
-    VkPipelineStageFlags waitStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &cmd;
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &m_perFrameData[index].swapchainAcquireSemaphore;
-    submitInfo.pWaitDstStageMask = &waitStageMask;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &m_perFrameData[index].swapchainReleaseSemaphore;
-    result = vkQueueSubmit(m_deviceQueue, 1, &submitInfo, m_perFrameData[index].queueSubmitFence);
+    submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStageMasks.data();
+    submitInfo.signalSemaphoreCount = (uint32_t)signalSemaphores.size();
+    submitInfo.pSignalSemaphores = signalSemaphores.data();
+    result = m_vk.vkQueueSubmit(m_deviceQueue, 1, &submitInfo, m_perFrameData[index].queueSubmitFence);
 }
 
 VkResult Renderer::Present(uint32_t index)
@@ -826,38 +4881,142 @@ VkResult Renderer::Present(uint32_t index)
     presentInfo.waitSemaphoreCount = 1;
     presentInfo.pWaitSemaphores = &m_perFrameData[index].swapchainReleaseSemaphore;
 
-    return vkQueuePresentKHR(m_deviceQueue, &presentInfo);
+    return m_vk.vkQueuePresentKHR(m_presentQueue, &presentInfo);
 }
 
 void Renderer::DestroyPerFrameData(PerFrameData& perFrameData)
 {
+    if (perFrameData.objectBufferMemory != nullptr)
+    {
+        m_vk.vkUnmapMemory(m_device, perFrameData.objectBuffer.memory);
+        perFrameData.objectBufferMemory = nullptr;
+    }
+    DestroyBuffer(perFrameData.objectBuffer);
+
+    if (perFrameData.indirectBufferMemory != nullptr)
+    {
+        m_vk.vkUnmapMemory(m_device, perFrameData.indirectBuffer.memory);
+        perFrameData.indirectBufferMemory = nullptr;
+    }
+    DestroyBuffer(perFrameData.indirectBuffer);
+
+    if (perFrameData.drawCountBufferMemory != nullptr)
+    {
+        m_vk.vkUnmapMemory(m_device, perFrameData.drawCountBuffer.memory);
+        perFrameData.drawCountBufferMemory = nullptr;
+    }
+    DestroyBuffer(perFrameData.drawCountBuffer);
+
+    if (perFrameData.cullObjectBufferMemory != nullptr)
+    {
+        m_vk.vkUnmapMemory(m_device, perFrameData.cullObjectBuffer.memory);
+        perFrameData.cullObjectBufferMemory = nullptr;
+    }
+    DestroyBuffer(perFrameData.cullObjectBuffer);
+
+    if (perFrameData.meshCullBufferMemory != nullptr)
+    {
+        m_vk.vkUnmapMemory(m_device, perFrameData.meshCullBuffer.memory);
+        perFrameData.meshCullBufferMemory = nullptr;
+    }
+    DestroyBuffer(perFrameData.meshCullBuffer);
+
+    if (perFrameData.drawGroupBufferMemory != nullptr)
+    {
+        m_vk.vkUnmapMemory(m_device, perFrameData.drawGroupBuffer.memory);
+        perFrameData.drawGroupBufferMemory = nullptr;
+    }
+    DestroyBuffer(perFrameData.drawGroupBuffer);
+    DestroyBuffer(perFrameData.clusterIndexBuffer);
+    perFrameData.clusterIndexCapacity = 0;
+    perFrameData.cullDescriptorSet = nullptr; // Freed with the descriptor pool
+    perFrameData.meshletDescriptorSet = nullptr;
+    perFrameData.hizDescriptorSets.clear();
+
+    for (VkImageView& view : perFrameData.hizMipViews)
+    {
+        m_vk.vkDestroyImageView(m_device, view, nullptr);
+    }
+    perFrameData.hizMipViews.clear();
+    perFrameData.hizView = nullptr; // Owned by the render graph
+    perFrameData.renderGraph.Destroy();
+
+    if (perFrameData.depthSampleView != nullptr)
+    {
+        m_vk.vkDestroyImageView(m_device, perFrameData.depthSampleView, nullptr);
+        perFrameData.depthSampleView = nullptr;
+    }
+    DestroyImage(perFrameData.depthImage);
+    DestroyImage(perFrameData.msaaColorImage);
+
+    if (perFrameData.timestampQueryPool != nullptr)
+    {
+        m_vk.vkDestroyQueryPool(m_device, perFrameData.timestampQueryPool, nullptr);
+        perFrameData.timestampQueryPool = nullptr;
+    }
+
+    if (perFrameData.statisticsQueryPool != nullptr)
+    {
+        m_vk.vkDestroyQueryPool(m_device, perFrameData.statisticsQueryPool, nullptr);
+        perFrameData.statisticsQueryPool = nullptr;
+    }
+    perFrameData.descriptorSet = nullptr; // Freed with the descriptor pool
+
     if (perFrameData.queueSubmitFence != nullptr)
     {
-        vkDestroyFence(m_device, perFrameData.queueSubmitFence, nullptr);
+        m_vk.vkDestroyFence(m_device, perFrameData.queueSubmitFence, nullptr);
         perFrameData.queueSubmitFence = nullptr;
     }
 
+    for (RecordWorker& worker : perFrameData.recordWorkers)
+    {
+        m_vk.vkDestroyCommandPool(m_device, worker.pool, nullptr); // Frees its secondaries
+    }
+    perFrameData.recordWorkers.clear();
+
     if (perFrameData.primaryCmdBuffer != nullptr)
     {
-        vkFreeCommandBuffers(m_device, perFrameData.primaryCmdPool, 1, &perFrameData.primaryCmdBuffer);
+        m_vk.vkFreeCommandBuffers(m_device, perFrameData.primaryCmdPool, 1, &perFrameData.primaryCmdBuffer);
         perFrameData.primaryCmdBuffer = nullptr;
     }
 
     if (perFrameData.primaryCmdPool != nullptr)
     {
-        vkDestroyCommandPool(m_device, perFrameData.primaryCmdPool, nullptr);
+        m_vk.vkDestroyCommandPool(m_device, perFrameData.primaryCmdPool, nullptr);
         perFrameData.primaryCmdPool = nullptr;
     }
 
     if (perFrameData.swapchainAcquireSemaphore != nullptr)
     {
-        vkDestroySemaphore(m_device, perFrameData.swapchainAcquireSemaphore, nullptr);
+        m_vk.vkDestroySemaphore(m_device, perFrameData.swapchainAcquireSemaphore, nullptr);
         perFrameData.swapchainAcquireSemaphore = nullptr;
     }
 
     if (perFrameData.swapchainReleaseSemaphore != nullptr)
     {
-        vkDestroySemaphore(m_device, perFrameData.swapchainReleaseSemaphore, nullptr);
+        m_vk.vkDestroySemaphore(m_device, perFrameData.swapchainReleaseSemaphore, nullptr);
         perFrameData.swapchainReleaseSemaphore = nullptr;
     }
+
+    for (VkSemaphore semaphore : perFrameData.uploadSemaphores)
+    {
+        m_vk.vkDestroySemaphore(m_device, semaphore, nullptr);
+    }
+    perFrameData.uploadSemaphores.clear();
+
+    for (VkSemaphore* semaphore : { &perFrameData.computeSemaphore, &perFrameData.visibilitySemaphore })
+    {
+        if (*semaphore != nullptr)
+        {
+            m_vk.vkDestroySemaphore(m_device, *semaphore, nullptr);
+            *semaphore = nullptr;
+        }
+    }
+
+    if (perFrameData.computeCmdPool != nullptr)
+    {
+        m_vk.vkDestroyCommandPool(m_device, perFrameData.computeCmdPool, nullptr);
+        perFrameData.computeCmdPool = nullptr;
+        perFrameData.computeCmdBuffer = nullptr;
+    }
 }
@@ -3,56 +3,630 @@
 #include <vulkan/vulkan.h>
 #include <GLFW/glfw3.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <filesystem>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include "Bvh.h"
+#include "JobSystem.h"
+#include "Mathmatics.h"
+#include "MeshletBuilder.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "RangeAllocator.h"
+#include "RenderGraph.h"
+#include "TransformHierarchy.h"
+#include "TripleBuffer.h"
+#include "VertexCompression.h"
+#include "VertexLayout.h"
+#include "VulkanDispatch.h"
+
+// Small per-draw data, pushed with vkCmdPushConstants (must match basic.vert.glsl)
+struct DrawPushConstants
+{
+	uint32_t objectOffset = 0; // Index of the first object in the object buffer for this draw
+	uint32_t materialId = 0;
+	Vector2 cameraPosition{};
+	float cameraZoom = 1.f;
+	float positionScale = 1.f; // The mesh's position dequantization, stored * scale + offset
+	uint32_t padding[2]{};
+	Vector3 positionOffset{};
+};
+
+// 2D camera looking down -Z, sees [position - 1/zoom, position + 1/zoom] and 0 <= z <= 1
+struct Camera
+{
+	Vector2 position{};
+	float zoom = 1.f;
+};
+
+enum class CullMode
+{
+	None, // One indirect command per draw item, nothing culled
+	Cpu,  // Objects tested on the CPU, survivors written as indirect commands
+	Gpu   // Objects tested and compacted by a compute pass (needs VK_KHR_draw_indirect_count)
+};
+
+// Bulk per-object data, stored in a per-frame SSBO and indexed by gl_InstanceIndex (std430 layout)
+struct ObjectData
+{
+	Vector3 position{};
+	float scale = 1.f;
+	Color color{};
+};
+
+// Per-instance vertex stream data (binding 1, VK_VERTEX_INPUT_RATE_INSTANCE, must match instanced.vert.glsl)
+struct InstanceData
+{
+	Vector3 position{};
+	float scale = 1.f;
+	uint32_t color = 0xFFFFFFFF; // RGBA8, see VertexCompression::PackUnorm8
+};
+
+// Vertex pool element for each VertexCompression::PositionFormat
+struct PositionVertex
+{
+	Vector3 position{};
+};
+
+struct PackedPositionVertex
+{
+	uint16_t position[4]{}; // Half or snorm16 xyz, w unused
+};
+
+// Vertex streams, see VertexLayout.h. Binding 0 is the vertex pool, binding 1 the instance ring
+using FloatPositionStream = VertexLayout::Stream<PositionVertex, 0, VK_VERTEX_INPUT_RATE_VERTEX,
+	VERTEX_FIELD(PositionVertex, position, 0, VK_FORMAT_R32G32B32_SFLOAT)>;
+using HalfPositionStream = VertexLayout::Stream<PackedPositionVertex, 0, VK_VERTEX_INPUT_RATE_VERTEX,
+	VERTEX_FIELD(PackedPositionVertex, position, 0, VK_FORMAT_R16G16B16A16_SFLOAT)>;
+using Snorm16PositionStream = VertexLayout::Stream<PackedPositionVertex, 0, VK_VERTEX_INPUT_RATE_VERTEX,
+	VERTEX_FIELD(PackedPositionVertex, position, 0, VK_FORMAT_R16G16B16A16_SNORM)>;
+using InstanceStream = VertexLayout::Stream<InstanceData, 1, VK_VERTEX_INPUT_RATE_INSTANCE,
+	VERTEX_FIELDS(InstanceData, position, scale, 1, VK_FORMAT_R32G32B32A32_SFLOAT),
+	VERTEX_FIELD(InstanceData, color, 2, VK_FORMAT_R8G8B8A8_UNORM)>;
+
+// Vertex input of the mesh pipelines and the instanced one for a position stream, checked against the inputs the
+// vertex shaders declare
+template<typename PositionStream>
+struct PipelineVertexInputs
+{
+	using Mesh = VertexLayout::Input<PositionStream>;
+	using Instanced = VertexLayout::Input<PositionStream, InstanceStream>;
+
+	static_assert(VertexLayout::Reads<Mesh>(0, VertexLayout::Numeric::Float), "basic.vert.glsl and depth.vert.glsl read vec3 a_Position at location 0");
+	static_assert(VertexLayout::Reads<Instanced>(0, VertexLayout::Numeric::Float), "instanced.vert.glsl reads vec3 a_Position at location 0");
+	static_assert(VertexLayout::Reads<Instanced>(1, VertexLayout::Numeric::Float), "instanced.vert.glsl reads vec4 a_InstancePositionScale at location 1");
+	static_assert(VertexLayout::Reads<Instanced>(2, VertexLayout::Numeric::Float), "instanced.vert.glsl reads vec4 a_InstanceColor at location 2");
+};
+
+// CPU side mesh, indices are narrowed to 16 bit on import when the vertex count allows
+struct MeshData
+{
+	std::vector<Vector3> vertices{};
+	std::vector<uint32_t> indices{};
+	uint32_t maxLods = MeshSimplifier::MaxLodCount; // Levels of detail ImportMesh builds, 1 keeps only the mesh itself
+};
+
+// A range of objects drawn with a single instanced draw call
+struct DrawItem
+{
+	uint32_t meshId = 0;
+	uint32_t firstObject = 0;
+	uint32_t objectCount = 0;
+	uint32_t materialId = 0;
+};
 
 class Renderer
 {
 public:
+	// What culling kept and dropped in one frame
+	struct CullStats
+	{
+		double cpuCullMs = 0.0;
+		double gpuCullMs = 0.0;
+		uint32_t visibleObjects = 0;
+		uint32_t totalObjects = 0;
+		uint32_t frustumCulled = 0;
+		uint32_t occlusionCulled = 0;
+		uint32_t drawnFirstPhase = 0;
+		uint32_t drawnSecondPhase = 0;
+		uint64_t drawnTriangles = 0;      // CPU culling and cluster culling, the GPU object cull picks its levels without reporting back
+		uint64_t clusterTriangles = 0;    // Cluster culling: triangles of every object going in
+		uint64_t coneCulledTriangles = 0; // Cluster culling: in clusters that face away, the rest not drawn was outside the frustum
+	};
+
 	void Init();
 	void Shutdown();
 
 	void Run();
+	void RunInstancingBenchmark();
+	void RunCullingBenchmark();
+	void RunPrepassBenchmark();
+	void RunRecordingBenchmark();
+	void RunAsyncComputeBenchmark();
+	void RunDispatchBenchmark();
+	void RunLodBenchmark();
+	void RunClusterBenchmark();
+	void RunVertexFormatBenchmark();
+
+	void SetCullMode(CullMode mode);
+	void SetOcclusionCulling(bool enabled); // Two-phase Hi-Z occlusion culling, GPU cull mode only
+	void SetDepthPrepass(bool enabled);     // Depth-only pass first, then shade with an EQUAL depth test
+	void SetMsaaSamples(uint32_t samples);  // 1, 2, 4 or 8 (clamped to the device), call before Init
+	void SetPositionFormat(VertexCompression::PositionFormat format); // How ImportMesh stores positions, call before Init
+	void SetRenderThread(bool enabled);     // Record and submit on a separate thread (default), call before Init
+	void SetDeviceOverride(const std::string& device); // GPU index or part of its name instead of the best scoring one, call before Init
+	void DumpRenderGraph();                 // Logs the next compiled frame graph
+	void SetRecordThreads(uint32_t threads); // Jobs recording the scene into secondary command buffers, 1 records it inline
+	void SetAsyncCompute(bool enabled);      // Cull on a compute-only queue when the device has one (default)
+	void SetLodError(float pixels);          // Screen space error culling may trade for a coarser LOD (default 1), 0 always draws full detail
+	void SetClusterCulling(bool enabled);    // GPU cull mode: per-meshlet bounds and backface tests at full detail, instead of Hi-Z occlusion and LODs
+
+	// Returns the mesh id used by DrawItem and DrawInstanced
+	uint32_t ImportMesh(const MeshData& meshData);
+	// Reorders indices and vertices for the GPU's caches before ImportMesh, meshes in parallel. Logs the stats
+	void OptimizeMeshes(MeshData* meshes, uint32_t meshCount);
+	void ReleaseMesh(uint32_t meshId);
+
+	// Queue instances for this frame, they go out with the frame's snapshot in Update
+	void DrawInstanced(uint32_t meshId, const InstanceData* instances, uint32_t instanceCount);
+
+	// Scene nodes: parented transforms that stay until cleared, drawn as instances of their mesh
+	// (TransformHierarchy::NoMesh for a pure transform). Changes go out with the frame's snapshot in Update
+	uint32_t AddSceneNode(uint32_t parent, const NodeTransform& local, uint32_t meshId, const Color& color = { 1.f, 1.f, 1.f, 1.f });
+	void SetSceneNodeTransform(uint32_t node, const NodeTransform& local);
+	void ClearSceneNodes();
+
+	// Hands this frame's state to the render thread, returns once the previous frame has been picked up
+	void Update(const float deltaTime);
+
+	// Culling of the last frame the render thread finished, a copy so the main thread can read it while the next one runs
+	CullStats GetCullStats() const;
 
 private:
 
+	struct Buffer
+	{
+		VkBuffer handle = nullptr;
+		VkDeviceMemory memory = nullptr;
+		VkDeviceSize size = 0;
+		VkBufferUsageFlags usageFlags = 0;
+		bool concurrent = false; // Used by both the graphics and the async compute queue
+	};
+
+	// One persistently mapped buffer split into a segment per frame in flight
+	struct RingBuffer
+	{
+		Buffer buffer{};
+		uint8_t* memory = nullptr;
+		VkDeviceSize segmentSize = 0;
+	};
+
+	struct MeshLod
+	{
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		float error = 0.f; // Mesh units, scaled by the object
+	};
+
+	// Sub-ranges of the geometry pool, in elements (vertices / indices).
+	// The levels of detail share the vertices, their indices follow the full mesh's in the same allocation
+	struct Mesh
+	{
+		uint32_t vertexOffset = 0;
+		uint32_t vertexCount = 0;
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;        // Full detail, lods[0]
+		uint32_t lodIndexCount = 0;     // All levels together
+		uint32_t lodCount = 1;
+		MeshLod lods[MeshSimplifier::MaxLodCount]{};
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+		Vector3 boundsCenter{};
+		float boundsRadius = 0.f;
+		VertexCompression::Dequantization positionDequantization{}; // Applied by the vertex shader, the bounds, LODs and meshlets above are in mesh units
+		uint32_t firstMeshlet = 0;          // Full detail clusters, in the meshlet pools
+		uint32_t meshletCount = 0;
+		uint32_t meshletVertexOffset = 0;
+		uint32_t meshletVertexCount = 0;
+		uint32_t meshletTriangleOffset = 0; // One packed uint per triangle
+		uint32_t meshletTriangleCount = 0;
+	};
+
+	// One device local buffer shared by many meshes, filled through staging copies
+	struct PoolBuffer
+	{
+		Buffer buffer{};
+		RangeAllocator ranges{};
+		uint32_t elementSize = 0;
+		VkAccessFlags readAccess = 0; // How draws read it, the destination of upload barriers
+	};
+
+	// Staging copy queued by ImportMesh, sent to the transfer queue by SubmitUploads
+	struct UploadCopy
+	{
+		VkBuffer dst = nullptr;
+		VkDeviceSize srcOffset = 0; // Into the staging data
+		VkDeviceSize dstOffset = 0;
+		VkDeviceSize size = 0;
+		VkAccessFlags dstAccess = 0;
+	};
+
+	// Submitted uploads, the staging buffer and command buffer are released once the fence signals
+	struct PendingUpload
+	{
+		Buffer staging{};
+		VkCommandBuffer cmd = nullptr;
+		VkFence fence = nullptr;
+	};
+
+	// All static meshes packed into one vertex buffer and one index buffer per index type,
+	// so drawing every mesh needs only a couple of binds
+	struct GeometryPool
+	{
+		PoolBuffer vertices{};
+		PoolBuffer indices16{};
+		PoolBuffer indices32{};
+		PoolBuffer meshlets{};         // MeshletCullData, read by cluster culling
+		PoolBuffer meshletVertices{};  // Mesh vertex of each meshlet vertex
+		PoolBuffer meshletTriangles{}; // Three meshlet vertices per triangle, 8 bits each
+	};
+
+	// Consecutive indirect commands sharing index type and material, submitted with one call.
+	// When culling, commandCount is the capacity (every object visible) and drawCount what survived
+	struct IndirectDrawGroup
+	{
+		VkIndexType indexType = VK_INDEX_TYPE_UINT32;
+		uint32_t materialId = 0;
+		VertexCompression::Dequantization positionDequantization{}; // Meshes only share a group when it's the same
+		uint32_t firstCommand = 0;
+		uint32_t commandCount = 0;
+		uint32_t drawCount = 0; // CPU modes only
+	};
+
+	// Device local image with a view over all of its mips
+	struct Image
+	{
+		VkImage handle = nullptr;
+		VkDeviceMemory memory = nullptr;
+		VkImageView view = nullptr;
+	};
+
+	// Per-object culling input (must match cull.comp.glsl)
+	struct ObjectCullData
+	{
+		uint32_t meshId = 0;
+		uint32_t drawGroup = UINT32_MAX; // UINT32_MAX: not part of any draw item
+	};
+
+	// Must match cull.comp.glsl
+	struct MeshLodCullData
+	{
+		uint32_t firstIndex = 0;
+		uint32_t indexCount = 0;
+		float error = 0.f; // Already in units of the allowed screen error, per unit of object scale
+		uint32_t padding = 0;
+	};
+
+	// Mesh bounds and draw arguments (must match cull.comp.glsl and cluster.comp.glsl)
+	struct MeshCullData
+	{
+		Vector3 boundsCenter{};
+		float boundsRadius = 0.f;
+		uint32_t indexCount = 0;
+		uint32_t firstIndex = 0;
+		int32_t vertexOffset = 0;
+		uint32_t lodCount = 1; // 1 when LOD selection is off
+		MeshLodCullData lods[MeshSimplifier::MaxLodCount]{};
+		uint32_t firstMeshlet = 0;
+		uint32_t meshletCount = 0;
+		uint32_t padding[2]{};
+	};
+
+	// One cluster (must match cluster.comp.glsl and cluster.task.glsl)
+	struct MeshletCullData
+	{
+		Vector3 center{};
+		float radius = 0.f;
+		Vector3 coneAxis{};
+		float coneCutoff = 1.f;
+		uint32_t firstVertex = 0;   // Into the meshlet vertex pool
+		uint32_t firstTriangle = 0; // Into the meshlet triangle pool
+		uint32_t vertexCount = 0;
+		uint32_t triangleCount = 0;
+	};
+
+	// Must match the PHASE_ constants in cull.comp.glsl
+	enum class CullPhase : uint32_t
+	{
+		Single, // Frustum only, everything drawn in one pass
+		First,  // Frustum test on last frame's visible set, drawn before the Hi-Z is built
+		Second  // Everything else tested against the Hi-Z, visibility updated for next frame
+	};
+
+	// Must match cull.comp.glsl (128 bytes, the guaranteed push constant limit)
+	struct CullPushConstants
+	{
+		Plane frustumPlanes[6]{};
+		uint32_t objectCount = 0;
+		CullPhase phase = CullPhase::Single;
+		Vector2 cameraPosition{};
+		float cameraZoom = 1.f;
+		uint32_t hizMipLevels = 0;
+		uint32_t hizWidth = 0;
+		uint32_t hizHeight = 0;
+	};
+
+	// Must match cluster.comp.glsl
+	struct ClusterCullPushConstants
+	{
+		Plane frustumPlanes[6]{};
+		uint32_t objectCount = 0;
+		uint32_t indexCapacity = 0; // Of the cluster index buffer, objects that don't fit anymore are skipped
+	};
+
+	// Must match cluster.task.glsl and cluster.mesh.glsl, DrawPushConstants plus the draw item's mesh
+	struct ClusterDrawPushConstants
+	{
+		uint32_t objectOffset = 0;
+		uint32_t materialId = 0;
+		Vector2 cameraPosition{};
+		float cameraZoom = 1.f;
+		uint32_t firstMeshlet = 0;
+		uint32_t meshletCount = 0;
+		int32_t vertexOffset = 0;
+		Vector3 boundsCenter{};
+		float boundsRadius = 0.f;
+		Vector3 positionOffset{};
+		float positionScale = 1.f;
+	};
+
+	// Must match hiz.comp.glsl
+	struct DepthPyramidPushConstants
+	{
+		uint32_t sourceWidth = 0;
+		uint32_t sourceHeight = 0;
+		uint32_t destinationWidth = 0;
+		uint32_t destinationHeight = 0;
+	};
+
+	// Draw count buffer layout: culling counters, then two counts (one per phase) for each draw group
+	static constexpr uint32_t FrustumCulledCounter = 0;
+	static constexpr uint32_t OcclusionCulledCounter = 1;
+	static constexpr uint32_t ClusterIndexCounter = 2;  // Cluster culling: indices of the surviving clusters
+	static constexpr uint32_t ConeCulledCounter = 3;    // Cluster culling: triangles in clusters facing away
+	static constexpr uint32_t DrawCountOffset = 4;
+
+	// Cluster index buffer cap per frame (64 MB), the worst case of big scenes is far beyond what survives
+	static constexpr uint32_t MaxClusterIndices = 1 << 24;
+
+	// CPU cull: frames of refits before the object BVH is rebuilt in the background
+	static constexpr uint32_t BvhRebuildInterval = 60;
+
+	// GPU side cost of the last completed frame
+	struct FrameStats
+	{
+		double gpuFrameMs = 0.0;          // Graphics queue
+		uint64_t fragmentInvocations = 0; // 0 when pipeline statistics queries are unsupported
+		double asyncComputeMs = 0.0;      // Culling on the async compute queue, 0 when it ran on the graphics queue
+		double queueOverlapMs = 0.0;      // Part of asyncComputeMs the graphics queue was busy as well
+	};
+
+	struct InstanceBatch
+	{
+		uint32_t meshId = 0;
+		uint32_t firstInstance = 0;
+		uint32_t instanceCount = 0;
+	};
+
+	// Set from the main thread, applied by the render thread with the frame that carries them
+	struct RenderSettings
+	{
+		CullMode cullMode = CullMode::None;
+		bool occlusionCulling = true;
+		bool depthPrepass = false;
+		uint32_t recordThreads = 1;
+		bool asyncCompute = true;
+		float lodErrorPixels = 1.f;
+		bool clusterCulling = false;
+	};
+
+	// Scene node change made on the main thread, the render thread owns the hierarchy and applies it
+	struct SceneNodeEdit
+	{
+		enum class Type
+		{
+			Add,
+			SetTransform,
+			Clear
+		};
+
+		Type type = Type::Add;
+		uint32_t node = 0;
+		uint32_t parent = TransformHierarchy::InvalidNode;
+		NodeTransform local{};
+		uint32_t meshId = TransformHierarchy::NoMesh;
+		Color color{};
+	};
+
+	// Everything a frame needs from the main thread, copied in Update and only read by the render thread
+	struct FrameSnapshot
+	{
+		std::vector<ObjectData> objects{};
+		std::vector<DrawItem> drawItems{};
+		uint64_t drawItemsVersion = 0;     // Draw items are only copied into a slot when this changed
+		std::vector<InstanceData> instanceData{};
+		std::vector<InstanceBatch> instanceBatches{};
+		std::vector<SceneNodeEdit> sceneNodeEdits{};
+		Camera camera{};
+		RenderSettings settings{};
+	};
+
+	// What the render thread measured, handed back to the main thread (benchmarks) under m_statsMutex
+	struct RenderStats
+	{
+		CullStats cull{};
+		FrameStats frame{};
+		double sceneRecordMs = 0.0;
+		VkDeviceSize instanceUploadBytes = 0;
+		double instanceUploadSeconds = 0.0;
+		double sceneUpdateMs = 0.0;
+		uint32_t sceneNodesUpdated = 0; // World matrices recomputed
+	};
+
+	// Command pool owned by one job system worker, its secondaries are reused after the pool is reset
+	struct RecordWorker
+	{
+		VkCommandPool pool = nullptr;
+		std::vector<VkCommandBuffer> secondaryCmdBuffers{};
+		uint32_t usedCmdBuffers = 0;
+	};
+
 	struct PerFrameData
 	{
 		VkFence         queueSubmitFence = nullptr;
 		VkCommandPool   primaryCmdPool = nullptr;
 		VkCommandBuffer primaryCmdBuffer = nullptr;
+		std::vector<RecordWorker> recordWorkers{}; // One per job system worker and the render thread, reset with the primary pool
 		VkSemaphore     swapchainAcquireSemaphore = nullptr;
 		VkSemaphore     swapchainReleaseSemaphore = nullptr;
+		VkCommandPool   computeCmdPool = nullptr;      // Async compute family, reset with the primary pool
+		VkCommandBuffer computeCmdBuffer = nullptr;
+		VkSemaphore     computeSemaphore = nullptr;    // Async cull done, waited on by this frame's graphics submit
+		VkSemaphore     visibilitySemaphore = nullptr; // Graphics wrote visibility, waited on by the next submit that reads it
+		bool            asyncCull = false;             // This frame culled on the async compute queue
+		std::vector<VkSemaphore> uploadSemaphores{}; // Transfer queue signals waited on by this frame, destroyed after its fence
+		VkDescriptorSet descriptorSet = nullptr;
+		Buffer          objectBuffer{};
+		ObjectData*     objectBufferMemory = nullptr; // Persistently mapped
+		Buffer          indirectBuffer{};
+		VkDrawIndexedIndirectCommand* indirectBufferMemory = nullptr; // Persistently mapped
+		Buffer          drawCountBuffer{};
+		uint32_t*       drawCountBufferMemory = nullptr; // Persistently mapped
+		VkDescriptorSet cullDescriptorSet = nullptr;
+		Buffer          cullObjectBuffer{};
+		ObjectCullData* cullObjectBufferMemory = nullptr; // Persistently mapped
+		Buffer          meshCullBuffer{};
+		MeshCullData*   meshCullBufferMemory = nullptr; // Persistently mapped
+		Buffer          drawGroupBuffer{};
+		uint32_t*       drawGroupBufferMemory = nullptr; // Persistently mapped, first command and capacity of each group
+		VkQueryPool     timestampQueryPool = nullptr; // 0-3 culling, 4-5 whole frame
+		VkQueryPool     statisticsQueryPool = nullptr;
+		bool            frameQueriesPending = false;
+		bool            statisticsQueryWritten = false; // Skipped when recording secondaries without inheritedQueries
+		uint32_t        timestampCount = 0;    // Culling timestamps written by the last submit of this frame
+		uint32_t        pendingCullGroups = 0; // Groups culled on the GPU by the last submit of this frame
+		uint64_t        pendingClusterTriangles = 0; // Triangles the last submit's cluster culling started from, 0 without it
+		bool            pendingMeshShaderCull = false; // Clusters culled by task shaders, no draw commands were written
+		Buffer          clusterIndexBuffer{};      // Device local, surviving clusters' triangles (compute cluster culling)
+		uint32_t        clusterIndexCapacity = 0;
+		VkDescriptorSet meshletDescriptorSet = nullptr; // Meshlet pools, cluster indices and counters
+		Image           msaaColorImage{};          // Transient, resolved into the swapchain image (MSAA only)
+		Image           depthImage{};              // Transient when MSAA is on
+		VkImageView     depthSampleView = nullptr; // Depth aspect only, for the Hi-Z build
+		RenderGraph     renderGraph{};
+		uint32_t        hizGeneration = UINT32_MAX; // Render graph transients the Hi-Z views were made for
+		VkImageView     hizView = nullptr;     // Max depth pyramid (R32_SFLOAT), a render graph transient
+		std::vector<VkImageView> hizMipViews{};
+		std::vector<VkDescriptorSet> hizDescriptorSets{}; // One per mip, reads the level above (or depth)
 	};
 
-	struct Buffer
+	// Queue families of a physical device, -1 when missing
+	struct QueueFamilies
 	{
-		VkBuffer handle = nullptr;
-		VkDeviceMemory memory = nullptr;
-		VkDeviceSize size = 0;
-		VkBufferUsageFlagBits usageFlags = VK_BUFFER_USAGE_FLAG_BITS_MAX_ENUM;
+		int32_t graphics = -1;
+		int32_t present = -1;  // Same as graphics when that family can present
+		int32_t compute = -1;  // Compute-only
+		int32_t transfer = -1; // Transfer-only
 	};
 
 	VkShaderModule LoadShader(const std::filesystem::path& path);
 	void InitPerFrameData(PerFrameData& perFrame);
 	void CreateWindow();
+	QueueFamilies FindQueueFamilies(VkPhysicalDevice device) const;
+	int64_t ScorePhysicalDevice(VkPhysicalDevice device) const; // -1 when the renderer can't run on it
+	void SelectPhysicalDevice();
 	void CreateDevice();
 	void CreateSwapchain(VkFormat& out_swapchainFormat);
+	void CreateRenderTargets(const VkFormat swapchainFormat);
 	void CreateRenderPass(const VkFormat swapchainFormat);
+	VkRenderPass CreateMainRenderPass(const VkFormat swapchainFormat, bool loadContents, bool storeDepth);
 	void CreateBuffers();
+	void CreateDescriptors();
 	void CreatePipeline();
 	void CreateFramebuffers();
 
-	void CreateOrResizeBuffer(Buffer& buffer, uint64_t newSize);
+	void CreateOrResizeBuffer(Buffer& buffer, uint64_t newSize, VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+	void DestroyBuffer(Buffer& buffer);
+	uint32_t FindMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) const; // UINT32_MAX if none
+	void CreateImage(Image& image, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect, uint32_t width, uint32_t height, uint32_t mipLevels,
+		VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT);
+	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspect, uint32_t baseMipLevel, uint32_t levelCount);
+	void DestroyImage(Image& image);
+	void ReserveMappedBuffer(Buffer& buffer, void** mappedMemory, VkDeviceSize size);
+	void FlushMappedBuffer(const Buffer& buffer);
+	void ReserveObjectBuffer(PerFrameData& perFrame, size_t objectCount);
+	void UploadObjectData(PerFrameData& perFrame);
+	void CreateGeometryPool();
+	void InitPoolBuffer(PoolBuffer& pool, VkBufferUsageFlags usage, uint32_t elementSize, uint32_t capacity);
+	uint32_t AllocateFromPool(PoolBuffer& pool, const void* data, uint32_t count);
+	void DestroyPoolBuffer(PoolBuffer& pool);
+	void QueueUpload(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size, VkAccessFlags dstAccess);
+	void SubmitUploads();                // Sends the queued copies to the transfer queue
+	void RetireUploads(bool wait);       // Frees the staging of finished uploads
+	void AcquireUploads(VkCommandBuffer cmd, VkPipelineStageFlags dstStages, VkAccessFlags extraAccess = 0); // Graphics side of the submitted uploads, extraAccess on top of their reads
+	DrawPushConstants GetDrawPushConstants(uint32_t objectOffset, uint32_t materialId, const VertexCompression::Dequantization& dequantization = {}) const;
+	void CreateCullPipeline();
+	void ComputeFrustum(Plane out_planes[6]) const;
+	bool IsTwoPhaseCulling() const;
+	bool IsGpuCulling() const; // Culling on the GPU this frame, render thread
+	bool IsClusterCulling() const;    // Per meshlet on top of that
+	bool IsMeshShaderCulling() const; // Clusters culled and drawn by task and mesh shaders, no compute pass
+	void SubmitAsyncCulling(PerFrameData& perFrame);
+	void BuildDrawGroups();
+	VkDeviceSize GetDrawCountBufferSize() const;
+	void WriteIndirectCommands(PerFrameData& perFrame);
+	void CullObjectsCpu(PerFrameData& perFrame);
+	void UploadCullInputs(PerFrameData& perFrame);
+	void UploadClusterInputs(PerFrameData& perFrame);
+	void RecordClusterCulling(VkCommandBuffer cmd, PerFrameData& perFrame);
+	uint32_t SelectLod(const Mesh& mesh, float objectScale) const; // Coarsest level within the allowed screen error
+	void ReadGpuCullResults(PerFrameData& perFrame);
+	void RecordCulling(VkCommandBuffer cmd, PerFrameData& perFrame, CullPhase phase);
+	void RecordDepthPyramid(VkCommandBuffer cmd, PerFrameData& perFrame);
+	void UpdateDepthPyramidViews(PerFrameData& perFrame, VkImage hizImage, VkImageView hizView);
+	void BuildRenderGraph(uint32_t index, VkDeviceSize instanceOffset);
+	void RecordInstancedDraws(VkCommandBuffer cmd, VkDeviceSize instanceOffset);
+	void BeginMainPass(VkCommandBuffer cmd, uint32_t index, VkRenderPass renderPass, VkSubpassContents contents);
+	void SetMainPassState(VkCommandBuffer cmd, uint32_t index);
+	void RecordMainPass(VkCommandBuffer cmd, uint32_t index, VkRenderPass renderPass, uint32_t phase, bool instanced, VkDeviceSize instanceOffset);
+	void RecordScene(VkCommandBuffer cmd, uint32_t index, uint32_t phase);
+	void RecordSceneParallel(VkCommandBuffer cmd, uint32_t index, VkRenderPass renderPass, uint32_t phase, bool instanced, VkDeviceSize instanceOffset);
+	VkCommandBuffer BeginSecondary(RecordWorker& worker, uint32_t index, VkRenderPass renderPass);
+	uint32_t GetDrawListSize() const;
+	void ReadFrameStats(PerFrameData& perFrame);
+	void RecordDrawItems(VkCommandBuffer cmd, PerFrameData& perFrame, uint32_t phase, uint32_t first = 0, uint32_t count = UINT32_MAX); // Range of the draw list
+	void RecordMeshShaderDraws(VkCommandBuffer cmd, PerFrameData& perFrame, uint32_t first, uint32_t count); // Range of the draw items
+	void ReserveInstanceRing(VkDeviceSize bytesPerFrame);
+	VkDeviceSize UploadInstanceData(uint32_t index);
 
 	VkResult NextImage(uint32_t& out_imageIndex);
-	void Update(const float deltaTime);
+	void RenderThreadMain();
+	void RenderFrame(const FrameSnapshot& frame);
 	void Render(uint32_t index);
 	VkResult Present(uint32_t index);
+	void WaitForRenderThread(); // Until the render thread is idle with nothing queued
+	void StopRenderThread();
+	RenderStats GetRenderStats();
 
 	void DestroyPerFrameData(PerFrameData& perFrameData);
 
 private:
+	JobSystem m_jobs{};
+
 	VkInstance m_vulkan;
 	GLFWwindow* m_window;
 	uint32_t m_windowWidth = 800;
@@ -60,18 +634,133 @@ private:
 	std::string m_windowName = "Hello Vulkan";
 
 	VkPipeline m_graphicsPipeline = nullptr;
+	VkPipeline m_graphicsEqualPipeline = nullptr; // Main pass after the depth prepass
+	VkPipeline m_depthPrepassPipeline = nullptr;
+	VkPipeline m_instancedPipeline = nullptr;
+	VkPipeline m_cullPipeline = nullptr;
+	VkPipelineLayout m_cullPipelineLayout = nullptr;
+	VkDescriptorSetLayout m_cullDescriptorSetLayout = nullptr;
+	VkPipeline m_clusterCullPipeline = nullptr;
+	VkPipelineLayout m_clusterCullPipelineLayout = nullptr;
+	VkPipeline m_meshShaderPipeline = nullptr;          // Null without VK_EXT_mesh_shader
+	VkPipelineLayout m_meshShaderPipelineLayout = nullptr;
+	VkDescriptorSetLayout m_meshletDescriptorSetLayout = nullptr;
+	VkPipeline m_hizPipeline = nullptr;
+	VkPipelineLayout m_hizPipelineLayout = nullptr;
+	VkDescriptorSetLayout m_hizDescriptorSetLayout = nullptr;
+	VkSampler m_pointSampler = nullptr;
 	VkPipelineLayout m_pipelineLayout = nullptr;
+	VkDescriptorSetLayout m_descriptorSetLayout = nullptr;
+	VkDescriptorPool m_descriptorPool = nullptr;
 	VkSwapchainKHR m_swapchain = nullptr;
-	VkRenderPass m_renderPass = nullptr;
-	VkQueue m_deviceQueue = nullptr;
+	VkRenderPass m_renderPass = nullptr;            // Clear, draw
+	VkRenderPass m_firstPhaseRenderPass = nullptr;  // Clear, draw, keep depth for the Hi-Z
+	VkRenderPass m_secondPhaseRenderPass = nullptr; // Load, draw
+	VkFormat m_swapchainFormat = VK_FORMAT_UNDEFINED;
+	VkFormat m_depthFormat = VK_FORMAT_UNDEFINED;
+	bool m_depthSampleable = false;                 // Hi-Z needs to sample depth (sampleable format, single sampled)
+	uint32_t m_requestedMsaaSamples = 1;
+	VertexCompression::PositionFormat m_positionFormat = VertexCompression::PositionFormat::Float32;
+	VkSampleCountFlagBits m_msaaSamples = VK_SAMPLE_COUNT_1_BIT;
+	bool m_depthPrepass = false;
+	float m_lodErrorPixels = 1.f;                   // Render thread copy of the setting
+	float m_lodErrorScale = 0.f;                    // This frame: LOD error times this is in allowed screen errors, 0 for no LODs
+	bool m_clusterCulling = false;                  // Render thread copy of the setting
+	uint64_t m_clusterTriangles = 0;                // This frame: full detail triangles of every object in a draw item
+	VkExtent2D m_hizExtent{};                       // Depth extent rounded down to powers of two
+	uint32_t m_hizMipLevels = 0;
+	VulkanDispatch m_vk{};                          // Every Vulkan call but vkCreateInstance goes through this
+	VkQueue m_deviceQueue = nullptr;                // Graphics
+	VkQueue m_presentQueue = nullptr;               // Same as m_deviceQueue when the graphics family can present
+	VkQueue m_transferQueue = nullptr;              // Same as m_deviceQueue without a dedicated transfer family
+	VkQueue m_computeQueue = nullptr;               // Same as m_deviceQueue without a compute-only family
 	VkPhysicalDevice m_gpu = nullptr;
+	VkPhysicalDeviceProperties m_gpuProperties{};
 	VkDevice m_device = nullptr;
 	VkSurfaceKHR m_surface = nullptr;
 
-	Buffer m_vertexBuffer{};
-	Buffer m_indexBuffer{};
+	GeometryPool m_geometryPool{};
+	std::vector<Mesh> m_meshes{};
+	std::vector<IndirectDrawGroup> m_indirectGroups{};
+	std::vector<uint32_t> m_drawOrder{};               // Draw items sorted into groups
+	std::vector<ObjectCullData> m_objectCullData{};
+	std::vector<uint8_t> m_cpuCullVisible{};           // Per object, written by the parallel CPU cull
+	Bvh m_objectBvh{};                                 // CPU cull, over the objects' world boxes
+	std::vector<Bounds> m_objectBounds{};              // Per object, as of the last CPU cull
+	std::vector<uint8_t> m_objectMoved{};              // Per object, box changed this frame
+	std::vector<uint32_t> m_movedObjects{};
+	std::vector<uint32_t> m_bvhVisibleObjects{};
+	uint32_t m_bvhRefitFrames = 0;                     // Frames with refits since the last (re)build
+	uint64_t m_groupedDrawItemsVersion = 0;            // Draw items version the groups were built from
+	CullMode m_cullMode = CullMode::None;              // Render thread copies of the frame's settings
+	bool m_occlusionCulling = true;
+	Buffer m_visibilityBuffer{};                       // Per-object visibility from the last frame, shared by all frames
+	uint32_t* m_visibilityBufferMemory = nullptr;
+	size_t m_visibilityObjectCount = 0;
+	CullStats m_cullStats{};
+	FrameStats m_frameStats{};
+	bool m_supportsPipelineStatistics = false;
+	bool m_supportsInheritedQueries = false;       // Statistics query can stay active across secondaries
+	Camera m_camera{};                                 // Main thread
+	bool m_supportsMultiDrawIndirect = false;
+	bool m_supportsIndirectFirstInstance = false;
+	PFN_vkCmdDrawIndexedIndirectCount m_vkCmdDrawIndexedIndirectCount = nullptr; // VK_KHR_draw_indirect_count, null when unavailable
+	PFN_vkCmdPipelineBarrier2KHR m_vkCmdPipelineBarrier2 = nullptr;               // VK_KHR_synchronization2, null when unavailable
+	PFN_vkCmdDrawMeshTasksEXT m_vkCmdDrawMeshTasks = nullptr;                      // VK_EXT_mesh_shader, null when unavailable
+	VkPipelineStageFlags m_geometryReadStages = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT; // Where uploaded geometry is first read
+	std::atomic<bool> m_dumpRenderGraph{ false };
+	uint32_t m_recordThreads = 1;
+	double m_sceneRecordMs = 0.0; // CPU time recording the main passes last frame
+
+	// Main thread state, snapshotted every Update
+	std::vector<ObjectData> m_objects{};
+	std::vector<DrawItem> m_drawItems{};
+	uint64_t m_drawItemsVersion = 1;        // Bumped whenever m_drawItems or anything grouping depends on changes
+	std::vector<InstanceData> m_instanceData{};
+	std::vector<InstanceBatch> m_instanceBatches{};
+	std::vector<SceneNodeEdit> m_sceneNodeEdits{};
+	uint32_t m_sceneNodeCount = 0;
+	RenderSettings m_settings{};
 
+	// Main thread -> render thread handoff
+	TripleBuffer<FrameSnapshot> m_frames{};
+	const FrameSnapshot* m_frame = nullptr; // Being rendered, render thread only
+	bool m_useRenderThread = true;
+	std::thread m_renderThread{};
+	std::mutex m_renderMutex{};             // Only parks a thread that got ahead, the frames themselves move lock-free
+	std::condition_variable m_renderWake{};
+	bool m_renderThreadBusy = false;
+	bool m_stopRenderThread = false;
+	mutable std::mutex m_statsMutex{};
+	RenderStats m_renderStats{};
+
+	RingBuffer m_instanceRing{};
+	VkDeviceSize m_instanceUploadBytes = 0; // Last frame
+	double m_instanceUploadSeconds = 0.0;   // Last frame
+
+	// Render thread only, world matrices go straight into the instance ring after the immediate instances
+	TransformHierarchy m_sceneHierarchy{};
+	std::vector<InstanceBatch> m_sceneNodeBatches{};
+	double m_sceneUpdateMs = 0.0;           // Last frame
+	uint32_t m_sceneNodesUpdated = 0;       // Last frame
+
+	std::string m_deviceOverride{};
 	int32_t m_graphicsFamilyIndex = -1;
+	int32_t m_presentFamilyIndex = -1;
+	int32_t m_transferFamilyIndex = -1; // Transfer-only family when there is one, otherwise the graphics family
+	int32_t m_computeFamilyIndex = -1;  // Compute-only family when there is one, otherwise the graphics family
+	bool m_asyncCompute = true;         // Render thread copy of the setting
+	VkSemaphore m_pendingVisibilitySemaphore = nullptr; // Signaled by the last graphics submit, not waited on yet
+	uint64_t m_lastGraphicsTimestamps[2]{};             // Last graphics queue interval read back, for the overlap
+
+	// Geometry uploads, main thread (the render thread is idle while meshes are imported)
+	VkCommandPool m_transferCmdPool = nullptr;
+	std::vector<uint8_t> m_uploadStaging{};              // Data of the queued copies
+	std::vector<UploadCopy> m_uploadCopies{};
+	std::vector<PendingUpload> m_pendingUploads{};
+	std::vector<VkBufferMemoryBarrier> m_uploadAcquires{}; // Recorded by the next frame before anything reads the geometry
+	std::vector<VkSemaphore> m_uploadSemaphores{};         // Signaled by the transfer queue, waited on by the next frame
+	std::vector<VkImage> m_swapchainImages{};
 	std::vector<VkImageView> m_imageViews{};
 	std::vector<VkFramebuffer> m_framebuffers{};
 	std::vector<PerFrameData> m_perFrameData{};
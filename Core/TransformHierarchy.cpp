@@ -0,0 +1,270 @@
+#include "TransformHierarchy.h"
+
+#include "Debug.h"
+#include "JobSystem.h"
+#include "Renderer.h"
+#include "VertexCompression.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+#include <string>
+
+static Matrix4x4 ComposeLocal(const NodeTransform& local)
+{
+    Matrix4x4 m = ToMatrix(local.rotation);
+    for (int column = 0; column < 3; ++column)
+    {
+        Vector4& c = m.columns[column];
+        c = { c.x * local.scale, c.y * local.scale, c.z * local.scale, 0.f };
+    }
+    m.columns[3] = { local.position.x, local.position.y, local.position.z, 1.f };
+    return m;
+}
+
+uint32_t TransformHierarchy::AddNode(uint32_t parent, const NodeTransform& local, uint32_t meshId, const Color& color)
+{
+    ASSERT(parent == InvalidNode || parent < GetNodeCount(), "Invalid parent node " + std::to_string(parent));
+
+    // Appended for now, the next Update sorts it into its level
+    const uint32_t node = GetNodeCount();
+    const uint32_t slot = (uint32_t)m_parents.size();
+    const uint32_t parentSlot = parent == InvalidNode ? InvalidNode : m_nodeSlots[parent];
+    m_parents.push_back(parentSlot);
+    m_depths.push_back(parentSlot == InvalidNode ? 0 : m_depths[parentSlot] + 1);
+    m_locals.push_back(local);
+    m_worlds.push_back(Matrix4x4::Identity());
+    m_dirty.push_back(1);
+    m_meshIds.push_back(meshId);
+    m_colors.push_back(VertexCompression::PackUnorm8(color));
+    m_slotNodes.push_back(node);
+    m_nodeSlots.push_back(slot);
+    m_sorted = false;
+    return node;
+}
+
+void TransformHierarchy::SetLocalTransform(uint32_t node, const NodeTransform& local)
+{
+    ASSERT(node < GetNodeCount(), "Invalid node " + std::to_string(node));
+
+    const uint32_t slot = m_nodeSlots[node];
+    m_locals[slot] = local;
+    m_dirty[slot] = 1;
+}
+
+void TransformHierarchy::Clear()
+{
+    m_parents.clear();
+    m_depths.clear();
+    m_locals.clear();
+    m_worlds.clear();
+    m_dirty.clear();
+    m_meshIds.clear();
+    m_colors.clear();
+    m_slotNodes.clear();
+    m_nodeSlots.clear();
+    m_levelStarts.clear();
+    m_meshRuns.clear();
+    m_sorted = true;
+}
+
+uint32_t TransformHierarchy::Update(JobSystem& jobs, InstanceData* instances)
+{
+    if (!m_sorted)
+        SortByDepth();
+
+    // A level only reads the one before it, so each level runs in parallel once the previous one is done.
+    // A parent's dirty flag stays set until the end, that's how its children know to follow
+    std::atomic<uint32_t> recomputed{ 0 };
+    for (size_t level = 0; level + 1 < m_levelStarts.size(); ++level)
+    {
+        const uint32_t levelStart = m_levelStarts[level];
+        jobs.ParallelFor(m_levelStarts[level + 1] - levelStart, 1024, [&](uint32_t begin, uint32_t end)
+        {
+            uint32_t batchRecomputed = 0;
+            for (uint32_t slot = levelStart + begin; slot < levelStart + end; ++slot)
+            {
+                const uint32_t parent = m_parents[slot];
+                if (m_dirty[slot] || (parent != InvalidNode && m_dirty[parent]))
+                {
+                    const Matrix4x4 local = ComposeLocal(m_locals[slot]);
+                    m_worlds[slot] = parent == InvalidNode ? local : Multiply(m_worlds[parent], local);
+                    m_dirty[slot] = 1;
+                    ++batchRecomputed;
+                }
+
+                if (m_meshIds[slot] == NoMesh)
+                    continue;
+
+                // Built whole and stored once, mapped memory is often write-combined
+                const Matrix4x4& world = m_worlds[slot];
+                const Vector4& xAxis = world.columns[0];
+                InstanceData instance{};
+                instance.position = { world.columns[3].x, world.columns[3].y, world.columns[3].z };
+                instance.scale = std::sqrt(xAxis.x * xAxis.x + xAxis.y * xAxis.y + xAxis.z * xAxis.z);
+                instance.color = m_colors[slot];
+                instances[slot] = instance;
+            }
+            recomputed.fetch_add(batchRecomputed, std::memory_order_relaxed);
+        });
+    }
+
+    if (!m_dirty.empty())
+        memset(m_dirty.data(), 0, m_dirty.size());
+    return recomputed.load(std::memory_order_relaxed);
+}
+
+void TransformHierarchy::SortByDepth()
+{
+    // Stable, so nodes keep their relative order within a level and mesh
+    const uint32_t slotCount = (uint32_t)m_parents.size();
+    std::vector<uint32_t> order(slotCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+    {
+        if (m_depths[a] != m_depths[b])
+            return m_depths[a] < m_depths[b];
+        return m_meshIds[a] < m_meshIds[b];
+    });
+
+    std::vector<uint32_t> newSlots(slotCount);
+    for (uint32_t slot = 0; slot < slotCount; ++slot)
+    {
+        newSlots[order[slot]] = slot;
+    }
+
+    auto permute = [&order](auto& values)
+    {
+        auto sorted = values;
+        for (size_t slot = 0; slot < order.size(); ++slot)
+        {
+            sorted[slot] = values[order[slot]];
+        }
+        values.swap(sorted);
+    };
+    permute(m_parents);
+    permute(m_depths);
+    permute(m_locals);
+    permute(m_worlds);
+    permute(m_dirty);
+    permute(m_meshIds);
+    permute(m_colors);
+    permute(m_slotNodes);
+
+    m_levelStarts.clear();
+    m_meshRuns.clear();
+    for (uint32_t slot = 0; slot < slotCount; ++slot)
+    {
+        if (m_parents[slot] != InvalidNode)
+            m_parents[slot] = newSlots[m_parents[slot]];
+        m_nodeSlots[m_slotNodes[slot]] = slot;
+
+        if (slot == 0 || m_depths[slot] != m_depths[slot - 1])
+            m_levelStarts.push_back(slot);
+
+        const uint32_t meshId = m_meshIds[slot];
+        if (meshId == NoMesh)
+            continue;
+        if (!m_meshRuns.empty() && m_meshRuns.back().meshId == meshId && m_meshRuns.back().firstSlot + m_meshRuns.back().count == slot)
+            ++m_meshRuns.back().count;
+        else
+            m_meshRuns.push_back({ meshId, slot, 1 });
+    }
+    m_levelStarts.push_back(slotCount);
+    m_sorted = true;
+}
+
+void RunHierarchyBenchmark(JobSystem& jobs)
+{
+    const uint32_t framesPerStep = 120;
+    const uint32_t groupCount = 100;      // Under one root, each group spins its own children
+    const uint32_t childrenPerGroup = 1000;
+
+    TransformHierarchy hierarchy;
+    const uint32_t root = hierarchy.AddNode(TransformHierarchy::InvalidNode, NodeTransform{});
+    std::vector<uint32_t> groups(groupCount);
+    const uint32_t side = (uint32_t)std::ceil(std::sqrt((double)groupCount));
+    for (uint32_t group = 0; group < groupCount; ++group)
+    {
+        NodeTransform local{};
+        local.position = { -1.f + 2.f * (group % side + 0.5f) / side, -1.f + 2.f * (group / side + 0.5f) / side, 0.f };
+        local.scale = 1.f / side;
+        groups[group] = hierarchy.AddNode(root, local);
+
+        for (uint32_t child = 0; child < childrenPerGroup; ++child)
+        {
+            const float angle = 6.2831853f * child / childrenPerGroup;
+            NodeTransform childLocal{};
+            childLocal.position = { std::cos(angle) * 0.8f, std::sin(angle) * 0.8f, 0.f };
+            childLocal.scale = 0.05f;
+            hierarchy.AddNode(groups[group], childLocal, 0, { (float)group / groupCount, (float)child / childrenPerGroup, 1.f, 1.f });
+        }
+    }
+
+    // The renderer writes the instances straight into its mapped ring, plain memory here
+    std::vector<InstanceData> instances(hierarchy.GetNodeCount());
+
+    struct HierarchyStep
+    {
+        const char* name;
+        uint32_t movingGroups; // UINT32_MAX moves the root instead
+    };
+    const HierarchyStep steps[] =
+    {
+        { "static", 0 },
+        { "1 group moving", 1 },
+        { "all groups moving", groupCount },
+        { "root moving", UINT32_MAX }
+    };
+
+    LOG("Hierarchy benchmark (" + std::to_string(hierarchy.GetNodeCount()) + " nodes, "
+        + std::to_string(jobs.GetWorkerCount()) + " workers, " + std::to_string(framesPerStep) + " frames per step)");
+    float time = 0.f;
+    for (const HierarchyStep& step : steps)
+    {
+        // The first update of a step still carries the previous step's changes (or the initial full update)
+        const uint32_t warmupFrames = 1;
+        double updateMs = 0.0;
+        uint64_t nodesUpdated = 0;
+        for (uint32_t frame = 0; frame < warmupFrames + framesPerStep; ++frame)
+        {
+            time += 1 / 60.f;
+            NodeTransform spin{};
+            spin.rotation = { 0.f, 0.f, std::sin(time * 0.5f), std::cos(time * 0.5f) };
+            if (step.movingGroups == UINT32_MAX)
+            {
+                hierarchy.SetLocalTransform(root, spin);
+            }
+            else
+            {
+                for (uint32_t group = 0; group < step.movingGroups; ++group)
+                {
+                    NodeTransform local{};
+                    local.position = { -1.f + 2.f * (group % side + 0.5f) / side, -1.f + 2.f * (group / side + 0.5f) / side, 0.f };
+                    local.scale = 1.f / side;
+                    local.rotation = spin.rotation;
+                    hierarchy.SetLocalTransform(groups[group], local);
+                }
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+            const uint32_t recomputed = hierarchy.Update(jobs, instances.data());
+            auto end = std::chrono::high_resolution_clock::now();
+
+            if (frame < warmupFrames)
+                continue;
+
+            updateMs += std::chrono::duration<double, std::milli>(end - start).count();
+            nodesUpdated += recomputed;
+        }
+
+        char line[256];
+        snprintf(line, sizeof(line), "%-18s: %8.3f ms/frame updating, %8.0f world matrices recomputed per frame",
+            step.name, updateMs / framesPerStep, (double)nodesUpdated / framesPerStep);
+        LOG(line);
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mathmatics.h"
+
+class JobSystem;
+struct InstanceData;
+
+// Transform relative to the parent node: scale, then rotation, then translation
+struct NodeTransform
+{
+	Vector3 position{};
+	float scale = 1.f;
+	Quaternion rotation{};
+};
+
+// Parent/child transforms in flat arrays, sorted by depth so parents always come before their children and every
+// depth level is one contiguous range. Update sweeps the levels in order, splitting each one across the job system,
+// and only recomputes nodes that changed and their subtrees.
+// Node ids are handed out in creation order and stay valid, a node's position in the arrays (its slot) moves when
+// nodes are added
+class TransformHierarchy
+{
+public:
+	static constexpr uint32_t InvalidNode = UINT32_MAX;
+	static constexpr uint32_t NoMesh = UINT32_MAX;
+
+	// Consecutive slots drawing the same mesh, one instanced draw each
+	struct MeshRun
+	{
+		uint32_t meshId = 0;
+		uint32_t firstSlot = 0;
+		uint32_t count = 0;
+	};
+
+	// parent is InvalidNode for a root, nodes without a mesh only carry a transform for their children
+	uint32_t AddNode(uint32_t parent, const NodeTransform& local, uint32_t meshId = NoMesh, const Color& color = { 1.f, 1.f, 1.f, 1.f });
+	void SetLocalTransform(uint32_t node, const NodeTransform& local);
+	void Clear();
+
+	uint32_t GetNodeCount() const { return (uint32_t)m_nodeSlots.size(); }
+	const Matrix4x4& GetWorldMatrix(uint32_t node) const { return m_worlds[m_nodeSlots[node]]; } // As of the last Update
+
+	// Recomputes dirty subtrees and writes each slot's instance into instances[slot] while its matrix is still in cache,
+	// instances can point straight into mapped GPU memory. Slots without a mesh are skipped.
+	// Returns how many world matrices were recomputed
+	uint32_t Update(JobSystem& jobs, InstanceData* instances);
+
+	// Valid after Update
+	const std::vector<MeshRun>& GetMeshRuns() const { return m_meshRuns; }
+
+private:
+	void SortByDepth(); // Also groups each level by mesh so the runs stay few
+
+	// By slot
+	std::vector<uint32_t> m_parents{}; // Parent's slot, InvalidNode for roots
+	std::vector<uint32_t> m_depths{};
+	std::vector<NodeTransform> m_locals{};
+	std::vector<Matrix4x4> m_worlds{};
+	std::vector<uint8_t> m_dirty{};    // Bytes rather than bits, a level is written from several threads
+	std::vector<uint32_t> m_meshIds{};
+	std::vector<uint32_t> m_colors{};  // Packed like InstanceData::color
+	std::vector<uint32_t> m_slotNodes{};
+
+	std::vector<uint32_t> m_nodeSlots{};   // By node id
+	std::vector<uint32_t> m_levelStarts{}; // First slot of each depth level, then the slot count
+	std::vector<MeshRun> m_meshRuns{};
+	bool m_sorted = true;
+};
+
+// Update times on a root, 100 groups and 100000 children with nothing, one group, every group or the root moving, logged
+void RunHierarchyBenchmark(JobSystem& jobs);
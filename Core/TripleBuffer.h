@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer handoff of the latest value.
+// The producer fills its own slot and publishes it, the consumer swaps in the most recent published slot.
+// A slot published again before the consumer looked is dropped, neither side ever waits on the other.
+template<typename T>
+class TripleBuffer
+{
+public:
+	// Producer side
+	T& GetWriteSlot() { return m_slots[m_writeIndex]; }
+	void Publish() { m_writeIndex = m_middle.exchange(m_writeIndex | FreshBit, std::memory_order_acq_rel) & IndexMask; }
+
+	// Consumer side, the read slot stays valid (and unchanged) until the next successful Acquire
+	bool HasFresh() const { return (m_middle.load(std::memory_order_acquire) & FreshBit) != 0; }
+	bool Acquire()
+	{
+		if (!HasFresh())
+			return false;
+		m_readIndex = m_middle.exchange(m_readIndex, std::memory_order_acq_rel) & IndexMask;
+		return true;
+	}
+	const T& GetReadSlot() const { return m_slots[m_readIndex]; }
+
+private:
+	static constexpr uint32_t IndexMask = 3;
+	static constexpr uint32_t FreshBit = 4; // Middle slot holds something the consumer hasn't taken
+
+	T m_slots[3]{};
+	uint32_t m_writeIndex = 0;
+	uint32_t m_readIndex = 1;
+	std::atomic<uint32_t> m_middle{ 2 };
+};
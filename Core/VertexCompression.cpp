@@ -0,0 +1,155 @@
+#include "VertexCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static int16_t ToSnorm16(float value)
+{
+    return (int16_t)std::lround(std::clamp(value, -1.f, 1.f) * 32767.f);
+}
+
+static float FromSnorm16(int16_t value)
+{
+    // -32768 and -32767 both mean -1, like the hardware conversion
+    return std::max(value / 32767.f, -1.f);
+}
+
+static uint8_t ToUnorm8(float value)
+{
+    return (uint8_t)std::lround(std::clamp(value, 0.f, 1.f) * 255.f);
+}
+
+uint32_t VertexCompression::GetPositionStride(PositionFormat format)
+{
+    return format == PositionFormat::Float32 ? (uint32_t)sizeof(Vector3) : 4 * sizeof(uint16_t);
+}
+
+const char* VertexCompression::GetPositionFormatName(PositionFormat format)
+{
+    switch (format)
+    {
+    case PositionFormat::Float32: return "float32";
+    case PositionFormat::Half: return "half";
+    case PositionFormat::Snorm16: return "snorm16";
+    }
+    return "unknown";
+}
+
+VertexCompression::Dequantization VertexCompression::EncodePositions(const std::vector<Vector3>& positions, PositionFormat format, std::vector<uint8_t>& out_data)
+{
+    const size_t start = out_data.size();
+    out_data.resize(start + positions.size() * GetPositionStride(format));
+    if (format == PositionFormat::Float32)
+    {
+        if (!positions.empty())
+            memcpy(out_data.data() + start, positions.data(), positions.size() * sizeof(Vector3));
+        return {};
+    }
+
+    // Centered on the AABB and scaled by its largest half extent, every stored coordinate is within [-1, 1]
+    Dequantization dequantization{};
+    if (!positions.empty())
+    {
+        Vector3 min = positions[0];
+        Vector3 max = positions[0];
+        for (const Vector3& p : positions)
+        {
+            min = { std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z) };
+            max = { std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z) };
+        }
+        dequantization.offset = { (min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f };
+        const float halfExtent = std::max({ max.x - min.x, max.y - min.y, max.z - min.z }) * 0.5f;
+        dequantization.scale = halfExtent > 0.f ? halfExtent : 1.f;
+    }
+
+    const float inverseScale = 1.f / dequantization.scale;
+    uint16_t* out = reinterpret_cast<uint16_t*>(out_data.data() + start);
+    for (const Vector3& p : positions)
+    {
+        const float local[3] = { (p.x - dequantization.offset.x) * inverseScale, (p.y - dequantization.offset.y) * inverseScale, (p.z - dequantization.offset.z) * inverseScale };
+        for (float value : local)
+        {
+            *out++ = format == PositionFormat::Half ? FloatToHalf(value) : (uint16_t)ToSnorm16(value);
+        }
+        *out++ = 0;
+    }
+    return dequantization;
+}
+
+Vector3 VertexCompression::DecodePosition(const uint8_t* data, PositionFormat format, const Dequantization& dequantization)
+{
+    Vector3 stored{};
+    if (format == PositionFormat::Float32)
+    {
+        memcpy(&stored, data, sizeof(Vector3));
+    }
+    else
+    {
+        uint16_t values[3];
+        memcpy(values, data, sizeof(values));
+        float* out = &stored.x;
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            out[i] = format == PositionFormat::Half ? HalfToFloat(values[i]) : FromSnorm16((int16_t)values[i]);
+        }
+    }
+    return { stored.x * dequantization.scale + dequantization.offset.x,
+        stored.y * dequantization.scale + dequantization.offset.y,
+        stored.z * dequantization.scale + dequantization.offset.z };
+}
+
+bool VertexCompression::SameDequantization(const Dequantization& a, const Dequantization& b)
+{
+    return a.scale == b.scale && a.offset.x == b.offset.x && a.offset.y == b.offset.y && a.offset.z == b.offset.z;
+}
+
+uint16_t VertexCompression::FloatToHalf(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7FFFFFFF;
+
+    if (magnitude >= 0x7F800000) // Infinity stays, NaN stays NaN
+        return (uint16_t)(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+    if (magnitude >= 0x477FF000) // 65520 and up round past the largest half
+        return (uint16_t)(sign | 0x7C00);
+    if (magnitude < 0x38800000)
+    {
+        // Below the smallest normal half, counted in steps of 2^-24. Exact in float, rounded to nearest even
+        float absolute;
+        memcpy(&absolute, &magnitude, sizeof(absolute));
+        return (uint16_t)(sign | (uint32_t)std::nearbyint(absolute * 16777216.f));
+    }
+
+    // Rebias the exponent (127 -> 15) and round the 13 dropped mantissa bits to nearest even, a carry into the
+    // exponent is still the right result
+    magnitude += 0xC8000FFF + ((magnitude >> 13) & 1);
+    return (uint16_t)(sign | (magnitude >> 13));
+}
+
+float VertexCompression::HalfToFloat(uint16_t value)
+{
+    const uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+    const uint32_t exponent = (value >> 10) & 0x1F;
+    const uint32_t mantissa = value & 0x3FF;
+
+    if (exponent == 0)
+    {
+        const float magnitude = std::ldexp((float)mantissa, -24);
+        return sign ? -magnitude : magnitude;
+    }
+
+    const uint32_t bits = exponent == 0x1F
+        ? sign | 0x7F800000 | (mantissa << 13)
+        : sign | ((exponent + 112) << 23) | (mantissa << 13);
+    float result;
+    memcpy(&result, &bits, sizeof(result));
+    return result;
+}
+
+uint32_t VertexCompression::PackUnorm8(const Color& color)
+{
+    return ToUnorm8(color.r) | (ToUnorm8(color.g) << 8) | (ToUnorm8(color.b) << 16) | ((uint32_t)ToUnorm8(color.a) << 24);
+}
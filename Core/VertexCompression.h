@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "Mathmatics.h"
+
+// Smaller vertex streams. Positions are stored relative to the mesh's bounds and scaled back in the vertex shader,
+// instance colors are 8 bit per channel
+namespace VertexCompression
+{
+	enum class PositionFormat
+	{
+		Float32, // R32G32B32_SFLOAT, as imported
+		Half,    // R16G16B16A16_SFLOAT, about 1/2048 of the mesh's extent
+		Snorm16  // R16G16B16A16_SNORM, 1/32767 of the mesh's extent
+	};
+
+	// position = stored * scale + offset. Identity for Float32
+	struct Dequantization
+	{
+		Vector3 offset{};
+		float scale = 1.f;
+	};
+
+	// The 16 bit formats carry an unused w, three component 16 bit vertex formats aren't required to be supported
+	uint32_t GetPositionStride(PositionFormat format);
+	const char* GetPositionFormatName(PositionFormat format);
+
+	// Appends the encoded positions to out_data, GetPositionStride bytes each
+	Dequantization EncodePositions(const std::vector<Vector3>& positions, PositionFormat format, std::vector<uint8_t>& out_data);
+	Vector3 DecodePosition(const uint8_t* data, PositionFormat format, const Dequantization& dequantization);
+	bool SameDequantization(const Dequantization& a, const Dequantization& b);
+
+	// IEEE half, round to nearest even. Out of range values become infinity
+	uint16_t FloatToHalf(float value);
+	float HalfToFloat(uint16_t value);
+
+	// RGBA8 unorm (r low). Matches unpackUnorm4x8 and R8G8B8A8_UNORM
+	uint32_t PackUnorm8(const Color& color);
+}
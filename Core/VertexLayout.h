@@ -0,0 +1,181 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Vertex input declared next to the vertex struct and turned into Vulkan descriptions at compile time. A stream lists
+// its struct's fields with a location and format each, Input combines the streams of a pipeline. Field sizes, strides
+// and locations are checked by static_assert, and so are the inputs a shader reads (see Reads)
+namespace VertexLayout
+{
+	enum class Numeric { Float, Uint, Sint, Unknown };
+
+	// Bytes the format reads, 0 for formats the layouts don't know
+	constexpr uint32_t FormatSize(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8_UNORM:
+		case VK_FORMAT_R8G8_SNORM:
+			return 2;
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SNORM:
+		case VK_FORMAT_R8G8B8A8_UINT:
+		case VK_FORMAT_R16G16_UNORM:
+		case VK_FORMAT_R16G16_SNORM:
+		case VK_FORMAT_R16G16_SFLOAT:
+		case VK_FORMAT_R32_UINT:
+		case VK_FORMAT_R32_SINT:
+		case VK_FORMAT_R32_SFLOAT:
+			return 4;
+		case VK_FORMAT_R16G16B16A16_UNORM:
+		case VK_FORMAT_R16G16B16A16_SNORM:
+		case VK_FORMAT_R16G16B16A16_SFLOAT:
+		case VK_FORMAT_R32G32_UINT:
+		case VK_FORMAT_R32G32_SFLOAT:
+			return 8;
+		case VK_FORMAT_R32G32B32_UINT:
+		case VK_FORMAT_R32G32B32_SFLOAT:
+			return 12;
+		case VK_FORMAT_R32G32B32A32_UINT:
+		case VK_FORMAT_R32G32B32A32_SFLOAT:
+			return 16;
+		default:
+			return 0;
+		}
+	}
+
+	// What the shader sees: normalized and float formats read as float, the integer ones as uint or int
+	constexpr Numeric FormatNumeric(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_R8G8B8A8_UINT:
+		case VK_FORMAT_R32_UINT:
+		case VK_FORMAT_R32G32_UINT:
+		case VK_FORMAT_R32G32B32_UINT:
+		case VK_FORMAT_R32G32B32A32_UINT:
+			return Numeric::Uint;
+		case VK_FORMAT_R32_SINT:
+			return Numeric::Sint;
+		default:
+			return FormatSize(format) != 0 ? Numeric::Float : Numeric::Unknown;
+		}
+	}
+
+	// Size bytes at Offset of the vertex, read as Format. Declared with VERTEX_FIELD / VERTEX_FIELDS
+	template<uint32_t Size, uint32_t Location, VkFormat Format, uint32_t Offset>
+	struct Field
+	{
+		static_assert(FormatSize(Format) != 0, "Vertex format unknown to VertexLayout::FormatSize");
+		static_assert(FormatSize(Format) == Size, "Vertex format size differs from the field it reads");
+
+		static constexpr uint32_t size = Size;
+		static constexpr uint32_t offset = Offset;
+
+		static constexpr VkVertexInputAttributeDescription Describe(uint32_t binding)
+		{
+			return { Location, binding, Format, Offset };
+		}
+	};
+
+	// One vertex buffer binding, a Vertex per vertex or per instance
+	template<typename Vertex, uint32_t Binding, VkVertexInputRate Rate, typename... Fields>
+	struct Stream
+	{
+		static_assert(sizeof...(Fields) > 0, "Vertex stream without fields");
+		static_assert(((Fields::offset + Fields::size <= sizeof(Vertex)) && ...), "Vertex field reads past the end of the vertex");
+
+		static constexpr VkVertexInputBindingDescription binding = { Binding, (uint32_t)sizeof(Vertex), Rate };
+		static constexpr std::array<VkVertexInputAttributeDescription, sizeof...(Fields)> attributes = { Fields::Describe(Binding)... };
+	};
+
+	template<size_t Count, size_t StreamCount>
+	constexpr void Append(std::array<VkVertexInputAttributeDescription, Count>& out, size_t& cursor, const std::array<VkVertexInputAttributeDescription, StreamCount>& in)
+	{
+		for (size_t i = 0; i < StreamCount; ++i)
+		{
+			out[cursor++] = in[i];
+		}
+	}
+
+	template<size_t Count>
+	constexpr bool UniqueLocations(const std::array<VkVertexInputAttributeDescription, Count>& attributes)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			for (size_t j = i + 1; j < Count; ++j)
+			{
+				if (attributes[i].location == attributes[j].location)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	template<size_t Count>
+	constexpr bool UniqueBindings(const std::array<VkVertexInputBindingDescription, Count>& bindings)
+	{
+		for (size_t i = 0; i < Count; ++i)
+		{
+			for (size_t j = i + 1; j < Count; ++j)
+			{
+				if (bindings[i].binding == bindings[j].binding)
+					return false;
+			}
+		}
+		return true;
+	}
+
+	// All streams of one pipeline. The arrays are static, CreateInfo only points at them
+	template<typename... Streams>
+	struct Input
+	{
+		static constexpr std::array<VkVertexInputBindingDescription, sizeof...(Streams)> bindings = { Streams::binding... };
+
+		static constexpr auto attributes = []()
+		{
+			std::array<VkVertexInputAttributeDescription, (Streams::attributes.size() + ...)> all{};
+			size_t cursor = 0;
+			(Append(all, cursor, Streams::attributes), ...);
+			return all;
+		}();
+
+		static_assert(UniqueBindings(bindings), "Two vertex streams on one binding");
+		static_assert(UniqueLocations(attributes), "Two vertex fields on one location");
+
+		static VkPipelineVertexInputStateCreateInfo CreateInfo()
+		{
+			VkPipelineVertexInputStateCreateInfo info{};
+			info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+			info.vertexBindingDescriptionCount = (uint32_t)bindings.size();
+			info.pVertexBindingDescriptions = bindings.data();
+			info.vertexAttributeDescriptionCount = (uint32_t)attributes.size();
+			info.pVertexAttributeDescriptions = attributes.data();
+			return info;
+		}
+	};
+
+	// The input feeds a shader's `layout(location = location) in` of the given numeric type
+	template<typename InputType>
+	constexpr bool Reads(uint32_t location, Numeric numeric)
+	{
+		for (const VkVertexInputAttributeDescription& attribute : InputType::attributes)
+		{
+			if (attribute.location == location)
+				return FormatNumeric(attribute.format) == numeric;
+		}
+		return false;
+	}
+}
+
+// One struct member as a vertex field
+#define VERTEX_FIELD(Vertex, member, location, format) \
+	VertexLayout::Field<(uint32_t)sizeof(Vertex::member), location, format, (uint32_t)offsetof(Vertex, member)>
+
+// Adjacent members first..last read as one vertex field, e.g. a position and a scale as one vec4
+#define VERTEX_FIELDS(Vertex, first, last, location, format) \
+	VertexLayout::Field<(uint32_t)(offsetof(Vertex, last) + sizeof(Vertex::last) - offsetof(Vertex, first)), location, format, (uint32_t)offsetof(Vertex, first)>
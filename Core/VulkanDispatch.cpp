@@ -0,0 +1,21 @@
+#include "VulkanDispatch.h"
+
+#include "Debug.h"
+
+void VulkanDispatch::LoadInstance(VkInstance instance)
+{
+#define VULKAN_LOAD_INSTANCE_FUNCTION(name) \
+    name = (PFN_##name)vkGetInstanceProcAddr(instance, #name); \
+    ASSERT(name != nullptr, "Could not load " #name);
+    VULKAN_INSTANCE_FUNCTIONS(VULKAN_LOAD_INSTANCE_FUNCTION)
+#undef VULKAN_LOAD_INSTANCE_FUNCTION
+}
+
+void VulkanDispatch::LoadDevice(VkDevice device)
+{
+#define VULKAN_LOAD_DEVICE_FUNCTION(name) \
+    name = (PFN_##name)vkGetDeviceProcAddr(device, #name); \
+    ASSERT(name != nullptr, "Could not load " #name);
+    VULKAN_DEVICE_FUNCTIONS(VULKAN_LOAD_DEVICE_FUNCTION)
+#undef VULKAN_LOAD_DEVICE_FUNCTION
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+// Instance level functions, loaded with vkGetInstanceProcAddr once the instance exists
+#define VULKAN_INSTANCE_FUNCTIONS(X) \
+	X(vkDestroyInstance) \
+	X(vkEnumeratePhysicalDevices) \
+	X(vkEnumerateDeviceExtensionProperties) \
+	X(vkGetPhysicalDeviceProperties) \
+	X(vkGetPhysicalDeviceFeatures) \
+	X(vkGetPhysicalDeviceFeatures2) \
+	X(vkGetPhysicalDeviceQueueFamilyProperties) \
+	X(vkGetPhysicalDeviceMemoryProperties) \
+	X(vkGetPhysicalDeviceFormatProperties) \
+	X(vkGetPhysicalDeviceSurfaceSupportKHR) \
+	X(vkGetPhysicalDeviceSurfaceCapabilitiesKHR) \
+	X(vkGetPhysicalDeviceSurfaceFormatsKHR) \
+	X(vkGetPhysicalDeviceSurfacePresentModesKHR) \
+	X(vkDestroySurfaceKHR) \
+	X(vkCreateDevice) \
+	X(vkGetDeviceProcAddr)
+
+// Device level functions, loaded with vkGetDeviceProcAddr so they go straight to the driver
+#define VULKAN_DEVICE_FUNCTIONS(X) \
+	X(vkDestroyDevice) \
+	X(vkDeviceWaitIdle) \
+	X(vkGetDeviceQueue) \
+	X(vkQueueSubmit) \
+	X(vkQueueWaitIdle) \
+	X(vkQueuePresentKHR) \
+	X(vkCreateSwapchainKHR) \
+	X(vkDestroySwapchainKHR) \
+	X(vkGetSwapchainImagesKHR) \
+	X(vkAcquireNextImageKHR) \
+	X(vkCreateBuffer) \
+	X(vkDestroyBuffer) \
+	X(vkCreateImage) \
+	X(vkDestroyImage) \
+	X(vkCreateImageView) \
+	X(vkDestroyImageView) \
+	X(vkCreateSampler) \
+	X(vkDestroySampler) \
+	X(vkAllocateMemory) \
+	X(vkFreeMemory) \
+	X(vkMapMemory) \
+	X(vkUnmapMemory) \
+	X(vkFlushMappedMemoryRanges) \
+	X(vkInvalidateMappedMemoryRanges) \
+	X(vkBindBufferMemory) \
+	X(vkBindImageMemory) \
+	X(vkGetBufferMemoryRequirements) \
+	X(vkGetImageMemoryRequirements) \
+	X(vkCreateFence) \
+	X(vkDestroyFence) \
+	X(vkWaitForFences) \
+	X(vkResetFences) \
+	X(vkGetFenceStatus) \
+	X(vkCreateSemaphore) \
+	X(vkDestroySemaphore) \
+	X(vkCreateQueryPool) \
+	X(vkDestroyQueryPool) \
+	X(vkGetQueryPoolResults) \
+	X(vkCreateCommandPool) \
+	X(vkDestroyCommandPool) \
+	X(vkResetCommandPool) \
+	X(vkAllocateCommandBuffers) \
+	X(vkFreeCommandBuffers) \
+	X(vkBeginCommandBuffer) \
+	X(vkEndCommandBuffer) \
+	X(vkCreateShaderModule) \
+	X(vkDestroyShaderModule) \
+	X(vkCreateRenderPass) \
+	X(vkDestroyRenderPass) \
+	X(vkCreateFramebuffer) \
+	X(vkDestroyFramebuffer) \
+	X(vkCreateDescriptorSetLayout) \
+	X(vkDestroyDescriptorSetLayout) \
+	X(vkCreateDescriptorPool) \
+	X(vkDestroyDescriptorPool) \
+	X(vkAllocateDescriptorSets) \
+	X(vkUpdateDescriptorSets) \
+	X(vkCreatePipelineLayout) \
+	X(vkDestroyPipelineLayout) \
+	X(vkCreateGraphicsPipelines) \
+	X(vkCreateComputePipelines) \
+	X(vkDestroyPipeline) \
+	X(vkCmdBeginRenderPass) \
+	X(vkCmdEndRenderPass) \
+	X(vkCmdExecuteCommands) \
+	X(vkCmdBindPipeline) \
+	X(vkCmdBindDescriptorSets) \
+	X(vkCmdBindVertexBuffers) \
+	X(vkCmdBindIndexBuffer) \
+	X(vkCmdPushConstants) \
+	X(vkCmdSetViewport) \
+	X(vkCmdSetScissor) \
+	X(vkCmdDrawIndexed) \
+	X(vkCmdDrawIndexedIndirect) \
+	X(vkCmdDispatch) \
+	X(vkCmdPipelineBarrier) \
+	X(vkCmdFillBuffer) \
+	X(vkCmdCopyBuffer) \
+	X(vkCmdResetQueryPool) \
+	X(vkCmdBeginQuery) \
+	X(vkCmdEndQuery) \
+	X(vkCmdWriteTimestamp)
+
+// Meta-loader: Vulkan entry points fetched from the instance and the device instead of the vulkan-1 exports.
+// Exported functions go through the loader's trampoline on every call, device level pointers from
+// vkGetDeviceProcAddr jump straight into the driver, which adds up at tens of thousands of draws per frame.
+// Only vkCreateInstance and vkGetInstanceProcAddr still come from the loader.
+struct VulkanDispatch
+{
+#define VULKAN_DISPATCH_MEMBER(name) PFN_##name name = nullptr;
+	VULKAN_INSTANCE_FUNCTIONS(VULKAN_DISPATCH_MEMBER)
+	VULKAN_DEVICE_FUNCTIONS(VULKAN_DISPATCH_MEMBER)
+#undef VULKAN_DISPATCH_MEMBER
+
+	void LoadInstance(VkInstance instance);
+	void LoadDevice(VkDevice device); // After LoadInstance
+};